@@ -0,0 +1,147 @@
+/**
+ * @file bench_b64.c
+ * @author MXPSQL
+ * @brief Equivalence check and throughput of the base64 encoders and decoders
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * First every SIMD encoder this machine supports is compared byte for byte against the scalar encoder on random data with random lengths and alignments, any difference fails the run.
+ * Every decoder then has to give back the random data from the scalar encoding of it, and has to reject it with one character outside the alphabet put in at a random place.
+ * Then each encoder and decoder is timed on a 64 MB buffer (decoder bytes are the base64 read).
+ * 
+ * Output is CSV: coder,impl,bytes,seconds,MB_per_s
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ROUNDS 20000
+#define BENCH_MAXLEN 4096
+#define BENCH_BIGLEN (64UL * 1024UL * 1024UL)
+
+static const char* impl_names[] = {"scalar", "ssse3", "avx2", "avx512vbmi"};
+
+/* small xorshift so runs are repeatable */
+static unsigned long bench_seed = 2463534242UL;
+static unsigned long bench_rand(void){
+    bench_seed ^= (bench_seed << 13) & 0xFFFFFFFFUL;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= (bench_seed << 5) & 0xFFFFFFFFUL;
+    return bench_seed & 0xFFFFFFFFUL;
+}
+
+int main(void){
+    char* in = NULL;
+    char* want = NULL;
+    char* got = NULL;
+    int best = mkmshar_b64Impl();
+    int impl;
+    long r;
+
+    in = (char*) malloc(BENCH_BIGLEN + 64);
+    want = (char*) malloc(((BENCH_BIGLEN + 2) / 3) * 4 + 64);
+    got = (char*) malloc(((BENCH_BIGLEN + 2) / 3) * 4 + 64);
+    if(in == NULL || want == NULL || got == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for(r = 0; r < (long) (BENCH_BIGLEN + 64); r++){
+        in[r] = (char) (bench_rand() & 0xFF);
+    }
+
+    for(impl = MXPSQL_MShar_B64_SSSE3; impl <= best; impl++){
+        for(r = 0; r < BENCH_ROUNDS; r++){
+            size_t len = (size_t) (bench_rand() % (BENCH_MAXLEN + 1));
+            size_t off = (size_t) (bench_rand() % 64);
+            size_t wl = mkmshar_b64EncodeWith(MXPSQL_MShar_B64_SCALAR, in + off, len, want);
+            size_t gl = mkmshar_b64EncodeWith(impl, in + off, len, got);
+            if(wl != gl || memcmp(want, got, wl) != 0 || wl != ((len + 2) / 3) * 4){
+                fprintf(stderr, "%s differs from scalar at length %lu offset %lu\n", impl_names[impl], (unsigned long) len, (unsigned long) off);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    for(impl = MXPSQL_MShar_B64_SCALAR; impl <= best; impl++){
+        for(r = 0; r < BENCH_ROUNDS; r++){
+            size_t len = (size_t) (bench_rand() % (BENCH_MAXLEN + 1));
+            size_t off = (size_t) (bench_rand() % 64);
+            size_t wl = mkmshar_b64EncodeWith(MXPSQL_MShar_B64_SCALAR, in + off, len, want);
+            size_t gl = 0;
+            if(mkmshar_b64DecodeWith(impl, want, wl, got, &gl) != 0 || gl != len || memcmp(in + off, got, len) != 0){
+                fprintf(stderr, "%s decoder does not give back length %lu offset %lu\n", impl_names[impl], (unsigned long) len, (unsigned long) off);
+                return EXIT_FAILURE;
+            }
+            if(wl > 0){
+                /* '.' is not base64 anywhere, '=' is not before the end */
+                want[bench_rand() % wl] = (r & 1) ? '.' : '\n';
+                if(mkmshar_b64DecodeWith(impl, want, wl, got, &gl) == 0){
+                    fprintf(stderr, "%s decoder takes a bad character at length %lu offset %lu\n", impl_names[impl], (unsigned long) len, (unsigned long) off);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    printf("coder,impl,bytes,seconds,MB_per_s\n");
+    for(impl = MXPSQL_MShar_B64_SCALAR; impl <= best; impl++){
+        clock_t start = clock();
+        double secs;
+        int rep;
+        for(rep = 0; rep < 4; rep++){
+            mkmshar_b64EncodeWith(impl, in, BENCH_BIGLEN, got);
+        }
+        secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf("encode,%s,%lu,%f,%f\n", impl_names[impl], BENCH_BIGLEN * 4UL, secs, secs > 0 ? (BENCH_BIGLEN * 4.0 / 1e6) / secs : 0.0);
+    }
+    {
+        size_t wl = mkmshar_b64EncodeWith(MXPSQL_MShar_B64_SCALAR, in, BENCH_BIGLEN, want);
+        for(impl = MXPSQL_MShar_B64_SCALAR; impl <= best; impl++){
+            clock_t start = clock();
+            double secs;
+            size_t gl;
+            int rep;
+            for(rep = 0; rep < 4; rep++){
+                mkmshar_b64DecodeWith(impl, want, wl, got, &gl);
+            }
+            secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+            printf("decode,%s,%lu,%f,%f\n", impl_names[impl], (unsigned long) wl * 4UL, secs, secs > 0 ? (wl * 4.0 / 1e6) / secs : 0.0);
+        }
+    }
+
+    free(in);
+    free(want);
+    free(got);
+    return EXIT_SUCCESS;
+}
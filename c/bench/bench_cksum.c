@@ -0,0 +1,172 @@
+/**
+ * @file bench_cksum.c
+ * @author MXPSQL
+ * @brief Equivalence check of the cksum CRCs and the cost of taking the checksum while encoding
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Every CRC this machine supports is checked against the known cksum of "123456789" and against the scalar one on random data with random lengths, alignments and splits, any difference fails the run.
+ * Then each is timed on a 64 MB buffer, and so are base64 alone and base64 with the checksum, both in MXPSQL_MShar_CRC_PIECE pieces the way archives are built (mkmshar_stagepayload).
+ * Those two are run once to warm up, then BENCH_TRIES times each, one after the other, and the best time of each is kept so neither pays for a cold cache or a busy moment the other did not.
+ * The last column of the fused row is how much slower it is than base64 alone, with a CRC the CPU has instructions for it warns on stderr if that is over BENCH_SLOWDOWN percent.
+ * That is only a warning, on a busy or single core machine the rows are too noisy to fail a run on.
+ * 
+ * Output is CSV: kernel,bytes,seconds,MB_per_s,slowdown_percent
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ROUNDS 20000
+#define BENCH_MAXLEN 4096
+#define BENCH_BIGLEN (64UL * 1024UL * 1024UL)
+#define BENCH_REPS 4
+#define BENCH_TRIES 15
+#define BENCH_SLOWDOWN 5.0
+
+static const char* impl_names[] = {"scalar", "pclmul", "vpclmul"};
+
+/* small xorshift so runs are repeatable */
+static unsigned long bench_seed = 2463534242UL;
+static unsigned long bench_rand(void){
+    bench_seed ^= (bench_seed << 13) & 0xFFFFFFFFUL;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= (bench_seed << 5) & 0xFFFFFFFFUL;
+    return bench_seed & 0xFFFFFFFFUL;
+}
+
+static void bench_print(const char* kernel, double bytes, double secs, double base){
+    printf("%s,%.0f,%f,%f,", kernel, bytes, secs, secs > 0 ? (bytes / 1e6) / secs : 0.0);
+    if(base > 0) printf("%.1f", 100.0 * (secs - base) / base);
+    printf("\n");
+}
+
+/* BENCH_REPS passes of base64 over the whole buffer in pieces, with the checksum taken piece by piece too if crc is not NULL, in seconds */
+static double bench_encode(const char* in, char* out, unsigned long* crc){
+    clock_t start = clock();
+    int rep;
+
+    for(rep = 0; rep < BENCH_REPS; rep++){
+        mkmshar_b64State st;
+        size_t off;
+        size_t m = 0;
+
+        mkmshar_b64Init(&st);
+        for(off = 0; off < BENCH_BIGLEN; off += MXPSQL_MShar_CRC_PIECE){
+            size_t k = (BENCH_BIGLEN - off < MXPSQL_MShar_CRC_PIECE) ? BENCH_BIGLEN - off : MXPSQL_MShar_CRC_PIECE;
+            if(crc != NULL) *crc = mkmshar_cksumUpdate(*crc, in + off, k);
+            m += mkmshar_b64Update(&st, in + off, k, out + m);
+        }
+    }
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void){
+    char* in = NULL;
+    char* out = NULL;
+    int best = mkmshar_cksumImpl();
+    unsigned long sink = 0;
+    unsigned long crc = 0;
+    double base = 0.0;
+    double fused = 0.0;
+    double slowdown;
+    clock_t start;
+    int impl;
+    int rep;
+    long r;
+
+    in = (char*) malloc(BENCH_BIGLEN + 64);
+    out = (char*) malloc(((BENCH_BIGLEN + 2) / 3) * 4 + 64);
+    if(in == NULL || out == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for(r = 0; r < (long) (BENCH_BIGLEN + 64); r++){
+        in[r] = (char) (bench_rand() & 0xFF);
+    }
+    /* touched once up front so no row pays for its page faults */
+    memset(out, 0, ((BENCH_BIGLEN + 2) / 3) * 4 + 64);
+
+    for(impl = MXPSQL_MShar_CRC_SCALAR; impl <= best; impl++){
+        if(mkmshar_cksumFinal(mkmshar_cksumUpdateWith(impl, 0, "123456789", 9), 9) != 930766865UL){
+            fprintf(stderr, "%s gets the check value of \"123456789\" wrong\n", impl_names[impl]);
+            return EXIT_FAILURE;
+        }
+        for(r = 0; r < BENCH_ROUNDS; r++){
+            size_t len = (size_t) (bench_rand() % (BENCH_MAXLEN + 1));
+            size_t off = (size_t) (bench_rand() % 64);
+            size_t cut = (len > 0) ? (size_t) (bench_rand() % len) : 0;
+            unsigned long want = mkmshar_cksumUpdateWith(MXPSQL_MShar_CRC_SCALAR, 0, in + off, len);
+            unsigned long got = mkmshar_cksumUpdateWith(impl, mkmshar_cksumUpdateWith(impl, 0, in + off, cut), in + off + cut, len - cut);
+            if(want != got){
+                fprintf(stderr, "%s differs from scalar at length %lu offset %lu split %lu\n", impl_names[impl], (unsigned long) len, (unsigned long) off, (unsigned long) cut);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf("kernel,bytes,seconds,MB_per_s,slowdown_percent\n");
+    for(impl = MXPSQL_MShar_CRC_SCALAR; impl <= best; impl++){
+        start = clock();
+        for(rep = 0; rep < BENCH_REPS; rep++){
+            sink ^= mkmshar_cksumUpdateWith(impl, 0, in, BENCH_BIGLEN);
+        }
+        bench_print(impl_names[impl], (double) BENCH_BIGLEN * BENCH_REPS, (double) (clock() - start) / CLOCKS_PER_SEC, 0.0);
+    }
+
+    /* both warmed up first and then taken in turns, the best of each is what they cost without noise */
+    bench_encode(in, out, NULL);
+    bench_encode(in, out, &crc);
+    for(rep = 0; rep < BENCH_TRIES; rep++){
+        double secs = bench_encode(in, out, NULL);
+        if(rep == 0 || secs < base) base = secs;
+        secs = bench_encode(in, out, &crc);
+        if(rep == 0 || secs < fused) fused = secs;
+    }
+    sink ^= crc;
+    bench_print("base64", (double) BENCH_BIGLEN * BENCH_REPS, base, 0.0);
+    bench_print("base64+cksum", (double) BENCH_BIGLEN * BENCH_REPS, fused, base);
+
+    /* keeps the CRC loops from being thrown away */
+    if(sink == 1) printf("\n");
+
+    free(in);
+    free(out);
+
+    /* the scalar CRC is only the fallback, it is not held to this */
+    slowdown = (base > 0) ? 100.0 * (fused - base) / base : 0.0;
+    if(best > MXPSQL_MShar_CRC_SCALAR && slowdown > BENCH_SLOWDOWN){
+        fprintf(stderr, "warning: base64 with the %s checksum is %.1f%% slower than base64 alone, over %.0f%% (rerun on a quiet machine before trusting it)\n", impl_names[best], slowdown, BENCH_SLOWDOWN);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file bench_ctx.c
+ * @author MXPSQL
+ * @brief Benchmark of many archives built at once from different threads with one mkmshar_ctx each
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Builds the same 200 file archive with mkmshar_ctx_str once on the main thread, then on 1, 2, 4 and 8 threads at the same time.
+ * Every context has its own counting allocator, so nothing is shared but the input files.
+ * It fails if any archive differs from the first one, if the stats (allocation counts included) disagree, if a context leaks or if errno or the locale changed.
+ * 
+ * Output is CSV: threads,archives,seconds,archives_per_s,allocs_per_archive
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define BENCH_DIR "mshar_bench_ctx"
+#define BENCH_FILES 200UL
+#define BENCH_ROUNDS 20UL
+
+typedef struct bench_heap {
+    unsigned long allocs;
+    unsigned long live;
+} bench_heap;
+
+typedef struct bench_job {
+    char** files;
+    char* ref;
+    size_t reflen;
+    unsigned long allocs;
+    int ok;
+} bench_job;
+
+static void* bench_alloc(void* userdata, size_t size){
+    bench_heap* heap = (bench_heap*) userdata;
+    void* ptr = malloc(size);
+    if(ptr != NULL){
+        heap->allocs++;
+        heap->live++;
+    }
+    return ptr;
+}
+
+static void* bench_resize(void* userdata, void* ptr, size_t size){
+    bench_heap* heap = (bench_heap*) userdata;
+    void* nptr = realloc(ptr, size);
+    if(nptr != NULL && ptr == NULL){
+        heap->allocs++;
+        heap->live++;
+    }
+    return nptr;
+}
+
+static void bench_release(void* userdata, void* ptr){
+    bench_heap* heap = (bench_heap*) userdata;
+    heap->live--;
+    free(ptr);
+}
+
+static double bench_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+static void* bench_thread(void* arg){
+    bench_job* job = (bench_job*) arg;
+    unsigned long r;
+
+    job->ok = 1;
+    for(r = 0; r < BENCH_ROUNDS; r++){
+        bench_heap heap = {0, 0};
+        mkmshar_ctx ctx;
+        size_t len = 0;
+        char* arc;
+
+        mkmshar_ctx_init(&ctx);
+        ctx.allocator.alloc = bench_alloc;
+        ctx.allocator.resize = bench_resize;
+        ctx.allocator.release = bench_release;
+        ctx.allocator.userdata = &heap;
+
+        arc = mkmshar_ctx_str(&ctx, NULL, NULL, job->files, BENCH_FILES, &len);
+        if(arc == NULL || ctx.err != 0 || ctx.stats.files != BENCH_FILES || ctx.stats.bytes_out != len){
+            job->ok = 0;
+        }
+        else if(job->ref != NULL && (len != job->reflen || memcmp(arc, job->ref, len) != 0)){
+            job->ok = 0;
+        }
+
+        if(arc != NULL) ctx.allocator.release(ctx.allocator.userdata, arc);
+        /* the context counts what it asked of the allocator, that has to be what the allocator saw */
+        if(heap.live != 0 || ctx.stats.allocs != heap.allocs){
+            job->ok = 0;
+        }
+        job->allocs = heap.allocs;
+    }
+    return NULL;
+}
+
+int main(void){
+    static const unsigned long threads[] = {1, 2, 4, 8};
+    char** files = NULL;
+    bench_job first;
+    char* ref = NULL;
+    unsigned long i;
+    size_t t;
+    int failed = 0;
+
+    files = (char**) malloc(sizeof(char*) * BENCH_FILES);
+    if(files == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    mkdir(BENCH_DIR, 0755);
+    for(i = 0; i < BENCH_FILES; i++){
+        FILE* f = NULL;
+        unsigned long j;
+        files[i] = (char*) malloc(sizeof(BENCH_DIR) + 16);
+        if(files[i] == NULL){
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        sprintf(files[i], "%s/f%lu", BENCH_DIR, i);
+        f = fopen(files[i], "wb");
+        if(f == NULL){
+            fprintf(stderr, "Could not create %s\n", files[i]);
+            return EXIT_FAILURE;
+        }
+        for(j = 0; j < 4096 + i * 37; j++){
+            putc((int) ((i * 131 + j * 7) & 0xff), f);
+        }
+        fclose(f);
+    }
+
+    /* the reference, also checks that errno and the locale are left alone */
+    {
+        mkmshar_ctx ctx;
+        const char* locale_before = setlocale(LC_ALL, NULL);
+        char before[64];
+        size_t len = 0;
+
+        strncpy(before, locale_before ? locale_before : "", sizeof(before) - 1);
+        before[sizeof(before) - 1] = '\0';
+
+        mkmshar_ctx_init(&ctx);
+        errno = ERANGE;
+        ref = mkmshar_ctx_str(&ctx, NULL, NULL, files, BENCH_FILES, &len);
+        if(ref == NULL || errno != ERANGE || strcmp(before, setlocale(LC_ALL, NULL)) != 0){
+            fprintf(stderr, "reference archive failed or errno/locale changed\n");
+            return EXIT_FAILURE;
+        }
+        first.files = files;
+        first.ref = ref;
+        first.reflen = len;
+    }
+
+    printf("threads,archives,seconds,archives_per_s,allocs_per_archive\n");
+    for(t = 0; t < sizeof(threads) / sizeof(threads[0]); t++){
+        pthread_t tid[8];
+        bench_job jobs[8];
+        double start, secs;
+        unsigned long n;
+
+        start = bench_now();
+        for(n = 0; n < threads[t]; n++){
+            jobs[n] = first;
+            if(pthread_create(&tid[n], NULL, bench_thread, &jobs[n]) != 0){
+                fprintf(stderr, "pthread_create failed\n");
+                return EXIT_FAILURE;
+            }
+        }
+        for(n = 0; n < threads[t]; n++){
+            pthread_join(tid[n], NULL);
+            if(!jobs[n].ok) failed = 1;
+        }
+        secs = bench_now() - start;
+
+        printf("%lu,%lu,%f,%f,%lu\n", threads[t], threads[t] * BENCH_ROUNDS, secs, (secs > 0) ? (double) (threads[t] * BENCH_ROUNDS) / secs : 0.0, jobs[0].allocs);
+        fflush(stdout);
+    }
+
+    for(i = 0; i < BENCH_FILES; i++){
+        remove(files[i]);
+        free(files[i]);
+    }
+    remove(BENCH_DIR);
+    free(files);
+    free(ref);
+
+    if(failed){
+        fprintf(stderr, "an archive built on a thread differs, has wrong stats or leaked\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,393 @@
+/**
+ * @file bench_e2e.c
+ * @author MXPSQL
+ * @brief End to end archive build benchmark on generated corpora
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Generates five corpora in a scratch directory:
+ * 
+ * - tiny: 5000 files of 1 to 64 bytes
+ * - huge: 3 files of 32 MB
+ * - deep: a directory tree 32 levels deep with 4 files per level
+ * - mixed: 400 text files and 400 binary files of 1 to 256 KB
+ * - vendored: 40 text files of 1 to 64 KB, copied into 25 directories (1000 files, 40 different ones)
+ * 
+ * Then builds an archive of each with mshar.exe, mshar.exe -j 0, mshar.exe -z (compressed), mshar.exe --dedup, mkmshar_x, mkmshar_s and sh/mshar make-archive (the baseline).
+ * Every build runs in its own child process, so wall time, CPU time (user + system, children included) and peak RSS are for that build alone.
+ * 
+ * Usage: bench_e2e.exe [path to mshar.exe] [path to sh/mshar], a tool that is not there is skipped.
+ * The defaults fit running from the bench directory.
+ * 
+ * Output is CSV: corpus,tool,files,input_bytes,output_bytes,wall_seconds,cpu_seconds,peak_rss_kb
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_DIR "mshar_bench_e2e"
+#define BENCH_OUT BENCH_DIR "/archive.out"
+#define BENCH_EMPTY BENCH_DIR "/empty.sh"
+#define BENCH_CORPORA 5
+
+typedef struct bench_corpus {
+    const char* name;
+    char** files;
+    size_t nfiles;
+    unsigned long bytes;
+} bench_corpus;
+
+typedef struct bench_result {
+    double wall;
+    double cpu;
+    long rss_kb;
+    unsigned long out_bytes;
+    int ok;
+} bench_result;
+
+static unsigned long bench_seed = 1;
+
+static unsigned long bench_rand(void){
+    bench_seed = bench_seed * 1103515245UL + 12345UL;
+    return (bench_seed >> 16) & 0x7fffUL;
+}
+
+static double bench_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+static int bench_add(bench_corpus* c, const char* path, unsigned long size, int text){
+    FILE* f = fopen(path, "wb");
+    unsigned long i;
+    char** grown;
+
+    if(f == NULL) return -1;
+    for(i = 0; i < size; i++){
+        int ch = text ? ((i % 64 == 63) ? '\n' : (int) ('a' + bench_rand() % 26)) : (int) (bench_rand() & 0xff);
+        putc(ch, f);
+    }
+    if(fclose(f) != 0) return -1;
+
+    grown = (char**) realloc(c->files, sizeof(char*) * (c->nfiles + 1));
+    if(grown == NULL) return -1;
+    c->files = grown;
+    c->files[c->nfiles] = (char*) malloc(strlen(path) + 1);
+    if(c->files[c->nfiles] == NULL) return -1;
+    strcpy(c->files[c->nfiles], path);
+    c->nfiles++;
+    c->bytes += size;
+    return 0;
+}
+
+/* another copy of a file already in c */
+static int bench_copy(bench_corpus* c, const char* from, const char* path){
+    char buf[4096];
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(path, "wb");
+    unsigned long size = 0;
+    size_t n;
+    char** grown;
+
+    if(in == NULL || out == NULL){
+        if(in != NULL) fclose(in);
+        if(out != NULL) fclose(out);
+        return -1;
+    }
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0){
+        fwrite(buf, 1, n, out);
+        size += (unsigned long) n;
+    }
+    fclose(in);
+    if(fclose(out) != 0) return -1;
+
+    grown = (char**) realloc(c->files, sizeof(char*) * (c->nfiles + 1));
+    if(grown == NULL) return -1;
+    c->files = grown;
+    c->files[c->nfiles] = (char*) malloc(strlen(path) + 1);
+    if(c->files[c->nfiles] == NULL) return -1;
+    strcpy(c->files[c->nfiles], path);
+    c->nfiles++;
+    c->bytes += size;
+    return 0;
+}
+
+static int bench_generate(bench_corpus* corpora){
+    char path[512];
+    char dir[512];
+    unsigned long i, j;
+
+    mkdir(BENCH_DIR, 0755);
+    memset(corpora, 0, sizeof(bench_corpus) * BENCH_CORPORA);
+
+    corpora[0].name = "tiny";
+    mkdir(BENCH_DIR "/tiny", 0755);
+    for(i = 0; i < 5000; i++){
+        sprintf(path, "%s/tiny/t%lu", BENCH_DIR, i);
+        if(bench_add(&corpora[0], path, 1 + bench_rand() % 64, 1) != 0) return -1;
+    }
+
+    corpora[1].name = "huge";
+    mkdir(BENCH_DIR "/huge", 0755);
+    for(i = 0; i < 3; i++){
+        sprintf(path, "%s/huge/h%lu", BENCH_DIR, i);
+        if(bench_add(&corpora[1], path, 32UL * 1024UL * 1024UL, 0) != 0) return -1;
+    }
+
+    corpora[2].name = "deep";
+    strcpy(dir, BENCH_DIR "/deep");
+    mkdir(dir, 0755);
+    for(i = 0; i < 32; i++){
+        sprintf(dir + strlen(dir), "/d%lu", i);
+        mkdir(dir, 0755);
+        for(j = 0; j < 4; j++){
+            sprintf(path, "%s/f%lu", dir, j);
+            if(bench_add(&corpora[2], path, 1 + bench_rand() % 4096, 1) != 0) return -1;
+        }
+    }
+
+    corpora[3].name = "mixed";
+    mkdir(BENCH_DIR "/mixed", 0755);
+    for(i = 0; i < 800; i++){
+        sprintf(path, "%s/mixed/m%lu", BENCH_DIR, i);
+        if(bench_add(&corpora[3], path, 1024UL + (bench_rand() * 8UL) % (255UL * 1024UL), (int) (i % 2)) != 0) return -1;
+    }
+
+    corpora[4].name = "vendored";
+    mkdir(BENCH_DIR "/vendored", 0755);
+    for(j = 0; j < 25; j++){
+        sprintf(dir, "%s/vendored/v%lu", BENCH_DIR, j);
+        mkdir(dir, 0755);
+        for(i = 0; i < 40; i++){
+            sprintf(path, "%s/f%lu", dir, i);
+            if(j == 0){
+                if(bench_add(&corpora[4], path, 1024UL + (bench_rand() * 2UL) % (63UL * 1024UL), 1) != 0) return -1;
+            }
+            else if(bench_copy(&corpora[4], corpora[4].files[i], path) != 0){
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void bench_cleanup(bench_corpus* corpora){
+    char dir[512];
+    size_t c, i;
+
+    for(c = 0; c < BENCH_CORPORA; c++){
+        for(i = 0; i < corpora[c].nfiles; i++){
+            remove(corpora[c].files[i]);
+            free(corpora[c].files[i]);
+        }
+        free(corpora[c].files);
+    }
+
+    strcpy(dir, BENCH_DIR "/deep");
+    for(i = 0; i < 32; i++) sprintf(dir + strlen(dir), "/d%lu", (unsigned long) i);
+    while(strcmp(dir, BENCH_DIR) != 0){
+        remove(dir);
+        *strrchr(dir, '/') = '\0';
+    }
+    remove(BENCH_DIR "/tiny");
+    remove(BENCH_DIR "/huge");
+    remove(BENCH_DIR "/mixed");
+    for(i = 0; i < 25; i++){
+        sprintf(dir, "%s/vendored/v%lu", BENCH_DIR, (unsigned long) i);
+        remove(dir);
+    }
+    remove(BENCH_DIR "/vendored");
+    remove(BENCH_OUT);
+    remove(BENCH_EMPTY);
+    remove(BENCH_DIR);
+}
+
+/* builds the archive in this (child) process, the size goes back through the exit pipe */
+static int bench_library(bench_corpus* c, int safe, int fd){
+    char* arc = safe ? mkmshar_s(NULL, NULL, c->files, c->nfiles) : mkmshar_x(NULL, NULL, c->files, c->nfiles);
+    unsigned long len;
+
+    if(arc == NULL) return EXIT_FAILURE;
+    len = (unsigned long) strlen(arc);
+    free(arc);
+    return (write(fd, &len, sizeof(len)) == (ssize_t) sizeof(len)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* run one build in a child and take its rusage, argv is NULL for the library ones */
+static bench_result bench_run(bench_corpus* c, char** argv, int library, int safe){
+    bench_result r;
+    struct rusage ru;
+    int status = 0;
+    int fds[2];
+    double start;
+    pid_t pid;
+
+    memset(&r, 0, sizeof(r));
+    if(pipe(fds) != 0) return r;
+
+    start = bench_now();
+    pid = fork();
+    if(pid == 0){
+        int out = open(BENCH_OUT, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int null = open("/dev/null", O_WRONLY);
+        close(fds[0]);
+        if(library){
+            _exit(bench_library(c, safe, fds[1]));
+        }
+        /* mshar.exe writes the archive to stdout, sh/mshar writes it itself and chats on stdout */
+        dup2((argv[0][0] == 's' && argv[0][1] == 'h' && argv[0][2] == '\0') ? null : out, 1);
+        dup2(null, 2);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    if(pid < 0){
+        close(fds[0]);
+        return r;
+    }
+
+    if(library){
+        unsigned long len = 0;
+        if(read(fds[0], &len, sizeof(len)) == (ssize_t) sizeof(len)) r.out_bytes = len;
+    }
+    close(fds[0]);
+
+    if(wait4(pid, &status, 0, &ru) != pid) return r;
+    r.wall = bench_now() - start;
+    r.cpu = (double) ru.ru_utime.tv_sec + (double) ru.ru_utime.tv_usec / 1e6 + (double) ru.ru_stime.tv_sec + (double) ru.ru_stime.tv_usec / 1e6;
+    r.rss_kb = ru.ru_maxrss;
+    r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    if(!library){
+        struct stat st;
+        if(stat(BENCH_OUT, &st) == 0) r.out_bytes = (unsigned long) st.st_size;
+    }
+    return r;
+}
+
+static void bench_print(bench_corpus* c, const char* tool, bench_result r){
+    if(!r.ok){
+        printf("%s,%s,%lu,%lu,failed,,,\n", c->name, tool, (unsigned long) c->nfiles, c->bytes);
+    }
+    else{
+        printf("%s,%s,%lu,%lu,%lu,%f,%f,%ld\n", c->name, tool, (unsigned long) c->nfiles, c->bytes, r.out_bytes, r.wall, r.cpu, r.rss_kb);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]){
+    const char* mshar_exe = (argc > 1) ? argv[1] : "../mshar.exe";
+    const char* mshar_sh = (argc > 2) ? argv[2] : "../../sh/mshar";
+    int have_exe = access(mshar_exe, X_OK) == 0;
+    int have_sh = access(mshar_sh, R_OK) == 0;
+    bench_corpus corpora[BENCH_CORPORA];
+    size_t c;
+
+    if(bench_generate(corpora) != 0){
+        fprintf(stderr, "Could not generate the corpora in %s\n", BENCH_DIR);
+        return EXIT_FAILURE;
+    }
+    if(!have_exe) fprintf(stderr, "%s not found, skipping it\n", mshar_exe);
+    if(!have_sh) fprintf(stderr, "%s not found, skipping it\n", mshar_sh);
+
+    /* sh/mshar needs a startup script file, its - and // do not work */
+    {
+        FILE* f = fopen(BENCH_EMPTY, "wb");
+        if(f != NULL) fclose(f);
+    }
+
+    printf("corpus,tool,files,input_bytes,output_bytes,wall_seconds,cpu_seconds,peak_rss_kb\n");
+    for(c = 0; c < BENCH_CORPORA; c++){
+        bench_corpus* cp = &corpora[c];
+        char** args = (char**) malloc(sizeof(char*) * (cp->nfiles + 8));
+        size_t i;
+
+        if(args == NULL){
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        if(have_exe){
+            args[0] = (char*) mshar_exe;
+            args[1] = (char*) "-";
+            args[2] = (char*) "-";
+            for(i = 0; i < cp->nfiles; i++) args[3 + i] = cp->files[i];
+            args[3 + cp->nfiles] = NULL;
+            bench_print(cp, "mshar.exe", bench_run(cp, args, 0, 0));
+
+            args[0] = (char*) mshar_exe;
+            args[1] = (char*) "-j";
+            args[2] = (char*) "0";
+            args[3] = (char*) "-";
+            args[4] = (char*) "-";
+            for(i = 0; i < cp->nfiles; i++) args[5 + i] = cp->files[i];
+            args[5 + cp->nfiles] = NULL;
+            bench_print(cp, "mshar.exe -j 0", bench_run(cp, args, 0, 0));
+
+            args[1] = (char*) "-z";
+            args[2] = (char*) "-";
+            args[3] = (char*) "-";
+            for(i = 0; i < cp->nfiles; i++) args[4 + i] = cp->files[i];
+            args[4 + cp->nfiles] = NULL;
+            bench_print(cp, "mshar.exe -z", bench_run(cp, args, 0, 0));
+
+            args[1] = (char*) "--dedup";
+            bench_print(cp, "mshar.exe --dedup", bench_run(cp, args, 0, 0));
+        }
+
+        bench_print(cp, "mkmshar_x", bench_run(cp, NULL, 1, 0));
+        bench_print(cp, "mkmshar_s", bench_run(cp, NULL, 1, 1));
+
+        if(have_sh){
+            args[0] = (char*) "sh";
+            args[1] = (char*) mshar_sh;
+            args[2] = (char*) "make-archive";
+            args[3] = (char*) BENCH_OUT;
+            args[4] = (char*) BENCH_EMPTY;
+            for(i = 0; i < cp->nfiles; i++) args[5 + i] = cp->files[i];
+            args[5 + cp->nfiles] = NULL;
+            bench_print(cp, "sh make-archive", bench_run(cp, args, 0, 0));
+        }
+
+        free(args);
+    }
+
+    bench_cleanup(corpora);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,486 @@
+/**
+ * @file bench_extract.c
+ * @author MXPSQL
+ * @brief Extraction benchmark of generated archives under dash, bash, busybox sh and mkmshar_unshar
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Generates four corpora, archives each with mkmshar_ctx_sink in every payload layout (printf, heredoc and trailer), then extracts every archive with each shell that is installed into an empty directory and checks every extracted file against its source.
+ * The native row extracts with mkmshar_unshar (what mshar -x does) in a forked child instead, it should fork nothing after that.
+ * 
+ * - tiny: 1000 files of 1 to 64 bytes
+ * - huge: 2 files of 32 MB
+ * - deep: 24 directory levels with 4 files each
+ * - mixed: 200 text and binary files of 1 to 256 KB
+ * 
+ * Forks are counted from the processes line of /proc/stat before and after the extraction, which counts every fork on the machine.
+ * So keep it quiet while this runs, it needs no strace and does not slow the shell down. Without /proc/stat the column is empty.
+ * 
+ * Then a small corpus with copies in it (the first file of their directory) is archived with dedup (cp and ln) in every layout and extracted whole with every shell and natively, that is a row too.
+ * It is also archived with a manifest, selective blocks or both, and copies are picked out by name or pattern without the file they are copies of.
+ * Exits with failure if a whole extraction of it is not right, or if a pick exits with an error, leaves a picked file different from its source or extracts a file that was not wanted.
+ * 
+ * Output is CSV: corpus,layout,shell,files,bytes,archive_bytes,seconds,cpu_seconds,seconds_per_file,MB_per_s,forks,forks_per_file,verified
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define BENCH_DIR "mshar_bench_extract"
+#define BENCH_OUTDIR BENCH_DIR "/out"
+#define BENCH_PATHMAX 512
+
+typedef struct bench_corpus {
+    const char* name;
+    char** files; /* relative to the corpus directory, which is what goes into the archive */
+    size_t nfiles;
+    unsigned long bytes;
+} bench_corpus;
+
+typedef struct bench_layout {
+    const char* name;
+    int layout;
+} bench_layout;
+
+/* files picked out of the dups corpus with args, and the ones that have to come out */
+typedef struct bench_pick {
+    const char* name;
+    int manifest;
+    int selective;
+    const char* args[4];
+    const char* want[3];
+} bench_pick;
+
+typedef struct bench_shell {
+    const char* name;
+    const char* argv0; /* NULL for mkmshar_unshar instead of a shell */
+    const char* argv1; /* NULL unless the shell is a multi-call binary */
+} bench_shell;
+
+static unsigned long bench_seed = 7;
+
+static unsigned long bench_rand(void){
+    bench_seed = bench_seed * 1103515245UL + 12345UL;
+    return (bench_seed >> 16) & 0x7fffUL;
+}
+
+static double bench_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+/* forks on the whole machine since boot, -1 if it cannot be known */
+static long bench_forks(void){
+    FILE* f = fopen("/proc/stat", "r");
+    char line[256];
+    long n = -1;
+
+    if(f == NULL) return -1;
+    while(fgets(line, sizeof(line), f) != NULL){
+        if(strncmp(line, "processes ", 10) == 0){
+            n = atol(line + 10);
+            break;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static int bench_add(bench_corpus* c, const char* rel, unsigned long size, int text){
+    char path[BENCH_PATHMAX];
+    FILE* f = NULL;
+    unsigned long i;
+    char** grown;
+
+    sprintf(path, "%s/src/%s/%s", BENCH_DIR, c->name, rel);
+    f = fopen(path, "wb");
+    if(f == NULL) return -1;
+    for(i = 0; i < size; i++){
+        int ch = text ? ((i % 64 == 63) ? '\n' : (int) ('a' + bench_rand() % 26)) : (int) (bench_rand() & 0xff);
+        putc(ch, f);
+    }
+    if(fclose(f) != 0) return -1;
+
+    grown = (char**) realloc(c->files, sizeof(char*) * (c->nfiles + 1));
+    if(grown == NULL) return -1;
+    c->files = grown;
+    c->files[c->nfiles] = (char*) malloc(strlen(rel) + 1);
+    if(c->files[c->nfiles] == NULL) return -1;
+    strcpy(c->files[c->nfiles], rel);
+    c->nfiles++;
+    c->bytes += size;
+    return 0;
+}
+
+static int bench_generate(bench_corpus* corpora){
+    static const char* names[] = {"tiny", "huge", "deep", "mixed"};
+    char rel[BENCH_PATHMAX];
+    char path[BENCH_PATHMAX];
+    unsigned long i, j;
+    size_t c;
+
+    mkdir(BENCH_DIR, 0755);
+    mkdir(BENCH_DIR "/src", 0755);
+    memset(corpora, 0, sizeof(bench_corpus) * 4);
+    for(c = 0; c < 4; c++){
+        corpora[c].name = names[c];
+        sprintf(path, "%s/src/%s", BENCH_DIR, names[c]);
+        mkdir(path, 0755);
+    }
+
+    for(i = 0; i < 1000; i++){
+        sprintf(rel, "t%lu", i);
+        if(bench_add(&corpora[0], rel, 1 + bench_rand() % 64, 1) != 0) return -1;
+    }
+
+    for(i = 0; i < 2; i++){
+        sprintf(rel, "h%lu", i);
+        if(bench_add(&corpora[1], rel, 32UL * 1024UL * 1024UL, 0) != 0) return -1;
+    }
+
+    /* parents come before children, the archive makes one directory level per file */
+    rel[0] = '\0';
+    for(i = 0; i < 24; i++){
+        sprintf(rel + strlen(rel), "%sd%lu", (i > 0) ? "/" : "", i);
+        sprintf(path, "%s/src/deep/%s", BENCH_DIR, rel);
+        mkdir(path, 0755);
+        for(j = 0; j < 4; j++){
+            char file[BENCH_PATHMAX];
+            sprintf(file, "%s/f%lu", rel, j);
+            if(bench_add(&corpora[2], file, 1 + bench_rand() % 4096, 1) != 0) return -1;
+        }
+    }
+
+    for(i = 0; i < 200; i++){
+        sprintf(rel, "m%lu", i);
+        if(bench_add(&corpora[3], rel, 1024UL + (bench_rand() * 8UL) % (255UL * 1024UL), (int) (i % 2)) != 0) return -1;
+    }
+
+    return 0;
+}
+
+/* d/b.txt and d/e.txt are copies of a.txt, c.txt is not */
+static int bench_dups(bench_corpus* c){
+    memset(c, 0, sizeof(bench_corpus));
+    c->name = "dups";
+    mkdir(BENCH_DIR "/src/dups", 0755);
+    mkdir(BENCH_DIR "/src/dups/d", 0755);
+    bench_seed = 11;
+    if(bench_add(c, "a.txt", 5000, 1) != 0) return -1;
+    bench_seed = 11;
+    if(bench_add(c, "d/b.txt", 5000, 1) != 0) return -1;
+    if(bench_add(c, "c.txt", 3000, 1) != 0) return -1;
+    bench_seed = 11;
+    return bench_add(c, "d/e.txt", 5000, 1);
+}
+
+/* the archive is built from inside the corpus directory so its paths are the relative ones */
+static int bench_archive(bench_corpus* c, const mkmshar_options* options, const char* archive, unsigned long* size){
+    char dir[BENCH_PATHMAX];
+    char cwd[BENCH_PATHMAX];
+    mkmshar_ctx ctx;
+    FILE* out = NULL;
+    int ret;
+
+    if(getcwd(cwd, sizeof(cwd)) == NULL) return -1;
+    out = fopen(archive, "wb");
+    if(out == NULL) return -1;
+
+    sprintf(dir, "%s/src/%s", BENCH_DIR, c->name);
+    if(chdir(dir) != 0){
+        fclose(out);
+        return -1;
+    }
+    mkmshar_ctx_init(&ctx);
+    ctx.options = *options;
+    ret = mkmshar_ctx_sink(&ctx, NULL, NULL, c->files, c->nfiles, mkmshar_sink_file, out);
+    *size = (unsigned long) ctx.stats.bytes_out;
+    if(chdir(cwd) != 0) ret = -1;
+    if(fclose(out) != 0) ret = -1;
+    return ret;
+}
+
+static int bench_same(const char* a, const char* b){
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    int same = (fa != NULL && fb != NULL);
+
+    while(same){
+        int ca = getc(fa);
+        int cb = getc(fb);
+        if(ca != cb) same = 0;
+        if(ca == EOF) break;
+    }
+    if(fa != NULL) fclose(fa);
+    if(fb != NULL) fclose(fb);
+    return same;
+}
+
+static int bench_have(const bench_shell* sh){
+    pid_t pid;
+    int status = 0;
+
+    if(sh->argv0 == NULL) return 1;
+    pid = fork();
+
+    if(pid == 0){
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, 1);
+        dup2(null, 2);
+        if(sh->argv1 != NULL) execlp(sh->argv0, sh->argv0, sh->argv1, "-c", ":", (char*) NULL);
+        else execlp(sh->argv0, sh->argv0, "-c", ":", (char*) NULL);
+        _exit(127);
+    }
+    if(pid < 0 || waitpid(pid, &status, 0) != pid) return 0;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* one row, 1 if every file came out right */
+static int bench_extract(bench_corpus* c, const bench_layout* layout, const bench_shell* sh, const char* archive, unsigned long size){
+    char abs[BENCH_PATHMAX];
+    struct rusage ru;
+    double start, secs, cpu;
+    long forks_before, forks_after;
+    int status = 0;
+    int verified = 1;
+    size_t i;
+    pid_t pid;
+
+    if(getcwd(abs, sizeof(abs)) == NULL) return 0;
+    sprintf(abs + strlen(abs), "/%s", archive);
+    if(system("rm -rf '" BENCH_OUTDIR "'") != 0 || mkdir(BENCH_OUTDIR, 0755) != 0){
+        fprintf(stderr, "Could not make %s\n", BENCH_OUTDIR);
+        return 0;
+    }
+
+    forks_before = bench_forks();
+    start = bench_now();
+    pid = fork();
+    if(pid == 0){
+        int null = open("/dev/null", O_WRONLY);
+        if(chdir(BENCH_OUTDIR) != 0) _exit(126);
+        dup2(null, 1);
+        dup2(null, 2);
+        if(sh->argv0 == NULL) _exit((mkmshar_unshar(abs, MXPSQL_MShar_UNSHAR_EXTRACT, NULL, NULL) == 0) ? 0 : 1);
+        if(sh->argv1 != NULL) execlp(sh->argv0, sh->argv0, sh->argv1, abs, (char*) NULL);
+        else execlp(sh->argv0, sh->argv0, abs, (char*) NULL);
+        _exit(127);
+    }
+    if(pid < 0 || wait4(pid, &status, 0, &ru) != pid){
+        fprintf(stderr, "Could not run %s\n", sh->name);
+        return 0;
+    }
+    secs = bench_now() - start;
+    forks_after = bench_forks();
+    cpu = (double) ru.ru_utime.tv_sec + (double) ru.ru_utime.tv_usec / 1e6 + (double) ru.ru_stime.tv_sec + (double) ru.ru_stime.tv_usec / 1e6;
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) verified = 0;
+    for(i = 0; i < c->nfiles && verified; i++){
+        char src[BENCH_PATHMAX];
+        char dst[BENCH_PATHMAX];
+        sprintf(src, "%s/src/%s/%s", BENCH_DIR, c->name, c->files[i]);
+        sprintf(dst, "%s/%s", BENCH_OUTDIR, c->files[i]);
+        verified = bench_same(src, dst);
+    }
+
+    printf("%s,%s,%s,%lu,%lu,%lu,%f,%f,%f,%f,", c->name, layout->name, sh->name, (unsigned long) c->nfiles, c->bytes, size, secs, cpu,
+        secs / (double) c->nfiles, (secs > 0) ? (double) c->bytes / 1e6 / secs : 0.0);
+    if(forks_before >= 0 && forks_after >= forks_before){
+        /* the one that started the shell (or the native child) is ours */
+        long forks = forks_after - forks_before - 1;
+        printf("%ld,%f,", forks, (double) forks / (double) c->nfiles);
+    }
+    else{
+        printf(",,");
+    }
+    printf("%s\n", verified ? "yes" : "no");
+    fflush(stdout);
+    return verified;
+}
+
+/* runs a pick of the dups corpus with sh, 1 if it came out right */
+static int bench_picked(bench_corpus* c, const bench_pick* pick, const bench_shell* sh, const char* archive){
+    char abs[BENCH_PATHMAX];
+    char src[BENCH_PATHMAX];
+    char dst[BENCH_PATHMAX];
+    const char* argv[8];
+    struct stat st;
+    int status = 0;
+    int ok;
+    size_t i, j, n = 0;
+    pid_t pid;
+
+    if(getcwd(abs, sizeof(abs)) == NULL) return 0;
+    sprintf(abs + strlen(abs), "/%s", archive);
+    if(system("rm -rf '" BENCH_OUTDIR "'") != 0 || mkdir(BENCH_OUTDIR, 0755) != 0) return 0;
+
+    argv[n++] = sh->argv0;
+    if(sh->argv1 != NULL) argv[n++] = sh->argv1;
+    argv[n++] = abs;
+    for(i = 0; pick->args[i] != NULL; i++) argv[n++] = pick->args[i];
+    argv[n] = NULL;
+
+    pid = fork();
+    if(pid == 0){
+        int null = open("/dev/null", O_WRONLY);
+        if(chdir(BENCH_OUTDIR) != 0) _exit(126);
+        dup2(null, 1);
+        dup2(null, 2);
+        execvp(argv[0], (char* const*) argv);
+        _exit(127);
+    }
+    if(pid < 0 || waitpid(pid, &status, 0) != pid) return 0;
+
+    ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    for(i = 0; i < c->nfiles && ok; i++){
+        int wanted = 0;
+
+        for(j = 0; pick->want[j] != NULL; j++){
+            if(strcmp(pick->want[j], c->files[i]) == 0) wanted = 1;
+        }
+        sprintf(src, "%s/src/%s/%s", BENCH_DIR, c->name, c->files[i]);
+        sprintf(dst, "%s/%s", BENCH_OUTDIR, c->files[i]);
+        /* the file a copy is made from may come out too, nothing else */
+        if(wanted) ok = bench_same(src, dst);
+        else if(strcmp(c->files[i], "a.txt") != 0) ok = (stat(dst, &st) != 0);
+    }
+    return ok;
+}
+
+int main(void){
+    static const bench_shell shells[] = {
+        {"dash", "dash", NULL},
+        {"bash", "bash", NULL},
+        {"busybox sh", "busybox", "sh"},
+        {"native", NULL, NULL}
+    };
+    static const bench_layout layouts[] = {
+        {"printf", MXPSQL_MShar_LAYOUT_PRINTF},
+        {"heredoc", MXPSQL_MShar_LAYOUT_HEREDOC},
+        {"trailer", MXPSQL_MShar_LAYOUT_TRAILER}
+    };
+    static const bench_pick picks[] = {
+        {"name", 1, 0, {"d/b.txt", NULL}, {"d/b.txt", NULL}},
+        {"names", 1, 0, {"d/e.txt", "a.txt", "d/e.txt", NULL}, {"d/e.txt", "a.txt", NULL}},
+        {"pattern", 0, 1, {"--include", "d/*", NULL}, {"d/b.txt", "d/e.txt", NULL}},
+        {"pattern manifest", 1, 1, {"--include", "d/*", NULL}, {"d/b.txt", "d/e.txt", NULL}},
+        {"selective name", 0, 1, {"d/e.txt", NULL}, {"d/e.txt", NULL}}
+    };
+    static const int dedups[] = {MXPSQL_MShar_DEDUP_COPY, MXPSQL_MShar_DEDUP_LINK};
+    bench_corpus corpora[4];
+    bench_corpus dups;
+    mkmshar_ctx defaults;
+    mkmshar_options options;
+    int have[4];
+    int ok = 1;
+    unsigned long size;
+    size_t c, l, s, i, d, p;
+
+    mkmshar_ctx_init(&defaults);
+    if(bench_generate(corpora) != 0 || bench_dups(&dups) != 0){
+        fprintf(stderr, "Could not generate the corpora in %s\n", BENCH_DIR);
+        return EXIT_FAILURE;
+    }
+
+    for(s = 0; s < 4; s++){
+        have[s] = bench_have(&shells[s]);
+        if(!have[s]) fprintf(stderr, "%s not found, skipping it\n", shells[s].name);
+    }
+
+    printf("corpus,layout,shell,files,bytes,archive_bytes,seconds,cpu_seconds,seconds_per_file,MB_per_s,forks,forks_per_file,verified\n");
+    for(c = 0; c < 4; c++){
+        for(l = 0; l < 3; l++){
+            options = defaults.options;
+            options.layout = layouts[l].layout;
+            if(bench_archive(&corpora[c], &options, BENCH_DIR "/archive.sh", &size) != 0){
+                fprintf(stderr, "Could not archive %s\n", corpora[c].name);
+                return EXIT_FAILURE;
+            }
+            for(s = 0; s < 4; s++){
+                if(have[s]) bench_extract(&corpora[c], &layouts[l], &shells[s], BENCH_DIR "/archive.sh", size);
+            }
+        }
+    }
+
+    /* the copies are the first files of d/, so the directory has to be made for them */
+    for(l = 0; l < 3; l++){
+        for(d = 0; d < 2; d++){
+            options = defaults.options;
+            options.layout = layouts[l].layout;
+            options.dedup = dedups[d];
+            if(bench_archive(&dups, &options, BENCH_DIR "/archive.sh", &size) != 0){
+                fprintf(stderr, "Could not archive %s\n", dups.name);
+                return EXIT_FAILURE;
+            }
+            for(s = 0; s < 4; s++){
+                if(!have[s] || bench_extract(&dups, &layouts[l], &shells[s], BENCH_DIR "/archive.sh", size)) continue;
+                fprintf(stderr, "%s did not extract the copies right with the %s layout and %s\n", shells[s].name, layouts[l].name, (d == 0) ? "cp" : "ln");
+                ok = 0;
+            }
+        }
+    }
+
+    for(l = 0; l < 3; l++){
+        for(d = 0; d < 2; d++){
+            for(p = 0; p < sizeof(picks) / sizeof(picks[0]); p++){
+                options = defaults.options;
+                options.layout = layouts[l].layout;
+                options.dedup = dedups[d];
+                options.manifest = picks[p].manifest;
+                options.selective = picks[p].selective;
+                if(bench_archive(&dups, &options, BENCH_DIR "/archive.sh", &size) != 0){
+                    fprintf(stderr, "Could not archive %s\n", dups.name);
+                    return EXIT_FAILURE;
+                }
+                for(s = 0; s < 4; s++){
+                    if(!have[s] || shells[s].argv0 == NULL || bench_picked(&dups, &picks[p], &shells[s], BENCH_DIR "/archive.sh")) continue;
+                    fprintf(stderr, "%s pick of a copy is wrong with %s, %s layout and %s\n", picks[p].name, shells[s].name, layouts[l].name, (d == 0) ? "cp" : "ln");
+                    ok = 0;
+                }
+            }
+        }
+    }
+
+    for(c = 0; c < 4; c++){
+        for(i = 0; i < corpora[c].nfiles; i++) free(corpora[c].files[i]);
+        free(corpora[c].files);
+    }
+    for(i = 0; i < dups.nfiles; i++) free(dups.files[i]);
+    free(dups.files);
+    return (system("rm -rf '" BENCH_DIR "'") == 0 && ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
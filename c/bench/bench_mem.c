@@ -0,0 +1,266 @@
+/**
+ * @file bench_mem.c
+ * @author MXPSQL
+ * @brief Memory report of archive building, also fails if too much memory is used
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Plugs a counting allocator in through the MXPSQL_MShar_* allocation macros and archives 1000 small files, once into memory with mkmshar_x and once through mkmshar_sink.
+ * Reports bytes allocated, the peak of live heap bytes, the allocation count and the peak RSS.
+ * Exits with failure if either the peak heap or the total bytes allocated is more than BENCH_MEM_MAXRATIO times the output size.
+ * 
+ * Then the same files are streamed through mkmshar_ctx_sink_next, 1000 and BENCH_STREAM_NFILES paths (the 1000 over and over) on 1 and 4 threads, with the paths made by the source on the counting allocator too.
+ * Exits with failure if the peak heap of the long list is over twice that of the short one, streaming should only hold the files in flight.
+ * 
+ * Output is CSV: api,files,output_bytes,bytes_allocated,peak_heap_bytes,allocs,peak_rss_kb
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+void* bench_malloc(size_t size);
+void* bench_calloc(size_t count, size_t size);
+void* bench_realloc(void* ptr, size_t size);
+void bench_free(void* ptr);
+
+#define MXPSQL_MShar_Malloc(size) bench_malloc(size)
+#define MXPSQL_MShar_Calloc(count, size) bench_calloc(count, size)
+#define MXPSQL_MShar_Realloc(ptr, size) bench_realloc(ptr, size)
+#define MXPSQL_MShar_Free(ptr) bench_free(ptr)
+
+#include "../src/mshar.h"
+
+#define BENCH_DIR "mshar_bench_mem"
+#define BENCH_NFILES 1000UL
+#define BENCH_MEM_MAXRATIO 4UL
+#define BENCH_STREAM_NFILES 100000UL
+
+/* every block carries its size in front of it so realloc and free can keep count */
+typedef union bench_hdr {
+    size_t size;
+    double align_d;
+    void* align_p;
+} bench_hdr;
+
+static unsigned long live = 0;
+static unsigned long peak = 0;
+static unsigned long total = 0;
+static unsigned long nallocs = 0;
+
+static void bench_count(size_t oldsize, size_t newsize){
+    live = live - (unsigned long) oldsize + (unsigned long) newsize;
+    if(newsize > oldsize) total += (unsigned long) (newsize - oldsize);
+    if(live > peak) peak = live;
+}
+
+void* bench_malloc(size_t size){
+    bench_hdr* h = (bench_hdr*) malloc(sizeof(bench_hdr) + size);
+    if(h == NULL) return NULL;
+    h->size = size;
+    nallocs++;
+    bench_count(0, size);
+    return h + 1;
+}
+
+void* bench_calloc(size_t count, size_t size){
+    void* p = bench_malloc(count * size);
+    if(p != NULL) memset(p, 0, count * size);
+    return p;
+}
+
+void* bench_realloc(void* ptr, size_t size){
+    bench_hdr* h = NULL;
+    size_t oldsize;
+
+    if(ptr == NULL) return bench_malloc(size);
+
+    h = ((bench_hdr*) ptr) - 1;
+    oldsize = h->size;
+    h = (bench_hdr*) realloc(h, sizeof(bench_hdr) + size);
+    if(h == NULL) return NULL;
+    h->size = size;
+    nallocs++;
+    bench_count(oldsize, size);
+    return h + 1;
+}
+
+void bench_free(void* ptr){
+    bench_hdr* h = NULL;
+    if(ptr == NULL) return;
+    h = ((bench_hdr*) ptr) - 1;
+    bench_count(h->size, 0);
+    free(h);
+}
+
+static void bench_reset(void){
+    live = 0;
+    peak = 0;
+    total = 0;
+    nallocs = 0;
+}
+
+static long bench_maxrss(void){
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+    return ru.ru_maxrss;
+}
+
+static unsigned long outbytes = 0;
+
+static int bench_sink_null(void* userdata, const char* data, size_t len){
+    (void) userdata;
+    (void) data;
+    outbytes += (unsigned long) len;
+    return 0;
+}
+
+static int bench_check(const char* api, unsigned long out){
+    int ok = (peak <= out * BENCH_MEM_MAXRATIO && total <= out * BENCH_MEM_MAXRATIO);
+
+    printf("%s,%lu,%lu,%lu,%lu,%lu,%ld\n", api, BENCH_NFILES, out, total, peak, nallocs, bench_maxrss());
+    if(!ok){
+        fprintf(stderr, "%s used more than %lu times the output size\n", api, BENCH_MEM_MAXRATIO);
+    }
+    return ok;
+}
+
+/* the benchmark files over and over, each path made when it is asked for */
+typedef struct bench_list {
+    unsigned long next;
+    unsigned long n;
+} bench_list;
+
+static const char* bench_next(void* userdata){
+    bench_list* list = (bench_list*) userdata;
+    char* path;
+
+    if(list->next >= list->n) return NULL;
+    path = (char*) bench_malloc(sizeof(BENCH_DIR) + 16);
+    if(path == NULL) return NULL;
+    sprintf(path, "%s/f%lu", BENCH_DIR, list->next++ % BENCH_NFILES);
+    return path;
+}
+
+static void bench_release(void* userdata, const char* path){
+    (void) userdata;
+    bench_free((void*) path);
+}
+
+/* peak heap of streaming n paths on nthreads, 0 if it fails */
+static unsigned long bench_stream(unsigned long n, size_t nthreads){
+    mkmshar_ctx ctx;
+    mkmshar_source source;
+    bench_list list;
+    char api[64];
+
+    list.next = 0;
+    list.n = n;
+    source.next = bench_next;
+    source.release = bench_release;
+    source.userdata = &list;
+    mkmshar_ctx_init(&ctx);
+    ctx.options.nthreads = nthreads;
+
+    bench_reset();
+    outbytes = 0;
+    if(mkmshar_ctx_sink_next(&ctx, NULL, NULL, &source, bench_sink_null, NULL) != 0 || live != 0){
+        fprintf(stderr, "mkmshar_ctx_sink_next failed or left %lu bytes\n", live);
+        return 0;
+    }
+    sprintf(api, "mkmshar_ctx_sink_next -j %lu", (unsigned long) nthreads);
+    printf("%s,%lu,%lu,%lu,%lu,%lu,%ld\n", api, n, outbytes, total, peak, nallocs, bench_maxrss());
+    return peak;
+}
+
+int main(void){
+    char* files[BENCH_NFILES];
+    char* arc = NULL;
+    unsigned long i;
+    int ok = 1;
+
+    mkdir(BENCH_DIR, 0755);
+    for(i = 0; i < BENCH_NFILES; i++){
+        FILE* f = NULL;
+        files[i] = (char*) malloc(sizeof(BENCH_DIR) + 16);
+        if(files[i] == NULL){
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        sprintf(files[i], "%s/f%lu", BENCH_DIR, i);
+        f = fopen(files[i], "wb");
+        if(f == NULL){
+            fprintf(stderr, "Could not create %s\n", files[i]);
+            return EXIT_FAILURE;
+        }
+        fprintf(f, "small file number %lu of the memory benchmark\n", i);
+        fclose(f);
+    }
+
+    printf("api,files,output_bytes,bytes_allocated,peak_heap_bytes,allocs,peak_rss_kb\n");
+
+    bench_reset();
+    outbytes = 0;
+    if(mkmshar_sink(NULL, NULL, files, BENCH_NFILES, 0, bench_sink_null, NULL) != 0){
+        fprintf(stderr, "mkmshar_sink failed\n");
+        return EXIT_FAILURE;
+    }
+    ok = bench_check("mkmshar_sink", outbytes) && ok;
+
+    bench_reset();
+    arc = mkmshar_x(NULL, NULL, files, BENCH_NFILES);
+    if(arc == NULL){
+        fprintf(stderr, "mkmshar_x failed\n");
+        return EXIT_FAILURE;
+    }
+    ok = bench_check("mkmshar_x", (unsigned long) strlen(arc)) && ok;
+    MXPSQL_MShar_Free(arc);
+
+    {
+        size_t nthreads;
+        for(nthreads = 1; nthreads <= 4; nthreads += 3){
+            unsigned long shortpeak = bench_stream(BENCH_NFILES, nthreads);
+            unsigned long longpeak = bench_stream(BENCH_STREAM_NFILES, nthreads);
+            if(shortpeak == 0 || longpeak == 0 || longpeak > shortpeak * 2){
+                fprintf(stderr, "streaming %lu paths peaked at %lu bytes against %lu for %lu\n", BENCH_STREAM_NFILES, longpeak, shortpeak, BENCH_NFILES);
+                ok = 0;
+            }
+        }
+    }
+
+    for(i = 0; i < BENCH_NFILES; i++){
+        remove(files[i]);
+        free(files[i]);
+    }
+    remove(BENCH_DIR);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
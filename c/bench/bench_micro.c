@@ -0,0 +1,188 @@
+/**
+ * @file bench_micro.c
+ * @author MXPSQL
+ * @brief Micro benchmarks of the hot paths: base64, the snprintf and block assembly
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Sizes go from 16 B to 1 GB (16x steps up to 256 MB), give a smaller maximum in bytes as the first argument to stop earlier.
+ * Each row repeats its call until about 256 MB went through it (at most a million times).
+ * 
+ * - b64Encode: mkmshar_b64Encode of a buffer, allocating the result each call
+ * - snprintf: mkmshar_snprintf of "TEKTONE='%s'\n" with a string of the size
+ * - dumbvsnprintf: the same through mkmshar_dumbvsnprintf directly
+ * - block: mkmshar_ctx_sink of one file of the size into a sink that throws it away (header, block and footer)
+ * 
+ * allocs_per_call counts calls to the MXPSQL_MShar_* allocation macros.
+ * 
+ * Output is CSV: bench,bytes,iterations,seconds,MB_per_s,ns_per_byte,allocs_per_call
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+static unsigned long bench_allocs = 0;
+
+#define MXPSQL_MShar_Malloc(size) (bench_allocs++, malloc(size))
+#define MXPSQL_MShar_Calloc(count, size) (bench_allocs++, calloc(count, size))
+#define MXPSQL_MShar_Realloc(ptr, size) (bench_allocs++, realloc(ptr, size))
+#define MXPSQL_MShar_Free(ptr) free(ptr)
+
+#include "../src/mshar.h"
+
+#define BENCH_FILE "mshar_bench_micro.bin"
+#define BENCH_VOLUME (256UL * 1024UL * 1024UL)
+#define BENCH_MAXITER 1000000UL
+#define BENCH_MAXSIZE 1073741824UL
+
+typedef struct bench_row {
+    unsigned long iterations;
+    clock_t start;
+    unsigned long allocs;
+} bench_row;
+
+static int bench_sink_null(void* userdata, const char* data, size_t len){
+    (void) userdata;
+    (void) data;
+    (void) len;
+    return 0;
+}
+
+static int bench_dumb(char* str, size_t size, const char* format, ...){
+    va_list arg;
+    int ret;
+    va_start(arg, format);
+    ret = mkmshar_dumbvsnprintf(str, size, format, arg);
+    va_end(arg);
+    return ret;
+}
+
+static void bench_begin(bench_row* row, unsigned long size){
+    row->iterations = BENCH_VOLUME / size;
+    if(row->iterations < 1) row->iterations = 1;
+    if(row->iterations > BENCH_MAXITER) row->iterations = BENCH_MAXITER;
+    row->allocs = bench_allocs;
+    row->start = clock();
+}
+
+static void bench_end(bench_row* row, const char* name, unsigned long size){
+    double secs = (double) (clock() - row->start) / CLOCKS_PER_SEC;
+    double bytes = (double) size * (double) row->iterations;
+
+    printf("%s,%lu,%lu,%f,%f,%f,%f\n", name, size, row->iterations, secs,
+        (secs > 0) ? bytes / 1e6 / secs : 0.0,
+        (bytes > 0) ? secs * 1e9 / bytes : 0.0,
+        (double) (bench_allocs - row->allocs) / (double) row->iterations);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]){
+    static const unsigned long sizes[] = {
+        16UL, 256UL, 4096UL, 65536UL, 1048576UL, 16777216UL, 268435456UL, 1073741824UL
+    };
+    unsigned long maxsize = BENCH_MAXSIZE;
+    size_t s;
+    char* files[1];
+
+    if(argc > 1){
+        maxsize = strtoul(argv[1], NULL, 10);
+    }
+    files[0] = (char*) BENCH_FILE;
+
+    printf("bench,bytes,iterations,seconds,MB_per_s,ns_per_byte,allocs_per_call\n");
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= maxsize; s++){
+        unsigned long size = sizes[s];
+        bench_row row;
+        unsigned long i;
+        char* data = (char*) malloc(size + 1);
+        char* out = (char*) malloc(size + 32);
+        FILE* f = NULL;
+
+        if(data == NULL || out == NULL){
+            fprintf(stderr, "Out of memory at %lu bytes\n", size);
+            return EXIT_FAILURE;
+        }
+        /* printable so the snprintf rows copy all of it */
+        for(i = 0; i < size; i++){
+            data[i] = (char) ('a' + (i * 7) % 26);
+        }
+        data[size] = '\0';
+
+        bench_begin(&row, size);
+        for(i = 0; i < row.iterations; i++){
+            char* enc = mkmshar_b64Encode(data, size);
+            if(enc == NULL){
+                fprintf(stderr, "mkmshar_b64Encode failed at %lu bytes\n", size);
+                return EXIT_FAILURE;
+            }
+            MXPSQL_MShar_Free(enc);
+        }
+        bench_end(&row, "b64Encode", size);
+
+        bench_begin(&row, size);
+        for(i = 0; i < row.iterations; i++){
+            mkmshar_snprintf(out, size + 32, "TEKTONE='%s'\n", data);
+        }
+        bench_end(&row, "snprintf", size);
+
+        bench_begin(&row, size);
+        for(i = 0; i < row.iterations; i++){
+            bench_dumb(out, size + 32, "TEKTONE='%s'\n", data);
+        }
+        bench_end(&row, "dumbvsnprintf", size);
+
+        free(out);
+
+        f = fopen(BENCH_FILE, "wb");
+        if(f == NULL || fwrite(data, 1, size, f) != size){
+            fprintf(stderr, "Could not write %s\n", BENCH_FILE);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+        free(data);
+
+        bench_begin(&row, size);
+        for(i = 0; i < row.iterations; i++){
+            mkmshar_ctx ctx;
+            mkmshar_ctx_init(&ctx);
+            if(mkmshar_ctx_sink(&ctx, NULL, NULL, files, 1, bench_sink_null, NULL) != 0){
+                fprintf(stderr, "mkmshar_ctx_sink failed at %lu bytes\n", size);
+                return EXIT_FAILURE;
+            }
+        }
+        bench_end(&row, "block", size);
+
+        remove(BENCH_FILE);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file bench_mmap.c
+ * @author MXPSQL
+ * @brief Buffered reads against memory mapping for one file of each size, to find MXPSQL_MShar_MMAP_THRESHOLD
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * MXPSQL_MShar_MMAP_THRESHOLD is defined to a variable here so both paths can be timed from the same build.
+ * Each size is archived enough times to move about 256 MB, with the file already in the page cache.
+ * The first row from which mmap stays faster is about where the threshold should be, each rate is the best of BENCH_TRIES runs.
+ * That row is printed to stderr at the end, with a warning if MXPSQL_MShar_MMAP_DEFAULT is more than one row away from it (it is not a failure, it depends on the machine).
+ * 
+ * Output is CSV: file_bytes,buffered_MB_per_s,mmap_MB_per_s,faster
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+static unsigned long bench_mmap_threshold = 0;
+
+#define MXPSQL_MShar_MMAP_THRESHOLD bench_mmap_threshold
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "mshar_bench_mmap.bin"
+#define BENCH_VOLUME (256UL * 1024UL * 1024UL)
+#define BENCH_TRIES 3
+
+static int bench_sink_null(void* userdata, const char* data, size_t len){
+    (void) userdata;
+    (void) data;
+    (void) len;
+    return 0;
+}
+
+static double bench_run(char** files, unsigned long size, unsigned long threshold){
+    unsigned long reps = BENCH_VOLUME / size;
+    unsigned long r;
+    clock_t start;
+    double secs;
+
+    bench_mmap_threshold = threshold;
+    start = clock();
+    for(r = 0; r < reps; r++){
+        if(mkmshar_sink(NULL, NULL, files, 1, 0, bench_sink_null, NULL) != 0){
+            fprintf(stderr, "mkmshar_sink failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+    return secs > 0 ? ((double) reps * (double) size / 1e6) / secs : 0.0;
+}
+
+int main(void){
+    static const unsigned long sizes[] = {
+        4096UL, 16384UL, 65536UL, 262144UL, 1048576UL, 4194304UL, 16777216UL, 67108864UL, 268435456UL
+    };
+    char* files[1];
+    char* data = NULL;
+    size_t wins = sizeof(sizes) / sizeof(sizes[0]);
+    size_t at = wins;
+    size_t i;
+
+    files[0] = (char*) BENCH_FILE;
+    data = (char*) malloc(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    if(data == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for(i = 0; i < sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]; i++){
+        data[i] = (char) ((i * 2654435761UL) >> 13);
+    }
+
+    printf("file_bytes,buffered_MB_per_s,mmap_MB_per_s,faster\n");
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        FILE* f = fopen(BENCH_FILE, "wb");
+        double buffered, mapped;
+        int t;
+
+        if(f == NULL || fwrite(data, 1, sizes[i], f) != sizes[i]){
+            fprintf(stderr, "Could not write %s\n", BENCH_FILE);
+            return EXIT_FAILURE;
+        }
+        fclose(f);
+
+        buffered = 0.0;
+        mapped = 0.0;
+        for(t = 0; t < BENCH_TRIES; t++){
+            double b = bench_run(files, sizes[i], (unsigned long) -1);
+            double m = bench_run(files, sizes[i], 0);
+            if(b > buffered) buffered = b;
+            if(m > mapped) mapped = m;
+        }
+        if(mapped <= buffered) wins = sizeof(sizes) / sizeof(sizes[0]);
+        else if(wins == sizeof(sizes) / sizeof(sizes[0])) wins = i;
+        printf("%lu,%f,%f,%s\n", sizes[i], buffered, mapped, (mapped > buffered) ? "mmap" : "buffered");
+        fflush(stdout);
+    }
+
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++){
+        if(sizes[i] == MXPSQL_MShar_MMAP_DEFAULT) at = i;
+    }
+    if(wins < sizeof(sizes) / sizeof(sizes[0])){
+        fprintf(stderr, "mmap is faster from %lu bytes on, MXPSQL_MShar_MMAP_DEFAULT is %lu\n", sizes[wins], (unsigned long) MXPSQL_MShar_MMAP_DEFAULT);
+        if(at == sizeof(sizes) / sizeof(sizes[0]) || at + 1 < wins || wins + 1 < at){
+            fprintf(stderr, "warning: MXPSQL_MShar_MMAP_DEFAULT is more than one row away from that here\n");
+        }
+    }
+    else{
+        fprintf(stderr, "mmap was not faster for the biggest files here\n");
+    }
+
+    remove(BENCH_FILE);
+    free(data);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file bench_parallel.c
+ * @author MXPSQL
+ * @brief Benchmark of mkmshar_sink_mt against the number of worker threads
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Creates 2000 files of 32 KB plus a few bigger than MXPSQL_MShar_PARALLEL_MAX_BLOCK, archives them with 1, 2, 4, 8 and auto (0) threads and compares each archive with the single threaded one.
+ * It fails if any archive differs. Times are wall clock, speedup is against 1 thread.
+ * 
+ * Output is CSV: threads,files,output_bytes,seconds,speedup,identical
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define BENCH_DIR "mshar_bench_parallel"
+#define BENCH_FILES 2000UL
+#define BENCH_BIG 4UL
+#define BENCH_SMALL_BYTES (32UL * 1024UL)
+#define BENCH_BIG_BYTES (8UL * 1024UL * 1024UL)
+
+typedef struct bench_out {
+    char* data;
+    size_t len;
+    size_t cap;
+} bench_out;
+
+static int bench_sink_mem(void* userdata, const char* data, size_t len){
+    bench_out* out = (bench_out*) userdata;
+    if(out->len + len > out->cap){
+        size_t cap = (out->cap > 0) ? out->cap : 4096;
+        char* grown;
+        while(cap < out->len + len) cap *= 2;
+        grown = (char*) realloc(out->data, cap);
+        if(grown == NULL) return -1;
+        out->data = grown;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    return 0;
+}
+
+static double bench_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+static int bench_write(const char* path, unsigned long size, unsigned long seed){
+    FILE* f = fopen(path, "wb");
+    unsigned long i;
+    if(f == NULL) return -1;
+    for(i = 0; i < size; i++){
+        seed = seed * 1103515245UL + 12345UL;
+        putc((int) ((seed >> 16) & 0xff), f);
+    }
+    return fclose(f);
+}
+
+int main(void){
+    static const size_t threads[] = {1, 2, 4, 8, 0};
+    unsigned long nfiles = BENCH_FILES + BENCH_BIG;
+    char** files = NULL;
+    bench_out ref = {NULL, 0, 0};
+    double refsecs = 0.0;
+    unsigned long i;
+    size_t t;
+    int failed = 0;
+
+    files = (char**) malloc(sizeof(char*) * nfiles);
+    if(files == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    mkdir(BENCH_DIR, 0755);
+    for(i = 0; i < nfiles; i++){
+        files[i] = (char*) malloc(sizeof(BENCH_DIR) + 16);
+        if(files[i] == NULL){
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        sprintf(files[i], "%s/f%lu", BENCH_DIR, i);
+        /* the big ones are spread out so the writer streams them between pooled blocks */
+        if(bench_write(files[i], (i % (nfiles / BENCH_BIG) == 1) ? BENCH_BIG_BYTES : BENCH_SMALL_BYTES, i + 1) != 0){
+            fprintf(stderr, "Could not create %s\n", files[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("threads,files,output_bytes,seconds,speedup,identical\n");
+    for(t = 0; t < sizeof(threads) / sizeof(threads[0]); t++){
+        bench_out out = {NULL, 0, 0};
+        double start, secs;
+        int same;
+
+        start = bench_now();
+        if(mkmshar_sink_mt(NULL, NULL, files, (size_t) nfiles, 0, threads[t], bench_sink_mem, &out) != 0){
+            fprintf(stderr, "mkmshar_sink_mt failed with %lu threads\n", (unsigned long) threads[t]);
+            return EXIT_FAILURE;
+        }
+        secs = bench_now() - start;
+
+        if(t == 0){
+            ref = out;
+            refsecs = secs;
+            same = 1;
+        }
+        else{
+            same = (out.len == ref.len && memcmp(out.data, ref.data, ref.len) == 0);
+            free(out.data);
+        }
+        if(!same) failed = 1;
+
+        printf("%lu,%lu,%lu,%f,%f,%s\n", (unsigned long) threads[t], nfiles, (unsigned long) ref.len, secs, (secs > 0) ? refsecs / secs : 0.0, same ? "yes" : "no");
+        fflush(stdout);
+    }
+
+    for(i = 0; i < nfiles; i++){
+        remove(files[i]);
+        free(files[i]);
+    }
+    remove(BENCH_DIR);
+    free(files);
+    free(ref.data);
+
+    if(failed){
+        fprintf(stderr, "parallel archive differs from the sequential one\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
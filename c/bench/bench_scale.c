@@ -0,0 +1,114 @@
+/**
+ * @file bench_scale.c
+ * @author MXPSQL
+ * @brief Benchmark of archive build time against the number of files
+ * @version 0
+ * @date 2022-06-04
+ * 
+ * @details
+ * Creates 100k small files in a scratch directory, then archives the first 10, 100, 1k, 10k and 100k of them into a sink that throws everything away.
+ * If archive assembly is linear, the time per file stays flat across the rows.
+ * 
+ * Output is CSV: files,output_bytes,seconds,us_per_file
+ * 
+ * @copyright 
+ * 
+ * MIT License
+ * 
+ * Copyright (c) 2022 MXPSQL
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * 
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BENCH_DIR "mshar_bench_scale"
+#define BENCH_MAXFILES 100000UL
+
+static unsigned long outbytes = 0;
+
+static int bench_sink_null(void* userdata, const char* data, size_t len){
+    (void) userdata;
+    (void) data;
+    outbytes += (unsigned long) len;
+    return 0;
+}
+
+int main(void){
+    static const unsigned long counts[] = {10UL, 100UL, 1000UL, 10000UL, 100000UL};
+    char** files = NULL;
+    unsigned long i;
+    size_t c;
+
+    files = (char**) malloc(sizeof(char*) * BENCH_MAXFILES);
+    if(files == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    mkdir(BENCH_DIR, 0755);
+    for(i = 0; i < BENCH_MAXFILES; i++){
+        FILE* f = NULL;
+        files[i] = (char*) malloc(sizeof(BENCH_DIR) + 16);
+        if(files[i] == NULL){
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+        sprintf(files[i], "%s/f%lu", BENCH_DIR, i);
+        f = fopen(files[i], "wb");
+        if(f == NULL){
+            fprintf(stderr, "Could not create %s\n", files[i]);
+            return EXIT_FAILURE;
+        }
+        fprintf(f, "file number %lu of the scaling benchmark\n", i);
+        fclose(f);
+    }
+
+    printf("files,output_bytes,seconds,us_per_file\n");
+    for(c = 0; c < sizeof(counts) / sizeof(counts[0]); c++){
+        clock_t start;
+        double secs;
+
+        outbytes = 0;
+        start = clock();
+        if(mkmshar_sink(NULL, NULL, files, (size_t) counts[c], 0, bench_sink_null, NULL) != 0){
+            fprintf(stderr, "mkmshar_sink failed at %lu files\n", counts[c]);
+            return EXIT_FAILURE;
+        }
+        secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+        printf("%lu,%lu,%f,%f\n", counts[c], outbytes, secs, (secs * 1e6) / (double) counts[c]);
+        fflush(stdout);
+    }
+
+    for(i = 0; i < BENCH_MAXFILES; i++){
+        remove(files[i]);
+        free(files[i]);
+    }
+    remove(BENCH_DIR);
+    free(files);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+/**
+ * @file bench_uring.c
+ * @author MXPSQL
+ * @brief Benchmark of reading many tiny files through io_uring (options.uring) against stdio
+ * @version 0
+ * @date 2022-06-04
+ *
+ * @details
+ * Generates a tree of tiny files (100000 by default, or as many as the first argument says) of 0 to 2 KB, BENCH_PER to a directory, and archives the list of them with mkmshar_ctx_sink on the calling thread, once with stdio and once per queue depth with options.uring.
+ * Every build is timed in this process, then run once more in a forked child that is traced with ptrace, which counts every system call it makes from the start of the build to its exit (the allocator's brk and mmap calls too).
+ * That needs no strace, but it does need ptrace to be allowed, without it the syscall columns are empty.
+ *
+ * uring_files is how many files went through the ring, it is 0 where the kernel has no io_uring (or it is not allowed) and the build fell back to stdio.
+ * Exits with failure if an archive is not byte for byte the stdio one, or if a build that used the ring made more system calls per file than stdio.
+ *
+ * Output is CSV: read,depth,files,uring_files,archive_bytes,seconds,files_per_s,syscalls,syscalls_per_file,identical
+ *
+ * @copyright
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 MXPSQL
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+#define BENCH_DIR "mshar_bench_uring"
+#define BENCH_PATHMAX 256
+#define BENCH_FILES 100000
+#define BENCH_PER 500
+
+/* what came out, hashed instead of kept */
+typedef struct bench_out {
+    unsigned long bytes;
+    unsigned long hash;
+} bench_out;
+
+static unsigned long bench_seed = 13;
+
+static unsigned long bench_rand(void){
+    bench_seed = bench_seed * 1103515245UL + 12345UL;
+    return (bench_seed >> 16) & 0x7fffUL;
+}
+
+static double bench_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+static int bench_sink(void* userdata, const char* data, size_t len){
+    bench_out* out = (bench_out*) userdata;
+    size_t i;
+
+    for(i = 0; i < len; i++){
+        out->hash = ((out->hash ^ (unsigned char) data[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    out->bytes += (unsigned long) len;
+    return 0;
+}
+
+static int bench_file(const char* path, unsigned long size){
+    FILE* f = fopen(path, "wb");
+    unsigned long i;
+
+    if(f == NULL) return -1;
+    for(i = 0; i < size; i++){
+        putc((int) ('a' + bench_rand() % 26), f);
+    }
+    return (fclose(f) == 0) ? 0 : -1;
+}
+
+/* the tree and the list of its files, NULL if it could not be made */
+static char** bench_generate(size_t nfiles){
+    char path[BENCH_PATHMAX];
+    char** files = (char**) malloc(sizeof(char*) * nfiles);
+    size_t i;
+
+    if(files == NULL || mkdir(BENCH_DIR, 0755) != 0){
+        free(files);
+        return NULL;
+    }
+    for(i = 0; i < nfiles; i++){
+        if(i % BENCH_PER == 0){
+            sprintf(path, "%s/d%lu", BENCH_DIR, (unsigned long) (i / BENCH_PER));
+            if(mkdir(path, 0755) != 0) break;
+        }
+        sprintf(path, "%s/d%lu/f%lu", BENCH_DIR, (unsigned long) (i / BENCH_PER), (unsigned long) i);
+        files[i] = (char*) malloc(strlen(path) + 1);
+        if(files[i] == NULL) break;
+        strcpy(files[i], path);
+        if(bench_file(path, bench_rand() % 2048) != 0){
+            free(files[i]);
+            break;
+        }
+    }
+    if(i < nfiles){
+        while(i > 0) free(files[--i]);
+        free(files);
+        return NULL;
+    }
+    return files;
+}
+
+/* one build, 0 if it failed */
+static int bench_build(char** files, size_t nfiles, size_t depth, bench_out* out, size_t* ringed){
+    mkmshar_ctx ctx;
+    int status;
+
+    out->bytes = 0;
+    out->hash = 2166136261UL;
+    mkmshar_ctx_init(&ctx);
+    ctx.options.uring = depth;
+    status = mkmshar_ctx_sink(&ctx, NULL, NULL, files, nfiles, bench_sink, out);
+    *ringed = ctx.stats.uring_files;
+    if(status != 0){
+        fprintf(stderr, "build with depth %lu failed: %s\n", (unsigned long) depth, strerror(ctx.err));
+        return 0;
+    }
+    return 1;
+}
+
+/* system calls made by a build in a traced child, -1 if it cannot be traced */
+static long bench_syscalls(char** files, size_t nfiles, size_t depth){
+    #ifdef __linux__
+    long stops = 0;
+    int status = 0;
+    pid_t pid = fork();
+
+    if(pid == 0){
+        bench_out out;
+        size_t ringed;
+
+        if(ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) _exit(2);
+        raise(SIGSTOP);
+        _exit(bench_build(files, nfiles, depth, &out, &ringed) ? 0 : 1);
+    }
+    if(pid < 0 || waitpid(pid, &status, 0) != pid) return -1;
+    if(!WIFSTOPPED(status)){
+        return -1;
+    }
+    /* syscall stops are told apart from signals by bit 7 */
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void*) PTRACE_O_TRACESYSGOOD);
+    for(;;){
+        if(ptrace(PTRACE_SYSCALL, pid, NULL, NULL) != 0 || waitpid(pid, &status, 0) != pid) break;
+        if(WIFEXITED(status) || WIFSIGNALED(status)) break;
+        if(WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP | 0x80)) stops++;
+    }
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        return -1;
+    }
+    /* a stop going in and one coming out, exit_group only goes in */
+    return (stops + 1) / 2;
+    #else
+    (void) files;
+    (void) nfiles;
+    (void) depth;
+    return -1;
+    #endif
+}
+
+int main(int argc, char* argv[]){
+    static const size_t depths[] = {0, 8, 32, 128};
+    size_t nfiles = (argc > 1) ? (size_t) strtoul(argv[1], NULL, 10) : BENCH_FILES;
+    char** files;
+    bench_out want;
+    double stdio_calls = 0.0;
+    size_t d;
+    size_t i;
+    int ok = 1;
+
+    if(nfiles == 0 || system("rm -rf '" BENCH_DIR "'") != 0 || (files = bench_generate(nfiles)) == NULL){
+        fprintf(stderr, "Could not generate %s\n", BENCH_DIR);
+        return EXIT_FAILURE;
+    }
+
+    /* warm the cache so the first row is not the only one paying for it */
+    if(!bench_build(files, nfiles, 0, &want, &i)){
+        return EXIT_FAILURE;
+    }
+
+    printf("read,depth,files,uring_files,archive_bytes,seconds,files_per_s,syscalls,syscalls_per_file,identical\n");
+    for(d = 0; d < sizeof(depths) / sizeof(depths[0]); d++){
+        bench_out got;
+        size_t ringed = 0;
+        double start, secs;
+        long calls;
+        int same;
+
+        start = bench_now();
+        if(!bench_build(files, nfiles, depths[d], &got, &ringed)){
+            return EXIT_FAILURE;
+        }
+        secs = bench_now() - start;
+        calls = bench_syscalls(files, nfiles, depths[d]);
+        same = (got.bytes == want.bytes && got.hash == want.hash);
+
+        printf("%s,%lu,%lu,%lu,%lu,%.6f,%.0f,", (depths[d] > 0) ? "io_uring" : "stdio", (unsigned long) depths[d], (unsigned long) nfiles, (unsigned long) ringed, got.bytes, secs, (double) nfiles / secs);
+        if(calls >= 0) printf("%ld,%.2f,", calls, (double) calls / (double) nfiles);
+        else printf(",,");
+        printf("%s\n", same ? "yes" : "no");
+
+        if(!same){
+            fprintf(stderr, "the archive read with depth %lu is not the stdio one\n", (unsigned long) depths[d]);
+            ok = 0;
+        }
+        if(depths[d] == 0 && calls >= 0){
+            stdio_calls = (double) calls;
+        }
+        else if(ringed > 0 && calls >= 0 && stdio_calls > 0.0 && (double) calls >= stdio_calls){
+            fprintf(stderr, "reading with depth %lu made %ld system calls, stdio %.0f\n", (unsigned long) depths[d], calls, stdio_calls);
+            ok = 0;
+        }
+        else if(depths[d] > 0 && ringed == 0){
+            fprintf(stderr, "no io_uring here, depth %lu was read with stdio\n", (unsigned long) depths[d]);
+        }
+    }
+
+    for(i = 0; i < nfiles; i++){
+        free(files[i]);
+    }
+    free(files);
+    if(system("rm -rf '" BENCH_DIR "'") != 0){
+        ok = 0;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,302 @@
+/**
+ * @file bench_walk.c
+ * @author MXPSQL
+ * @brief Benchmark of archiving directory trees with options.recurse against listing them first
+ * @version 0
+ * @date 2022-06-04
+ *
+ * @details
+ * Generates BENCH_TOP directories of BENCH_SUB directories of BENCH_PER small files, each top directory also has a build directory of BENCH_BUILD files.
+ * Every tree is archived twice per thread count, once the way it had to be done before: walked up front with readdir and an lstat per entry into a sorted list that goes to mkmshar_ctx_sink,
+ * and once with options.recurse, where the walk reads directories (on the worker threads with more than one) while the files found so far are encoded.
+ * Then again with the build directories left out, by an exclude pattern for the walk (so they are never read) and by name for the list.
+ *
+ * first_file_seconds is how long it took for the block of the first file to come out, files_per_s counts the archived files over the whole build.
+ * Exits with failure if a recursive archive is not byte for byte the one made from the list.
+ *
+ * Output is CSV: walk,threads,exclude,files,archive_bytes,seconds,first_file_seconds,files_per_s,identical
+ *
+ * @copyright
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 MXPSQL
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "../src/mshar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define BENCH_DIR "mshar_bench_walk"
+#define BENCH_PATHMAX 256
+#define BENCH_TOP 64
+#define BENCH_SUB 8
+#define BENCH_PER 16
+#define BENCH_BUILD 32
+
+/* what came out, hashed instead of kept */
+typedef struct bench_out {
+    double start;
+    double first;
+    unsigned long bytes;
+    unsigned long hash;
+} bench_out;
+
+/* the list a caller had to make before options.recurse */
+typedef struct bench_list {
+    char** files;
+    size_t nfiles;
+    size_t cap;
+} bench_list;
+
+static unsigned long bench_seed = 11;
+
+static unsigned long bench_rand(void){
+    bench_seed = bench_seed * 1103515245UL + 12345UL;
+    return (bench_seed >> 16) & 0x7fffUL;
+}
+
+static double bench_now(void){
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
+}
+
+static int bench_sink(void* userdata, const char* data, size_t len){
+    bench_out* out = (bench_out*) userdata;
+    size_t i;
+
+    /* the header goes out before any file is looked at, so it is the first block that counts */
+    for(i = 0; out->first == 0.0 && i + 9 <= len; i++){
+        if(memcmp(data + i, "TEKTONE='", 9) == 0) out->first = bench_now();
+    }
+    for(i = 0; i < len; i++){
+        out->hash = ((out->hash ^ (unsigned char) data[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    out->bytes += (unsigned long) len;
+    return 0;
+}
+
+static int bench_file(const char* path, unsigned long size){
+    FILE* f = fopen(path, "wb");
+    unsigned long i;
+
+    if(f == NULL) return -1;
+    for(i = 0; i < size; i++){
+        putc((int) ('a' + bench_rand() % 26), f);
+    }
+    return (fclose(f) == 0) ? 0 : -1;
+}
+
+static int bench_generate(void){
+    char path[BENCH_PATHMAX];
+    int t;
+    int s;
+    int f;
+
+    if(mkdir(BENCH_DIR, 0755) != 0) return -1;
+    for(t = 0; t < BENCH_TOP; t++){
+        sprintf(path, "%s/t%d", BENCH_DIR, t);
+        if(mkdir(path, 0755) != 0) return -1;
+        sprintf(path, "%s/t%d/build", BENCH_DIR, t);
+        if(mkdir(path, 0755) != 0) return -1;
+        for(f = 0; f < BENCH_BUILD; f++){
+            sprintf(path, "%s/t%d/build/o%d", BENCH_DIR, t, f);
+            if(bench_file(path, 64 + bench_rand() % 448) != 0) return -1;
+        }
+        for(s = 0; s < BENCH_SUB; s++){
+            sprintf(path, "%s/t%d/s%d", BENCH_DIR, t, s);
+            if(mkdir(path, 0755) != 0) return -1;
+            for(f = 0; f < BENCH_PER; f++){
+                sprintf(path, "%s/t%d/s%d/f%d", BENCH_DIR, t, s, f);
+                if(bench_file(path, 64 + bench_rand() % 448) != 0) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int bench_cmp(const void* a, const void* b){
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* depth first in name order like the walk, an lstat for every entry */
+static int bench_listdir(bench_list* list, const char* dir, int exclude){
+    DIR* d = opendir(dir);
+    struct dirent* de;
+    char** names = NULL;
+    size_t nnames = 0;
+    size_t i;
+    int ret = 0;
+
+    if(d == NULL) return -1;
+    while((de = readdir(d)) != NULL){
+        char** grown;
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if(exclude && strcmp(de->d_name, "build") == 0) continue;
+        grown = (char**) realloc(names, sizeof(char*) * (nnames + 1));
+        if(grown == NULL){
+            ret = -1;
+            break;
+        }
+        names = grown;
+        names[nnames] = (char*) malloc(strlen(dir) + strlen(de->d_name) + 2);
+        if(names[nnames] == NULL){
+            ret = -1;
+            break;
+        }
+        sprintf(names[nnames++], "%s/%s", dir, de->d_name);
+    }
+    closedir(d);
+    if(nnames > 1) qsort(names, nnames, sizeof(char*), bench_cmp);
+
+    for(i = 0; i < nnames; i++){
+        struct stat st;
+        int isdir = 0;
+        int isreg = 0;
+        if(ret == 0 && lstat(names[i], &st) == 0){
+            isdir = S_ISDIR(st.st_mode);
+            isreg = S_ISREG(st.st_mode);
+        }
+        if(isdir){
+            ret = bench_listdir(list, names[i], exclude);
+            free(names[i]);
+        }
+        else if(isreg){
+            if(list->nfiles == list->cap){
+                char** grown;
+                list->cap = (list->cap > 0) ? list->cap * 2 : 1024;
+                grown = (char**) realloc(list->files, sizeof(char*) * list->cap);
+                if(grown == NULL){
+                    free(names[i]);
+                    ret = -1;
+                    continue;
+                }
+                list->files = grown;
+            }
+            list->files[list->nfiles++] = names[i];
+        }
+        else{
+            free(names[i]);
+        }
+    }
+    free(names);
+    return ret;
+}
+
+/* one build, 0 if it failed */
+static int bench_run(int recurse, size_t nthreads, int exclude, bench_out* out, size_t* nfiles){
+    mkmshar_ctx ctx;
+    const char* excludes[1];
+    char* root = (char*) BENCH_DIR;
+    bench_list list;
+    size_t i;
+    int status;
+
+    list.files = NULL;
+    list.nfiles = 0;
+    list.cap = 0;
+    out->first = 0.0;
+    out->bytes = 0;
+    out->hash = 2166136261UL;
+
+    mkmshar_ctx_init(&ctx);
+    ctx.options.nthreads = nthreads;
+    out->start = bench_now();
+    if(recurse){
+        excludes[0] = "*/build";
+        ctx.options.recurse = 1;
+        ctx.options.exclude = excludes;
+        ctx.options.nexclude = exclude ? 1 : 0;
+        status = mkmshar_ctx_sink(&ctx, NULL, NULL, &root, 1, bench_sink, out);
+    }
+    else{
+        status = bench_listdir(&list, BENCH_DIR, exclude);
+        if(status == 0) status = mkmshar_ctx_sink(&ctx, NULL, NULL, list.files, list.nfiles, bench_sink, out);
+    }
+    *nfiles = ctx.stats.files;
+    mkmshar_ctx_free(&ctx);
+
+    for(i = 0; i < list.nfiles; i++){
+        free(list.files[i]);
+    }
+    free(list.files);
+    if(status != 0){
+        fprintf(stderr, "%s build failed: %s\n", recurse ? "recursive" : "listed", strerror(ctx.err));
+        return 0;
+    }
+    return 1;
+}
+
+int main(void){
+    static const size_t threads[] = {1, 4};
+    int ok = 1;
+    int exclude;
+    size_t t;
+
+    if(system("rm -rf '" BENCH_DIR "'") != 0 || bench_generate() != 0){
+        fprintf(stderr, "Could not generate %s\n", BENCH_DIR);
+        return EXIT_FAILURE;
+    }
+
+    printf("walk,threads,exclude,files,archive_bytes,seconds,first_file_seconds,files_per_s,identical\n");
+    for(exclude = 0; exclude <= 1; exclude++){
+        bench_out want;
+        size_t nwant = 0;
+        double end;
+
+        /* warm the cache so the first row is not the only one paying for it */
+        if(!bench_run(0, 1, exclude, &want, &nwant)){
+            return EXIT_FAILURE;
+        }
+        for(t = 0; t < sizeof(threads) / sizeof(threads[0]); t++){
+            int recurse;
+            for(recurse = 0; recurse <= 1; recurse++){
+                bench_out got;
+                size_t n = 0;
+                int same;
+
+                if(!bench_run(recurse, threads[t], exclude, &got, &n)){
+                    return EXIT_FAILURE;
+                }
+                end = bench_now();
+                same = (got.bytes == want.bytes && got.hash == want.hash && n == nwant);
+                printf("%s,%lu,%s,%lu,%lu,%.6f,%.6f,%.0f,%s\n", recurse ? "recurse" : "readdir+lstat list", (unsigned long) threads[t], exclude ? "*/build" : "-",
+                    (unsigned long) n, got.bytes, end - got.start, got.first - got.start, (double) n / (end - got.start), same ? "yes" : "no");
+                if(!same){
+                    fprintf(stderr, "the archive of the %s is not the one made from the list\n", recurse ? "walk" : "list");
+                    ok = 0;
+                }
+            }
+        }
+    }
+
+    if(system("rm -rf '" BENCH_DIR "'") != 0){
+        ok = 0;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
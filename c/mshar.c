@@ -39,89 +39,491 @@
 #include <stddef.h>
 #include <string.h>
 
+/* read a whole pre or post script into a null terminated string, the size comes from mkmshar_fileInfo so it is not read twice */
+static char* readscript(const char* path){
+    mkmshar_fileinfo info;
+    char* script = NULL;
+    size_t len = 0;
+    size_t cap = 0;
+    FILE* f = fopen(path, "rb");
+
+    if(f == NULL){
+        return NULL;
+    }
+
+    if(mkmshar_fileInfo(f, &info) != 0){
+        fclose(f);
+        return NULL;
+    }
+
+    /* pipes have no size up front, grow as we go */
+    cap = info.sized ? info.size + 1 : 4096;
+    for(;;){
+        size_t n;
+        char* grown = (char*) realloc(script, cap);
+        if(grown == NULL){
+            free(script);
+            fclose(f);
+            return NULL;
+        }
+        script = grown;
+
+        n = fread(script + len, 1, cap - len - 1, f);
+        len += n;
+        if(len < cap - 1 || (info.sized && len == info.size)){
+            break;
+        }
+        cap *= 2;
+    }
+
+    if(ferror(f)){
+        free(script);
+        fclose(f);
+        return NULL;
+    }
+
+    script[len] = '\0';
+    fclose(f);
+    return script;
+}
+
+/* the files named on the command line and then the ones in a -T list, each path malloc'd when it is asked for and freed when its block is written */
+typedef struct listreader {
+    char** files;
+    size_t nfiles;
+    FILE* list;
+    int sep; /* '\n' or '\0', '\0' with -0 and otherwise whichever ends the first path of the list, -1 before that */
+    char* line;
+    size_t cap;
+    int failed; /* errno of a read error */
+} listreader;
+
+static char* listcopy(const char* path, size_t len){
+    char* copy = (char*) malloc(len + 1);
+
+    if(copy == NULL){
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static const char* listnext(void* userdata){
+    listreader* r = (listreader*) userdata;
+
+    if(r->nfiles > 0){
+        r->nfiles--;
+        r->files++;
+        return listcopy(r->files[-1], strlen(r->files[-1]));
+    }
+
+    /* a character at a time, stdio hands over what a pipe has so far, so paths go out while find is still running */
+    while(r->list != NULL){
+        size_t len = 0;
+        int c = EOF;
+
+        for(;;){
+            c = getc(r->list);
+            if(c == EOF || c == r->sep || (r->sep < 0 && (c == '\n' || c == '\0'))){
+                break;
+            }
+            if(len + 1 >= r->cap){
+                size_t ncap = (r->cap > 0) ? r->cap * 2 : 256;
+                char* grown = (char*) realloc(r->line, ncap);
+                if(grown == NULL){
+                    r->failed = ENOMEM;
+                    errno = ENOMEM;
+                    return NULL;
+                }
+                r->line = grown;
+                r->cap = ncap;
+            }
+            r->line[len++] = (char) c;
+        }
+        if(c != EOF && r->sep < 0){
+            r->sep = c;
+        }
+        if(c == EOF && ferror(r->list)){
+            r->failed = (errno != 0) ? errno : EIO;
+            errno = r->failed;
+            return NULL;
+        }
+        if(len > 0){
+            return listcopy(r->line, len);
+        }
+        if(c == EOF){
+            break;
+        }
+        /* an empty line, nothing to archive */
+    }
+
+    errno = 0;
+    return NULL;
+}
+
+static void listrelease(void* userdata, const char* path){
+    (void) userdata;
+    free((char*) path);
+}
+
+/* what -x, --verify and --list print for every file, problems to stderr */
+static int reportfile(void* userdata, const mkmshar_unsharfile* file){
+    int mode = *(const int*) userdata;
+
+    if(file->problem != NULL){
+        if(file->err != 0){
+            fprintf(stderr, "mshar: %s: %s: %s\n", file->path, file->problem, strerror(file->err));
+        }
+        else{
+            fprintf(stderr, "mshar: %s: %s\n", file->path, file->problem);
+        }
+    }
+    else if(mode == MXPSQL_MShar_UNSHAR_LIST){
+        printf("%lu %s\n", (unsigned long) file->size, file->path);
+    }
+    else if(mode == MXPSQL_MShar_UNSHAR_EXTRACT){
+        printf("x - %s\n", file->path);
+    }
+    return 0;
+}
+
+/* mshar -x, --verify or --list and the archives, without running them */
+static int unshar(int mode, int argc, char* argv[]){
+    int i;
+    int ret = EXIT_SUCCESS;
+
+    for(i = 2; i < argc; i++){
+        int status = mkmshar_unshar(argv[i], mode, reportfile, &mode);
+        if(status < 0){
+            fprintf(stderr, "mshar: %s: %s\n", argv[i], (errno == EDOM) ? "not an MShar archive" : (errno == EIO) ? "the archive is cut short or could not be read" : strerror(errno));
+        }
+        if(status != 0){
+            ret = EXIT_FAILURE;
+        }
+    }
+    if(fflush(stdout) != 0){
+        fprintf(stderr, "mshar: %s\n", strerror(errno));
+        ret = EXIT_FAILURE;
+    }
+    return ret;
+}
+
+/* what --stats prints, to stderr so the archive on stdout is untouched */
+static void printstats(const mkmshar_stats* st){
+    int i;
+
+    fprintf(stderr, "mshar: %lu files (%lu skipped), %lu bytes read, %lu bytes written\n",
+        (unsigned long) st->files, (unsigned long) st->skipped, (unsigned long) st->bytes_in, (unsigned long) st->bytes_out);
+    if(st->compressed > 0){
+        fprintf(stderr, "mshar: %lu files compressed, %lu bytes of payload, %.1f%% of what was read\n",
+            (unsigned long) st->compressed, (unsigned long) st->bytes_packed, (st->bytes_in > 0) ? 100.0 * (double) st->bytes_packed / (double) st->bytes_in : 100.0);
+    }
+    if(st->uring_files > 0){
+        fprintf(stderr, "mshar: %lu files read through io_uring\n", (unsigned long) st->uring_files);
+    }
+    if(st->duplicates > 0){
+        fprintf(stderr, "mshar: %lu files extracted as copies, %lu bytes read to find them\n", (unsigned long) st->duplicates, (unsigned long) st->bytes_hashed);
+    }
+    fprintf(stderr, "mshar: %lu allocations, %lu reallocations\n", (unsigned long) st->allocs, (unsigned long) st->reallocs);
+    fprintf(stderr, "mshar: %.6fs total, dedup %.6fs, open %.6fs, read %.6fs, compress %.6fs, base64 %.6fs, format %.6fs, output %.6fs\n",
+        st->total_seconds, st->dedup_seconds, st->open_seconds, st->read_seconds, st->compress_seconds, st->base64_seconds, st->format_seconds, st->output_seconds);
+    for(i = 0; i < MXPSQL_MShar_STATS_SLOWEST && st->slowest[i].path != NULL; i++){
+        fprintf(stderr, "mshar: slowest %d: %s, %.6fs, %lu bytes\n", i + 1, st->slowest[i].path, st->slowest[i].seconds, (unsigned long) st->slowest[i].bytes);
+    }
+}
+
 int main(int argc, char* argv[]){
     char* pre_script = NULL;
     char* post_script = NULL;
     char** files = NULL;
-    FILE* f = NULL;
-    char* script = NULL;
+    size_t nthreads = 1;
+    int stats = 0;
+    int layout = MXPSQL_MShar_LAYOUT_PRINTF;
+    int compress = 0;
+    int dedup = MXPSQL_MShar_DEDUP_OFF;
+    int checksum = MXPSQL_MShar_CHECKSUM_OFF;
+    int manifest = 0;
+    int selective = 0;
+    const char* listpath = NULL;
+    int recurse = 0;
+    const char** include = NULL;
+    const char** exclude = NULL;
+    size_t ninclude = 0;
+    size_t nexclude = 0;
+    size_t uring = 0;
+    int nullsep = 0;
+    int argi = 1;
 
     /*
-        usage: mshar [pre execution script] [post execution script] file1 file2 file3 file4 file5 file6 file7 file8 file9 ... > archive
+        usage: mshar [-j threads] [--stats] [--heredoc | --trailer] [-z] [--dedup | --dedup-link] [--cksum | --cksum-failfast] [--manifest] [--selective] [-T list [-0]] [-r [--include pattern] [--exclude pattern]] [--uring depth] [pre execution script] [post execution script] file1 file2 file3 file4 file5 file6 file7 file8 file9 ... > archive
         the [pre execution script] and the [post execution script] can be replaced with - for no script
+        -j 0 uses one thread per processor
+        --stats prints where the time went to stderr
+        --heredoc pipes each payload to base64 -d as a heredoc instead of printf and a temporary file
+        --trailer stores the files raw after the script instead of in base64
+        -z deflates the files that get smaller, extracting them needs gzip
+        --dedup stores files with the same bytes once and cp's the others from it, --dedup-link hard links them instead
+        --cksum checks every extracted file with cksum, --cksum-failfast stops at the first damaged one
+        --manifest starts the archive with a list of its files, sh archive --list prints it and sh archive file... extracts only those
+        --selective lets the archive be run as sh archive --include 'pattern' --exclude 'pattern' file... to extract only some files
+        -T list also archives the files listed in list (- for stdin), one per line or NUL terminated like find -print0 (whichever ends the first path, -0 or --null to always take NUL terminated), read while the archive is written
+        -r archives what is under the directories given, --include 'pattern' and --exclude 'pattern' (more than once) pick what is archived from them
+        --uring opens and reads small files through io_uring that many at a time on Linux (with one thread), stdio where there is none
+
+        usage: mshar -x | --verify | --list archive...
+        -x extracts the archives here without running them, --verify only checks them, --list prints the size and path of every file
      */
 
-    if(argc < 3){
-        fprintf(stderr, "usage: %s [pre execution script] [post execution script] file1 file2 file3 file4 file5 file6 file7 file8 file9 ... > archive\n", argv[0]);
+    /* reading archives instead of writing one */
+    if(argc >= 3 && strcmp(argv[1], "-x") == 0){
+        return unshar(MXPSQL_MShar_UNSHAR_EXTRACT, argc, argv);
+    }
+    if(argc >= 3 && strcmp(argv[1], "--verify") == 0){
+        return unshar(MXPSQL_MShar_UNSHAR_VERIFY, argc, argv);
+    }
+    if(argc >= 3 && strcmp(argv[1], "--list") == 0){
+        return unshar(MXPSQL_MShar_UNSHAR_LIST, argc, argv);
+    }
+
+    /* every option could be a pattern, so that is as many as there can be */
+    include = (const char**) malloc(sizeof(char*) * argc);
+    exclude = (const char**) malloc(sizeof(char*) * argc);
+    if(include == NULL || exclude == NULL){
+        fprintf(stderr, "Error creating script: %s\n", strerror(ENOMEM));
+        free(include);
+        free(exclude);
+        return EXIT_FAILURE;
+    }
+
+    /* options come first, a lone - is the no script marker so it is not one */
+    while(argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'){
+        if(strcmp(argv[argi], "-j") == 0 && argi + 1 < argc){
+            nthreads = (size_t) strtoul(argv[argi + 1], NULL, 10);
+            argi += 2;
+        }
+        else if(strcmp(argv[argi], "--stats") == 0){
+            stats = 1;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--heredoc") == 0){
+            layout = MXPSQL_MShar_LAYOUT_HEREDOC;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--trailer") == 0){
+            layout = MXPSQL_MShar_LAYOUT_TRAILER;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "-z") == 0){
+            compress = 1;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--dedup") == 0){
+            dedup = MXPSQL_MShar_DEDUP_COPY;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--dedup-link") == 0){
+            dedup = MXPSQL_MShar_DEDUP_LINK;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--cksum") == 0){
+            checksum = MXPSQL_MShar_CHECKSUM_ON;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--cksum-failfast") == 0){
+            checksum = MXPSQL_MShar_CHECKSUM_FAILFAST;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--manifest") == 0){
+            manifest = 1;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--selective") == 0){
+            selective = 1;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "-T") == 0 && argi + 1 < argc){
+            listpath = argv[argi + 1];
+            argi += 2;
+        }
+        else if(strcmp(argv[argi], "-0") == 0 || strcmp(argv[argi], "--null") == 0){
+            nullsep = 1;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "-r") == 0){
+            recurse = 1;
+            argi++;
+        }
+        else if(strcmp(argv[argi], "--include") == 0 && argi + 1 < argc){
+            include[ninclude++] = argv[argi + 1];
+            argi += 2;
+        }
+        else if(strcmp(argv[argi], "--exclude") == 0 && argi + 1 < argc){
+            exclude[nexclude++] = argv[argi + 1];
+            argi += 2;
+        }
+        else if(strcmp(argv[argi], "--uring") == 0 && argi + 1 < argc){
+            uring = (size_t) strtoul(argv[argi + 1], NULL, 10);
+            argi += 2;
+        }
+        else if(strcmp(argv[argi], "--") == 0){
+            argi++;
+            break;
+        }
+        else{
+            argi = argc;
+        }
+    }
+
+    if(argc - argi < 2){
+        fprintf(stderr, "usage: %s [-j threads] [--stats] [--heredoc | --trailer] [-z] [--dedup | --dedup-link] [--cksum | --cksum-failfast] [--manifest] [--selective] [-T list [-0]] [-r [--include pattern] [--exclude pattern]] [--uring depth] [pre execution script] [post execution script] file1 file2 file3 file4 file5 file6 file7 file8 file9 ... > archive\n", argv[0]);
         fprintf(stderr, "Put - for [pre execution script] and [post execution script] to not use a script\n");
+        fprintf(stderr, "-j encodes files on that many threads (0 for one per processor), the archive is the same either way\n");
+        fprintf(stderr, "--stats prints timings, counts and the slowest files to stderr when done\n");
+        fprintf(stderr, "--heredoc writes each file as a heredoc piped to base64 -d, faster to extract and no temporary files\n");
+        fprintf(stderr, "--trailer stores the files raw after the script, a quarter smaller and nothing to decode, but the archive is binary and needs tail and head -c or dd\n");
+        fprintf(stderr, "-z compresses every file that gets smaller with the built in deflate, extracting those needs gzip\n");
+        fprintf(stderr, "--dedup stores files with the same bytes only once, the later ones are extracted with cp (--dedup-link: ln, cp where that fails)\n");
+        fprintf(stderr, "--cksum has the archive check every file it extracts with cksum and exit 1 if any is damaged (--cksum-failfast: at the first one)\n");
+        fprintf(stderr, "--manifest starts the archive with the offset, size and checksum of every file, so sh archive --list lists them and sh archive file... extracts only those files\n");
+        fprintf(stderr, "--selective has the archive take --include 'pattern' and --exclude 'pattern' (shell patterns, more than once) and file names (matched as they are), and extract only the files they pick\n");
+        fprintf(stderr, "-T archives the files in list (- for stdin) after the ones given, one per line or NUL terminated (find -print0), the list is read while the archive is written so it can be any length\n");
+        fprintf(stderr, "-0 (or --null) takes the -T list as NUL terminated only, so paths in it can have newlines (without it the list is split on whichever of newline and NUL ends the first path)\n");
+        fprintf(stderr, "-r archives the files under the directories given (and listed), in name order, --include 'pattern' archives only the files that match one, --exclude 'pattern' leaves out the files and directories that match one (shell patterns on the whole path, more than once)\n");
+        fprintf(stderr, "--uring opens, reads and closes small files through io_uring that many at a time, two system calls a batch instead of several a file (Linux with -j 1 only, stdio is used where io_uring is not there)\n");
+        fprintf(stderr, "usage: %s -x | --verify | --list archive...\n", argv[0]);
+        fprintf(stderr, "-x extracts archives into the current directory without running them or anything else, --verify decodes and checks every file without writing it, --list prints the size and path of every file\n");
+        free(include);
+        free(exclude);
         return EXIT_FAILURE;
     }
 
-    pre_script = argv[1];
-    post_script = argv[2];
+    pre_script = argv[argi];
+    post_script = argv[argi + 1];
 
     if(strcmp(pre_script, "-") == 0){
         pre_script = NULL;
     }
     else{
-        size_t fsize;
-        f = fopen(pre_script, "rb");
-        if(f == NULL){
-            fprintf(stderr, "Could not open pre script file %s\n", pre_script);
+        pre_script = readscript(pre_script);
+        if(pre_script == NULL){
+            fprintf(stderr, "Could not open pre script file %s\n", argv[argi]);
             return EXIT_FAILURE;
         }
-        {
-            while(fgetc(f) != EOF){;}
-            fsize = ftell(f);
-            fseek(f, 0, SEEK_SET);
-        }
-        pre_script = (char*) malloc(fsize + 1);
-        fread(pre_script, fsize, 1, f);
-        pre_script[fsize] = '\0';
-        fclose(f);
     }
 
     if(strcmp(post_script, "-") == 0){
         post_script = NULL;
     }
     else{
-        size_t fsize;
-        f = fopen(post_script, "rb");
-        if(f == NULL){
-            fprintf(stderr, "Could not open post script file %s\n", post_script);
+        post_script = readscript(post_script);
+        if(post_script == NULL){
+            fprintf(stderr, "Could not open post script file %s\n", argv[argi + 1]);
             return EXIT_FAILURE;
         }
-        {
-            while(fgetc(f) != EOF){;}
-            fsize = ftell(f);
-            fseek(f, 0, SEEK_SET);
-        }
-        post_script = (char*) malloc(fsize + 1);
-        fread(post_script, fsize, 1, f);
-        post_script[fsize] = '\0';
-        fclose(f);
     }
 
     {
         int i;
-        files = (char**) malloc(sizeof(char*) * (argc - 3));
-        for(i = 3; i < argc; i++){
-            files[i - 3] = argv[i];
+        files = (char**) malloc(sizeof(char*) * (argc - argi - 2 + 1));
+        for(i = argi + 2; i < argc; i++){
+            files[i - argi - 2] = argv[i];
         }
     }
 
-    script = mkmshar_s(pre_script, post_script, files, argc - 3);
-    if(script == NULL){
+    /* stream it straight to stdout, nothing is kept around */
+    {
+        mkmshar_ctx ctx;
+        listreader reader;
+        int status;
+
+        mkmshar_ctx_init(&ctx);
+        ctx.options.ignorefileerrors = 1;
+        ctx.options.nthreads = nthreads;
+        ctx.options.timing = stats;
+        ctx.options.layout = layout;
+        ctx.options.compress = compress;
+        ctx.options.dedup = dedup;
+        ctx.options.checksum = checksum;
+        ctx.options.manifest = manifest;
+        ctx.options.selective = selective;
+        ctx.options.recurse = recurse;
+        ctx.options.include = include;
+        ctx.options.ninclude = ninclude;
+        ctx.options.exclude = exclude;
+        ctx.options.nexclude = nexclude;
+        ctx.options.uring = uring;
+        if(uring > 0 && (nthreads != 1 || layout == MXPSQL_MShar_LAYOUT_TRAILER)){
+            fprintf(stderr, "mshar: --uring only works with -j 1 and without --trailer, the files are read with stdio\n");
+        }
+
+        reader.files = files;
+        reader.nfiles = (size_t) (argc - argi - 2);
+        reader.list = NULL;
+        reader.sep = nullsep ? '\0' : -1;
+        reader.line = NULL;
+        reader.cap = 0;
+        reader.failed = 0;
+
+        if(listpath == NULL){
+            status = mkmshar_ctx_sink(&ctx, pre_script, post_script, files, argc - argi - 2, mkmshar_sink_file, stdout);
+        }
+        else{
+            mkmshar_source source;
+
+            reader.list = (strcmp(listpath, "-") == 0) ? stdin : fopen(listpath, "rb");
+            if(reader.list == NULL){
+                fprintf(stderr, "Could not open file list %s\n", listpath);
+                free(files);
+                free(include);
+                free(exclude);
+                return EXIT_FAILURE;
+            }
+            source.next = listnext;
+            source.release = listrelease;
+            source.userdata = &reader;
+            status = mkmshar_ctx_sink_next(&ctx, pre_script, post_script, &source, mkmshar_sink_file, stdout);
+            if(reader.list != stdin){
+                fclose(reader.list);
+            }
+            free(reader.line);
+        }
+
+        if(status != 0){
+            if(reader.failed != 0){
+                fprintf(stderr, "Error reading file list %s: %s\n", listpath, strerror(reader.failed));
+            }
+            else if(ctx.errpath != NULL){
+                fprintf(stderr, "Error creating script: %s: %s\n", ctx.errpath, strerror(ctx.err));
+            }
+            else{
+                fprintf(stderr, "Error creating script: %s\n", strerror(ctx.err));
+            }
+            /* perror("Error creating script"); */
+        }
+        else if(stats){
+            printstats(&ctx.stats);
+        }
+
+        mkmshar_ctx_free(&ctx);
+        if(status != 0){
+            free(files);
+            free(include);
+            free(exclude);
+            return EXIT_FAILURE;
+        }
+    }
+    if(fflush(stdout) != 0){
         fprintf(stderr, "Error creating script: %s\n", strerror(errno));
-        /* perror("Error creating script"); */
-        free(script);
+        free(files);
+        free(include);
+        free(exclude);
         return EXIT_FAILURE;
     }
-    else{
-        fprintf(stdout, "%s", script);
-        fflush(stdout);
-        free(script);
-    }
+    free(files);
+    free(include);
+    free(exclude);
 
     return EXIT_SUCCESS;
 }
@@ -75,6 +75,15 @@
  */
 #define MXPSQL_MShar_H
 
+/* feature test macros have to come before any system header, strict ANSI mode hides fileno and friends without them */
+#if (defined(__linux__) || defined(linux) || defined(__linux) || defined(__CYGWIN__)) && !defined(_DEFAULT_SOURCE) && !defined(MXPSQL_MShar_NO_FEATURE_MACROS)
+    /**
+     * @brief POSIX and the usual extensions on glibc and newlib, define MXPSQL_MShar_NO_FEATURE_MACROS to pick your own
+     * 
+     */
+    #define _DEFAULT_SOURCE 1
+#endif
+
 #if __STDC_VERSION__ >= 201112L
 
     #ifndef __STDC_WANT_LIB_EXT1__
@@ -97,8 +106,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdarg>
-#include <clocale>
 #include <cerrno>
+#include <ctime>
 #else
 #include <math.h>
 #include <stdio.h>
@@ -106,11 +115,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
-#include <locale.h>
 #include <errno.h>
+#include <time.h>
 #endif
 
-/* All these to be used for later things, right now no use. */
 #if (defined(__linux__) || defined(linux) || defined(__linux))
     /**
      * @brief I liek linux. I use arch btw.
@@ -148,36 +156,68 @@
 
 #if (defined(MXPSQL_MShar_OS_Unix) || defined(MXPSQL_MShar_OS_MacOSX) || defined(__CYGWIN__) || defined(MXPSQL_MShar_OS_Linux) || defined(__FreeBSD__))
 
-    /* 
-    #ifndef _BSD_SOURCE
-        #define _BSD_SOURCE
-    #endif
+   /**
+    * @brief We like POSIX and SUS (Not sus, but Single Unix Specification)
+    * 
+    */
+    #define MXPSQL_MShar_OS_POSIX_SUS
 
-    #ifndef _GNU_SOURCE
-        #define _GNU_SOURCE
-    #endif
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <dirent.h>
 
-    #ifndef _POSIX_SOURCE
-        #define _POSIX_SOURCE
+    #if !defined(__cplusplus) && !defined(c_plusplus) && !defined(fileno)
+    /* stdio.h only has it with _DEFAULT_SOURCE, which is too late if a system header came before this one */
+    int fileno(FILE* stream);
     #endif
 
-    #ifndef _XOPEN_SOURCE
-        #define _XOPEN_SOURCE
+#endif
+
+#if defined(MXPSQL_MShar_OS_POSIX_SUS) && !defined(MXPSQL_MShar_NO_THREADS)
+    /**
+     * @brief Files can be encoded by a pool of POSIX threads, define MXPSQL_MShar_NO_THREADS to always encode them one after another
+     * 
+     */
+    #define MXPSQL_MShar_THREADS
+
+    #include <pthread.h>
+#endif
+
+#if defined(MXPSQL_MShar_OS_Linux) && !defined(MXPSQL_MShar_NO_URING) && (defined(__GNUC__) || defined(__clang__)) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
     #endif
 
-    #ifndef _POSIX_C_SOURCE
-        #define _POSIX_C_SOURCE
+    /* kernel headers of 5.6 or newer, the first with every opcode used here */
+    #ifdef IORING_FEAT_RW_CUR_POS
+        /**
+         * @brief Small files can be opened and read through io_uring in batches (see mkmshar_options.uring), define MXPSQL_MShar_NO_URING to always read them with stdio
+         * 
+         * @details Only defined where the compiler has __has_include and the kernel headers have linux/io_uring.h from Linux 5.6 or newer, anything older (or libc without kernel headers) builds without it.
+         */
+        #define MXPSQL_MShar_URING
+
+        #include <fcntl.h>
+        #include <sys/syscall.h>
+        #include <linux/stat.h>
     #endif
+#endif
 
-#include <unistd.h> 
-    */
+#if defined(_WIN32) && !defined(MXPSQL_MShar_OS_POSIX_SUS)
+    #include <io.h>
+    #include <direct.h>
+#endif
 
-   /**
-    * @brief We like POSIX and SUS (Not sus, but Single Unix Specification)
-    * 
-    */
-    #define MXPSQL_MShar_OS_POSIX_SUS
+#if !defined(MXPSQL_MShar_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && ((__GNUC__ >= 8) || defined(__clang__))
+    /**
+     * @brief SSSE3, AVX2 and AVX-512 VBMI encoders and decoders are compiled in and picked at runtime, define MXPSQL_MShar_NO_SIMD to only get the portable ones
+     * 
+     */
+    #define MXPSQL_MShar_SIMD_X86
 
+    #include <immintrin.h>
 #endif
 
 #ifndef __STDC__
@@ -235,6 +275,271 @@ extern "C" {
  */
 char* mkmshar_b64Encode(char *data, size_t inlen);
 
+/**
+ * @brief Portable scalar base64 encoder, used on every build and for the leftover bytes of the SIMD encoders.
+ * 
+ */
+#define MXPSQL_MShar_B64_SCALAR 0
+
+/**
+ * @brief SSSE3 base64 encoder, 12 bytes in and 16 bytes out per step.
+ * 
+ */
+#define MXPSQL_MShar_B64_SSSE3 1
+
+/**
+ * @brief AVX2 base64 encoder, 24 bytes in and 32 bytes out per step.
+ * 
+ */
+#define MXPSQL_MShar_B64_AVX2 2
+
+/**
+ * @brief AVX-512 VBMI base64 encoder, 48 bytes in and 64 bytes out per step.
+ * 
+ */
+#define MXPSQL_MShar_B64_AVX512VBMI 3
+
+/**
+ * @brief Which base64 encoder mkmshar_b64Encode uses on this machine.
+ * 
+ * @details
+ * Picked once with cpuid on the first call, the fastest one the CPU and OS support wins.
+ * Builds without SIMD (not GCC or Clang on x86, C90 compilers, or MXPSQL_MShar_NO_SIMD defined) always get MXPSQL_MShar_B64_SCALAR.
+ * 
+ * @return int one of the MXPSQL_MShar_B64_* values
+ */
+int mkmshar_b64Impl(void);
+
+/**
+ * @brief Encode with a chosen base64 encoder into a buffer you own, mostly for tests and benchmarks.
+ * 
+ * @param impl one of the MXPSQL_MShar_B64_* values, if it is not available here the scalar encoder is used
+ * @param data the bytes to encode
+ * @param inlen how many bytes to encode
+ * @param out where the base64 goes, must have room for ((inlen + 2) / 3) * 4 bytes, it is not null terminated
+ * @return size_t how many bytes were written to out
+ */
+size_t mkmshar_b64EncodeWith(int impl, const char *data, size_t inlen, char *out);
+
+/**
+ * @brief State of an incremental base64 encoder, carries the 0 to 2 bytes that did not make a whole group yet.
+ * 
+ * @see mkmshar_b64Init
+ */
+typedef struct mkmshar_b64State {
+    unsigned char carry[2];
+    size_t ncarry;
+} mkmshar_b64State;
+
+/**
+ * @brief Start an incremental base64 encode.
+ * 
+ * @param state the state to reset
+ */
+void mkmshar_b64Init(mkmshar_b64State* state);
+
+/**
+ * @brief Feed the next chunk of input to an incremental base64 encode.
+ * 
+ * @details Chunks can be any size, the output is the same as encoding everything at once with mkmshar_b64Encode.
+ * 
+ * @param state the state from mkmshar_b64Init
+ * @param data the next bytes
+ * @param len how many bytes
+ * @param out where the base64 goes, must have room for ((len + 2) / 3) * 4 bytes, it is not null terminated
+ * @return size_t how many bytes were written to out
+ */
+size_t mkmshar_b64Update(mkmshar_b64State* state, const char* data, size_t len, char* out);
+
+/**
+ * @brief Finish an incremental base64 encode, writing the last group and its padding.
+ * 
+ * @param state the state from mkmshar_b64Init
+ * @param out where the base64 goes, must have room for 4 bytes, it is not null terminated
+ * @return size_t how many bytes were written to out (0 or 4)
+ */
+size_t mkmshar_b64Final(mkmshar_b64State* state, char* out);
+
+/**
+ * @brief Decode base64 with a chosen decoder into a buffer you own, mostly for tests and benchmarks.
+ * 
+ * @details
+ * The same decoders as the encoders, picked with the same MXPSQL_MShar_B64_* values.
+ * Only the last group of 4 may be padded with =, there can be no newlines or any other character outside the base64 alphabet.
+ * 
+ * @param impl one of the MXPSQL_MShar_B64_* values, if it is not available here the scalar decoder is used
+ * @param data the base64 to decode
+ * @param inlen how many characters, a multiple of 4
+ * @param out where the bytes go, must have room for (inlen / 4) * 3 bytes
+ * @param outlen set to how many bytes were written to out
+ * @return int 0, or -1 with errno set to EDOM if data is not base64
+ */
+int mkmshar_b64DecodeWith(int impl, const char *data, size_t inlen, char *out, size_t *outlen);
+
+/**
+ * @brief Decode base64 with the fastest decoder this machine has, see mkmshar_b64DecodeWith.
+ * 
+ * @param data the base64 to decode
+ * @param inlen how many characters, a multiple of 4
+ * @param out where the bytes go, must have room for (inlen / 4) * 3 bytes
+ * @param outlen set to how many bytes were written to out
+ * @return int 0, or -1 with errno set to EDOM if data is not base64
+ */
+int mkmshar_b64Decode(const char *data, size_t inlen, char *out, size_t *outlen);
+
+/**
+ * @brief Portable slice-by-8 cksum CRC, used on every build and for what the PCLMUL one leaves over.
+ * 
+ */
+#define MXPSQL_MShar_CRC_SCALAR 0
+
+/**
+ * @brief Carry-less multiply cksum CRC, folds 64 bytes per step with PCLMULQDQ.
+ * 
+ */
+#define MXPSQL_MShar_CRC_PCLMUL 1
+
+/**
+ * @brief AVX-512 carry-less multiply cksum CRC, folds 256 bytes per step with VPCLMULQDQ.
+ * 
+ */
+#define MXPSQL_MShar_CRC_VPCLMUL 2
+
+/**
+ * @brief Which cksum CRC mkmshar_cksumUpdate uses on this machine.
+ * 
+ * @details Picked once with cpuid on the first call, the tables are filled in then too, so call it once before sharing the CRC between threads.
+ * Builds without SIMD always get MXPSQL_MShar_CRC_SCALAR.
+ * 
+ * @return int one of the MXPSQL_MShar_CRC_* values
+ */
+int mkmshar_cksumImpl(void);
+
+/**
+ * @brief Feed the next bytes to a POSIX cksum CRC with a chosen implementation, mostly for tests and benchmarks.
+ * 
+ * @param impl one of the MXPSQL_MShar_CRC_* values, if it is not available here the scalar one is used
+ * @param crc 0 to start, or what the last call returned
+ * @param data the next bytes
+ * @param len how many bytes
+ * @return unsigned long the CRC so far, give it to mkmshar_cksumFinal when done
+ */
+unsigned long mkmshar_cksumUpdateWith(int impl, unsigned long crc, const char* data, size_t len);
+
+/**
+ * @brief Feed the next bytes to a POSIX cksum CRC, chunks can be any size.
+ * 
+ * @param crc 0 to start, or what the last call returned
+ * @param data the next bytes
+ * @param len how many bytes
+ * @return unsigned long the CRC so far, give it to mkmshar_cksumFinal when done
+ */
+unsigned long mkmshar_cksumUpdate(unsigned long crc, const char* data, size_t len);
+
+/**
+ * @brief Finish a POSIX cksum CRC, the result is the first number cksum prints for the same bytes.
+ * 
+ * @param crc what the last mkmshar_cksumUpdate returned
+ * @param total how many bytes went in altogether
+ * @return unsigned long the checksum
+ */
+unsigned long mkmshar_cksumFinal(unsigned long crc, size_t total);
+
+/**
+ * @brief What is known about an input file before reading it, found once with mkmshar_fileInfo and then reused.
+ * 
+ */
+typedef struct mkmshar_fileinfo {
+    /**
+     * @brief Size in bytes, only meaningful if sized is not 0
+     * 
+     */
+    size_t size;
+    /**
+     * @brief 1 if the size is known up front, 0 for pipes, terminals and other things that have to be read to the end
+     * 
+     */
+    int sized;
+    /**
+     * @brief 1 if it is a regular file
+     * 
+     */
+    int regular;
+} mkmshar_fileinfo;
+
+/**
+ * @brief Find the size of an open file without reading it.
+ * 
+ * @details
+ * On POSIX this is one fstat call. Anywhere else, or if fstat fails, the file is read to the end with fgetc and rewound, which is portable but reads everything twice.
+ * The position of the file is left at the beginning either way.
+ * 
+ * @param fptr the file, opened for reading and not read from yet
+ * @param info where the result goes
+ * @return int 0 on success, -1 on file errors
+ */
+int mkmshar_fileInfo(FILE* fptr, mkmshar_fileinfo* info);
+
+#ifndef MXPSQL_MShar_CHUNK_SIZE
+/**
+ * @brief How many bytes of a file are read and encoded at a time, define it to change it.
+ * 
+ */
+#define MXPSQL_MShar_CHUNK_SIZE (1024UL * 1024UL)
+#endif
+
+/**
+ * @brief What MXPSQL_MShar_MMAP_THRESHOLD is unless it is defined, bench/bench_mmap.c checks it against where mapping starts to win.
+ * 
+ * @details Buffered reads into the reused buffer win up to 256 KB and mapping wins from 1 MB, on the machines it was measured on.
+ */
+#define MXPSQL_MShar_MMAP_DEFAULT (1024UL * 1024UL)
+
+#ifndef MXPSQL_MShar_MMAP_THRESHOLD
+/**
+ * @brief Regular files at least this big are memory mapped instead of read on POSIX, define it to change it (it can be a variable).
+ * 
+ * @details Smaller files are cheaper to read into the reused buffer than to map and unmap, bench/bench_mmap.c shows where the two meet.
+ * A mapped file that is truncated by someone else while it is encoded raises SIGBUS when the missing pages are touched, instead of the short read stdio would give.
+ * Define it to (size_t) -1 to never map files where that can happen.
+ */
+#define MXPSQL_MShar_MMAP_THRESHOLD MXPSQL_MShar_MMAP_DEFAULT
+#endif
+
+#ifndef MXPSQL_MShar_REORDER_WINDOW
+/**
+ * @brief How many finished blocks per worker thread may wait for their turn to be written when encoding in parallel, define it to change it.
+ * 
+ */
+#define MXPSQL_MShar_REORDER_WINDOW 2
+#endif
+
+#ifndef MXPSQL_MShar_PARALLEL_MAX_BLOCK
+/**
+ * @brief Regular files bigger than this are not encoded by the worker threads but streamed by the writing thread when their turn comes, define it to change it.
+ * 
+ * @details This keeps the reorder window from holding whole huge files in memory, it holds at most about 4/3 of this per slot.
+ */
+#define MXPSQL_MShar_PARALLEL_MAX_BLOCK (4UL * 1024UL * 1024UL)
+#endif
+
+#ifndef MXPSQL_MShar_WALK_AHEAD
+/**
+ * @brief How many directories may be read ahead of the encoder when walking directories recursively, define it to change it.
+ *
+ */
+#define MXPSQL_MShar_WALK_AHEAD 256
+#endif
+
+#ifndef MXPSQL_MShar_URING_MAX
+/**
+ * @brief Regular files smaller than this (64 KB) are read whole through io_uring with options.uring, bigger ones are read (or mapped) with stdio, define it to change it.
+ *
+ * @details A batch holds up to options.uring of them in one buffer at once, so this times the queue depth is what a batch can take.
+ */
+#define MXPSQL_MShar_URING_MAX (64UL * 1024UL)
+#endif
+
 
 /**
  * @brief strnlen function for mkmshar if not compiled on posix platforms, uses strlen from string if compiled on posix platforms.
@@ -336,966 +641,7780 @@ int mkmshar_snprintf(char *str, size_t size, const char *format, ...);
 
 
 /**
- * @brief Make an MShar archive
+ * @brief Write callback used by mkmshar_sink to hand out the archive piece by piece.
  * 
- * @note You may want to save your current locale because it will be changed to "C". This function will try to set it back to the old locale, but just save it just in case it doesn't (this is a bug, please report it). 
+ * @param userdata the user pointer given to mkmshar_sink
+ * @param data the bytes to write, not null terminated
+ * @param len how many bytes to write
+ * @return int 0 on success, anything else aborts the archive
+ */
+typedef int (*mkmshar_write_func)(void* userdata, const char* data, size_t len);
+
+/**
+ * @brief Ready-made sink that writes to a FILE*.
  * 
- * Also you can't ignore memory allocation errors, those realloc spams are needed.
+ * @param userdata the FILE* to write to (like stdout)
+ * @param data the bytes to write
+ * @param len how many bytes to write
+ * @return int 0 on success, -1 if fwrite could not write everything
+ */
+int mkmshar_sink_file(void* userdata, const char* data, size_t len);
+
+#if defined(MXPSQL_MShar_OS_POSIX_SUS) || defined(_WIN32)
+/**
+ * @brief Ready-made sink that writes to a file descriptor, retrying on short writes and EINTR.
  * 
- * @warning This function's return value must be manually freed if not null.
+ * @param userdata pointer to the int file descriptor to write to
+ * @param data the bytes to write
+ * @param len how many bytes to write
+ * @return int 0 on success, -1 on write errors
+ */
+int mkmshar_sink_fd(void* userdata, const char* data, size_t len);
+#endif
+
+/**
+ * @brief Make an MShar archive and write it out as it is produced instead of building it in memory.
  * 
- * Sometimes this function can fail if you try to archive big files (like the executable itself).
+ * @details
+ * The header, the prescript, each file block and the postscript are given to writer as soon as they are made, so only one file is held in memory at a time and output starts immediately.
+ * On failure the archive is incomplete, but what was already written stays written.
  * 
- * @param prescript the script to run before extraction. Put NULL if empty and do not put the filename, put the content of the script you want to run (putting the filename will just place the filename, not the content)
- * @param postscript the script to run after extraction. Put NULL if empty and do not put the filename, put the content of the script you want to run (putting the filename will just place the filename, not the content)
- * @param files the files to be archived, retuning null will set the errno to EDOM and return NULL
+ * @param prescript the script to run before extraction. Put NULL if empty, put the content of the script, not the filename
+ * @param postscript the script to run after extraction. Put NULL if empty, put the content of the script, not the filename
+ * @param files the files to be archived, passing null will set the errno to EDOM and return -1
  * @param nfiles how many files to archive
  * @param ignorefileerrors Ignore file errors and continue, set to 0 to not ignore
- * @return char* the archive or NULL if there is a problem (memory allocation failures, file errors or too big base64)
+ * @param writer the write callback, see mkmshar_sink_file and mkmshar_sink_fd for ready-made ones
+ * @param userdata passed as is to writer
+ * @return int 0 on success, -1 if there is a problem (memory allocation failures, file errors or writer failures)
+ * 
+ * @see mkmshar_write_func
  */
-char* mkmshar(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors);
+int mkmshar_sink(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors, mkmshar_write_func writer, void* userdata);
 
 /**
- * @brief A version of mkmshar, but on all error, return null. Internally uses mkmshar.
+ * @brief mkmshar_sink, but the file blocks are encoded by a pool of worker threads.
  * 
- * @param prescript script to be executed before extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
- * @param postscript script to be executed after extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
- * @param files the path to files
- * @param nfiles the number of files
- * @return char* the archive or NULL if there is a problem 
+ * @details
+ * Blocks are still written in the order of files through a bounded reorder window (MXPSQL_MShar_REORDER_WINDOW blocks per thread), so the archive is byte for byte the same as the one from mkmshar_sink.
+ * Without thread support (see MXPSQL_MShar_THREADS) or with one thread this is mkmshar_sink.
+ * writer is only ever called from the calling thread.
  * 
- * @see mkmshar
+ * @param prescript the script to run before extraction. Put NULL if empty, put the content of the script, not the filename
+ * @param postscript the script to run after extraction. Put NULL if empty, put the content of the script, not the filename
+ * @param files the files to be archived, passing null will set the errno to EDOM and return -1
+ * @param nfiles how many files to archive
+ * @param ignorefileerrors Ignore file errors and continue, set to 0 to not ignore
+ * @param nthreads how many worker threads to use, 0 for one per online processor
+ * @param writer the write callback, see mkmshar_sink_file and mkmshar_sink_fd for ready-made ones
+ * @param userdata passed as is to writer
+ * @return int 0 on success, -1 if there is a problem (memory allocation failures, file errors or writer failures)
+ * 
+ * @see mkmshar_sink
  */
-char* mkmshar_x(char* prescript, char* postscript, char** files, size_t nfiles);
+int mkmshar_sink_mt(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors, size_t nthreads, mkmshar_write_func writer, void* userdata);
 
 /**
- * @brief A version of mkmshar, but on file operation error, ignores it.
+ * @brief Allocator used by everything a mkmshar_ctx allocates, picked at runtime instead of with the MXPSQL_MShar_* macros.
  * 
- * Does not ignore sprintf and memory allocation errors though, this means it returns null on those kind of errors. Internally uses mkmshar.
+ * @details
+ * With more than one thread it is also called from the worker threads, so it has to be thread safe then.
+ * Per file scratch memory does not come from it directly but from a bump arena per thread that is reset after every block, so once the arenas have grown to fit the biggest block the allocator is barely called.
+ */
+typedef struct mkmshar_allocator {
+    /**
+     * @brief Like malloc
+     * 
+     */
+    void* (*alloc)(void* userdata, size_t size);
+    /**
+     * @brief Like realloc, ptr may be NULL
+     * 
+     */
+    void* (*resize)(void* userdata, void* ptr, size_t size);
+    /**
+     * @brief Like free, never called with NULL
+     * 
+     */
+    void (*release)(void* userdata, void* ptr);
+    /**
+     * @brief Passed as is to alloc, resize and release
+     * 
+     */
+    void* userdata;
+} mkmshar_allocator;
+
+/**
+ * @brief Payload layout of mkmshar_options.layout, each file is a printf of its whole base64 into the file followed by mktemp, base64 -d and mv (the classic one)
  * 
- * @param prescript the script to be executed before extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
- * @param postscript the script to be executed after extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
- * @param files the path to the files
- * @param nfiles the number of files
- * @return char* the archive or NULL if there is a problem
+ */
+#define MXPSQL_MShar_LAYOUT_PRINTF 0
+/**
+ * @brief Payload layout of mkmshar_options.layout, each file is a quoted heredoc of line wrapped base64 piped into base64 -d, no temporary file and the shell never holds the payload as one word
  * 
- * @see mkmshar
  */
-char* mkmshar_s(char* prescript, char* postscript, char** files, size_t nfiles);
-
-
+#define MXPSQL_MShar_LAYOUT_HEREDOC 1
+/**
+ * @brief Payload layout of mkmshar_options.layout, a script ending in exit followed by the raw files, each cut out of the archive with tail and head -c (dd without head -c) at offsets worked out up front
+ * 
+ * @details No base64 so the archive is about a quarter smaller and nothing is decoded.
+ * The size of every file is known before anything is written, so files that are not regular (pipes) are file errors, files that change size while the archive is written are write errors.
+ * The archive has to be run as a file (sh archive, not cat archive | sh) and is not text, run any other way it exits with 1 before writing anything, and a file that cannot be cut out whole (a truncated archive) makes it exit with 1 at the end.
+ * It is always written by the calling thread, nthreads is not used.
+ */
+#define MXPSQL_MShar_LAYOUT_TRAILER 2
+
+/**
+ * @brief Duplicate handling of mkmshar_options.dedup, every file gets its own payload
+ * 
+ */
+#define MXPSQL_MShar_DEDUP_OFF 0
+/**
+ * @brief Duplicate handling of mkmshar_options.dedup, a file with the same bytes as an earlier one is extracted with cp from it
+ * 
+ * @details Files are first grouped by size, only files that share a size are read and hashed, and files with the same hash are compared byte for byte before one is taken as a copy.
+ * Only regular files take part, a copy whose first file could not be archived after all gets its own payload.
+ * A copy that cannot be made (cp reports why) makes the script exit 1 at the end.
+ */
+#define MXPSQL_MShar_DEDUP_COPY 1
+/**
+ * @brief Duplicate handling of mkmshar_options.dedup, like MXPSQL_MShar_DEDUP_COPY but the copies are hard links (ln -f, cp where that fails)
+ * 
+ */
+#define MXPSQL_MShar_DEDUP_LINK 2
+
+/**
+ * @brief Checking of mkmshar_options.checksum, files are extracted as they come
+ * 
+ */
+#define MXPSQL_MShar_CHECKSUM_OFF 0
+/**
+ * @brief Checking of mkmshar_options.checksum, every file is compared with cksum against the CRC and size it was archived with, damaged ones are reported and the script exits 1 at the end
+ * 
+ * @details The CRC is worked out while the file is encoded, so nothing is read twice (except with the trailer layout, where it has to be in the script before the files).
+ * Copies found by options.dedup are not checked again, the file they are copied from was.
+ */
+#define MXPSQL_MShar_CHECKSUM_ON 1
+/**
+ * @brief Checking of mkmshar_options.checksum, like MXPSQL_MShar_CHECKSUM_ON but the script exits 1 at the first damaged file
+ * 
+ */
+#define MXPSQL_MShar_CHECKSUM_FAILFAST 2
+
+#ifndef MXPSQL_MShar_WRAP
+/**
+ * @brief Line length of the base64 in heredoc payloads, define it to change it.
+ * 
+ */
+#define MXPSQL_MShar_WRAP 76
+#endif
+
+/**
+ * @brief What to do, set by the caller before a mkmshar_ctx_* call.
+ * 
+ */
+typedef struct mkmshar_options {
+    /**
+     * @brief Skip files that cannot be read instead of failing, 0 to not ignore
+     * 
+     */
+    int ignorefileerrors;
+    /**
+     * @brief How many worker threads encode files, 0 for one per online processor, see mkmshar_sink_mt
+     * 
+     */
+    size_t nthreads;
+    /**
+     * @brief Time the phases of the build into the stats, 0 to leave the clock alone (the timing fields stay 0)
+     * 
+     */
+    int timing;
+    /**
+     * @brief How file payloads are laid out in the script, one of the MXPSQL_MShar_LAYOUT_* macros
+     * 
+     */
+    int layout;
+    /**
+     * @brief Deflate each file (gzip -dc undoes it on extraction), 0 to store files as they are
+     * 
+     * @details Files that do not get smaller are stored as they are, decided on the first MXPSQL_MShar_Z_PROBE bytes and then the first MXPSQL_MShar_CHUNK_SIZE (the whole file with the trailer layout). Files under MXPSQL_MShar_Z_MIN bytes are never compressed.
+     */
+    int compress;
+    /**
+     * @brief What to do with files that have the same bytes as an earlier one, one of the MXPSQL_MShar_DEDUP_* macros
+     * 
+     */
+    int dedup;
+    /**
+     * @brief Whether the script checks every file with cksum after extracting it, one of the MXPSQL_MShar_CHECKSUM_* macros
+     * 
+     */
+    int checksum;
+    /**
+     * @brief Start the archive with a manifest of every file (offset and length of its block, size, encoded length, cksum CRC and path), 0 for none
+     *
+     * @details The script then takes arguments: sh archive --list prints the manifest and stops before anything is extracted, sh archive name... extracts only the named files, each cut out of the archive at its offset (so the archive has to be run as a file for that) without running the rest of the script, pre and post scripts included.
+     * Every block length has to be known before the first one is written, so files that are not regular (pipes) are file errors and files that change while the archive is written are write errors, like with MXPSQL_MShar_LAYOUT_TRAILER.
+     * The lengths follow from the sizes, only with compress or checksum are files read once more up front, on the calling thread.
+     * The cksum column is - without checksum, a copy found by dedup has 0 for its encoded length, picking it out extracts the file it is a copy of first (once, however often either is named).
+     * A path is a line of the manifest, so a path with a newline in it is a file error (EINVAL). With dedup, such a file is never taken as a copy or as what copies are made from.
+     */
+    int manifest;
+    /**
+     * @brief Let the script be told which files to extract, 0 to always extract all of them
+     *
+     * @details sh archive --include 'pattern' --exclude 'pattern' file... extracts the files that match an include pattern (or a file named, all files if there are neither) and no exclude pattern, both can be given more than once.
+     * The patterns are shell case patterns matched against the whole path, so * matches across directories too.
+     * The files named are compared with the whole path as they are, not as patterns, and come after the options; --include or --exclude without a pattern makes the script exit 1.
+     * Every block is wrapped in a test, a file that is not wanted is parsed past but never decoded, and its directories are not made.
+     * With options.manifest, an archive that is run as a file only reads the blocks of the files it extracts.
+     * A copy found by dedup is extracted with cp from the file it is a copy of, so when a copy is wanted that file is extracted too, wanted or not.
+     */
+    int selective;
+    /**
+     * @brief Archive what is under the directories in files (and in the source), 0 to take every entry as a file
+     *
+     * @details Directories are walked depth first with their entries in strcmp order, so the archive does not depend on the order the system lists them in.
+     * With worker threads (see nthreads) directories are read by the workers ahead of the encoder, up to MXPSQL_MShar_WALK_AHEAD of them, and the first blocks go out while the tree is still being walked.
+     * Regular files and symbolic links to regular files are archived, symbolic links to directories are not followed and anything else (pipes, devices, sockets) is left out.
+     * A directory that cannot be read is a file error, so it is skipped with ignorefileerrors.
+     * The archived paths are made by the walk, the ones that end up in ctx->stats.slowest or as ctx->errpath are kept by the context until mkmshar_ctx_free.
+     */
+    int recurse;
+    /**
+     * @brief Shell case patterns, a file found by the walk is only archived if it matches one of them (all files if ninclude is 0)
+     *
+     * @details Patterns are matched against the whole path as it is archived, * and ? match across directories too, [...] takes ranges and ! or ^ to negate, and \ quotes the next character.
+     * Only paths found by recurse are filtered, the entries of files are always archived as they are.
+     */
+    const char* const* include;
+    /**
+     * @brief How many patterns include has
+     *
+     */
+    size_t ninclude;
+    /**
+     * @brief Shell case patterns, a file or directory found by the walk that matches one of them is left out (a directory with everything under it, without being read)
+     *
+     */
+    const char* const* exclude;
+    /**
+     * @brief How many patterns exclude has
+     *
+     */
+    size_t nexclude;
+    /**
+     * @brief Open and read small files through io_uring this many at a time (the queue depth), 0 to read every file with stdio
+     *
+     * @details Only on Linux where the build has it (see MXPSQL_MShar_URING), and only when the files are encoded on the calling thread: nthreads of 1 with the printf or heredoc layout.
+     * It is ignored with any other nthreads (0 included) and with MXPSQL_MShar_LAYOUT_TRAILER, the worker threads and the trailer layout read every file with stdio and stats.uring_files stays 0.
+     * A batch is opened and stat'ed with one io_uring_enter, and its regular files under MXPSQL_MShar_URING_MAX bytes are read and closed with another, instead of an fopen, fstat, read and fclose each.
+     * Files are taken from the list (or the source) up to a batch ahead of the one being encoded.
+     * Everything else, and every file if the kernel has no io_uring (or does not let this process use it), is read with stdio as without it, stats.uring_files counts the ones that were read through the ring.
+     */
+    size_t uring;
+} mkmshar_options;
+
+#ifndef MXPSQL_MShar_STATS_SLOWEST
+/**
+ * @brief How many of the slowest files mkmshar_stats keeps, define it to change it.
+ * 
+ */
+#define MXPSQL_MShar_STATS_SLOWEST 8
+#endif
+
+/**
+ * @brief One file and how long it took, see mkmshar_stats.slowest.
+ * 
+ */
+typedef struct mkmshar_filetime {
+    /**
+     * @brief The entry of files it was, NULL for unused entries
+     * 
+     */
+    const char* path;
+    /**
+     * @brief Seconds from opening it to its block being written
+     * 
+     */
+    double seconds;
+    /**
+     * @brief Bytes read from it
+     * 
+     */
+    size_t bytes;
+} mkmshar_filetime;
+
+/**
+ * @brief What happened, filled in by a mkmshar_ctx_* call and added to by every following one.
+ * 
+ */
+typedef struct mkmshar_stats {
+    /**
+     * @brief Files archived
+     * 
+     */
+    size_t files;
+    /**
+     * @brief Files skipped because of file errors (only with ignorefileerrors)
+     * 
+     */
+    size_t skipped;
+    /**
+     * @brief Bytes read from the archived files
+     * 
+     */
+    size_t bytes_in;
+    /**
+     * @brief Bytes of archive written
+     * 
+     */
+    size_t bytes_out;
+    /**
+     * @brief Files stored compressed (only with options.compress)
+     * 
+     */
+    size_t compressed;
+    /**
+     * @brief Payload bytes before base64, after compression, bytes_packed / bytes_in is the compression ratio
+     * 
+     */
+    size_t bytes_packed;
+    /**
+     * @brief Files extracted as a copy of an earlier file instead of a payload of their own (only with options.dedup), counted in files too
+     * 
+     */
+    size_t duplicates;
+    /**
+     * @brief Bytes read to find the duplicates, that is hashing and comparing
+     * 
+     */
+    size_t bytes_hashed;
+    /**
+     * @brief Files read through io_uring (only with options.uring), counted in files too
+     * 
+     */
+    size_t uring_files;
+    /**
+     * @brief Calls to allocator.alloc, and to allocator.resize with a NULL pointer
+     * 
+     */
+    size_t allocs;
+    /**
+     * @brief Calls to allocator.resize that grew or shrank an existing block
+     * 
+     */
+    size_t reallocs;
+    /**
+     * @brief Wall clock seconds of the whole build (only with options.timing, like the rest of the seconds)
+     * 
+     */
+    double total_seconds;
+    /**
+     * @brief Seconds opening files and finding their size
+     * 
+     * @details The phase seconds are added up over all threads, so with workers they can add up to more than total_seconds.
+     */
+    double open_seconds;
+    /**
+     * @brief Seconds reading files (mapping them for mapped files, their page faults land in base64_seconds)
+     * 
+     */
+    double read_seconds;
+    /**
+     * @brief Seconds base64 encoding, and taking checksums (with options.checksum, they are taken in the same pass)
+     * 
+     */
+    double base64_seconds;
+    /**
+     * @brief Seconds putting together the text around the payloads and staging blocks
+     * 
+     */
+    double format_seconds;
+    /**
+     * @brief Seconds spent in the writer
+     * 
+     */
+    double output_seconds;
+    /**
+     * @brief Seconds compressing
+     * 
+     */
+    double compress_seconds;
+    /**
+     * @brief Seconds finding duplicates (only with options.dedup)
+     * 
+     */
+    double dedup_seconds;
+    /**
+     * @brief The slowest files of the build, slowest first
+     * 
+     */
+    mkmshar_filetime slowest[MXPSQL_MShar_STATS_SLOWEST];
+} mkmshar_stats;
+
+/**
+ * @brief Everything one archive build needs, so builds on different contexts share nothing.
+ * 
+ * @details
+ * The mkmshar_ctx_* functions do not touch the locale and give errno back as they found it, errors go to err and errpath instead.
+ * Any number of contexts can be used from different threads at once, one context is used by one call at a time.
+ * 
+ * @see mkmshar_ctx_init
+ */
+typedef struct mkmshar_ctx {
+    /**
+     * @brief Where memory comes from
+     * 
+     */
+    mkmshar_allocator allocator;
+    /**
+     * @brief What to do
+     * 
+     */
+    mkmshar_options options;
+    /**
+     * @brief What happened
+     * 
+     */
+    mkmshar_stats stats;
+    /**
+     * @brief errno value of the last failure (EDOM for bad arguments, EIO if nothing more specific is known), 0 after a successful call
+     * 
+     */
+    int err;
+    /**
+     * @brief The entry of files the last failure happened on, or NULL if it was not about a file
+     * 
+     */
+    const char* errpath;
+    /**
+     * @brief Copies of the paths from a source or options.recurse that stats.slowest or errpath still point to, given back by mkmshar_ctx_free
+     *
+     */
+    void* kept;
+} mkmshar_ctx;
+
+/**
+ * @brief Set up a context with the default allocator (the MXPSQL_MShar_* macros), one thread, file errors not ignored, no timing, the printf layout, no compression and zeroed stats.
+ * 
+ * @param ctx the context to set up, change its fields afterwards as needed
+ */
+void mkmshar_ctx_init(mkmshar_ctx* ctx);
+
+/**
+ * @brief Give back what the context still holds (the paths from a source or options.recurse it kept for stats.slowest and errpath), the context can be used again afterwards.
+ *
+ * @param ctx the context, see mkmshar_ctx_init
+ */
+void mkmshar_ctx_free(mkmshar_ctx* ctx);
+
+/**
+ * @brief Reentrant mkmshar_sink_mt, options come from ctx and errors go to ctx.
+ * 
+ * @param ctx the context, see mkmshar_ctx_init
+ * @param prescript the script to run before extraction, NULL if none
+ * @param postscript the script to run after extraction, NULL if none
+ * @param files the files to be archived, passing null sets ctx->err to EDOM and returns -1
+ * @param nfiles how many files to archive
+ * @param writer the write callback, see mkmshar_sink_file and mkmshar_sink_fd for ready-made ones
+ * @param userdata passed as is to writer
+ * @return int 0 on success, -1 with ctx->err set if there is a problem
+ */
+int mkmshar_ctx_sink(mkmshar_ctx* ctx, const char* prescript, const char* postscript, char** files, size_t nfiles, mkmshar_write_func writer, void* userdata);
+
+/**
+ * @brief Reentrant mkmshar, the archive is built in memory from ctx's allocator.
+ * 
+ * @warning The return value must be given back with ctx->allocator.release if not null.
+ * 
+ * @param ctx the context, see mkmshar_ctx_init
+ * @param prescript the script to run before extraction, NULL if none
+ * @param postscript the script to run after extraction, NULL if none
+ * @param files the files to be archived, passing null sets ctx->err to EDOM and returns NULL
+ * @param nfiles how many files to archive
+ * @param len set to the length of the archive if not NULL
+ * @return char* the null terminated archive, or NULL with ctx->err set if there is a problem
+ */
+char* mkmshar_ctx_str(mkmshar_ctx* ctx, const char* prescript, const char* postscript, char** files, size_t nfiles, size_t* len);
+
+/**
+ * @brief Where mkmshar_ctx_sink_next gets the files to archive from, one path at a time.
+ * 
+ */
+typedef struct mkmshar_source {
+    /**
+     * @brief The next path, or NULL at the end (errno left 0) or on an error (errno set, the build fails with it)
+     * 
+     * @details The path has to stay valid until it is given back with release, it is never written to. Calls come one at a time, in archive order, from whichever thread claims the next file.
+     */
+    const char* (*next)(void* userdata);
+    /**
+     * @brief Called with every path once the build is done with it, can be NULL
+     * 
+     * @details Every path is given back before the build returns, ctx->stats.slowest and ctx->errpath point at copies the context keeps until mkmshar_ctx_free.
+     */
+    void (*release)(void* userdata, const char* path);
+    /**
+     * @brief Passed as is to next and release
+     * 
+     */
+    void* userdata;
+} mkmshar_source;
+
+/**
+ * @brief mkmshar_ctx_sink with the files pulled from source while the archive is written, instead of an array made up front.
+ * 
+ * @details
+ * With the printf and heredoc layouts and without options.manifest or options.dedup, each path is asked for when a file is about to be encoded and given back when its block is written,
+ * so only the files in flight (a reorder window per thread, see MXPSQL_MShar_REORDER_WINDOW) are held however long the list is, and the first blocks go out while the list is still being read.
+ * The trailer layout, the manifest and dedup need every file before the first block, so for those the whole list is read first and given back at the end.
+ * 
+ * @param ctx the context, see mkmshar_ctx_init
+ * @param prescript the script to run before extraction, NULL if none
+ * @param postscript the script to run after extraction, NULL if none
+ * @param source where the files come from, passing null (or a null next) sets ctx->err to EDOM and returns -1
+ * @param writer the write callback, see mkmshar_sink_file and mkmshar_sink_fd for ready-made ones
+ * @param userdata passed as is to writer
+ * @return int 0 on success, -1 with ctx->err set if there is a problem (ctx->errpath is NULL if it was the source that failed)
+ */
+int mkmshar_ctx_sink_next(mkmshar_ctx* ctx, const char* prescript, const char* postscript, const mkmshar_source* source, mkmshar_write_func writer, void* userdata);
+
+/**
+ * @brief Make an MShar archive
+ * 
+ * @details Internally uses mkmshar_ctx_str with a default context.
+ * 
+ * @note You can't ignore memory allocation errors, those realloc spams are needed.
+ * 
+ * @warning This function's return value must be manually freed if not null.
+ * 
+ * Sometimes this function can fail if you try to archive big files (like the executable itself).
+ * 
+ * @param prescript the script to run before extraction. Put NULL if empty and do not put the filename, put the content of the script you want to run (putting the filename will just place the filename, not the content)
+ * @param postscript the script to run after extraction. Put NULL if empty and do not put the filename, put the content of the script you want to run (putting the filename will just place the filename, not the content)
+ * @param files the files to be archived, retuning null will set the errno to EDOM and return NULL
+ * @param nfiles how many files to archive
+ * @param ignorefileerrors Ignore file errors and continue, set to 0 to not ignore
+ * @return char* the archive or NULL if there is a problem (memory allocation failures, file errors or too big base64)
+ */
+char* mkmshar(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors);
+
+/**
+ * @brief A version of mkmshar, but on all error, return null. Internally uses mkmshar.
+ * 
+ * @param prescript script to be executed before extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
+ * @param postscript script to be executed after extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
+ * @param files the path to files
+ * @param nfiles the number of files
+ * @return char* the archive or NULL if there is a problem 
+ * 
+ * @see mkmshar
+ */
+char* mkmshar_x(char* prescript, char* postscript, char** files, size_t nfiles);
+
+/**
+ * @brief A version of mkmshar, but on file operation error, ignores it.
+ * 
+ * Does not ignore sprintf and memory allocation errors though, this means it returns null on those kind of errors. Internally uses mkmshar.
+ * 
+ * @param prescript the script to be executed before extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
+ * @param postscript the script to be executed after extraction, put NULL if empty and do not put the filename, put the content of the script you want to run
+ * @param files the path to the files
+ * @param nfiles the number of files
+ * @return char* the archive or NULL if there is a problem
+ * 
+ * @see mkmshar
+ */
+char* mkmshar_s(char* prescript, char* postscript, char** files, size_t nfiles);
+
+/**
+ * @brief mkmshar_unshar only goes through the archive and reports its files, nothing is decoded or checked.
+ * 
+ */
+#define MXPSQL_MShar_UNSHAR_LIST 0
+
+/**
+ * @brief mkmshar_unshar decodes every file and checks it (base64, the gzip CRC-32 and size of compressed files, cksum if the archive has it) without writing anything.
+ * 
+ */
+#define MXPSQL_MShar_UNSHAR_VERIFY 1
+
+/**
+ * @brief mkmshar_unshar decodes, checks and writes every file under the current directory, like running the archive does.
+ * 
+ */
+#define MXPSQL_MShar_UNSHAR_EXTRACT 2
+
+/**
+ * @brief One file of an archive, as mkmshar_unshar found it.
+ * 
+ */
+typedef struct mkmshar_unsharfile {
+    /**
+     * @brief Its path, relative to the directory the archive is extracted in
+     * 
+     */
+    const char* path;
+    /**
+     * @brief Its size in bytes, with MXPSQL_MShar_UNSHAR_LIST the size of a compressed file without a cksum is only known modulo 2^32
+     * 
+     */
+    size_t size;
+    /**
+     * @brief Bytes of the archive its payload takes (base64 characters, or raw bytes with the trailer layout), 0 for copies
+     * 
+     */
+    size_t stored;
+    /**
+     * @brief 1 if it was deflated
+     * 
+     */
+    int compressed;
+    /**
+     * @brief The earlier file it is extracted as a copy of (see mkmshar_options.dedup), or NULL
+     * 
+     */
+    const char* from;
+    /**
+     * @brief 1 if it was compared against a checksum (its cksum, or the gzip CRC-32 of a compressed file), never with MXPSQL_MShar_UNSHAR_LIST
+     * 
+     */
+    int checked;
+    /**
+     * @brief NULL if it is fine, otherwise what is wrong with it
+     * 
+     */
+    const char* problem;
+    /**
+     * @brief errno of the failure when the problem is that a file could not be read or written, 0 otherwise
+     * 
+     */
+    int err;
+} mkmshar_unsharfile;
+
+/**
+ * @brief Called by mkmshar_unshar once for each file of the archive, in archive order, when it is done with it.
+ * 
+ * @param userdata what was given to mkmshar_unshar
+ * @param file the file, only valid during the call
+ * @return int 0 to go on, anything else to stop
+ */
+typedef int (*mkmshar_unshar_func)(void* userdata, const mkmshar_unsharfile* file);
+
+/**
+ * @brief List, verify or extract an archive made by this library, without a shell and without starting a single process.
+ * 
+ * @details
+ * The archive is read as data and never run: the file blocks are parsed in any layout, with or without compression, dedup, checksums, manifest or selective blocks, and everything else (pre and post scripts too) is skipped.
+ * Base64 is decoded with the fastest decoder the CPU has (see mkmshar_b64DecodeWith) and compressed files are inflated in process.
+ * Paths that are absolute or go up with .. are reported as a problem and never written, so untrusted archives can be checked in CI.
+ * Parent directories are made as needed, files that exist are overwritten.
+ * 
+ * @param archive the whole archive
+ * @param len its length in bytes
+ * @param mode MXPSQL_MShar_UNSHAR_LIST, MXPSQL_MShar_UNSHAR_VERIFY or MXPSQL_MShar_UNSHAR_EXTRACT
+ * @param report called for every file, can be NULL
+ * @param userdata passed as is to report
+ * @return int 0 if every file is fine, 1 if any has a problem (the others are still done), -1 with errno set if it is not an MShar archive (EDOM), it is cut short (EIO), memory runs out or report asked to stop (errno is then whatever report left)
+ */
+int mkmshar_unshar_mem(const char* archive, size_t len, int mode, mkmshar_unshar_func report, void* userdata);
+
+/**
+ * @brief mkmshar_unshar_mem on an archive file, mapped on POSIX and read whole anywhere else.
+ * 
+ * @param path the archive
+ * @param mode MXPSQL_MShar_UNSHAR_LIST, MXPSQL_MShar_UNSHAR_VERIFY or MXPSQL_MShar_UNSHAR_EXTRACT
+ * @param report called for every file, can be NULL
+ * @param userdata passed as is to report
+ * @return int 0 if every file is fine, 1 if any has a problem, -1 with errno set if the archive cannot be read or see mkmshar_unshar_mem
+ * 
+ * @see mkmshar_unshar_mem
+ */
+int mkmshar_unshar(const char* path, int mode, mkmshar_unshar_func report, void* userdata);
+
+
 
 
 
 
 #ifndef MXPSQL_MShar_NO_IMPL_4_LANG_BINDING /* define this if you want a custom implementation or you need to write a binding */
 
-char* mkmshar_b64Encode(char *data, size_t inlen)
-{
-    #if defined(__cplusplus) || defined(c_plusplus)
-    using namespace std;
+static const char mkmshar_b64e[] = {
+    'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
+    'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+    'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+    'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+    'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
+    'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+    'w', 'x', 'y', 'z', '0', '1', '2', '3',
+    '4', '5', '6', '7', '8', '9', '+', '/'};
+
+/* the scalar encoder, also finishes what the SIMD encoders leave behind */
+static size_t mkmshar_b64EncodeScalar(const unsigned char *data, size_t inlen, char *out)
+{
+    char *p = out;
+    size_t i;
+
+    for (i = 0; i + 2 < inlen; i += 3)
+    {
+        *p++ = mkmshar_b64e[(data[i] >> 2) & 0x3F];
+        *p++ = mkmshar_b64e[((data[i] & 0x3) << 4) | ((data[i + 1] & 0xF0) >> 4)];
+        *p++ = mkmshar_b64e[((data[i + 1] & 0xF) << 2) | ((data[i + 2] & 0xC0) >> 6)];
+        *p++ = mkmshar_b64e[data[i + 2] & 0x3F];
+    }
+
+    if (i < inlen)
+    {
+        *p++ = mkmshar_b64e[(data[i] >> 2) & 0x3F];
+        if (i == (inlen - 1))
+        {
+            *p++ = mkmshar_b64e[((data[i] & 0x3) << 4)];
+            *p++ = '=';
+        }
+        else
+        {
+            *p++ = mkmshar_b64e[((data[i] & 0x3) << 4) | ((data[i + 1] & 0xF0) >> 4)];
+            *p++ = mkmshar_b64e[((data[i + 1] & 0xF) << 2)];
+        }
+        *p++ = '=';
+    }
+
+    return (size_t) (p - out);
+}
+
+#ifdef MXPSQL_MShar_SIMD_X86
+
+/*
+ * The SIMD encoders follow Wojciech Mula's base64 work (http://0x80.pl/articles/index.html#base64-algorithm-new).
+ * Each 3 input bytes are spread over a 32 bit lane as [b1 b0 b2 b1], the four 6 bit indices are cut out of it and mapped to ASCII.
+ * They only take whole steps and always leave at least a few bytes for the scalar encoder so they never read past the input.
+ */
+
+__attribute__((target("ssse3")))
+static __m128i mkmshar_b64_ssse3_lookup(__m128i indices){
+    const __m128i shift_lut = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+
+    /* 0..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12, then 0..25 -> 13 */
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(shift_lut, result);
+    return _mm_add_epi8(result, indices);
+}
+
+__attribute__((target("ssse3")))
+static size_t mkmshar_b64EncodeSSSE3(const unsigned char *data, size_t inlen, char *out, size_t *consumed){
+    const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t i = 0;
+    char *p = out;
+
+    /* 16 bytes are loaded for 12 used */
+    for(; i + 16 <= inlen; i += 12){
+        __m128i in = _mm_loadu_si128((const __m128i*) (data + i));
+        __m128i t0, t1, t2, t3;
+        in = _mm_shuffle_epi8(in, shuf);
+        t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        _mm_storeu_si128((__m128i*) p, mkmshar_b64_ssse3_lookup(_mm_or_si128(t1, t3)));
+        p += 16;
+    }
+
+    *consumed = i;
+    return (size_t) (p - out);
+}
+
+__attribute__((target("avx2")))
+static size_t mkmshar_b64EncodeAVX2(const unsigned char *data, size_t inlen, char *out, size_t *consumed){
+    const __m256i shuf = _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    char *p = out;
+
+    /* each lane gets 12 bytes out of a 16 byte load, the second load ends 28 bytes in */
+    for(; i + 28 <= inlen; i += 24){
+        __m128i lo = _mm_loadu_si128((const __m128i*) (data + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*) (data + i + 12));
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        __m256i t0, t1, t2, t3, indices, result, less;
+        in = _mm256_shuffle_epi8(in, shuf);
+        t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        indices = _mm256_or_si256(t1, t3);
+
+        result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        result = _mm256_shuffle_epi8(shift_lut, result);
+        _mm256_storeu_si256((__m256i*) p, _mm256_add_epi8(result, indices));
+        p += 32;
+    }
+
+    *consumed = i;
+    return (size_t) (p - out);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t mkmshar_b64EncodeAVX512VBMI(const unsigned char *data, size_t inlen, char *out, size_t *consumed){
+    const __m512i shuf = _mm512_setr_epi32(
+        0x01020001, 0x04050304, 0x07080607, 0x0a0b090a,
+        0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516,
+        0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122,
+        0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+    /* bit offsets of the four indices in each lane, 0x3036242a1016040a per 64 bits */
+    const __m512i shifts = _mm512_set4_epi32(0x3036242a, 0x1016040a, 0x3036242a, 0x1016040a);
+    const __m512i lookup = _mm512_loadu_si512((const void*) mkmshar_b64e);
+    size_t i = 0;
+    char *p = out;
+
+    /* 64 bytes are loaded for 48 used */
+    for(; i + 64 <= inlen; i += 48){
+        __m512i in = _mm512_loadu_si512((const void*) (data + i));
+        /* the zero-masked forms, gcc fills the unmasked ones from an undefined register and -Wmaybe-uninitialized says so */
+        in = _mm512_maskz_permutexvar_epi8((__mmask64) -1, shuf, in);
+        in = _mm512_maskz_multishift_epi64_epi8((__mmask64) -1, shifts, in);
+        _mm512_storeu_si512((void*) p, _mm512_maskz_permutexvar_epi8((__mmask64) -1, in, lookup));
+        p += 64;
+    }
+
+    *consumed = i;
+    return (size_t) (p - out);
+}
+
+#endif
+
+/* what mkmshar_once runs its init function under, so contexts on different threads can all be the first */
+#if defined(MXPSQL_MShar_THREADS)
+typedef pthread_once_t mkmshar_onceflag;
+#define MXPSQL_MShar_ONCE_INIT PTHREAD_ONCE_INIT
+#else
+typedef int mkmshar_onceflag;
+#define MXPSQL_MShar_ONCE_INIT 0
+#endif
+
+/* init runs once, and whatever it stored is seen by every caller once this returns */
+static void mkmshar_once(mkmshar_onceflag* flag, void (*init)(void)){
+    #if defined(MXPSQL_MShar_THREADS)
+    pthread_once(flag, init);
+    #elif defined(__GNUC__) || defined(__clang__)
+    /* 0 not run yet, 1 running, 2 done */
+    int expect = 0;
+
+    if(__atomic_load_n(flag, __ATOMIC_ACQUIRE) == 2){
+        return;
+    }
+    if(__atomic_compare_exchange_n(flag, &expect, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+        init();
+        __atomic_store_n(flag, 2, __ATOMIC_RELEASE);
+        return;
+    }
+    while(__atomic_load_n(flag, __ATOMIC_ACQUIRE) != 2);
+    #else
+    /* no threads and no atomics, so nothing to race with */
+    if(*flag == 0){
+        init();
+        *flag = 2;
+    }
+    #endif
+}
+
+static int mkmshar_b64Found = MXPSQL_MShar_B64_SCALAR;
+
+static void mkmshar_b64Setup(void){
+    #ifdef MXPSQL_MShar_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw")){
+        mkmshar_b64Found = MXPSQL_MShar_B64_AVX512VBMI;
+    }
+    else if(__builtin_cpu_supports("avx2")){
+        mkmshar_b64Found = MXPSQL_MShar_B64_AVX2;
+    }
+    else if(__builtin_cpu_supports("ssse3")){
+        mkmshar_b64Found = MXPSQL_MShar_B64_SSSE3;
+    }
+    #endif
+}
+
+int mkmshar_b64Impl(void){
+    static mkmshar_onceflag once = MXPSQL_MShar_ONCE_INIT;
+
+    mkmshar_once(&once, mkmshar_b64Setup);
+    return mkmshar_b64Found;
+}
+
+size_t mkmshar_b64EncodeWith(int impl, const char *data, size_t inlen, char *out){
+    const unsigned char* udata = (const unsigned char*) data;
+    size_t done = 0;
+    size_t written = 0;
+
+    #ifdef MXPSQL_MShar_SIMD_X86
+    if(impl > mkmshar_b64Impl()){
+        impl = MXPSQL_MShar_B64_SCALAR;
+    }
+
+    switch(impl){
+        case MXPSQL_MShar_B64_AVX512VBMI:
+            written = mkmshar_b64EncodeAVX512VBMI(udata, inlen, out, &done);
+            break;
+        case MXPSQL_MShar_B64_AVX2:
+            written = mkmshar_b64EncodeAVX2(udata, inlen, out, &done);
+            break;
+        case MXPSQL_MShar_B64_SSSE3:
+            written = mkmshar_b64EncodeSSSE3(udata, inlen, out, &done);
+            break;
+        default:
+            break;
+    }
+    #else
+    (void) impl;
+    #endif
+
+    return written + mkmshar_b64EncodeScalar(udata + done, inlen - done, out + written);
+}
+
+void mkmshar_b64Init(mkmshar_b64State* state){
+    state->ncarry = 0;
+}
+
+size_t mkmshar_b64Update(mkmshar_b64State* state, const char* data, size_t len, char* out){
+    size_t written = 0;
+    size_t whole = 0;
+
+    /* finish the group left over from last time first */
+    if(state->ncarry > 0){
+        unsigned char group[3];
+        size_t k;
+
+        if(state->ncarry + len < 3){
+            for(k = 0; k < len; k++) state->carry[state->ncarry++] = (unsigned char) data[k];
+            return 0;
+        }
+
+        for(k = 0; k < state->ncarry; k++) group[k] = state->carry[k];
+        for(; k < 3; k++){
+            group[k] = (unsigned char) *data++;
+            len--;
+        }
+        state->ncarry = 0;
+        written = mkmshar_b64EncodeScalar(group, 3, out);
+    }
+
+    whole = len - (len % 3);
+    written += mkmshar_b64EncodeWith(mkmshar_b64Impl(), data, whole, out + written);
+
+    for(; whole < len; whole++){
+        state->carry[state->ncarry++] = (unsigned char) data[whole];
+    }
+
+    return written;
+}
+
+size_t mkmshar_b64Final(mkmshar_b64State* state, char* out){
+    size_t written = mkmshar_b64EncodeScalar(state->carry, state->ncarry, out);
+    state->ncarry = 0;
+    return written;
+}
+
+/* base64 character to its 6 bits, 0xFF for everything else (= too, the last group takes care of it) */
+static const unsigned char mkmshar_b64d[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   62, 0xFF, 0xFF, 0xFF,   63,
+      52,   53,   54,   55,   56,   57,   58,   59,   60,   61, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,    0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,
+      15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,
+      41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+/* the scalar decoder, also finishes what the SIMD decoders leave behind, inlen is a multiple of 4 and only the last group can be padded */
+static int mkmshar_b64DecodeScalar(const unsigned char *data, size_t inlen, unsigned char *out, size_t *outlen){
+    unsigned char *p = out;
+    size_t i;
+
+    *outlen = 0;
+    for(i = 0; i + 4 < inlen; i += 4){
+        unsigned long a = mkmshar_b64d[data[i]];
+        unsigned long b = mkmshar_b64d[data[i + 1]];
+        unsigned long c = mkmshar_b64d[data[i + 2]];
+        unsigned long d = mkmshar_b64d[data[i + 3]];
+        unsigned long v = (a << 18) | (b << 12) | (c << 6) | d;
+
+        if(((a | b | c | d) & 0x80) != 0){
+            return -1;
+        }
+        *p++ = (unsigned char) ((v >> 16) & 0xFF);
+        *p++ = (unsigned char) ((v >> 8) & 0xFF);
+        *p++ = (unsigned char) (v & 0xFF);
+    }
+
+    if(i < inlen){
+        unsigned long a = mkmshar_b64d[data[i]];
+        unsigned long b = mkmshar_b64d[data[i + 1]];
+        unsigned long c = (data[i + 2] == '=') ? 0 : mkmshar_b64d[data[i + 2]];
+        unsigned long d = (data[i + 3] == '=') ? 0 : mkmshar_b64d[data[i + 3]];
+        unsigned long v = (a << 18) | (b << 12) | (c << 6) | d;
+
+        /* x=y= is not padding */
+        if(((a | b | c | d) & 0x80) != 0 || (data[i + 2] == '=' && data[i + 3] != '=')){
+            return -1;
+        }
+        *p++ = (unsigned char) ((v >> 16) & 0xFF);
+        if(data[i + 2] != '=') *p++ = (unsigned char) ((v >> 8) & 0xFF);
+        if(data[i + 3] != '=') *p++ = (unsigned char) (v & 0xFF);
+    }
+
+    *outlen = (size_t) (p - out);
+    return 0;
+}
+
+#ifdef MXPSQL_MShar_SIMD_X86
+
+/*
+ * The SIMD decoders follow Wojciech Mula and Daniel Lemire's "Faster Base64 Encoding and Decoding Using AVX2 Instructions".
+ * Characters are checked and mapped to their 6 bits with nibble lookups (a 128 entry lookup with VBMI), then maddubs and madd put 4 of them into 3 bytes.
+ * They stop at the first character that is not base64 and always leave the last group (which can be padded) to the scalar decoder, which finds the error if there is one.
+ */
+
+__attribute__((target("ssse3")))
+static size_t mkmshar_b64DecodeSSSE3(const unsigned char *data, size_t inlen, unsigned char *out, size_t *consumed){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask = _mm_set1_epi8(0x2F);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    unsigned char *p = out;
+
+    /* 16 characters in, 12 bytes out */
+    for(; i + 16 + 4 <= inlen; i += 16){
+        __m128i in = _mm_loadu_si128((const __m128i*) (data + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, mask));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i roll;
+        int tail;
+
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF){
+            break;
+        }
+        roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, mask), hi_nibbles));
+        in = _mm_add_epi8(in, roll);
+        in = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+        in = _mm_madd_epi16(in, _mm_set1_epi32(0x00011000));
+        in = _mm_shuffle_epi8(in, pack);
+        _mm_storel_epi64((__m128i*) p, in);
+        tail = _mm_cvtsi128_si32(_mm_srli_si128(in, 8));
+        memcpy(p + 8, &tail, 4);
+        p += 12;
+    }
+
+    *consumed = i;
+    return (size_t) (p - out);
+}
+
+__attribute__((target("avx2")))
+static size_t mkmshar_b64DecodeAVX2(const unsigned char *data, size_t inlen, unsigned char *out, size_t *consumed){
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask = _mm256_set1_epi8(0x2F);
+    const __m256i pack = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+    unsigned char *p = out;
+
+    /* 32 characters in, 24 bytes out */
+    for(; i + 32 + 4 <= inlen; i += 32){
+        __m256i in = _mm256_loadu_si256((const __m256i*) (data + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, mask));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        __m256i roll;
+
+        if(!_mm256_testz_si256(lo, hi)){
+            break;
+        }
+        roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, mask), hi_nibbles));
+        in = _mm256_add_epi8(in, roll);
+        in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+        in = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(in, pack), lanes);
+        _mm_storeu_si128((__m128i*) p, _mm256_castsi256_si128(in));
+        _mm_storel_epi64((__m128i*) (p + 16), _mm256_extracti128_si256(in, 1));
+        p += 24;
+    }
+
+    *consumed = i;
+    return (size_t) (p - out);
+}
+
+/* where each of the 48 bytes of a step comes from after madd, the 3 low bytes of every 32 bit lane backwards */
+static const unsigned char mkmshar_b64pack[64] = {
+     2,  1,  0,  6,  5,  4, 10,  9,  8, 14, 13, 12, 18, 17, 16, 22,
+    21, 20, 26, 25, 24, 30, 29, 28, 34, 33, 32, 38, 37, 36, 42, 41,
+    40, 46, 45, 44, 50, 49, 48, 54, 53, 52, 58, 57, 56, 62, 61, 60,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0};
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static size_t mkmshar_b64DecodeAVX512VBMI(const unsigned char *data, size_t inlen, unsigned char *out, size_t *consumed){
+    /* the first 128 entries of the scalar table, every character with its top bit set is caught by the or below */
+    const __m512i lookup_lo = _mm512_loadu_si512((const void*) mkmshar_b64d);
+    const __m512i lookup_hi = _mm512_loadu_si512((const void*) (mkmshar_b64d + 64));
+    const __m512i pack = _mm512_loadu_si512((const void*) mkmshar_b64pack);
+    size_t i = 0;
+    unsigned char *p = out;
+
+    /* 64 characters in, 48 bytes out */
+    for(; i + 64 + 4 <= inlen; i += 64){
+        __m512i in = _mm512_loadu_si512((const void*) (data + i));
+        __m512i v = _mm512_permutex2var_epi8(lookup_lo, in, lookup_hi);
+
+        if(_mm512_movepi8_mask(_mm512_or_si512(v, in)) != 0){
+            break;
+        }
+        v = _mm512_maddubs_epi16(v, _mm512_set1_epi32(0x01400140));
+        v = _mm512_madd_epi16(v, _mm512_set1_epi32(0x00011000));
+        /* zero-masked for the same reason as in the encoder */
+        v = _mm512_maskz_permutexvar_epi8((__mmask64) -1, pack, v);
+        _mm256_storeu_si256((__m256i*) p, _mm512_maskz_extracti64x4_epi64((__mmask8) -1, v, 0));
+        _mm_storeu_si128((__m128i*) (p + 32), _mm512_maskz_extracti32x4_epi32((__mmask8) -1, v, 2));
+        p += 48;
+    }
+
+    *consumed = i;
+    return (size_t) (p - out);
+}
+
+#endif
+
+int mkmshar_b64DecodeWith(int impl, const char *data, size_t inlen, char *out, size_t *outlen){
+    const unsigned char* udata = (const unsigned char*) data;
+    unsigned char* uout = (unsigned char*) out;
+    size_t done = 0;
+    size_t written = 0;
+    size_t rest = 0;
+
+    *outlen = 0;
+    if(inlen % 4 != 0){
+        errno = EDOM;
+        return -1;
+    }
+
+    #ifdef MXPSQL_MShar_SIMD_X86
+    if(impl > mkmshar_b64Impl()){
+        impl = MXPSQL_MShar_B64_SCALAR;
+    }
+
+    switch(impl){
+        case MXPSQL_MShar_B64_AVX512VBMI:
+            written = mkmshar_b64DecodeAVX512VBMI(udata, inlen, uout, &done);
+            break;
+        case MXPSQL_MShar_B64_AVX2:
+            written = mkmshar_b64DecodeAVX2(udata, inlen, uout, &done);
+            break;
+        case MXPSQL_MShar_B64_SSSE3:
+            written = mkmshar_b64DecodeSSSE3(udata, inlen, uout, &done);
+            break;
+        default:
+            break;
+    }
+    #else
+    (void) impl;
+    #endif
+
+    if(mkmshar_b64DecodeScalar(udata + done, inlen - done, uout + written, &rest) != 0){
+        errno = EDOM;
+        return -1;
+    }
+    *outlen = written + rest;
+    return 0;
+}
+
+int mkmshar_b64Decode(const char *data, size_t inlen, char *out, size_t *outlen){
+    return mkmshar_b64DecodeWith(mkmshar_b64Impl(), data, inlen, out, outlen);
+}
+
+/*
+ * The cksum CRC is the non-reflected CRC-32 (polynomial 0x04C11DB7, first bit of a byte highest) with the length appended and the result inverted.
+ * mkmshar_crctab[k][i] is the CRC of byte i followed by k zero bytes, which is what slice-by-8 takes 8 bytes at a time with.
+ */
+#define MXPSQL_MShar_CRC_POLY 0x04C11DB7UL
+
+static unsigned long mkmshar_crctab[8][256];
+
+static unsigned long mkmshar_cksumScalar(unsigned long crc, const unsigned char* p, size_t n){
+    while(n >= 8){
+        unsigned long w = crc ^ (((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | (unsigned long) p[3]);
+        crc = mkmshar_crctab[7][(w >> 24) & 0xFF] ^ mkmshar_crctab[6][(w >> 16) & 0xFF] ^ mkmshar_crctab[5][(w >> 8) & 0xFF] ^ mkmshar_crctab[4][w & 0xFF]
+            ^ mkmshar_crctab[3][p[4]] ^ mkmshar_crctab[2][p[5]] ^ mkmshar_crctab[1][p[6]] ^ mkmshar_crctab[0][p[7]];
+        p += 8;
+        n -= 8;
+    }
+    while(n-- > 0){
+        crc = ((crc << 8) & 0xFFFFFFFFUL) ^ mkmshar_crctab[0][((crc >> 24) ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef MXPSQL_MShar_SIMD_X86
+
+/*
+ * Folding as in Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * Bytes are swapped on load so a 128 bit lane reads as the polynomial of its 16 message bytes, four lanes are folded 64 bytes ahead,
+ * then into each other, and the last lane goes through the table like 16 message bytes would. The constants come from mkmshar_crc_xpow.
+ */
+static unsigned long mkmshar_crcfold[6];
+
+/* x^n mod the polynomial, the PCLMUL fold constants */
+static unsigned long mkmshar_crc_xpow(size_t n){
+    unsigned long r = 1;
+
+    while(n-- > 0){
+        r = (r & 0x80000000UL) ? ((r << 1) ^ MXPSQL_MShar_CRC_POLY) & 0xFFFFFFFFUL : (r << 1) & 0xFFFFFFFFUL;
+    }
+    return r;
+}
+
+__attribute__((target("pclmul,ssse3")))
+static __m128i mkmshar_crc_fold(__m128i x, __m128i k){
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static unsigned long mkmshar_cksumPCLMUL(unsigned long crc, const unsigned char* p, size_t n, size_t* consumed){
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k512 = _mm_set_epi32(0, (int) mkmshar_crcfold[0], 0, (int) mkmshar_crcfold[1]);
+    const __m128i k128 = _mm_set_epi32(0, (int) mkmshar_crcfold[2], 0, (int) mkmshar_crcfold[3]);
+    __m128i x0, x1, x2, x3;
+    unsigned char last[16];
+    size_t i;
+
+    if(n < 128){
+        *consumed = 0;
+        return crc;
+    }
+
+    x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) p), swap);
+    x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + 16)), swap);
+    x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + 32)), swap);
+    x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + 48)), swap);
+    /* the CRC so far goes on top of the first 4 bytes */
+    x0 = _mm_xor_si128(x0, _mm_set_epi32((int) crc, 0, 0, 0));
+
+    for(i = 64; i + 64 <= n; i += 64){
+        x0 = _mm_xor_si128(mkmshar_crc_fold(x0, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + i)), swap));
+        x1 = _mm_xor_si128(mkmshar_crc_fold(x1, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + i + 16)), swap));
+        x2 = _mm_xor_si128(mkmshar_crc_fold(x2, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + i + 32)), swap));
+        x3 = _mm_xor_si128(mkmshar_crc_fold(x3, k512), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p + i + 48)), swap));
+    }
+
+    x1 = _mm_xor_si128(mkmshar_crc_fold(x0, k128), x1);
+    x2 = _mm_xor_si128(mkmshar_crc_fold(x1, k128), x2);
+    x3 = _mm_xor_si128(mkmshar_crc_fold(x2, k128), x3);
+
+    _mm_storeu_si128((__m128i*) last, _mm_shuffle_epi8(x3, swap));
+    *consumed = i;
+    return mkmshar_cksumScalar(0, last, 16);
+}
+
+/* the same with four lanes per register, four registers 256 bytes ahead, folded into one and then into one lane like the PCLMUL one */
+__attribute__((target("avx512f,avx512bw,vpclmulqdq,pclmul,ssse3")))
+static unsigned long mkmshar_cksumVPCLMUL(unsigned long crc, const unsigned char* p, size_t n, size_t* consumed){
+    /* set4 rather than broadcasts and zero-masked extracts, gcc builds those from an undefined register and warns */
+    const __m128i swap128 = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i swap = _mm512_set4_epi32(0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f);
+    const __m512i k2048 = _mm512_set4_epi32(0, (int) mkmshar_crcfold[4], 0, (int) mkmshar_crcfold[5]);
+    const __m512i k512 = _mm512_set4_epi32(0, (int) mkmshar_crcfold[0], 0, (int) mkmshar_crcfold[1]);
+    const __m128i k128 = _mm_set_epi32(0, (int) mkmshar_crcfold[2], 0, (int) mkmshar_crcfold[3]);
+    __m512i z0, z1, z2, z3;
+    __m128i x0, x1, x2, x3;
+    unsigned char last[16];
+    size_t i;
+
+    if(n < 512){
+        *consumed = 0;
+        return crc;
+    }
+
+    z0 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) p), swap);
+    z1 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + 64)), swap);
+    z2 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + 128)), swap);
+    z3 = _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + 192)), swap);
+    z0 = _mm512_xor_si512(z0, _mm512_inserti32x4(_mm512_setzero_si512(), _mm_set_epi32((int) crc, 0, 0, 0), 0));
+
+    for(i = 256; i + 256 <= n; i += 256){
+        z0 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z0, k2048, 0x11), _mm512_clmulepi64_epi128(z0, k2048, 0x00), _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + i)), swap), 0x96);
+        z1 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z1, k2048, 0x11), _mm512_clmulepi64_epi128(z1, k2048, 0x00), _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + i + 64)), swap), 0x96);
+        z2 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z2, k2048, 0x11), _mm512_clmulepi64_epi128(z2, k2048, 0x00), _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + i + 128)), swap), 0x96);
+        z3 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z3, k2048, 0x11), _mm512_clmulepi64_epi128(z3, k2048, 0x00), _mm512_shuffle_epi8(_mm512_loadu_si512((const void*) (p + i + 192)), swap), 0x96);
+    }
+
+    z1 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z0, k512, 0x11), _mm512_clmulepi64_epi128(z0, k512, 0x00), z1, 0x96);
+    z2 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z1, k512, 0x11), _mm512_clmulepi64_epi128(z1, k512, 0x00), z2, 0x96);
+    z3 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z2, k512, 0x11), _mm512_clmulepi64_epi128(z2, k512, 0x00), z3, 0x96);
+
+    x0 = _mm512_maskz_extracti32x4_epi32((__mmask8) -1, z3, 0);
+    x1 = _mm512_maskz_extracti32x4_epi32((__mmask8) -1, z3, 1);
+    x2 = _mm512_maskz_extracti32x4_epi32((__mmask8) -1, z3, 2);
+    x3 = _mm512_maskz_extracti32x4_epi32((__mmask8) -1, z3, 3);
+    x1 = _mm_xor_si128(mkmshar_crc_fold(x0, k128), x1);
+    x2 = _mm_xor_si128(mkmshar_crc_fold(x1, k128), x2);
+    x3 = _mm_xor_si128(mkmshar_crc_fold(x2, k128), x3);
+
+    _mm_storeu_si128((__m128i*) last, _mm_shuffle_epi8(x3, swap128));
+    *consumed = i;
+    return mkmshar_cksumScalar(0, last, 16);
+}
+
+#endif
+
+static int mkmshar_cksumFound = MXPSQL_MShar_CRC_SCALAR;
+
+/* the tables and the fold constants, then what the CPU can do */
+static void mkmshar_cksumSetup(void){
+    int i;
+    int k;
+
+    for(i = 0; i < 256; i++){
+        unsigned long c = (unsigned long) i << 24;
+        for(k = 0; k < 8; k++){
+            c = (c & 0x80000000UL) ? ((c << 1) ^ MXPSQL_MShar_CRC_POLY) & 0xFFFFFFFFUL : (c << 1) & 0xFFFFFFFFUL;
+        }
+        mkmshar_crctab[0][i] = c;
+    }
+    for(k = 1; k < 8; k++){
+        for(i = 0; i < 256; i++){
+            unsigned long c = mkmshar_crctab[k - 1][i];
+            mkmshar_crctab[k][i] = ((c << 8) & 0xFFFFFFFFUL) ^ mkmshar_crctab[0][(c >> 24) & 0xFF];
+        }
+    }
+
+    #ifdef MXPSQL_MShar_SIMD_X86
+    mkmshar_crcfold[0] = mkmshar_crc_xpow(512 + 64);
+    mkmshar_crcfold[1] = mkmshar_crc_xpow(512);
+    mkmshar_crcfold[2] = mkmshar_crc_xpow(128 + 64);
+    mkmshar_crcfold[3] = mkmshar_crc_xpow(128);
+    mkmshar_crcfold[4] = mkmshar_crc_xpow(2048 + 64);
+    mkmshar_crcfold[5] = mkmshar_crc_xpow(2048);
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("vpclmulqdq") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("pclmul")){
+        mkmshar_cksumFound = MXPSQL_MShar_CRC_VPCLMUL;
+    }
+    else if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")){
+        mkmshar_cksumFound = MXPSQL_MShar_CRC_PCLMUL;
+    }
+    #endif
+}
+
+int mkmshar_cksumImpl(void){
+    static mkmshar_onceflag once = MXPSQL_MShar_ONCE_INIT;
+
+    mkmshar_once(&once, mkmshar_cksumSetup);
+    return mkmshar_cksumFound;
+}
+
+unsigned long mkmshar_cksumUpdateWith(int impl, unsigned long crc, const char* data, size_t len){
+    const unsigned char* udata = (const unsigned char*) data;
+    size_t done = 0;
+
+    #ifdef MXPSQL_MShar_SIMD_X86
+    if(impl > mkmshar_cksumImpl()){
+        impl = MXPSQL_MShar_CRC_SCALAR;
+    }
+    if(impl == MXPSQL_MShar_CRC_VPCLMUL){
+        crc = mkmshar_cksumVPCLMUL(crc, udata, len, &done);
+    }
+    /* whatever is left over is still worth folding 64 bytes at a time */
+    if(impl >= MXPSQL_MShar_CRC_PCLMUL){
+        size_t more = 0;
+        crc = mkmshar_cksumPCLMUL(crc, udata + done, len - done, &more);
+        done += more;
+    }
+    #else
+    (void) impl;
+    mkmshar_cksumImpl();
+    #endif
+
+    return mkmshar_cksumScalar(crc, udata + done, len - done);
+}
+
+unsigned long mkmshar_cksumUpdate(unsigned long crc, const char* data, size_t len){
+    return mkmshar_cksumUpdateWith(mkmshar_cksumImpl(), crc, data, len);
+}
+
+unsigned long mkmshar_cksumFinal(unsigned long crc, size_t total){
+    unsigned char b;
+
+    mkmshar_cksumImpl();
+    /* the length goes in too, lowest byte first and only as many bytes as it needs */
+    while(total > 0){
+        b = (unsigned char) (total & 0xFF);
+        crc = mkmshar_cksumScalar(crc, &b, 1);
+        total >>= 8;
+    }
+    return ~crc & 0xFFFFFFFFUL;
+}
+
+char* mkmshar_b64Encode(char *data, size_t inlen)
+{
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t outlen = ((((inlen) + 2) / 3) * 4);
+
+    char *out = (char*) MXPSQL_MShar_Malloc(outlen + 1);
+
+    if (out == NULL) {
+        return NULL;
+    }
+    out[outlen] = '\0';
+
+    mkmshar_b64EncodeWith(mkmshar_b64Impl(), data, inlen, out);
+
+    return out;
+}
+
+
+size_t mkmshar_strnlen(const char *s, size_t maxlen)
+{
+
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    #if ((__STDC_VERSION__ >= 201112L) && defined(__STDC_LIB_EXT1__))
+        return strnlen_s(s, maxlen);
+    #else
+    size_t len = 0;
+    while (len < maxlen && s[len] != '\0') {
+        len++;
+    }
+    return len;
+    #endif
+}
+
+static void
+print_pad(char** at, size_t* left, int* ret, char p, int num)
+{
+	while(num--) {
+		if(*left > 1) {
+			*(*at)++ = p;
+			(*left)--;
+		}
+		(*ret)++;
+	}
+}
+
+static void
+spool_str(char** at, size_t* left, int* ret, const char* buf, int len)
+{
+	int i;
+	for(i=0; i<len; i++) {
+		if(*left > 1) {
+			*(*at)++ = buf[i];
+			(*left)--;
+		}
+		(*ret)++;
+	}
+}
+
+static void
+print_str(char** at, size_t* left, int* ret, char* s,
+	int minw, int precision, int prgiven, int minus)
+{
+	int w;
+	/* with prec: no more than x characters from this string, stop at 0 */
+	if(prgiven)
+		w = mkmshar_strnlen(s, precision);
+	else	w = (int)strlen(s); /* up to the nul */
+	if(w < minw && !minus)
+		print_pad(at, left, ret, ' ', minw - w);
+	spool_str(at, left, ret, s, w);
+	if(w < minw && minus)
+		print_pad(at, left, ret, ' ', minw - w);
+}
+
+static void
+print_char(char** at, size_t* left, int* ret, int c,
+	int minw, int minus)
+{
+	if(1 < minw && !minus)
+		print_pad(at, left, ret, ' ', minw - 1);
+	print_pad(at, left, ret, c, 1);
+	if(1 < minw && minus)
+		print_pad(at, left, ret, ' ', minw - 1);
+}
+
+int mkmshar_dumbvsnprintf(char* str, size_t size, const char* format, va_list arg)
+{
+	char* at = str;
+	size_t left = size;
+	int ret = 0;
+	const char* fmt = format;
+	int conv, minw, precision, prgiven, minus;
+	while(*fmt) {
+		/* copy string before % */
+		while(*fmt && *fmt!='%') {
+			if(left > 1) {
+				*at++ = *fmt++;
+				left--;
+			} else fmt++;
+			ret++;
+		}
+		
+		/* see if we are at end */
+		if(!*fmt) break;
+
+		/* fetch next argument % designation from format string */
+		fmt++; /* skip the '%' */
+
+		/********************************/
+		/* get the argument designation */
+		/********************************/
+		/* we must do this vararg stuff inside this function for
+		 * portability.  Hence, get_designation, and print_designation
+		 * are not their own functions. */
+
+		/* printout designation:
+		 * conversion specifier: x, d, u, s, c, n, m, p
+		 * flags: # not supported
+		 *        0 zeropad (on the left)
+		 *	  - left adjust (right by default)
+		 *	  ' ' printspace for positive number (in - position).
+		 *	  + alwayssign
+		 * fieldwidth: [1-9][0-9]* minimum field width.
+		 * 	if this is * then type int next argument specifies the minwidth.
+		 * 	if this is negative, the - flag is set (with positive width).
+		 * precision: period[digits]*, %.2x.
+		 * 	if this is * then type int next argument specifies the precision.
+		 *	just '.' or negative value means precision=0.
+		 *		this is mindigits to print for d, i, u, x
+		 *		this is aftercomma digits for f
+		 *		this is max number significant digits for g
+		 *		maxnumber characters to be printed for s
+		 * length: 0-none (int), 1-l (long), 2-ll (long long)
+		 * 	notsupported: hh (char), h (short), L (long double), q, j, z, t
+		 * Does not support %m$ and *m$ argument designation as array indices.
+		 * Does not support %#x
+		 *
+		 */
+		minw = 0;
+		precision = 1;
+		prgiven = 0;
+		minus = 0;
+
+		/* field width */
+		if(*fmt == '*') {
+			fmt++; /* skip char */
+			minw = va_arg(arg, int);
+			if(minw < 0) {
+				minus = 1;
+				minw = -minw;
+			}
+		} else while(*fmt >= '0' && *fmt <= '9') {
+			minw = minw*10 + (*fmt++)-'0';
+		}
+
+		/* precision */
+		if(*fmt == '.') {
+			fmt++; /* skip period */
+			prgiven = 1;
+			precision = 0;
+			if(*fmt == '*') {
+				fmt++; /* skip char */
+				precision = va_arg(arg, int);
+				if(precision < 0)
+					precision = 0;
+			} else while(*fmt >= '0' && *fmt <= '9') {
+				precision = precision*10 + (*fmt++)-'0';
+			}
+		}
+
+		/* get the conversion */
+		if(!*fmt) conv = 0;
+		else	conv = *fmt++;
+
+		/***********************************/
+		/* print that argument designation */
+		/***********************************/
+		switch(conv) {
+		case 's':
+			print_str(&at, &left, &ret, va_arg(arg, char*),
+				minw, precision, prgiven, minus);
+			break;
+		case 'c':
+			print_char(&at, &left, &ret, va_arg(arg, int),
+				minw, minus);
+			break;
+		case 'n':
+			*va_arg(arg, int*) = ret;
+			break;
+		case 'm':
+			print_str(&at, &left, &ret, strerror(errno),
+				minw, precision, prgiven, minus);
+			break;
+		case '%':
+			print_pad(&at, &left, &ret, '%', 1);
+			break;
+		/* unknown */
+		default:
+		case 0: break;
+		}
+	}
+
+	/* zero terminate */
+	if(left > 0)
+		*at = 0;
+	return ret;
+}
+
+int mkmshar_snprintf(char *str, size_t size, const char *format, ...)
+{
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    va_list arg_list;
+    int chars_printed = 0;
+    va_start(arg_list, format);
+
+    /* check c standard version */
+    #if ((!defined(__STDC_VERSION__) || (__STDC_VERSION__ < 199901L)) || (defined(__STDC__) && !defined(__STDC_VERSION__)))
+    chars_printed = mkmshar_dumbvsnprintf(str, size, format, arg_list);
+    #else
+    chars_printed = vsnprintf(str, size, format, arg_list);
+    #endif
+
+    va_end(arg_list);
+    return chars_printed;
+}
+
+
+int mkmshar_sink_file(void* userdata, const char* data, size_t len){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    if(len == 0) return 0;
+    if(fwrite(data, 1, len, (FILE*) userdata) != len){
+        return -1;
+    }
+    return 0;
+}
+
+#if defined(MXPSQL_MShar_OS_POSIX_SUS) || defined(_WIN32)
+int mkmshar_sink_fd(void* userdata, const char* data, size_t len){
+    int fd = *((int*) userdata);
+
+    while(len > 0){
+        #if defined(MXPSQL_MShar_OS_POSIX_SUS)
+        ssize_t w = write(fd, data, len);
+        #else
+        int w = _write(fd, data, (unsigned int) ((len > 0x40000000) ? 0x40000000 : len));
+        #endif
+        if(w < 0){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        data += w;
+        len -= (size_t) w;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * @brief Growable byte buffer that knows its own length, so appending never has to look for the end with strlen.
+ * 
+ * @details
+ * Grows geometrically and appends with memcpy, so building a block of B bytes costs O(B).
+ * It can hold NUL bytes, but there is always room left to null terminate it.
+ */
+typedef struct mkmshar_buf {
+    char* data;
+    size_t len;
+    size_t cap;
+    const mkmshar_allocator* a;
+} mkmshar_buf;
+
+/* the default allocator of a context, just the MXPSQL_MShar_* macros */
+static void* mkmshar_default_alloc(void* userdata, size_t size){
+    (void) userdata;
+    return MXPSQL_MShar_Malloc(size);
+}
+
+static void* mkmshar_default_resize(void* userdata, void* ptr, size_t size){
+    (void) userdata;
+    return MXPSQL_MShar_Realloc(ptr, size);
+}
+
+static void mkmshar_default_release(void* userdata, void* ptr){
+    (void) userdata;
+    MXPSQL_MShar_Free(ptr);
+}
+
+static void mkmshar_buf_init(mkmshar_buf* buf, const mkmshar_allocator* a){
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+    buf->a = a;
+}
+
+static void mkmshar_buf_free(mkmshar_buf* buf){
+    if(buf->data != NULL) buf->a->release(buf->a->userdata, buf->data);
+    mkmshar_buf_init(buf, buf->a);
+}
+
+/* make room for extra more bytes plus the null terminator */
+static int mkmshar_buf_reserve(mkmshar_buf* buf, size_t extra){
+    size_t need = buf->len + extra + 1;
+    size_t ncap = buf->cap;
+    char* ndata = NULL;
+
+    if(need < buf->len){
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if(need <= buf->cap) return 0;
+
+    if(ncap < 256) ncap = 256;
+    while(ncap < need){
+        if(ncap > ((size_t) -1) / 2){
+            ncap = need;
+            break;
+        }
+        ncap *= 2;
+    }
+
+    ndata = (char*) buf->a->resize(buf->a->userdata, buf->data, ncap);
+    if(ndata == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    buf->data = ndata;
+    buf->cap = ncap;
+    return 0;
+}
+
+/* make room for exactly len bytes plus the null terminator when the final size is known up front, does not shrink */
+static int mkmshar_buf_fit(mkmshar_buf* buf, size_t len){
+    char* ndata = NULL;
+
+    if(len + 1 == 0){
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if(buf->len + len + 1 <= buf->cap) return 0;
+
+    ndata = (char*) buf->a->resize(buf->a->userdata, buf->data, buf->len + len + 1);
+    if(ndata == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    buf->data = ndata;
+    buf->cap = buf->len + len + 1;
+    return 0;
+}
+
+static int mkmshar_buf_append(mkmshar_buf* buf, const char* data, size_t len){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    if(mkmshar_buf_reserve(buf, len) != 0){
+        return -1;
+    }
+    if(len > 0) memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+static int mkmshar_buf_appends(mkmshar_buf* buf, const char* str){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    return mkmshar_buf_append(buf, str, strlen(str));
+}
+
+/* decimal digits of v into out (room for 20), no snprintf as the C90 one has no integers, returns how many */
+static size_t mkmshar_ultoa(char* out, size_t v){
+    char rev[20];
+    size_t n = 0;
+    size_t i;
+
+    do{
+        rev[n++] = (char) ('0' + (v % 10));
+        v /= 10;
+    } while(v > 0);
+    for(i = 0; i < n; i++) out[i] = rev[n - 1 - i];
+    return n;
+}
+
+static int mkmshar_buf_appendul(mkmshar_buf* buf, size_t v){
+    char num[20];
+    return mkmshar_buf_append(buf, num, mkmshar_ultoa(num, v));
+}
+
+/* counts what one thread asks of the context allocator, summed into the stats once the threads are done */
+typedef struct mkmshar_counter {
+    mkmshar_allocator face;
+    const mkmshar_allocator* real;
+    size_t allocs;
+    size_t reallocs;
+} mkmshar_counter;
+
+static void* mkmshar_counter_alloc(void* userdata, size_t size){
+    mkmshar_counter* c = (mkmshar_counter*) userdata;
+    c->allocs++;
+    return c->real->alloc(c->real->userdata, size);
+}
+
+static void* mkmshar_counter_resize(void* userdata, void* ptr, size_t size){
+    mkmshar_counter* c = (mkmshar_counter*) userdata;
+    if(ptr == NULL) c->allocs++;
+    else c->reallocs++;
+    return c->real->resize(c->real->userdata, ptr, size);
+}
+
+static void mkmshar_counter_release(void* userdata, void* ptr){
+    mkmshar_counter* c = (mkmshar_counter*) userdata;
+    c->real->release(c->real->userdata, ptr);
+}
+
+static void mkmshar_counter_init(mkmshar_counter* c, const mkmshar_allocator* real){
+    c->face.alloc = mkmshar_counter_alloc;
+    c->face.resize = mkmshar_counter_resize;
+    c->face.release = mkmshar_counter_release;
+    c->face.userdata = c;
+    c->real = real;
+    c->allocs = 0;
+    c->reallocs = 0;
+}
+
+/* everything handed out by the arena is aligned to this */
+typedef union mkmshar_arena_align {
+    void* p;
+    double d;
+    long l;
+    size_t z;
+} mkmshar_arena_align;
+
+#define MXPSQL_MShar_ARENA_ALIGN(n) ((((n) + sizeof(mkmshar_arena_align) - 1) / sizeof(mkmshar_arena_align)) * sizeof(mkmshar_arena_align))
+
+/* one block of arena memory, allocations follow the header */
+typedef struct mkmshar_arena_chunk {
+    struct mkmshar_arena_chunk* prev;
+    size_t cap;
+    size_t used;
+} mkmshar_arena_chunk;
+
+#define MXPSQL_MShar_ARENA_HEADER MXPSQL_MShar_ARENA_ALIGN(sizeof(mkmshar_arena_chunk))
+
+/**
+ * @brief Bump allocator for the scratch memory of one file (the staging block and the read buffer).
+ * 
+ * @details
+ * Allocations are carved off the newest chunk, each with its size in front so it can be copied when it grows.
+ * The newest allocation grows and shrinks in place, which is what mkmshar_buf does most.
+ * Release only gives back the newest allocation, everything else waits for mkmshar_arena_reset, called after every block.
+ * A reset folds all chunks into one as big as all of them, so after the first few files no more memory is asked for.
+ */
+typedef struct mkmshar_arena {
+    mkmshar_allocator face;
+    const mkmshar_allocator* backing;
+    mkmshar_arena_chunk* top;
+    size_t total;
+    char* last;
+} mkmshar_arena;
+
+static size_t* mkmshar_arena_sizeof(void* ptr){
+    return (size_t*) (((char*) ptr) - MXPSQL_MShar_ARENA_ALIGN(sizeof(size_t)));
+}
+
+static void* mkmshar_arena_alloc(void* userdata, size_t size){
+    mkmshar_arena* arena = (mkmshar_arena*) userdata;
+    size_t need = MXPSQL_MShar_ARENA_ALIGN(sizeof(size_t)) + MXPSQL_MShar_ARENA_ALIGN(size);
+    char* ptr;
+
+    if(need < size){
+        return NULL;
+    }
+
+    if(arena->top == NULL || arena->top->cap - arena->top->used < need){
+        /* the first chunk fits the block and read buffer of most small files at once */
+        size_t cap = (arena->total > 65536) ? arena->total : 65536;
+        mkmshar_arena_chunk* chunk;
+
+        if(cap < need) cap = need;
+        chunk = (mkmshar_arena_chunk*) arena->backing->alloc(arena->backing->userdata, MXPSQL_MShar_ARENA_HEADER + cap);
+        if(chunk == NULL){
+            return NULL;
+        }
+        chunk->prev = arena->top;
+        chunk->cap = cap;
+        chunk->used = 0;
+        arena->top = chunk;
+        arena->total += cap;
+    }
+
+    ptr = ((char*) arena->top) + MXPSQL_MShar_ARENA_HEADER + arena->top->used + MXPSQL_MShar_ARENA_ALIGN(sizeof(size_t));
+    arena->top->used += need;
+    *mkmshar_arena_sizeof(ptr) = size;
+    arena->last = ptr;
+    return ptr;
+}
+
+static void* mkmshar_arena_resize(void* userdata, void* ptr, size_t size){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    mkmshar_arena* arena = (mkmshar_arena*) userdata;
+    size_t old;
+    char* nptr;
+
+    if(ptr == NULL){
+        return mkmshar_arena_alloc(userdata, size);
+    }
+
+    old = *mkmshar_arena_sizeof(ptr);
+
+    /* the newest allocation just moves the end of the chunk */
+    if((char*) ptr == arena->last){
+        size_t start = (size_t) (((char*) ptr) - ((char*) arena->top) - MXPSQL_MShar_ARENA_HEADER);
+        size_t grown = MXPSQL_MShar_ARENA_ALIGN(size);
+        if(grown >= size && grown <= arena->top->cap - start){
+            arena->top->used = start + grown;
+            *mkmshar_arena_sizeof(ptr) = size;
+            return ptr;
+        }
+    }
+
+    nptr = (char*) mkmshar_arena_alloc(userdata, size);
+    if(nptr == NULL){
+        return NULL;
+    }
+    memcpy(nptr, ptr, (old < size) ? old : size);
+    return nptr;
+}
+
+static void mkmshar_arena_release(void* userdata, void* ptr){
+    mkmshar_arena* arena = (mkmshar_arena*) userdata;
+
+    if((char*) ptr == arena->last){
+        arena->top->used = (size_t) (((char*) ptr) - ((char*) arena->top) - MXPSQL_MShar_ARENA_HEADER) - MXPSQL_MShar_ARENA_ALIGN(sizeof(size_t));
+        arena->last = NULL;
+    }
+}
+
+static void mkmshar_arena_init(mkmshar_arena* arena, const mkmshar_allocator* backing){
+    arena->face.alloc = mkmshar_arena_alloc;
+    arena->face.resize = mkmshar_arena_resize;
+    arena->face.release = mkmshar_arena_release;
+    arena->face.userdata = arena;
+    arena->backing = backing;
+    arena->top = NULL;
+    arena->total = 0;
+    arena->last = NULL;
+}
+
+static void mkmshar_arena_free(mkmshar_arena* arena){
+    while(arena->top != NULL){
+        mkmshar_arena_chunk* prev = arena->top->prev;
+        arena->backing->release(arena->backing->userdata, arena->top);
+        arena->top = prev;
+    }
+    arena->total = 0;
+    arena->last = NULL;
+}
+
+/* forget everything handed out, memory is kept for the next file */
+static void mkmshar_arena_reset(mkmshar_arena* arena){
+    if(arena->top != NULL && arena->top->prev != NULL){
+        size_t total = arena->total;
+        mkmshar_arena_free(arena);
+
+        /* if this fails the next allocation just tries again */
+        arena->top = (mkmshar_arena_chunk*) arena->backing->alloc(arena->backing->userdata, MXPSQL_MShar_ARENA_HEADER + total);
+        if(arena->top != NULL){
+            arena->top->prev = NULL;
+            arena->top->cap = total;
+            arena->total = total;
+        }
+    }
+
+    if(arena->top != NULL) arena->top->used = 0;
+    arena->last = NULL;
+}
+
+int mkmshar_fileInfo(FILE* fptr, mkmshar_fileinfo* info){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    info->size = 0;
+    info->sized = 0;
+    info->regular = 0;
+
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    {
+        struct stat st;
+        if(fstat(fileno(fptr), &st) == 0){
+            /* too big to map or hold in a size_t (32 bit), stream it like a pipe */
+            if(S_ISREG(st.st_mode) && (st.st_size < 0 || (off_t) (size_t) st.st_size != st.st_size)){
+                info->regular = 1;
+                return 0;
+            }
+            if(S_ISREG(st.st_mode)){
+                info->size = (size_t) st.st_size;
+                info->sized = 1;
+                info->regular = 1;
+            }
+            /* pipes and special files cannot be rewound, they are just read until EOF */
+            return 0;
+        }
+    }
+    #endif
+
+    /* Read until the end and get the size as C++ does not need to implement SEEK_END */
+    {
+        long int ifsize = 0;
+
+        while(fgetc(fptr) != EOF || ferror(fptr)){;} /* this may seem hacky, convoluted and unsophisticated, but it is portable and sophisticated due to C++ not mandating to implement SEEK_END just like the comment before (no longer existing). 
+        All you do is read until you reach EOF, then get the file size and return to beginning. 
+        This will also return if an error occured.
+        */
+
+        if(ferror(fptr) || fseek(fptr, 0, SEEK_CUR) != 0){
+            return -1;
+        }
+
+        ifsize = ftell(fptr);
+        if(ifsize < 0){
+            return -1;
+        }
+
+        if(fseek(fptr, 0, SEEK_SET) != 0 || ferror(fptr) != 0){
+            return -1;
+        }
+
+        info->size = (size_t) ifsize;
+        info->sized = 1;
+        info->regular = 1;
+    }
+
+    return 0;
+}
+
+/* phases of mkmshar_stats, in the order of its fields */
+#define MXPSQL_MShar_PHASE_OPEN 0
+#define MXPSQL_MShar_PHASE_READ 1
+#define MXPSQL_MShar_PHASE_BASE64 2
+#define MXPSQL_MShar_PHASE_FORMAT 3
+#define MXPSQL_MShar_PHASE_OUTPUT 4
+#define MXPSQL_MShar_PHASE_COMPRESS 5
+#define MXPSQL_MShar_PHASE_DEDUP 6
+#define MXPSQL_MShar_PHASES 7
+
+/* phase clock of one thread, the clock is only read when on is set */
+typedef struct mkmshar_meter {
+    int on;
+    double phase[MXPSQL_MShar_PHASES];
+} mkmshar_meter;
+
+/* seconds from some fixed point, monotonic where POSIX has it and processor time elsewhere */
+static double mkmshar_now(void){
+    #if defined(MXPSQL_MShar_OS_POSIX_SUS) && defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+    #else
+    return (double) clock() / CLOCKS_PER_SEC;
+    #endif
+}
+
+static void mkmshar_meter_init(mkmshar_meter* meter, int on){
+    int i;
+    meter->on = on;
+    for(i = 0; i < MXPSQL_MShar_PHASES; i++) meter->phase[i] = 0.0;
+}
+
+static double mkmshar_meter_start(const mkmshar_meter* meter){
+    return meter->on ? mkmshar_now() : 0.0;
+}
+
+static void mkmshar_meter_stop(mkmshar_meter* meter, int phase, double start){
+    if(meter->on) meter->phase[phase] += mkmshar_now() - start;
+}
+
+/* DEFLATE (RFC 1951) in a gzip (RFC 1952) wrapper, enough of a compressor for gzip -dc to undo, no zlib needed */
+#define MXPSQL_MShar_Z_WSIZE 32768
+#define MXPSQL_MShar_Z_MINMATCH 3
+#define MXPSQL_MShar_Z_MAXMATCH 258
+#define MXPSQL_MShar_Z_LOOKAHEAD (MXPSQL_MShar_Z_MAXMATCH + MXPSQL_MShar_Z_MINMATCH + 1)
+#define MXPSQL_MShar_Z_MAXDIST (MXPSQL_MShar_Z_WSIZE - MXPSQL_MShar_Z_LOOKAHEAD)
+#define MXPSQL_MShar_Z_HASHBITS 15
+#define MXPSQL_MShar_Z_SYMBOLS 16384
+/* zlib level 6: give up lazy matching past 16, search less past 8, stop at 128, follow 128 links */
+#define MXPSQL_MShar_Z_LAZY 16
+#define MXPSQL_MShar_Z_GOOD 8
+#define MXPSQL_MShar_Z_NICE 128
+#define MXPSQL_MShar_Z_CHAIN 128
+/* how much of a file is compressed before deciding whether it is worth it */
+#define MXPSQL_MShar_Z_PROBE 65536
+/* files known to be smaller than this are never compressed, the gzip framing and the extra gzip run on extraction eat whatever it saves */
+#define MXPSQL_MShar_Z_MIN 128
+
+static const unsigned short mkmshar_z_lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char mkmshar_z_lext[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short mkmshar_z_dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char mkmshar_z_dext[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const unsigned char mkmshar_z_clorder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+/**
+ * @brief Streaming gzip compressor, LZ77 over a 32 KB window with lazy matching, each block goes out as dynamic Huffman, fixed Huffman or stored, whichever is smallest.
+ *
+ * @details The compressed bytes pile up in out, take them from there between mkmshar_deflate_write calls.
+ */
+typedef struct mkmshar_deflate {
+    const mkmshar_allocator* a;
+    void* mem;
+    unsigned char* win; /* two windows, the upper one is slid down when full */
+    unsigned short* head; /* newest position of each hash, 0 for none */
+    unsigned short* prev; /* older positions with the same hash */
+    unsigned short* lbuf; /* literal, or match length - 3 */
+    unsigned short* dbuf; /* match distance, 0 for a literal */
+    size_t nsym;
+    size_t strstart;
+    size_t lookahead;
+    size_t block_start; /* first byte of the block being collected */
+    size_t tallied; /* bytes up to here are in lbuf and dbuf */
+    size_t match_length;
+    size_t match_start;
+    size_t prev_length;
+    size_t prev_match;
+    int match_available;
+    unsigned long bitbuf;
+    int bitcnt;
+    unsigned long crc;
+    unsigned long isize;
+    size_t covered; /* input bytes in blocks already in out */
+    unsigned char lcode[256];
+    unsigned char dcode[512];
+    unsigned long crctab[256];
+    mkmshar_buf out;
+} mkmshar_deflate;
+
+static size_t mkmshar_z_hash(const unsigned char* p){
+    unsigned long v = (unsigned long) p[0] | ((unsigned long) p[1] << 8) | ((unsigned long) p[2] << 16);
+    return (size_t) (((v * 0x9E3779B1UL) & 0xFFFFFFFFUL) >> (32 - MXPSQL_MShar_Z_HASHBITS));
+}
+
+static size_t mkmshar_z_dist(const mkmshar_deflate* z, size_t dist){
+    return (dist - 1 < 256) ? z->dcode[dist - 1] : z->dcode[256 + ((dist - 1) >> 7)];
+}
+
+/* lengths of a Huffman code for freq that fit in maxbits, frequencies are halved until they do */
+static void mkmshar_z_lengths(const unsigned long* freq, int n, int maxbits, unsigned char* lens){
+    unsigned long f[288];
+    unsigned long w[576];
+    int sym[288];
+    int parent[576];
+    int depth[576];
+    int m = 0;
+    int i;
+
+    for(i = 0; i < n; i++){
+        f[i] = freq[i];
+        lens[i] = 0;
+        if(f[i] > 0) m++;
+    }
+    /* a code needs two symbols, the extra one is never used */
+    for(i = 0; m < 2 && i < n; i++){
+        if(f[i] == 0){
+            f[i] = 1;
+            m++;
+        }
+    }
+
+    for(;;){
+        int li = 0, qi, ni, maxd = 0;
+
+        /* leaves by weight, few enough for an insertion sort */
+        m = 0;
+        for(i = 0; i < n; i++){
+            int j = m++;
+            if(f[i] == 0){
+                m--;
+                continue;
+            }
+            while(j > 0 && f[sym[j - 1]] > f[i]){
+                sym[j] = sym[j - 1];
+                j--;
+            }
+            sym[j] = i;
+        }
+        for(i = 0; i < m; i++) w[i] = f[sym[i]];
+
+        /* two queues, the leaves and the joined nodes, both already in order */
+        qi = m;
+        for(ni = m; ni < 2 * m - 1; ni++){
+            int k, pick[2];
+            for(k = 0; k < 2; k++){
+                if(li < m && (qi >= ni || w[li] <= w[qi])) pick[k] = li++;
+                else pick[k] = qi++;
+            }
+            w[ni] = w[pick[0]] + w[pick[1]];
+            parent[pick[0]] = ni;
+            parent[pick[1]] = ni;
+        }
+
+        depth[2 * m - 2] = 0;
+        for(i = 2 * m - 3; i >= 0; i--){
+            depth[i] = depth[parent[i]] + 1;
+        }
+        for(i = 0; i < m; i++){
+            if(depth[i] > maxd) maxd = depth[i];
+        }
+        if(maxd <= maxbits){
+            for(i = 0; i < m; i++) lens[sym[i]] = (unsigned char) depth[i];
+            return;
+        }
+
+        for(i = 0; i < n; i++){
+            if(f[i] > 0) f[i] = (f[i] + 1) / 2;
+        }
+    }
+}
+
+/* canonical codes for lens, bit reversed as deflate sends codes from their top bit but packs from the bottom */
+static void mkmshar_z_codes(const unsigned char* lens, int n, unsigned short* codes){
+    unsigned short count[16];
+    unsigned short next[16];
+    unsigned short code = 0;
+    int i;
+
+    memset(count, 0, sizeof(count));
+    for(i = 0; i < n; i++) count[lens[i]]++;
+    count[0] = 0;
+    for(i = 1; i < 16; i++){
+        code = (unsigned short) ((code + count[i - 1]) << 1);
+        next[i] = code;
+    }
+    for(i = 0; i < n; i++){
+        unsigned short c, r = 0;
+        int b;
+        if(lens[i] == 0) continue;
+        c = next[lens[i]]++;
+        for(b = 0; b < lens[i]; b++){
+            r = (unsigned short) ((r << 1) | (c & 1));
+            c >>= 1;
+        }
+        codes[i] = r;
+    }
+}
+
+/* at most 16 bits, out already has room */
+static void mkmshar_z_put(mkmshar_deflate* z, unsigned long v, int n){
+    z->bitbuf |= v << z->bitcnt;
+    z->bitcnt += n;
+    while(z->bitcnt >= 8){
+        z->out.data[z->out.len++] = (char) (z->bitbuf & 0xff);
+        z->bitbuf >>= 8;
+        z->bitcnt -= 8;
+    }
+}
+
+static void mkmshar_z_align(mkmshar_deflate* z){
+    if(z->bitcnt > 0){
+        z->out.data[z->out.len++] = (char) (z->bitbuf & 0xff);
+    }
+    z->bitbuf = 0;
+    z->bitcnt = 0;
+}
+
+/* bits the block's symbols take with these code lengths */
+static unsigned long mkmshar_z_cost(const mkmshar_deflate* z, const unsigned char* llen, const unsigned char* dlen){
+    unsigned long bits = llen[256];
+    size_t i;
+
+    for(i = 0; i < z->nsym; i++){
+        if(z->dbuf[i] == 0){
+            bits += llen[z->lbuf[i]];
+        }
+        else{
+            size_t lc = z->lcode[z->lbuf[i]];
+            size_t dc = mkmshar_z_dist(z, z->dbuf[i]);
+            bits += llen[257 + lc] + mkmshar_z_lext[lc] + dlen[dc] + mkmshar_z_dext[dc];
+        }
+    }
+    return bits;
+}
+
+static void mkmshar_z_symbols(mkmshar_deflate* z, const unsigned char* llen, const unsigned short* lcodes, const unsigned char* dlen, const unsigned short* dcodes){
+    size_t i;
+
+    for(i = 0; i < z->nsym; i++){
+        if(z->dbuf[i] == 0){
+            mkmshar_z_put(z, lcodes[z->lbuf[i]], llen[z->lbuf[i]]);
+        }
+        else{
+            size_t len = (size_t) z->lbuf[i] + 3;
+            size_t dist = z->dbuf[i];
+            size_t lc = z->lcode[z->lbuf[i]];
+            size_t dc = mkmshar_z_dist(z, dist);
+
+            mkmshar_z_put(z, lcodes[257 + lc], llen[257 + lc]);
+            if(mkmshar_z_lext[lc] > 0) mkmshar_z_put(z, (unsigned long) (len - mkmshar_z_lbase[lc]), mkmshar_z_lext[lc]);
+            mkmshar_z_put(z, dcodes[dc], dlen[dc]);
+            if(mkmshar_z_dext[dc] > 0) mkmshar_z_put(z, (unsigned long) (dist - mkmshar_z_dbase[dc]), mkmshar_z_dext[dc]);
+        }
+    }
+    mkmshar_z_put(z, lcodes[256], llen[256]);
+}
+
+/* send what was collected since block_start as one block (or a run of stored ones), whichever kind is smallest */
+static int mkmshar_z_block(mkmshar_deflate* z, int last){
+    unsigned long lfreq[286];
+    unsigned long dfreq[30];
+    unsigned long cfreq[19];
+    unsigned char llen[288];
+    unsigned char dlen[30];
+    unsigned char clen[19];
+    unsigned char flen[288];
+    unsigned char fdlen[30];
+    unsigned short lcodes[288];
+    unsigned short dcodes[30];
+    unsigned short ccodes[19];
+    unsigned char all[286 + 30];
+    unsigned char rsym[286 + 30];
+    unsigned char rext[286 + 30];
+    size_t stored = z->tallied - z->block_start;
+    size_t nchunks = (stored == 0) ? 1 : (stored + 65534) / 65535;
+    unsigned long dynbits, fixbits, storebits;
+    int hlit, hdist, hclen, total, nr = 0;
+    int i;
+
+    memset(lfreq, 0, sizeof(lfreq));
+    memset(dfreq, 0, sizeof(dfreq));
+    memset(cfreq, 0, sizeof(cfreq));
+    for(i = 0; (size_t) i < z->nsym; i++){
+        if(z->dbuf[i] == 0){
+            lfreq[z->lbuf[i]]++;
+        }
+        else{
+            lfreq[257 + z->lcode[z->lbuf[i]]]++;
+            dfreq[mkmshar_z_dist(z, z->dbuf[i])]++;
+        }
+    }
+    lfreq[256] = 1;
+
+    mkmshar_z_lengths(lfreq, 286, 15, llen);
+    mkmshar_z_lengths(dfreq, 30, 15, dlen);
+    llen[286] = llen[287] = 0;
+
+    for(hlit = 286; hlit > 257 && llen[hlit - 1] == 0; hlit--){;}
+    for(hdist = 30; hdist > 1 && dlen[hdist - 1] == 0; hdist--){;}
+
+    /* the code lengths themselves, run length coded with 16 (repeat), 17 and 18 (zeros) */
+    memcpy(all, llen, (size_t) hlit);
+    memcpy(all + hlit, dlen, (size_t) hdist);
+    total = hlit + hdist;
+    for(i = 0; i < total;){
+        int run = 1;
+        while(i + run < total && all[i + run] == all[i]) run++;
+        if(all[i] == 0 && run >= 3){
+            int r = (run > 138) ? 138 : run;
+            rsym[nr] = (unsigned char) ((r >= 11) ? 18 : 17);
+            rext[nr++] = (unsigned char) ((r >= 11) ? r - 11 : r - 3);
+            i += r;
+        }
+        else if(all[i] != 0 && run >= 4){
+            int r = (run - 1 > 6) ? 6 : run - 1;
+            rsym[nr] = all[i];
+            rext[nr++] = 0;
+            rsym[nr] = 16;
+            rext[nr++] = (unsigned char) (r - 3);
+            i += 1 + r;
+        }
+        else{
+            rsym[nr] = all[i];
+            rext[nr++] = 0;
+            i++;
+        }
+    }
+    for(i = 0; i < nr; i++) cfreq[rsym[i]]++;
+    mkmshar_z_lengths(cfreq, 19, 7, clen);
+    for(hclen = 19; hclen > 4 && clen[mkmshar_z_clorder[hclen - 1]] == 0; hclen--){;}
+
+    dynbits = 3 + 14 + 3 * (unsigned long) hclen + mkmshar_z_cost(z, llen, dlen);
+    for(i = 0; i < nr; i++){
+        dynbits += clen[rsym[i]] + ((rsym[i] == 16) ? 2 : (rsym[i] == 17) ? 3 : (rsym[i] == 18) ? 7 : 0);
+    }
+
+    for(i = 0; i < 288; i++) flen[i] = (unsigned char) ((i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8);
+    for(i = 0; i < 30; i++) fdlen[i] = 5;
+    fixbits = 3 + mkmshar_z_cost(z, flen, fdlen);
+
+    storebits = (unsigned long) nchunks * (3 + 7 + 32) + 8 * (unsigned long) stored;
+
+    if(mkmshar_buf_reserve(&z->out, stored + nchunks * 5 + z->nsym * 6 + 1024) != 0){
+        return -1;
+    }
+
+    if(storebits <= fixbits && storebits <= dynbits){
+        const unsigned char* p = z->win + z->block_start;
+        size_t left = stored;
+        do{
+            size_t n = (left > 65535) ? 65535 : left;
+            left -= n;
+            mkmshar_z_put(z, (unsigned long) (last && left == 0), 1);
+            mkmshar_z_put(z, 0, 2);
+            mkmshar_z_align(z);
+            z->out.data[z->out.len++] = (char) (n & 0xff);
+            z->out.data[z->out.len++] = (char) (n >> 8);
+            z->out.data[z->out.len++] = (char) (~n & 0xff);
+            z->out.data[z->out.len++] = (char) ((~n >> 8) & 0xff);
+            memcpy(z->out.data + z->out.len, p, n);
+            z->out.len += n;
+            p += n;
+        } while(left > 0);
+    }
+    else if(fixbits <= dynbits){
+        mkmshar_z_codes(flen, 288, lcodes);
+        mkmshar_z_codes(fdlen, 30, dcodes);
+        mkmshar_z_put(z, (unsigned long) last, 1);
+        mkmshar_z_put(z, 1, 2);
+        mkmshar_z_symbols(z, flen, lcodes, fdlen, dcodes);
+    }
+    else{
+        mkmshar_z_codes(llen, 286, lcodes);
+        mkmshar_z_codes(dlen, 30, dcodes);
+        mkmshar_z_codes(clen, 19, ccodes);
+        mkmshar_z_put(z, (unsigned long) last, 1);
+        mkmshar_z_put(z, 2, 2);
+        mkmshar_z_put(z, (unsigned long) (hlit - 257), 5);
+        mkmshar_z_put(z, (unsigned long) (hdist - 1), 5);
+        mkmshar_z_put(z, (unsigned long) (hclen - 4), 4);
+        for(i = 0; i < hclen; i++) mkmshar_z_put(z, clen[mkmshar_z_clorder[i]], 3);
+        for(i = 0; i < nr; i++){
+            mkmshar_z_put(z, ccodes[rsym[i]], clen[rsym[i]]);
+            if(rsym[i] == 16) mkmshar_z_put(z, rext[i], 2);
+            else if(rsym[i] == 17) mkmshar_z_put(z, rext[i], 3);
+            else if(rsym[i] == 18) mkmshar_z_put(z, rext[i], 7);
+        }
+        mkmshar_z_symbols(z, llen, lcodes, dlen, dcodes);
+    }
+
+    z->covered += stored;
+    z->block_start = z->tallied;
+    z->nsym = 0;
+    return 0;
+}
+
+static void mkmshar_z_insert(mkmshar_deflate* z, size_t pos){
+    size_t h = mkmshar_z_hash(z->win + pos);
+    z->prev[pos & (MXPSQL_MShar_Z_WSIZE - 1)] = z->head[h];
+    z->head[h] = (unsigned short) pos;
+}
+
+/* longest match for strstart along the hash chain from cur, sets match_start */
+static size_t mkmshar_z_longest(mkmshar_deflate* z, size_t cur){
+    const unsigned char* scan = z->win + z->strstart;
+    size_t chain = MXPSQL_MShar_Z_CHAIN;
+    size_t limit = (z->strstart > MXPSQL_MShar_Z_MAXDIST) ? z->strstart - MXPSQL_MShar_Z_MAXDIST : 0;
+    size_t maxlen = (z->lookahead < MXPSQL_MShar_Z_MAXMATCH) ? z->lookahead : MXPSQL_MShar_Z_MAXMATCH;
+    size_t best = z->prev_length;
+
+    if(best >= maxlen) return best;
+    if(z->prev_length >= MXPSQL_MShar_Z_GOOD) chain >>= 2;
+
+    do{
+        const unsigned char* match = z->win + cur;
+        size_t len;
+
+        if(match[best] != scan[best] || match[0] != scan[0] || match[1] != scan[1]) continue;
+        for(len = 2; len < maxlen && match[len] == scan[len]; len++){;}
+        if(len > best){
+            z->match_start = cur;
+            best = len;
+            if(len >= MXPSQL_MShar_Z_NICE || len >= maxlen) break;
+        }
+    } while((cur = z->prev[cur & (MXPSQL_MShar_Z_WSIZE - 1)]) > limit && --chain != 0);
+
+    return best;
+}
+
+/* LZ77 over the lookahead, all of it when flushing, otherwise while a whole match still fits */
+static int mkmshar_z_run(mkmshar_deflate* z, int flush){
+    for(;;){
+        size_t hash_head = 0;
+
+        if(z->lookahead < MXPSQL_MShar_Z_LOOKAHEAD && !flush) return 0;
+        if(z->lookahead == 0) break;
+
+        if(z->lookahead >= MXPSQL_MShar_Z_MINMATCH){
+            hash_head = z->head[mkmshar_z_hash(z->win + z->strstart)];
+            mkmshar_z_insert(z, z->strstart);
+        }
+
+        z->prev_length = z->match_length;
+        z->prev_match = z->match_start;
+        z->match_length = MXPSQL_MShar_Z_MINMATCH - 1;
+
+        /* strictly inside the distance so a slide never leaves prev_match below 0 */
+        if(hash_head != 0 && z->prev_length < MXPSQL_MShar_Z_LAZY && z->strstart - hash_head < MXPSQL_MShar_Z_MAXDIST){
+            z->match_length = mkmshar_z_longest(z, hash_head);
+            /* a 3 byte match far away costs more than 3 literals */
+            if(z->match_length == MXPSQL_MShar_Z_MINMATCH && z->strstart - z->match_start > 4096){
+                z->match_length = MXPSQL_MShar_Z_MINMATCH - 1;
+            }
+        }
+
+        if(z->prev_length >= MXPSQL_MShar_Z_MINMATCH && z->match_length <= z->prev_length){
+            /* the match at the previous byte wins */
+            size_t max_insert = z->strstart + z->lookahead - MXPSQL_MShar_Z_MINMATCH;
+            size_t n = z->prev_length - 2;
+
+            z->lbuf[z->nsym] = (unsigned short) (z->prev_length - 3);
+            z->dbuf[z->nsym++] = (unsigned short) (z->strstart - 1 - z->prev_match);
+            z->tallied += z->prev_length;
+            z->lookahead -= z->prev_length - 1;
+            while(n-- > 0){
+                if(++z->strstart <= max_insert) mkmshar_z_insert(z, z->strstart);
+            }
+            z->match_available = 0;
+            z->match_length = MXPSQL_MShar_Z_MINMATCH - 1;
+            z->strstart++;
+        }
+        else if(z->match_available){
+            z->lbuf[z->nsym] = z->win[z->strstart - 1];
+            z->dbuf[z->nsym++] = 0;
+            z->tallied++;
+            z->strstart++;
+            z->lookahead--;
+        }
+        else{
+            z->match_available = 1;
+            z->strstart++;
+            z->lookahead--;
+        }
+
+        if(z->nsym == MXPSQL_MShar_Z_SYMBOLS && mkmshar_z_block(z, 0) != 0){
+            return -1;
+        }
+    }
+
+    if(z->match_available){
+        z->lbuf[z->nsym] = z->win[z->strstart - 1];
+        z->dbuf[z->nsym++] = 0;
+        z->tallied++;
+        z->match_available = 0;
+    }
+    return 0;
+}
+
+/* the upper window becomes the lower one, the block ends here so its bytes stay around for a stored block */
+static int mkmshar_z_slide(mkmshar_deflate* z){
+    size_t i;
+
+    if(mkmshar_z_block(z, 0) != 0){
+        return -1;
+    }
+    memcpy(z->win, z->win + MXPSQL_MShar_Z_WSIZE, MXPSQL_MShar_Z_WSIZE);
+    z->strstart -= MXPSQL_MShar_Z_WSIZE;
+    z->block_start -= MXPSQL_MShar_Z_WSIZE;
+    z->tallied -= MXPSQL_MShar_Z_WSIZE;
+    z->match_start -= MXPSQL_MShar_Z_WSIZE;
+    z->prev_match -= MXPSQL_MShar_Z_WSIZE;
+    for(i = 0; i < ((size_t) 1 << MXPSQL_MShar_Z_HASHBITS); i++){
+        z->head[i] = (unsigned short) ((z->head[i] >= MXPSQL_MShar_Z_WSIZE) ? z->head[i] - MXPSQL_MShar_Z_WSIZE : 0);
+    }
+    for(i = 0; i < MXPSQL_MShar_Z_WSIZE; i++){
+        z->prev[i] = (unsigned short) ((z->prev[i] >= MXPSQL_MShar_Z_WSIZE) ? z->prev[i] - MXPSQL_MShar_Z_WSIZE : 0);
+    }
+    return 0;
+}
+
+/* ready for a new gzip member, the tables are kept */
+static int mkmshar_deflate_reset(mkmshar_deflate* z){
+    static const char header[10] = {(char) 0x1f, (char) 0x8b, 8, 0, 0, 0, 0, 0, 0, (char) 0xff};
+
+    /* prev is not cleared, a link is only followed from a position that was inserted, which set it */
+    memset(z->head, 0, sizeof(unsigned short) << MXPSQL_MShar_Z_HASHBITS);
+    z->nsym = 0;
+    z->strstart = 0;
+    z->lookahead = 0;
+    z->block_start = 0;
+    z->tallied = 0;
+    z->match_length = MXPSQL_MShar_Z_MINMATCH - 1;
+    z->match_start = 0;
+    z->prev_length = MXPSQL_MShar_Z_MINMATCH - 1;
+    z->prev_match = 0;
+    z->match_available = 0;
+    z->bitbuf = 0;
+    z->bitcnt = 0;
+    z->crc = 0xFFFFFFFFUL;
+    z->isize = 0;
+    z->covered = 0;
+    z->out.len = 0;
+    return mkmshar_buf_append(&z->out, header, sizeof(header));
+}
+
+/**
+ * @brief Set up a compressor, all of its memory (about 256 KB plus out) comes from a.
+ *
+ * @return int 0, or -1 if there is no memory
+ */
+static int mkmshar_deflate_init(mkmshar_deflate* z, const mkmshar_allocator* a){
+    size_t tables = (sizeof(unsigned short) << MXPSQL_MShar_Z_HASHBITS) + sizeof(unsigned short) * (MXPSQL_MShar_Z_WSIZE + 2 * MXPSQL_MShar_Z_SYMBOLS);
+    unsigned char* mem;
+    size_t i;
+
+    z->a = a;
+    mkmshar_buf_init(&z->out, a);
+    z->mem = a->alloc(a->userdata, tables + 2 * MXPSQL_MShar_Z_WSIZE);
+    if(z->mem == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    mem = (unsigned char*) z->mem;
+    z->head = (unsigned short*) mem;
+    z->prev = z->head + ((size_t) 1 << MXPSQL_MShar_Z_HASHBITS);
+    z->lbuf = z->prev + MXPSQL_MShar_Z_WSIZE;
+    z->dbuf = z->lbuf + MXPSQL_MShar_Z_SYMBOLS;
+    z->win = mem + tables;
+
+    for(i = 0; i < 28; i++){
+        size_t l;
+        for(l = mkmshar_z_lbase[i]; l < (size_t) mkmshar_z_lbase[i] + ((size_t) 1 << mkmshar_z_lext[i]) && l <= 258; l++){
+            z->lcode[l - 3] = (unsigned char) i;
+        }
+    }
+    z->lcode[258 - 3] = 28;
+    for(i = 0; i < 30; i++){
+        size_t d;
+        for(d = (size_t) mkmshar_z_dbase[i] - 1; d < (size_t) mkmshar_z_dbase[i] - 1 + ((size_t) 1 << mkmshar_z_dext[i]); d++){
+            if(d < 256) z->dcode[d] = (unsigned char) i;
+            else z->dcode[256 + (d >> 7)] = (unsigned char) i;
+        }
+    }
+    for(i = 0; i < 256; i++){
+        unsigned long c = (unsigned long) i;
+        int k;
+        for(k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+        z->crctab[i] = c;
+    }
+
+    if(mkmshar_deflate_reset(z) != 0){
+        a->release(a->userdata, z->mem);
+        z->mem = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void mkmshar_deflate_free(mkmshar_deflate* z){
+    if(z->mem != NULL) z->a->release(z->a->userdata, z->mem);
+    z->mem = NULL;
+    mkmshar_buf_free(&z->out);
+}
+
+/**
+ * @brief Compress n more bytes, whole blocks land in z->out as they fill up.
+ *
+ * @return int 0, or -1 if out cannot grow
+ */
+static int mkmshar_deflate_write(mkmshar_deflate* z, const char* data, size_t n){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const unsigned char* p = (const unsigned char*) data;
+    unsigned long crc = z->crc;
+    size_t i;
+
+    for(i = 0; i < n; i++) crc = z->crctab[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    z->crc = crc;
+    z->isize = (z->isize + (unsigned long) n) & 0xFFFFFFFFUL;
+
+    while(n > 0){
+        size_t space = 2 * MXPSQL_MShar_Z_WSIZE - (z->strstart + z->lookahead);
+        size_t k;
+
+        if(space == 0){
+            if(mkmshar_z_slide(z) != 0) return -1;
+            space = MXPSQL_MShar_Z_WSIZE;
+        }
+        k = (n < space) ? n : space;
+        memcpy(z->win + z->strstart + z->lookahead, p, k);
+        z->lookahead += k;
+        p += k;
+        n -= k;
+        if(mkmshar_z_run(z, 0) != 0) return -1;
+    }
+    return 0;
+}
+
+/* end the current block early (not the stream), so covered and out say how well it is going */
+static int mkmshar_deflate_flush(mkmshar_deflate* z){
+    return (z->tallied > z->block_start) ? mkmshar_z_block(z, 0) : 0;
+}
+
+/**
+ * @brief Compress what is left and end the gzip member with its CRC-32 and size.
+ *
+ * @return int 0, or -1 if out cannot grow
+ */
+static int mkmshar_deflate_finish(mkmshar_deflate* z){
+    unsigned long crc = z->crc ^ 0xFFFFFFFFUL;
+    int i;
+
+    if(mkmshar_z_run(z, 1) != 0 || mkmshar_z_block(z, 1) != 0 || mkmshar_buf_reserve(&z->out, 9) != 0){
+        return -1;
+    }
+    mkmshar_z_align(z);
+    for(i = 0; i < 4; i++) z->out.data[z->out.len++] = (char) ((crc >> (8 * i)) & 0xff);
+    for(i = 0; i < 4; i++) z->out.data[z->out.len++] = (char) ((z->isize >> (8 * i)) & 0xff);
+    return 0;
+}
+
+/*
+ * Inflate (RFC 1951) of a whole gzip (RFC 1952) member that is already in memory, so mkmshar_unshar needs no gzip either.
+ * What comes out goes to a writer a chunk at a time, only the last MXPSQL_MShar_Z_WSIZE bytes are kept for matches to copy from.
+ * Codes of up to MXPSQL_MShar_ZI_FASTBITS bits take one table lookup, longer ones are found a bit at a time like zlib's puff does.
+ */
+#define MXPSQL_MShar_ZI_FASTBITS 10
+
+/* a canonical Huffman code */
+typedef struct mkmshar_huff {
+    unsigned short count[16]; /* codes of each length, count[0] is the unused symbols */
+    unsigned short symbol[288]; /* symbols ordered by code */
+    unsigned short fast[1 << MXPSQL_MShar_ZI_FASTBITS]; /* symbol | length << 9 by the next bits of input, 0 if the code is longer */
+} mkmshar_huff;
+
+typedef struct mkmshar_inflate {
+    const unsigned char* in;
+    size_t inlen;
+    size_t pos;
+    unsigned long bitbuf;
+    int bitcnt;
+    unsigned char* win; /* the kept window, then what is not written yet */
+    size_t wlen;
+    size_t total;
+    unsigned long crc;
+    mkmshar_huff lencode;
+    mkmshar_huff distcode;
+    unsigned long crctab[256];
+    mkmshar_write_func writer;
+    void* userdata;
+    int failed; /* the writer failed, as opposed to the data being bad */
+} mkmshar_inflate;
+
+/* room in win, a whole match always fits after a check against MXPSQL_MShar_Z_MAXMATCH */
+#define MXPSQL_MShar_ZI_WINSIZE (MXPSQL_MShar_Z_WSIZE + MXPSQL_MShar_CHUNK_SIZE)
+
+/* n more bits (up to 16) into bitbuf, -1 if the input ends first */
+static int mkmshar_zi_need(mkmshar_inflate* z, int n){
+    while(z->bitcnt < n){
+        if(z->pos >= z->inlen){
+            return -1;
+        }
+        z->bitbuf |= (unsigned long) z->in[z->pos++] << z->bitcnt;
+        z->bitcnt += 8;
+    }
+    return 0;
+}
+
+static unsigned long mkmshar_zi_take(mkmshar_inflate* z, int n){
+    unsigned long v = z->bitbuf & ((1UL << n) - 1);
+    z->bitbuf >>= n;
+    z->bitcnt -= n;
+    return v;
+}
+
+/* the code with lens[i] bits for symbol i, -1 if there are more codes than lengths allow (fewer is fine, the missing ones are errors when met) */
+static int mkmshar_zi_build(mkmshar_huff* h, const unsigned char* lens, int n){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    unsigned short offs[16];
+    unsigned short next[16];
+    unsigned short code = 0;
+    long left = 1;
+    int len, sym;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for(sym = 0; sym < n; sym++) h->count[lens[sym]]++;
+
+    for(len = 1; len < 16; len++){
+        left = (left << 1) - h->count[len];
+        if(left < 0) return -1;
+    }
+
+    offs[1] = 0;
+    for(len = 1; len < 15; len++) offs[len + 1] = (unsigned short) (offs[len] + h->count[len]);
+    for(len = 1; len < 16; len++){
+        next[len] = code;
+        code = (unsigned short) ((code + h->count[len]) << 1);
+    }
+
+    for(sym = 0; sym < n; sym++){
+        unsigned rev = 0;
+        unsigned c;
+        int k;
+
+        len = lens[sym];
+        if(len == 0) continue;
+        h->symbol[offs[len]++] = (unsigned short) sym;
+        c = next[len]++;
+        if(len > MXPSQL_MShar_ZI_FASTBITS) continue;
+        /* codes go in first bit highest, bits come out of bitbuf lowest first */
+        for(k = 0; k < len; k++) rev |= ((c >> k) & 1) << (len - 1 - k);
+        for(; rev < (1U << MXPSQL_MShar_ZI_FASTBITS); rev += 1U << len) h->fast[rev] = (unsigned short) (sym | (len << 9));
+    }
+    return 0;
+}
+
+/* the next symbol of h, -1 if the input is bad or ends */
+static int mkmshar_zi_decode(mkmshar_inflate* z, const mkmshar_huff* h){
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    int len;
+    unsigned e;
+
+    while(z->bitcnt <= 24 && z->pos < z->inlen){
+        z->bitbuf |= (unsigned long) z->in[z->pos++] << z->bitcnt;
+        z->bitcnt += 8;
+    }
+    e = h->fast[z->bitbuf & ((1U << MXPSQL_MShar_ZI_FASTBITS) - 1)];
+    if(e != 0){
+        len = (int) (e >> 9);
+        if(len > z->bitcnt) return -1;
+        z->bitbuf >>= len;
+        z->bitcnt -= len;
+        return (int) (e & 0x1FF);
+    }
+
+    for(len = 1; len < 16; len++){
+        int count;
+        if(mkmshar_zi_need(z, 1) != 0) return -1;
+        code |= (int) mkmshar_zi_take(z, 1);
+        count = h->count[len];
+        if(code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/* hand all but the last keep bytes of win to the writer */
+static int mkmshar_zi_flush(mkmshar_inflate* z, size_t keep){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    unsigned long crc = z->crc;
+    size_t n, i;
+
+    if(z->wlen <= keep) return 0;
+    n = z->wlen - keep;
+    for(i = 0; i < n; i++) crc = z->crctab[(crc ^ z->win[i]) & 0xff] ^ (crc >> 8);
+    z->crc = crc;
+    if(z->writer(z->userdata, (const char*) z->win, n) != 0){
+        z->failed = 1;
+        return -1;
+    }
+    memmove(z->win, z->win + n, keep);
+    z->wlen = keep;
+    return 0;
+}
+
+/* one stored block, the input is byte aligned from here */
+static int mkmshar_zi_stored(mkmshar_inflate* z){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t len;
+
+    /* whole bytes that were read ahead go back */
+    z->pos -= (size_t) (z->bitcnt / 8);
+    z->bitbuf = 0;
+    z->bitcnt = 0;
+    if(z->inlen - z->pos < 4) return -1;
+    len = (size_t) z->in[z->pos] | ((size_t) z->in[z->pos + 1] << 8);
+    if((len ^ ((size_t) z->in[z->pos + 2] | ((size_t) z->in[z->pos + 3] << 8))) != 0xFFFF) return -1;
+    z->pos += 4;
+    if(z->inlen - z->pos < len) return -1;
+
+    while(len > 0){
+        size_t n = MXPSQL_MShar_ZI_WINSIZE - z->wlen;
+        if(n == 0){
+            if(mkmshar_zi_flush(z, MXPSQL_MShar_Z_WSIZE) != 0) return -1;
+            continue;
+        }
+        if(n > len) n = len;
+        memcpy(z->win + z->wlen, z->in + z->pos, n);
+        z->wlen += n;
+        z->total += n;
+        z->pos += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* the symbols of one Huffman block up to its end code */
+static int mkmshar_zi_codes(mkmshar_inflate* z){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    for(;;){
+        int sym;
+        size_t len, dist;
+
+        if(z->wlen + MXPSQL_MShar_Z_MAXMATCH > MXPSQL_MShar_ZI_WINSIZE && mkmshar_zi_flush(z, MXPSQL_MShar_Z_WSIZE) != 0){
+            return -1;
+        }
+
+        sym = mkmshar_zi_decode(z, &z->lencode);
+        if(sym < 0) return -1;
+        if(sym < 256){
+            z->win[z->wlen++] = (unsigned char) sym;
+            z->total++;
+            continue;
+        }
+        if(sym == 256) return 0;
+
+        sym -= 257;
+        if(sym >= 29 || mkmshar_zi_need(z, mkmshar_z_lext[sym]) != 0) return -1;
+        len = (size_t) mkmshar_z_lbase[sym] + (size_t) mkmshar_zi_take(z, mkmshar_z_lext[sym]);
+        sym = mkmshar_zi_decode(z, &z->distcode);
+        if(sym < 0 || sym >= 30 || mkmshar_zi_need(z, mkmshar_z_dext[sym]) != 0) return -1;
+        dist = (size_t) mkmshar_z_dbase[sym] + (size_t) mkmshar_zi_take(z, mkmshar_z_dext[sym]);
+        /* a flush keeps a whole window, so anything made so far is still in win */
+        if(dist > z->total || dist > z->wlen) return -1;
+
+        if(dist >= len){
+            memcpy(z->win + z->wlen, z->win + z->wlen - dist, len);
+            z->wlen += len;
+        }
+        else{
+            size_t k;
+            for(k = 0; k < len; k++, z->wlen++) z->win[z->wlen] = z->win[z->wlen - dist];
+        }
+        z->total += len;
+    }
+}
+
+/* the code lengths of a dynamic block and its two codes */
+static int mkmshar_zi_dynamic(mkmshar_inflate* z){
+    unsigned char lens[288 + 32];
+    size_t nlen, ndist, ncode, i;
+
+    if(mkmshar_zi_need(z, 14) != 0) return -1;
+    nlen = (size_t) mkmshar_zi_take(z, 5) + 257;
+    ndist = (size_t) mkmshar_zi_take(z, 5) + 1;
+    ncode = (size_t) mkmshar_zi_take(z, 4) + 4;
+    if(nlen > 286 || ndist > 30) return -1;
+
+    for(i = 0; i < 19; i++) lens[mkmshar_z_clorder[i]] = 0;
+    for(i = 0; i < ncode; i++){
+        if(mkmshar_zi_need(z, 3) != 0) return -1;
+        lens[mkmshar_z_clorder[i]] = (unsigned char) mkmshar_zi_take(z, 3);
+    }
+    if(mkmshar_zi_build(&z->lencode, lens, 19) != 0) return -1;
+
+    for(i = 0; i < nlen + ndist;){
+        int sym = mkmshar_zi_decode(z, &z->lencode);
+        unsigned char fill = 0;
+        size_t rep;
+
+        if(sym < 0) return -1;
+        if(sym < 16){
+            lens[i++] = (unsigned char) sym;
+            continue;
+        }
+        if(sym == 16){
+            if(i == 0 || mkmshar_zi_need(z, 2) != 0) return -1;
+            fill = lens[i - 1];
+            rep = 3 + (size_t) mkmshar_zi_take(z, 2);
+        }
+        else if(sym == 17){
+            if(mkmshar_zi_need(z, 3) != 0) return -1;
+            rep = 3 + (size_t) mkmshar_zi_take(z, 3);
+        }
+        else{
+            if(mkmshar_zi_need(z, 7) != 0) return -1;
+            rep = 11 + (size_t) mkmshar_zi_take(z, 7);
+        }
+        if(i + rep > nlen + ndist) return -1;
+        while(rep-- > 0) lens[i++] = fill;
+    }
+
+    /* no end of block code, no way to end the block */
+    if(lens[256] == 0) return -1;
+    if(mkmshar_zi_build(&z->lencode, lens, (int) nlen) != 0 || mkmshar_zi_build(&z->distcode, lens + nlen, (int) ndist) != 0) return -1;
+    return mkmshar_zi_codes(z);
+}
+
+/* the fixed codes of RFC 1951 3.2.6 */
+static int mkmshar_zi_fixed(mkmshar_inflate* z){
+    unsigned char lens[288];
+    int i;
+
+    for(i = 0; i < 144; i++) lens[i] = 8;
+    for(; i < 256; i++) lens[i] = 9;
+    for(; i < 280; i++) lens[i] = 7;
+    for(; i < 288; i++) lens[i] = 8;
+    if(mkmshar_zi_build(&z->lencode, lens, 288) != 0) return -1;
+    for(i = 0; i < 30; i++) lens[i] = 5;
+    if(mkmshar_zi_build(&z->distcode, lens, 30) != 0) return -1;
+    return mkmshar_zi_codes(z);
+}
+
+/**
+ * @brief Inflate the one gzip member at in, handing what comes out to writer and checking the CRC-32 and size it ends with.
+ * 
+ * @param win room for MXPSQL_MShar_ZI_WINSIZE bytes
+ * @param size set to how many bytes came out
+ * @return int 0, 1 if the member is damaged (bad header, bad deflate data or a CRC or size that does not match), -1 if writer fails
+ */
+static int mkmshar_inflate_member(const char* in, size_t inlen, unsigned char* win, mkmshar_write_func writer, void* userdata, size_t* size){
+    mkmshar_inflate z;
+    const unsigned char* p = (const unsigned char*) in;
+    size_t pos = 10;
+    unsigned long crc = 0;
+    unsigned long isize = 0;
+    int last = 0;
+    int flags, i;
+
+    *size = 0;
+    if(inlen < 18 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8){
+        return 1;
+    }
+    flags = p[3];
+    if((flags & 4) != 0){
+        pos += 2 + ((size_t) p[10] | ((size_t) p[11] << 8));
+    }
+    /* name and comment are null terminated */
+    for(i = 8; i <= 16; i <<= 1){
+        if((flags & i) == 0) continue;
+        while(pos < inlen && p[pos] != 0) pos++;
+        pos++;
+    }
+    if((flags & 2) != 0) pos += 2;
+    if(pos + 8 > inlen){
+        return 1;
+    }
+
+    z.in = p;
+    z.inlen = inlen - 8;
+    z.pos = pos;
+    z.bitbuf = 0;
+    z.bitcnt = 0;
+    z.win = win;
+    z.wlen = 0;
+    z.total = 0;
+    z.crc = 0xFFFFFFFFUL;
+    z.writer = writer;
+    z.userdata = userdata;
+    z.failed = 0;
+    for(i = 0; i < 256; i++){
+        unsigned long c = (unsigned long) i;
+        int k;
+        for(k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+        z.crctab[i] = c;
+    }
+
+    while(!last){
+        int type;
+        int status;
+
+        if(mkmshar_zi_need(&z, 3) != 0) return 1;
+        last = (int) mkmshar_zi_take(&z, 1);
+        type = (int) mkmshar_zi_take(&z, 2);
+        if(type == 0) status = mkmshar_zi_stored(&z);
+        else if(type == 1) status = mkmshar_zi_fixed(&z);
+        else if(type == 2) status = mkmshar_zi_dynamic(&z);
+        else status = -1;
+        /* a writer that failed is not the member's fault */
+        if(status != 0) return z.failed ? -1 : 1;
+    }
+    if(mkmshar_zi_flush(&z, 0) != 0){
+        return -1;
+    }
+
+    /* what was read ahead of the last block goes back, the trailer is the next 8 bytes */
+    z.pos -= (size_t) (z.bitcnt / 8);
+    for(i = 0; i < 4; i++) crc |= (unsigned long) p[z.pos + i] << (8 * i);
+    for(i = 0; i < 4; i++) isize |= (unsigned long) p[z.pos + 4 + i] << (8 * i);
+    *size = z.total;
+    if(z.pos + 8 != inlen || crc != (z.crc ^ 0xFFFFFFFFUL) || isize != ((unsigned long) z.total & 0xFFFFFFFFUL)){
+        return 1;
+    }
+    return 0;
+}
+
+/* break the m base64 characters at text into MXPSQL_MShar_WRAP long lines in place, col is how far into its line text starts and is moved along, there has to be room for m / MXPSQL_MShar_WRAP + 1 more bytes after text, returns the new length */
+static size_t mkmshar_b64wrap(char* text, size_t m, size_t* col){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t w = MXPSQL_MShar_WRAP;
+    size_t first = w - *col;
+    size_t k, src, i;
+
+    if(m < first){
+        *col += m;
+        return m;
+    }
+
+    /* k newlines go in, move the lines back to front so every byte is moved once */
+    k = 1 + (m - first) / w;
+    src = first + (k - 1) * w;
+    *col = m - src;
+    memmove(text + src + k, text + src, m - src);
+    for(i = k; i > 0; i--){
+        size_t len = (i == 1) ? first : w;
+        text[src + i - 1] = '\n';
+        src -= len;
+        memmove(text + src + i - 1, text + src, len);
+    }
+    return m + k;
+}
+
+/* what became of one file */
+typedef struct mkmshar_fileresult {
+    size_t nbytes; /* read from it */
+    size_t packed; /* payload bytes before base64, the compressed size when compressed */
+    int compressed;
+    int duplicate; /* extracted as a copy of an earlier file */
+    unsigned long crc; /* cksum CRC of what was read, with options.checksum */
+    double seconds;
+} mkmshar_fileresult;
+
+/* bytes taken by the checksum before base64 gets them, a multiple of 3 so base64 carries nothing between pieces, small enough that the piece and its base64 stay in L1 */
+#define MXPSQL_MShar_CRC_PIECE 3072
+
+/* one file's payload on its way into the block, compressed or not, base64 encoded and maybe wrapped */
+typedef struct mkmshar_payload {
+    mkmshar_buf* block;
+    mkmshar_b64State b64;
+    size_t chunk;
+    size_t col;
+    size_t* wrap; /* NULL for one long line, &col to wrap */
+    mkmshar_deflate* z; /* not NULL while compressing, or while it is still to be decided */
+    int decided; /* the opening line is in the block */
+    int whole; /* the first write is all of the file */
+    const char* open; /* opening line of the payload */
+    const char* zopen; /* the same for a compressed payload */
+    size_t packed;
+    int flushed;
+    int sum; /* crc is kept */
+    unsigned long crc; /* cksum CRC of the file so far */
+    mkmshar_write_func writer;
+    void* userdata;
+    mkmshar_meter* meter;
+} mkmshar_payload;
+
+/* encode n more payload bytes into block, handing block to writer once a chunk worth of it is staged, sum to also take their CRC */
+static int mkmshar_stagepayload(mkmshar_payload* p, const char* data, size_t n, int sum){
+    mkmshar_buf* block = p->block;
+    size_t enc = ((n + 2) / 3) * 4;
+    size_t m;
+    double t;
+
+    t = mkmshar_meter_start(p->meter);
+    if(mkmshar_buf_reserve(block, enc + ((p->wrap != NULL) ? enc / (MXPSQL_MShar_WRAP) + 1 : 0)) != 0){
+        return -1;
+    }
+    mkmshar_meter_stop(p->meter, MXPSQL_MShar_PHASE_FORMAT, t);
+
+    t = mkmshar_meter_start(p->meter);
+    if(sum){
+        size_t off;
+
+        /* a piece at a time, it is still in L1 when base64 gets to it, so the file is only brought in once */
+        m = 0;
+        for(off = 0; off < n; off += MXPSQL_MShar_CRC_PIECE){
+            size_t k = (n - off < (size_t) (MXPSQL_MShar_CRC_PIECE)) ? n - off : (size_t) (MXPSQL_MShar_CRC_PIECE);
+            p->crc = mkmshar_cksumUpdate(p->crc, data + off, k);
+            m += mkmshar_b64Update(&p->b64, data + off, k, block->data + block->len + m);
+        }
+    }
+    else{
+        m = mkmshar_b64Update(&p->b64, data, n, block->data + block->len);
+    }
+    mkmshar_meter_stop(p->meter, MXPSQL_MShar_PHASE_BASE64, t);
+
+    if(p->wrap != NULL){
+        t = mkmshar_meter_start(p->meter);
+        m = mkmshar_b64wrap(block->data + block->len, m, p->wrap);
+        mkmshar_meter_stop(p->meter, MXPSQL_MShar_PHASE_FORMAT, t);
+    }
+    block->len += m;
+    p->packed += n;
+
+    if(block->len >= p->chunk){
+        if(p->writer(p->userdata, block->data, block->len) != 0){
+            return -1;
+        }
+        block->len = 0;
+        p->flushed = 1;
+    }
+    return 0;
+}
+
+/* stage what the compressor has made so far */
+static int mkmshar_stagedeflated(mkmshar_payload* p){
+    int ret = mkmshar_stagepayload(p, p->z->out.data, p->z->out.len, 0);
+    p->z->out.len = 0;
+    return ret;
+}
+
+/* n more bytes of the file, the first ones decide whether it is compressed (it has to get smaller) */
+static int mkmshar_payload_write(mkmshar_payload* p, const char* data, size_t n){
+    double t;
+
+    if(p->z != NULL){
+        size_t probe = (!p->decided && n > MXPSQL_MShar_Z_PROBE) ? MXPSQL_MShar_Z_PROBE : n;
+        int helps = 1;
+
+        /* a look at the start first, so an incompressible file is not compressed all the way just to be thrown away */
+        t = mkmshar_meter_start(p->meter);
+        if(mkmshar_deflate_write(p->z, data, probe) != 0){
+            return -1;
+        }
+        if(probe < n){
+            if(mkmshar_deflate_flush(p->z) != 0){
+                return -1;
+            }
+            helps = p->z->out.len < p->z->covered;
+            if(helps && mkmshar_deflate_write(p->z, data + probe, n - probe) != 0){
+                return -1;
+            }
+        }
+        if(helps && !p->decided && (p->whole ? mkmshar_deflate_finish(p->z) : mkmshar_deflate_flush(p->z)) != 0){
+            return -1;
+        }
+        mkmshar_meter_stop(p->meter, MXPSQL_MShar_PHASE_COMPRESS, t);
+
+        if(!p->decided && !(helps && (p->whole ? p->z->out.len < n : (p->z->covered > 0 && p->z->out.len < p->z->covered)))){
+            /* did not help, this file goes as it is */
+            p->z = NULL;
+        }
+    }
+
+    if(!p->decided){
+        if(mkmshar_buf_appends(p->block, (p->z != NULL) ? p->zopen : p->open) != 0){
+            return -1;
+        }
+        p->decided = 1;
+    }
+
+    if(p->z != NULL){
+        if(p->sum){
+            t = mkmshar_meter_start(p->meter);
+            p->crc = mkmshar_cksumUpdate(p->crc, data, n);
+            mkmshar_meter_stop(p->meter, MXPSQL_MShar_PHASE_COMPRESS, t);
+        }
+        return mkmshar_stagedeflated(p);
+    }
+    return mkmshar_stagepayload(p, data, n, p->sum);
+}
+
+/* a file that is all in memory, a chunk at a time */
+static int mkmshar_payload_mem(mkmshar_payload* p, const char* data, size_t size){
+    size_t off;
+    int ret = 0;
+
+    for(off = 0; off < size && ret == 0; off += p->chunk){
+        size_t n = (size - off < p->chunk) ? size - off : p->chunk;
+        ret = mkmshar_payload_write(p, data + off, n);
+    }
+    return ret;
+}
+
+/* the end of the payload, the compressor is finished (unless the file was whole already) and base64 padded */
+static int mkmshar_payload_finish(mkmshar_payload* p){
+    size_t m;
+
+    if(!p->decided){
+        /* empty, nothing to compress */
+        p->z = NULL;
+        if(mkmshar_buf_appends(p->block, p->open) != 0){
+            return -1;
+        }
+        p->decided = 1;
+    }
+    else if(p->z != NULL && !p->whole){
+        double t = mkmshar_meter_start(p->meter);
+        if(mkmshar_deflate_finish(p->z) != 0){
+            return -1;
+        }
+        mkmshar_meter_stop(p->meter, MXPSQL_MShar_PHASE_COMPRESS, t);
+        if(mkmshar_stagedeflated(p) != 0){
+            return -1;
+        }
+    }
+
+    if(mkmshar_buf_reserve(p->block, 6) != 0){
+        return -1;
+    }
+    m = mkmshar_b64Final(&p->b64, p->block->data + p->block->len);
+    if(p->wrap != NULL){
+        m = mkmshar_b64wrap(p->block->data + p->block->len, m, p->wrap);
+        /* the closing delimiter has to start a line */
+        if(p->col != 0) p->block->data[p->block->len + m++] = '\n';
+    }
+    p->block->len += m;
+    return 0;
+}
+
+/* in the header of archives with checksums, after MSHAR_STRICT is set (to 1 to stop at the first damaged file) */
+static const char mkmshar_cksumcheck[] =
+"MSHAR_BAD=;\n\
+mshar_check(){\n\
+    MSHAR_SUM=\"$(cksum < \"./$TEKTONE\")\";\n\
+    if test \"$MSHAR_SUM\" != \"$1 $2\"; then\n\
+        printf \"x - %s is damaged, cksum gives %s instead of %s %s\\n\" \"$TEKTONE\" \"$MSHAR_SUM\" \"$1\" \"$2\";\n\
+        MSHAR_BAD=1;\n\
+        if test -n \"$MSHAR_STRICT\"; then exit 1; fi\n\
+    fi\n\
+}\n\
+if ! command -v cksum > /dev/null 2>&1; then\n\
+    printf \"The cksum command is not found, the files will not be checked.\\n\";\n\
+    mshar_check(){ :; }\n\
+fi\n\
+\n";
+
+/* after the post script of archives with checksums */
+static const char mkmshar_cksumend[] =
+"if test -n \"$MSHAR_BAD\"; then\n\
+    printf \"Some files are damaged.\\n\";\n\
+    exit 1;\n\
+fi\n";
+
+/* the header part that sets up mshar_check, nothing without options.checksum */
+static int mkmshar_checkhead(const mkmshar_options* options, mkmshar_write_func writer, void* userdata){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const char* strict = (options->checksum == MXPSQL_MShar_CHECKSUM_FAILFAST) ? "MSHAR_STRICT=1;\n" : "MSHAR_STRICT=;\n";
+
+    if(options->checksum == MXPSQL_MShar_CHECKSUM_OFF){
+        return 0;
+    }
+    if(writer(userdata, strict, strlen(strict)) != 0){
+        return -1;
+    }
+    return writer(userdata, mkmshar_cksumcheck, strlen(mkmshar_cksumcheck));
+}
+
+/* the line that checks the file just extracted */
+static int mkmshar_checkline(mkmshar_buf* block, unsigned long crc, size_t size){
+    if(mkmshar_buf_appends(block, "mshar_check ") != 0 || mkmshar_buf_appendul(block, (size_t) crc) != 0 || mkmshar_buf_append(block, " ", 1) != 0
+        || mkmshar_buf_appendul(block, size) != 0 || mkmshar_buf_appends(block, ";\n\n") != 0){
+        return -1;
+    }
+    return 0;
+}
+
+/* the pieces of the blocks mkmshar_emitfile writes, see mkmshar_blocklen */
+static const char mkmshar_blk_name1[] = "TEKTONE='";
+static const char mkmshar_blk_name2[] = "'\n";
+static const char mkmshar_blk_dirname[] =
+"DIRNAME=\"./$(dirname \"$TEKTONE\")\"\n\
+mkdir -p \"$DIRNAME\" 2> /dev/null;\
+\n";
+static const char mkmshar_blk_info[] = "printf \"x - %s\\n\" \"$TEKTONE\";\n";
+static const char mkmshar_blk_marker[] = "#@EE\n";
+static const char mkmshar_blk_printf1[] = "printf '%s' '";
+static const char mkmshar_blk_printf2[] = "' > \"./$TEKTONE\";\n";
+static const char mkmshar_blk_decode[] =
+"tmp=$(mktemp);\n\
+\"$TTk\" -d \"./$TEKTONE\" > \"$tmp\";\n\
+mv \"$tmp\" \"./$TEKTONE\";\n\
+tmp=;\
+\n\n";
+static const char mkmshar_blk_decodegz[] =
+"tmp=$(mktemp);\n\
+\"$TTk\" -d \"./$TEKTONE\" | gzip -dc > \"$tmp\";\n\
+mv \"$tmp\" \"./$TEKTONE\";\n\
+tmp=;\
+\n\n";
+/* around the rest of a block of archives with options.selective, after the name */
+static const char mkmshar_blk_want[] = "if mshar_want; then\n";
+static const char mkmshar_blk_end[] = "fi\n\n";
+/* @ is not base64 so no payload line can end the heredoc early */
+static const char mkmshar_blk_heredoc1[] = "\"$TTk\" -d > \"./$TEKTONE\" <<'@MSHAR_EOF@'\n";
+static const char mkmshar_blk_heredoc1gz[] = "\"$TTk\" -d <<'@MSHAR_EOF@' | gzip -dc > \"./$TEKTONE\"\n";
+static const char mkmshar_blk_heredoc2[] = "@MSHAR_EOF@\n\n";
+/* the payload of MXPSQL_MShar_LAYOUT_TRAILER blocks, offset and length go in between */
+static const char mkmshar_blk_cut1[] = "mshar_cut ";
+static const char mkmshar_blk_cut2[] = " > \"./$TEKTONE\" || MSHAR_CUTBAD=1;\n\n";
+static const char mkmshar_blk_cut2gz[] = " | gzip -dc > \"./$TEKTONE\" || MSHAR_CUTBAD=1;\n\n";
+/* instead of the payload in mkmshar_emitcopy blocks */
+static const char mkmshar_blk_from1[] = "TEKTTWO='";
+static const char mkmshar_blk_cp[] = "cp \"./$TEKTTWO\" \"./$TEKTONE\" || MSHAR_BAD=1;\n\n";
+static const char mkmshar_blk_ln[] = "ln -f \"./$TEKTTWO\" \"./$TEKTONE\" 2> /dev/null || cp \"./$TEKTTWO\" \"./$TEKTONE\" || MSHAR_BAD=1;\n\n";
+
+/**
+ * @brief Archive one file, reading and encoding it MXPSQL_MShar_CHUNK_SIZE bytes at a time and writing the block out as it goes.
+ *
+ * @details Regular files of at least MXPSQL_MShar_MMAP_THRESHOLD bytes are mapped instead of read on POSIX.
+ *
+ * @param path the file to archive
+ * @param data the whole file if it was read already (see mkmshar_uring), NULL to open path
+ * @param size how many bytes data has
+ * @param block staging buffer for the block, it is flushed to writer whenever a chunk worth is in it, the compressor comes from its allocator too
+ * @param readbuf buffer the file is read into when it is not mapped, grown to min(file size, MXPSQL_MShar_CHUNK_SIZE)
+ * @param options layout picks how the payload is written, see MXPSQL_MShar_LAYOUT_PRINTF, compress whether it is deflated
+ * @param writer where the block goes
+ * @param userdata passed to writer
+ * @param res set to how many bytes of the file went into the block, how many came out and whether they were compressed
+ * @param meter where the open, read, compress, base64 and format time goes (the writer times itself)
+ * @return int 0 if the block was written, 1 if the file could not be read before anything was written (a file error that can be skipped), -1 on memory allocation failures, writer failures or a read error in the middle of the block
+ */
+static int mkmshar_emitfile(const char* path, const char* data, size_t size, mkmshar_buf* block, mkmshar_buf* readbuf, const mkmshar_options* options, mkmshar_write_func writer, void* userdata, mkmshar_fileresult* res, mkmshar_meter* meter){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    int heredoc = (options->layout == MXPSQL_MShar_LAYOUT_HEREDOC);
+    mkmshar_fileinfo finfo;
+    mkmshar_payload pay;
+    mkmshar_deflate z;
+    size_t chunk = MXPSQL_MShar_CHUNK_SIZE;
+    size_t nread = 0;
+    int mapped = 0;
+    int ret = 0;
+    FILE* fptr = NULL;
+    double t;
+
+    block->len = 0;
+    res->nbytes = 0;
+    res->packed = 0;
+    res->compressed = 0;
+    res->duplicate = 0;
+    res->crc = 0;
+
+    t = mkmshar_meter_start(meter);
+    if(data != NULL){
+        finfo.size = size;
+        finfo.sized = 1;
+        finfo.regular = 1;
+    }
+    else{
+        fptr = fopen(path, "rb");
+        if(fptr == NULL){
+            return 1;
+        }
+
+        if(ferror(fptr) != 0){
+            fclose(fptr);
+            return 1;
+        }
+
+        if(mkmshar_fileInfo(fptr, &finfo) != 0){
+            fclose(fptr);
+            return 1;
+        }
+    }
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_OPEN, t);
+
+    t = mkmshar_meter_start(meter);
+    /* only as big as needed, small files do not get a whole chunk */
+    if(finfo.sized && finfo.size < chunk){
+        chunk = (finfo.size > 0) ? finfo.size : 1;
+    }
+    if(mkmshar_buf_fit(block, strlen(mkmshar_blk_name1) + strlen(path) + strlen(mkmshar_blk_name2) + strlen(mkmshar_blk_want) + strlen(mkmshar_blk_dirname) + strlen(mkmshar_blk_info) + strlen(mkmshar_blk_marker) + strlen(mkmshar_blk_heredoc1gz) + ((chunk + 2) / 3) * 4 + (heredoc ? ((chunk + 2) / 3) * 4 / (MXPSQL_MShar_WRAP) + 1 : 0) + 6 + strlen(mkmshar_blk_heredoc2) + strlen(mkmshar_blk_decodegz)) != 0){
+        if(fptr != NULL) fclose(fptr);
+        return -1;
+    }
+
+    /* cannot fail, the room is already there */
+    mkmshar_buf_appends(block, mkmshar_blk_name1);
+    mkmshar_buf_appends(block, path);
+    mkmshar_buf_appends(block, mkmshar_blk_name2);
+    if(options->selective) mkmshar_buf_appends(block, mkmshar_blk_want);
+    mkmshar_buf_appends(block, mkmshar_blk_dirname);
+    mkmshar_buf_appends(block, mkmshar_blk_info);
+    mkmshar_buf_appends(block, mkmshar_blk_marker);
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_FORMAT, t);
+
+    /* the payload may contain NUL so never strlen it */
+    pay.block = block;
+    mkmshar_b64Init(&pay.b64);
+    pay.chunk = chunk;
+    pay.col = 0;
+    pay.wrap = heredoc ? &pay.col : NULL;
+    pay.z = NULL;
+    pay.decided = 0;
+    pay.whole = finfo.sized && finfo.size <= chunk;
+    pay.open = heredoc ? mkmshar_blk_heredoc1 : mkmshar_blk_printf1;
+    pay.zopen = heredoc ? mkmshar_blk_heredoc1gz : mkmshar_blk_printf1;
+    pay.packed = 0;
+    pay.flushed = 0;
+    pay.sum = (options->checksum != MXPSQL_MShar_CHECKSUM_OFF);
+    pay.crc = 0;
+    pay.writer = writer;
+    pay.userdata = userdata;
+    pay.meter = meter;
+
+    if(options->compress && !(finfo.sized && finfo.size < MXPSQL_MShar_Z_MIN)){
+        if(mkmshar_deflate_init(&z, block->a) != 0){
+            if(fptr != NULL) fclose(fptr);
+            return -1;
+        }
+        pay.z = &z;
+    }
+
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    /* big regular files are encoded straight from a read-only mapping instead of being copied into readbuf */
+    if(fptr != NULL && finfo.regular && finfo.sized && finfo.size > 0 && finfo.size >= (size_t) (MXPSQL_MShar_MMAP_THRESHOLD)){
+        void* map;
+
+        t = mkmshar_meter_start(meter);
+        map = mmap(NULL, finfo.size, PROT_READ, MAP_PRIVATE, fileno(fptr), 0);
+        if(map != MAP_FAILED){
+            #ifdef MADV_SEQUENTIAL
+            madvise(map, finfo.size, MADV_SEQUENTIAL);
+            #endif
+            mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_READ, t);
+
+            ret = mkmshar_payload_mem(&pay, (const char*) map, finfo.size);
+
+            munmap(map, finfo.size);
+            nread = finfo.size;
+            mapped = 1;
+        }
+        /* if it cannot be mapped, read it like everything else */
+    }
+    #endif
+
+    if(data != NULL){
+        ret = mkmshar_payload_mem(&pay, data, size);
+        nread = size;
+        mapped = 1;
+    }
+
+    if(!mapped && mkmshar_buf_fit(readbuf, chunk) != 0){
+        ret = -1;
+    }
+    else if(!mapped){
+        readbuf->len = 0;
+        for(;;){
+            size_t n;
+
+            t = mkmshar_meter_start(meter);
+            n = fread(readbuf->data, 1, chunk, fptr);
+            mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_READ, t);
+
+            if(n > 0){
+                nread += n;
+                if(mkmshar_payload_write(&pay, readbuf->data, n) != 0){
+                    ret = -1;
+                    break;
+                }
+            }
+
+            /* all that was sized is in, no need to ask again (and a file that grew is cut where it was sized, as when mapped) */
+            if(finfo.sized && nread == finfo.size && ferror(fptr) == 0){
+                break;
+            }
+            if(n < chunk){
+                if(ferror(fptr) != 0 || (finfo.sized && nread != finfo.size)){
+                    /* nothing written yet, it can still be skipped like any other file error */
+                    if(!pay.flushed){
+                        ret = 1;
+                    }
+                    else{
+                        errno = EIO;
+                        ret = -1;
+                    }
+                }
+                break;
+            }
+        }
+    }
+    if(fptr != NULL) fclose(fptr);
+
+    if(ret == 0){
+        t = mkmshar_meter_start(meter);
+        ret = mkmshar_payload_finish(&pay);
+        res->compressed = (pay.z != NULL);
+        if(ret == 0 && (mkmshar_buf_appends(block, heredoc ? mkmshar_blk_heredoc2 : mkmshar_blk_printf2) != 0 || (!heredoc && mkmshar_buf_appends(block, res->compressed ? mkmshar_blk_decodegz : mkmshar_blk_decode) != 0))){
+            ret = -1;
+        }
+        if(pay.sum) res->crc = mkmshar_cksumFinal(pay.crc, nread);
+        if(ret == 0 && pay.sum && mkmshar_checkline(block, res->crc, nread) != 0){
+            ret = -1;
+        }
+        if(ret == 0 && options->selective && mkmshar_buf_appends(block, mkmshar_blk_end) != 0){
+            ret = -1;
+        }
+        mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_FORMAT, t);
+    }
+    if(options->compress && !(finfo.sized && finfo.size < MXPSQL_MShar_Z_MIN)){
+        mkmshar_deflate_free(&z);
+    }
+
+    if(ret == 0 && writer(userdata, block->data, block->len) != 0){
+        ret = -1;
+    }
+    if(ret != 0){
+        return ret;
+    }
+    block->len = 0;
+    res->nbytes = nread;
+    res->packed = pay.packed;
+
+    return 0;
+}
+
+/* length of the block mkmshar_emitfile writes for size bytes that are neither compressed nor checksummed, so it is known before the file is read */
+static size_t mkmshar_blocklen(const char* path, size_t size, const mkmshar_options* options){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t enc = ((size + 2) / 3) * 4;
+    size_t len = strlen(mkmshar_blk_name1) + strlen(path) + strlen(mkmshar_blk_name2) + strlen(mkmshar_blk_dirname) + strlen(mkmshar_blk_info) + strlen(mkmshar_blk_marker);
+
+    if(options->selective){
+        len += strlen(mkmshar_blk_want) + strlen(mkmshar_blk_end);
+    }
+
+    if(options->layout == MXPSQL_MShar_LAYOUT_HEREDOC){
+        /* every line of base64 ends in a newline, the last one too */
+        return len + strlen(mkmshar_blk_heredoc1) + enc + (enc + (MXPSQL_MShar_WRAP) - 1) / (MXPSQL_MShar_WRAP) + strlen(mkmshar_blk_heredoc2);
+    }
+    return len + strlen(mkmshar_blk_printf1) + enc + strlen(mkmshar_blk_printf2) + strlen(mkmshar_blk_decode);
+}
+
+/* collects everything into one null terminated string, used by mkmshar_ctx_str */
+static int mkmshar_sink_str(void* userdata, const char* data, size_t len){
+    return mkmshar_buf_append((mkmshar_buf*) userdata, data, len);
+}
+
+/* what mkmshar_ctx_sink hands to the file emitters, the writer here already counts into the stats */
+typedef struct mkmshar_out {
+    mkmshar_ctx* ctx;
+    mkmshar_meter* meter;
+    mkmshar_write_func writer;
+    void* userdata;
+} mkmshar_out;
+
+static int mkmshar_out_write(void* userdata, const char* data, size_t len){
+    mkmshar_out* out = (mkmshar_out*) userdata;
+    double t = mkmshar_meter_start(out->meter);
+    int ret;
+
+    out->ctx->stats.bytes_out += len;
+    ret = out->writer(out->userdata, data, len);
+    mkmshar_meter_stop(out->meter, MXPSQL_MShar_PHASE_OUTPUT, t);
+    return ret;
+}
+
+/* keep the file if it is one of the slowest so far, the list stays sorted slowest first */
+static void mkmshar_slowest(mkmshar_stats* stats, const char* path, double seconds, size_t nbytes){
+    int i = MXPSQL_MShar_STATS_SLOWEST - 1;
+
+    if(i < 0 || (stats->slowest[i].path != NULL && stats->slowest[i].seconds >= seconds)){
+        return;
+    }
+    while(i > 0 && (stats->slowest[i - 1].path == NULL || stats->slowest[i - 1].seconds < seconds)){
+        stats->slowest[i] = stats->slowest[i - 1];
+        i--;
+    }
+    stats->slowest[i].path = path;
+    stats->slowest[i].seconds = seconds;
+    stats->slowest[i].bytes = nbytes;
+}
+
+/* bookkeeping for a file that is done, 0 to go on or -1 to stop */
+static int mkmshar_filedone(mkmshar_ctx* ctx, const char* path, int status, const mkmshar_fileresult* res){
+    if(status == 0){
+        ctx->stats.files++;
+        ctx->stats.bytes_in += res->nbytes;
+        ctx->stats.bytes_packed += res->packed;
+        if(res->compressed) ctx->stats.compressed++;
+        if(res->duplicate) ctx->stats.duplicates++;
+        if(ctx->options.timing) mkmshar_slowest(&ctx->stats, path, res->seconds, res->nbytes);
+        return 0;
+    }
+
+    if(status == 1 && ctx->options.ignorefileerrors != 0){
+        ctx->stats.skipped++;
+        return 0;
+    }
+
+    ctx->errpath = path;
+    return -1;
+}
+
+/* one file with its scratch (the staging block and the read buffer) taken from arena, which is reset afterwards, data is the file if it was read already */
+static int mkmshar_emitscratch(mkmshar_arena* arena, const char* path, const char* data, size_t size, const mkmshar_options* options, mkmshar_write_func writer, void* userdata, mkmshar_fileresult* res, mkmshar_meter* meter){
+    mkmshar_buf block;
+    mkmshar_buf readbuf;
+    double t = mkmshar_meter_start(meter);
+    int status;
+
+    mkmshar_buf_init(&block, &arena->face);
+    mkmshar_buf_init(&readbuf, &arena->face);
+    status = mkmshar_emitfile(path, data, size, &block, &readbuf, options, writer, userdata, res, meter);
+    mkmshar_arena_reset(arena);
+
+    res->seconds = meter->on ? mkmshar_now() - t : 0.0;
+    return status;
+}
+
+/* origin entry of a file that is not a copy of anything */
+#define MXPSQL_MShar_DUP_NONE ((size_t) -1)
+/* origin entry of a first file that could not be archived, its copies get their own payload */
+#define MXPSQL_MShar_DUP_FAILED ((size_t) -2)
+
+/* 1 if file i is to be extracted as a copy of origin[i] */
+#define MXPSQL_MShar_DUP_COPY(origin, i) ((origin) != NULL && (origin)[i] < MXPSQL_MShar_DUP_FAILED && (origin)[(origin)[i]] == MXPSQL_MShar_DUP_NONE)
+
+/* murmur3 style 32 bit hash of n more bytes on top of h, only ever compared with hashes of the same size read in the same pieces */
+static unsigned long mkmshar_hash(unsigned long h, const unsigned char* p, size_t n){
+    size_t i;
+
+    for(i = 0; i + 4 <= n; i += 4){
+        unsigned long k = (unsigned long) p[i] | ((unsigned long) p[i + 1] << 8) | ((unsigned long) p[i + 2] << 16) | ((unsigned long) p[i + 3] << 24);
+        k = (k * 0xcc9e2d51UL) & 0xFFFFFFFFUL;
+        k = ((k << 15) | (k >> 17)) & 0xFFFFFFFFUL;
+        k = (k * 0x1b873593UL) & 0xFFFFFFFFUL;
+        h ^= k;
+        h = ((h << 13) | (h >> 19)) & 0xFFFFFFFFUL;
+        h = (h * 5 + 0xe6546b64UL) & 0xFFFFFFFFUL;
+    }
+    for(; i < n; i++){
+        h = ((h ^ p[i]) * 0x01000193UL) & 0xFFFFFFFFUL;
+    }
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bUL) & 0xFFFFFFFFUL;
+    h ^= h >> 13;
+    return h;
+}
+
+/* what a file of a list read whole was found to be when it was first opened, see mkmshar_lookall */
+typedef struct mkmshar_look {
+    mkmshar_fileinfo info;
+    int err; /* errno if it could not be opened or sized, 0 if info is good */
+} mkmshar_look;
+
+/* open and size every file once, the duplicate search, the manifest, the trailer and the workers go by that instead of opening each file again */
+static void mkmshar_lookall(char** files, size_t nfiles, mkmshar_look* looks, mkmshar_meter* meter){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    double t = mkmshar_meter_start(meter);
+    size_t i;
+
+    for(i = 0; i < nfiles; i++){
+        mkmshar_look* l = &looks[i];
+        FILE* fptr = NULL;
+
+        l->info.size = 0;
+        l->info.sized = 0;
+        l->info.regular = 0;
+        l->err = 0;
+        errno = 0;
+        if(files[i] != NULL) fptr = fopen(files[i], "rb");
+        if(fptr == NULL || mkmshar_fileInfo(fptr, &l->info) != 0){
+            l->err = (errno != 0) ? errno : EIO;
+        }
+        if(fptr != NULL) fclose(fptr);
+    }
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_OPEN, t);
+}
+
+/* 0 if the file was sized, 1 with errno set like opening it again would if not */
+static int mkmshar_looksized(const mkmshar_look* l){
+    if(l->err != 0){
+        errno = l->err;
+        return 1;
+    }
+    if(!l->info.sized){
+        #ifdef ESPIPE
+        errno = ESPIPE;
+        #endif
+        return 1;
+    }
+    return 0;
+}
+
+/* mkmshar_looksized for a file that goes in the manifest, its path is a line of it so it cannot have a newline (EINVAL) */
+static int mkmshar_looklisted(const mkmshar_look* l, const char* path){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    if(strchr(path, '\n') != NULL){
+        errno = EINVAL;
+        return 1;
+    }
+    return mkmshar_looksized(l);
+}
+
+/* one candidate of the duplicate search */
+typedef struct mkmshar_dupkey {
+    size_t size;
+    unsigned long hash;
+    size_t index;
+} mkmshar_dupkey;
+
+static int mkmshar_dupkey_cmp(const void* l, const void* r){
+    const mkmshar_dupkey* a = (const mkmshar_dupkey*) l;
+    const mkmshar_dupkey* b = (const mkmshar_dupkey*) r;
+
+    if(a->size != b->size) return (a->size < b->size) ? -1 : 1;
+    if(a->hash != b->hash) return (a->hash < b->hash) ? -1 : 1;
+    if(a->index != b->index) return (a->index < b->index) ? -1 : 1;
+    return 0;
+}
+
+/* hash a whole file of size bytes, 0 or 1 if it cannot be read (or is not that size any more) */
+static int mkmshar_hashfile(mkmshar_ctx* ctx, const char* path, size_t size, mkmshar_buf* readbuf, unsigned long* hash){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t chunk = (size < (size_t) (MXPSQL_MShar_CHUNK_SIZE)) ? size : (size_t) (MXPSQL_MShar_CHUNK_SIZE);
+    unsigned long h = (unsigned long) (size & 0xFFFFFFFFUL);
+    size_t total = 0;
+    FILE* fptr;
+
+    if(mkmshar_buf_fit(readbuf, chunk) != 0){
+        return -1;
+    }
+
+    fptr = fopen(path, "rb");
+    if(fptr == NULL){
+        return 1;
+    }
+    for(;;){
+        size_t n = fread(readbuf->data, 1, chunk, fptr);
+        if(n == 0) break;
+        h = mkmshar_hash(h, (const unsigned char*) readbuf->data, n);
+        total += n;
+    }
+    if(ferror(fptr)) total = (size_t) -1;
+    fclose(fptr);
+
+    ctx->stats.bytes_hashed += (total == (size_t) -1) ? 0 : total;
+    *hash = h;
+    return (total == size) ? 0 : 1;
+}
+
+/* 1 if the two files have the same size bytes, 0 if not or if either cannot be read */
+static int mkmshar_samefile(mkmshar_ctx* ctx, const char* a, const char* b, size_t size, mkmshar_buf* readbuf){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t chunk = (size < (size_t) (MXPSQL_MShar_CHUNK_SIZE)) ? size : (size_t) (MXPSQL_MShar_CHUNK_SIZE);
+    FILE* fa;
+    FILE* fb;
+    int same = 1;
+    size_t total = 0;
+
+    if(mkmshar_buf_fit(readbuf, 2 * chunk) != 0){
+        return 0;
+    }
+    fa = fopen(a, "rb");
+    if(fa == NULL){
+        return 0;
+    }
+    fb = fopen(b, "rb");
+    if(fb == NULL){
+        fclose(fa);
+        return 0;
+    }
+
+    while(same){
+        size_t na = fread(readbuf->data, 1, chunk, fa);
+        size_t nb = fread(readbuf->data + chunk, 1, chunk, fb);
+        if(na != nb || memcmp(readbuf->data, readbuf->data + chunk, na) != 0){
+            same = 0;
+        }
+        total += na;
+        if(na == 0) break;
+    }
+    if(ferror(fa) || ferror(fb) || total != size) same = 0;
+
+    fclose(fa);
+    fclose(fb);
+    ctx->stats.bytes_hashed += 2 * total;
+    return same;
+}
+
+/**
+ * @brief Find the files that have the same bytes as an earlier one.
+ * 
+ * @details The sizes come from looks (see mkmshar_lookall) and only the files that share their size with another are hashed, a hash match is then compared byte for byte.
+ * Files that are not regular or cannot be read are left alone, they fail (or not) later like they would without this.
+ * 
+ * @param looks nfiles entries, what mkmshar_lookall found
+ * @param origin nfiles entries, each set to the index of the first file with the same bytes or MXPSQL_MShar_DUP_NONE
+ * @return int 0, or -1 if there is no memory
+ */
+static int mkmshar_finddups(mkmshar_ctx* ctx, mkmshar_counter* counter, mkmshar_meter* meter, char** files, size_t nfiles, const mkmshar_look* looks, size_t* origin){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const mkmshar_allocator* a = &counter->face;
+    mkmshar_dupkey* keys;
+    mkmshar_buf readbuf;
+    size_t nkeys = 0;
+    size_t i;
+    size_t j;
+    int ret = 0;
+    double t = mkmshar_meter_start(meter);
+
+    for(i = 0; i < nfiles; i++){
+        origin[i] = MXPSQL_MShar_DUP_NONE;
+    }
+
+    keys = (mkmshar_dupkey*) a->alloc(a->userdata, (nfiles > 0 ? nfiles : 1) * sizeof(mkmshar_dupkey));
+    if(keys == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    mkmshar_buf_init(&readbuf, a);
+
+    /* empty files cost nothing to extract, a copy would not save anything, and a path with a newline cannot go in the list of copies (mkmshar_copyhead) */
+    for(i = 0; i < nfiles; i++){
+        const mkmshar_fileinfo* finfo = &looks[i].info;
+
+        if(files[i] != NULL && looks[i].err == 0 && finfo->regular && finfo->sized && finfo->size > 0
+            && ((!ctx->options.selective && !ctx->options.manifest) || strchr(files[i], '\n') == NULL)){
+            keys[nkeys].size = finfo->size;
+            keys[nkeys].hash = 0;
+            keys[nkeys].index = i;
+            nkeys++;
+        }
+    }
+    qsort(keys, nkeys, sizeof(mkmshar_dupkey), mkmshar_dupkey_cmp);
+
+    /* a size nobody else has is unique already, only the rest is read; a file that cannot be hashed gets a size of 0 so it matches nothing */
+    for(i = 0; i < nkeys && ret == 0; i = j){
+        for(j = i + 1; j < nkeys && keys[j].size == keys[i].size; j++);
+        if(j - i > 1){
+            size_t k;
+            for(k = i; k < j && ret == 0; k++){
+                int status = mkmshar_hashfile(ctx, files[keys[k].index], keys[k].size, &readbuf, &keys[k].hash);
+                if(status < 0) ret = -1;
+                else if(status > 0) keys[k].size = 0;
+            }
+        }
+    }
+    qsort(keys, nkeys, sizeof(mkmshar_dupkey), mkmshar_dupkey_cmp);
+
+    /* same size and hash, each one is compared against the earlier ones of its run that are not copies themselves */
+    for(i = 0; i < nkeys && ret == 0; i = j){
+        for(j = i + 1; j < nkeys && keys[j].size == keys[i].size && keys[j].hash == keys[i].hash; j++);
+        if(keys[i].size > 0 && j - i > 1){
+            size_t k;
+            for(k = i + 1; k < j; k++){
+                size_t m;
+                for(m = i; m < k; m++){
+                    if(origin[keys[m].index] == MXPSQL_MShar_DUP_NONE && mkmshar_samefile(ctx, files[keys[m].index], files[keys[k].index], keys[k].size, &readbuf)){
+                        origin[keys[k].index] = keys[m].index;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    mkmshar_buf_free(&readbuf);
+    a->release(a->userdata, keys);
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_DEDUP, t);
+    return ret;
+}
+
+/**
+ * @brief Put the block of a file that is extracted as a copy of an earlier one at the end of block.
+ * 
+ * @param path the file
+ * @param from the earlier file with the same bytes, already extracted by the time this runs
+ * @param options dedup MXPSQL_MShar_DEDUP_LINK to hard link it instead, falling back to cp, selective to wrap it in mshar_want
+ * @return int 0, or -1 if there is no memory
+ */
+static int mkmshar_emitcopy(const char* path, const char* from, const mkmshar_options* options, mkmshar_buf* block, mkmshar_fileresult* res){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    int link = (options->dedup == MXPSQL_MShar_DEDUP_LINK);
+
+    res->nbytes = 0;
+    res->packed = 0;
+    res->compressed = 0;
+    res->duplicate = 1;
+    res->crc = 0;
+
+    if(mkmshar_buf_appends(block, mkmshar_blk_name1) != 0 || mkmshar_buf_appends(block, path) != 0 || mkmshar_buf_appends(block, mkmshar_blk_name2) != 0
+        || (options->selective && mkmshar_buf_appends(block, mkmshar_blk_want) != 0)
+        || mkmshar_buf_appends(block, mkmshar_blk_dirname) != 0 || mkmshar_buf_appends(block, mkmshar_blk_info) != 0 || mkmshar_buf_appends(block, mkmshar_blk_marker) != 0){
+        return -1;
+    }
+    /* the same path twice, the first one already put it there */
+    if(strcmp(path, from) == 0){
+        if(mkmshar_buf_appends(block, "\n") != 0){
+            return -1;
+        }
+    }
+    else if(mkmshar_buf_appends(block, mkmshar_blk_from1) != 0 || mkmshar_buf_appends(block, from) != 0 || mkmshar_buf_appends(block, mkmshar_blk_name2) != 0
+        || mkmshar_buf_appends(block, link ? mkmshar_blk_ln : mkmshar_blk_cp) != 0){
+        return -1;
+    }
+    return options->selective ? mkmshar_buf_appends(block, mkmshar_blk_end) : 0;
+}
+
+/* mkmshar_emitcopy on scratch from arena, handed to writer */
+static int mkmshar_copyscratch(mkmshar_arena* arena, const char* path, const char* from, const mkmshar_options* options, mkmshar_write_func writer, void* userdata, mkmshar_fileresult* res, mkmshar_meter* meter){
+    mkmshar_buf block;
+    double t = mkmshar_meter_start(meter);
+    int status;
+
+    mkmshar_buf_init(&block, &arena->face);
+    status = mkmshar_emitcopy(path, from, options, &block, res);
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_FORMAT, t);
+    if(status == 0) status = writer(userdata, block.data, block.len);
+    mkmshar_arena_reset(arena);
+
+    res->seconds = meter->on ? mkmshar_now() - t : 0.0;
+    return status;
+}
+
+/* counts what goes through it on the way to writer, writer can be NULL to only count */
+typedef struct mkmshar_tally {
+    mkmshar_write_func writer;
+    void* userdata;
+    size_t n;
+} mkmshar_tally;
+
+static int mkmshar_sink_tally(void* userdata, const char* data, size_t len){
+    mkmshar_tally* tally = (mkmshar_tally*) userdata;
+    tally->n += len;
+    return (tally->writer != NULL) ? tally->writer(tally->userdata, data, len) : 0;
+}
+
+/* a file's line in the manifest, see mkmshar_options.manifest */
+typedef struct mkmshar_entry {
+    size_t block; /* length of its block, MXPSQL_MShar_ENTRY_NONE if it is left out */
+    size_t size;
+    size_t encoded; /* payload bytes in the archive */
+    unsigned long crc;
+} mkmshar_entry;
+
+/* block of an entry whose file could not be archived, it is done with and not in the manifest */
+#define MXPSQL_MShar_ENTRY_NONE ((size_t) -1)
+
+/* in the manifest, the files are a line each in a heredoc so nothing in a path is expanded */
+static const char mkmshar_manifest1[] =
+"# The manifest, a line for every file: offset of its block from MSHAR_BASE, block length, size, encoded length, cksum (- if not kept) and path\n\
+# sh archive --list prints it, sh archive file... extracts only those files\n\
+MSHAR_BASE=";
+/* MSHAR_BASE is where the first block starts, padded to 20 columns so it can be filled in once the header is done */
+static const char mkmshar_manifest2[] =
+";\n\
+mshar_manifest(){\n\
+    cat <<'@MSHAR_MANIFEST@'\n";
+static const char mkmshar_manifest3[] =
+"@MSHAR_MANIFEST@\n\
+}\n\
+if test \"$1\" = \"--list\"; then\n\
+    mshar_manifest;\n\
+    exit 0;\n\
+fi\n\
+\n";
+
+/* where the archive is and whether head -c works, for anything cut out of the archive with tail */
+static const char mkmshar_selfhead[] =
+"case \"$0\" in\n\
+    /*) MSHAR_SELF=\"$0\";;\n\
+    *) MSHAR_SELF=\"$(pwd)/$0\";;\n\
+esac\n\
+MSHAR_HEADC=;\n\
+if head -c 0 < /dev/null > /dev/null 2>&1; then MSHAR_HEADC=1; fi\n";
+
+/* MXPSQL_MShar_LAYOUT_TRAILER archives cut every file out of themselves, so they stop before extracting anything if they are not a file */
+static const char mkmshar_selfcheck[] =
+"if test ! -f \"$MSHAR_SELF\" || test ! -r \"$MSHAR_SELF\"; then\n\
+    printf \"The files are stored after the script, so this archive has to be run as a file (sh archive), not from a pipe.\\n\";\n\
+    exit 1;\n\
+fi\n\
+MSHAR_TOTAL=\"$(($(wc -c < \"$MSHAR_SELF\")))\";\n\
+MSHAR_CUTBAD=;\n";
+
+/* after the header of archives with a manifest, the named files are extracted by running only their blocks, cut out of the archive */
+static const char mkmshar_pick1[] =
+"mshar_block(){\n\
+    if test -n \"$MSHAR_HEADC\"; then\n\
+        tail -c +\"$((MSHAR_BASE + $1 + 1))\" \"$MSHAR_SELF\" | head -c \"$2\";\n\
+    else\n\
+        tail -c +\"$((MSHAR_BASE + $1 + 1))\" \"$MSHAR_SELF\" | dd bs=1 count=\"$2\" 2> /dev/null;\n\
+    fi\n\
+}\n";
+/* a line of the manifest into MSHAR_OFF, MSHAR_LEN and TEKTONE, the path is all that follows the fifth space, blanks and all */
+static const char mkmshar_pickline[] =
+"mshar_line(){\n\
+    MSHAR_OFF=\"${1%% *}\";\n\
+    MSHAR_LEN=\"${1#* }\";\n\
+    MSHAR_LEN=\"${MSHAR_LEN%% *}\";\n\
+    TEKTONE=\"${1#* * * * * }\";\n\
+}\n\
+mshar_find(){\n\
+    mshar_manifest | while IFS= read -r MSHAR_LINE; do\n\
+        mshar_line \"$MSHAR_LINE\";\n\
+        if test \"$TEKTONE\" = \"$1\"; then printf \"%s %s\" \"$MSHAR_OFF\" \"$MSHAR_LEN\"; break; fi;\n\
+    done\n\
+}\n";
+static const char mkmshar_pick2[] =
+"if test $# -gt 0; then\n\
+    if test ! -f \"$MSHAR_SELF\"; then\n\
+        printf \"Files can only be picked out of an archive that is run as a file.\\n\";\n\
+        exit 1;\n\
+    fi\n\
+    MSHAR_MISSING=;\n\
+    MSHAR_DONE='\n';\n\
+    mshar_undone(){\n\
+        case \"$MSHAR_DONE\" in *\"\n$1\n\"*) return 1;; esac\n\
+        MSHAR_DONE=\"$MSHAR_DONE$1\n\";\n\
+        return 0;\n\
+    }\n";
+static const char mkmshar_pick3[] =
+"    for MSHAR_NAME in \"$@\"; do\n\
+        MSHAR_AT=\"$(mshar_find \"$MSHAR_NAME\")\";\n\
+        if test -z \"$MSHAR_AT\"; then\n\
+            printf \"x - %s is not in this archive\\n\" \"$MSHAR_NAME\";\n\
+            MSHAR_MISSING=1;\n\
+        elif mshar_undone \"$MSHAR_NAME\"; then\n";
+/* with options.dedup, a copy picked out has the file it is a copy of extracted first, once (a hard link would be written through again) */
+static const char mkmshar_pickfrom[] =
+"            MSHAR_FROM=\"$(mshar_origin \"$MSHAR_NAME\")\";\n\
+            if test -n \"$MSHAR_FROM\" && mshar_undone \"$MSHAR_FROM\"; then MSHAR_FROM=\"$(mshar_find \"$MSHAR_FROM\")\"; else MSHAR_FROM=; fi\n\
+            if test -n \"$MSHAR_FROM\"; then eval \"$(mshar_block $MSHAR_FROM)\"; fi\n";
+static const char mkmshar_pick4[] =
+"            mkdir -p \"./$(dirname \"$MSHAR_NAME\")\" 2> /dev/null;\n\
+            eval \"$(mshar_block $MSHAR_AT)\";\n\
+        fi\n\
+    done\n\
+    if test -n \"$MSHAR_MISSING$MSHAR_BAD$MSHAR_CUTBAD\"; then exit 1; fi\n\
+    exit 0;\n\
+fi\n\
+\n";
+
+/* near the top of archives with options.selective, the --include and --exclude patterns and the files named go into newline separated lists */
+static const char mkmshar_select1[] =
+"MSHAR_INCLUDE=;\n\
+MSHAR_EXCLUDE=;\n\
+MSHAR_NAMES=;\n\
+while test $# -gt 0; do\n\
+    case \"$1\" in\n\
+        --include|--exclude) if test $# -lt 2; then printf \"x - %s needs a pattern\\n\" \"$1\"; exit 1; fi;;\n\
+        *) break;;\n\
+    esac\n\
+    if test \"$1\" = --include; then MSHAR_INCLUDE=\"$MSHAR_INCLUDE$2\n\"; else MSHAR_EXCLUDE=\"$MSHAR_EXCLUDE$2\n\"; fi\n\
+    shift 2;\n\
+done\n";
+/* names are compared as they are, a [ or * in one is not a pattern */
+static const char mkmshar_selectnames[] =
+"for MSHAR_NAME in \"$@\"; do\n\
+    MSHAR_NAMES=\"$MSHAR_NAMES$MSHAR_NAME\n\";\n\
+done\n\
+shift $#;\n";
+/* whether $TEKTONE is wanted, with its directories made if it is picked out (the files around it may not be) */
+static const char mkmshar_select2[] =
+"mshar_want(){\n\
+    if test -z \"$MSHAR_INCLUDE$MSHAR_EXCLUDE$MSHAR_NAMES\"; then return 0; fi\n\
+    MSHAR_WANT=;\n\
+    if test -z \"$MSHAR_INCLUDE$MSHAR_NAMES\"; then MSHAR_WANT=1; fi\n\
+    set -f;\n\
+    MSHAR_IFS=\"$IFS\";\n\
+    IFS='\n';\n\
+    for MSHAR_PAT in $MSHAR_NAMES; do if test \"$TEKTONE\" = \"$MSHAR_PAT\"; then MSHAR_WANT=1; fi; done\n\
+    for MSHAR_PAT in $MSHAR_INCLUDE; do case \"$TEKTONE\" in $MSHAR_PAT) MSHAR_WANT=1;; esac; done\n";
+static const char mkmshar_select3[] =
+"    for MSHAR_PAT in $MSHAR_EXCLUDE; do case \"$TEKTONE\" in $MSHAR_PAT) MSHAR_WANT=;; esac; done\n\
+    IFS=\"$MSHAR_IFS\";\n\
+    set +f;\n";
+/* with options.dedup, a file not wanted itself is still extracted if a copy of it is */
+static const char mkmshar_selectcopy[] =
+"    if test -z \"$MSHAR_WANT$MSHAR_INCOPY\" && test -n \"$(MSHAR_INCOPY=1; mshar_wantcopy \"$TEKTONE\")\"; then MSHAR_WANT=1; fi\n";
+static const char mkmshar_select4[] =
+"    if test -z \"$MSHAR_WANT\"; then return 1; fi\n\
+    mkdir -p \"./$(dirname \"$TEKTONE\")\" 2> /dev/null;\n\
+    return 0;\n\
+}\n\
+\n";
+
+/* with options.manifest too, only the blocks of the wanted files are cut out of the archive and run */
+static const char mkmshar_pickwant[] =
+"if test -n \"$MSHAR_INCLUDE$MSHAR_EXCLUDE$MSHAR_NAMES\" && test -f \"$MSHAR_SELF\"; then\n\
+    mshar_manifest | {\n\
+        while IFS= read -r MSHAR_LINE; do\n\
+            mshar_line \"$MSHAR_LINE\";\n\
+            if mshar_want; then eval \"$(mshar_block \"$MSHAR_OFF\" \"$MSHAR_LEN\")\" < /dev/null; fi\n\
+        done\n\
+        test -z \"$MSHAR_BAD$MSHAR_CUTBAD\";\n\
+    } || exit 1;\n\
+    exit 0;\n\
+fi\n";
+
+/* the part of the header that takes the patterns, nothing without options.selective */
+static int mkmshar_selecthead(const mkmshar_options* options, mkmshar_buf* buf){
+    if(!options->selective){
+        return 0;
+    }
+    if(mkmshar_buf_appends(buf, mkmshar_select1) != 0 || mkmshar_buf_appends(buf, mkmshar_selectnames) != 0
+        || mkmshar_buf_appends(buf, mkmshar_select2) != 0 || mkmshar_buf_appends(buf, mkmshar_select3) != 0
+        || (options->dedup != MXPSQL_MShar_DEDUP_OFF && mkmshar_buf_appends(buf, mkmshar_selectcopy) != 0)){
+        return -1;
+    }
+    return mkmshar_buf_appends(buf, mkmshar_select4);
+}
+
+/* with options.dedup and options.selective or options.manifest, the copies (each line after a < or >, so no line starts a block) and what they are looked up with */
+static const char mkmshar_copies1[] =
+"# The files extracted as copies of earlier ones, the earlier one then the copy\n\
+mshar_copies(){\n\
+    cat <<'@MSHAR_COPIES@'\n";
+static const char mkmshar_copies2[] =
+"@MSHAR_COPIES@\n\
+}\n\
+mshar_wantcopy(){\n\
+    mshar_copies | while IFS= read -r MSHAR_ONE && IFS= read -r TEKTONE; do\n\
+        TEKTONE=\"${TEKTONE#?}\";\n\
+        if test \"${MSHAR_ONE#?}\" = \"$1\" && mshar_want; then printf 1; break; fi;\n\
+    done\n\
+}\n\
+mshar_origin(){\n\
+    mshar_copies | while IFS= read -r MSHAR_ONE && IFS= read -r MSHAR_TWO; do\n\
+        if test \"${MSHAR_TWO#?}\" = \"$1\"; then printf \"%s\" \"${MSHAR_ONE#?}\"; break; fi;\n\
+    done\n\
+}\n\
+\n";
+
+/* after the post script of archives with options.dedup and no checksums, a copy that failed is an error too */
+static const char mkmshar_copyend[] =
+"if test -n \"$MSHAR_BAD\"; then\n\
+    printf \"Some files could not be copied.\\n\";\n\
+    exit 1;\n\
+fi\n";
+
+/* the header part for the copies of options.dedup, after mkmshar_checkhead, nothing without dedup */
+static int mkmshar_copyhead(const mkmshar_options* options, mkmshar_buf* buf, char** files, size_t nfiles, const size_t* origin){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t i;
+
+    if(options->dedup == MXPSQL_MShar_DEDUP_OFF){
+        return 0;
+    }
+    if(options->checksum == MXPSQL_MShar_CHECKSUM_OFF && mkmshar_buf_appends(buf, "MSHAR_BAD=;\n") != 0){
+        return -1;
+    }
+    if(!options->selective && !options->manifest){
+        return 0;
+    }
+    if(mkmshar_buf_appends(buf, mkmshar_copies1) != 0){
+        return -1;
+    }
+    for(i = 0; i < nfiles; i++){
+        if(!MXPSQL_MShar_DUP_COPY(origin, i) || strcmp(files[i], files[origin[i]]) == 0) continue;
+        if(mkmshar_buf_append(buf, "<", 1) != 0 || mkmshar_buf_appends(buf, files[origin[i]]) != 0 || mkmshar_buf_append(buf, "\n>", 2) != 0
+            || mkmshar_buf_appends(buf, files[i]) != 0 || mkmshar_buf_append(buf, "\n", 1) != 0){
+            return -1;
+        }
+    }
+    return mkmshar_buf_appends(buf, mkmshar_copies2);
+}
+
+/* the manifest of the files in entries at the end of buf, baseat set to where the MSHAR_BASE padding is */
+static int mkmshar_manifesthead(mkmshar_buf* buf, char** files, size_t nfiles, const mkmshar_entry* entries, int sums, size_t* baseat){
+    size_t offset = 0;
+    size_t i;
+
+    if(mkmshar_buf_appends(buf, mkmshar_manifest1) != 0){
+        return -1;
+    }
+    *baseat = buf->len;
+    if(mkmshar_buf_appends(buf, "                    ") != 0 || mkmshar_buf_appends(buf, mkmshar_manifest2) != 0){
+        return -1;
+    }
+    for(i = 0; i < nfiles; i++){
+        const mkmshar_entry* e = &entries[i];
+        if(e->block == MXPSQL_MShar_ENTRY_NONE) continue;
+        if(mkmshar_buf_appendul(buf, offset) != 0 || mkmshar_buf_append(buf, " ", 1) != 0 || mkmshar_buf_appendul(buf, e->block) != 0 || mkmshar_buf_append(buf, " ", 1) != 0
+            || mkmshar_buf_appendul(buf, e->size) != 0 || mkmshar_buf_append(buf, " ", 1) != 0 || mkmshar_buf_appendul(buf, e->encoded) != 0 || mkmshar_buf_append(buf, " ", 1) != 0
+            || (sums ? mkmshar_buf_appendul(buf, (size_t) e->crc) : mkmshar_buf_append(buf, "-", 1)) != 0 || mkmshar_buf_append(buf, " ", 1) != 0
+            || mkmshar_buf_appends(buf, files[i]) != 0 || mkmshar_buf_append(buf, "\n", 1) != 0){
+            return -1;
+        }
+        offset += e->block;
+    }
+    return mkmshar_buf_appends(buf, mkmshar_manifest3);
+}
+
+/* a file that is in the manifest has to come out as planned, the offsets after it depend on it, so anything else is a write error */
+static int mkmshar_planned(const mkmshar_entry* e, int status, size_t written){
+    if(status == 0 && written != e->block){
+        errno = EIO;
+        return -1;
+    }
+    return (status != 0) ? -1 : 0;
+}
+
+/**
+ * @brief The manifest entry of every file, for mkmshar_options.manifest with the base64 layouts, before any block is written.
+ *
+ * @details Block lengths follow from the sizes mkmshar_lookall found with mkmshar_blocklen, files that are compressed or checksummed are made into a block once just to measure it.
+ * Files that cannot be archived are done with here (mkmshar_filedone) and left out.
+ *
+ * @return int 0, or -1 to stop like mkmshar_filedone
+ */
+static int mkmshar_plan(mkmshar_ctx* ctx, mkmshar_counter* counter, char** files, size_t nfiles, const mkmshar_look* looks, size_t* origin, mkmshar_entry* entries, mkmshar_meter* meter){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    int sums = (ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF);
+    mkmshar_arena arena;
+    size_t i;
+    int ret = 0;
+
+    mkmshar_arena_init(&arena, &counter->face);
+
+    for(i = 0; i < nfiles && ret == 0; i++){
+        mkmshar_entry* e = &entries[i];
+        mkmshar_fileresult res;
+        mkmshar_tally tally;
+        int status = 1;
+
+        memset(&res, 0, sizeof(res));
+        e->block = MXPSQL_MShar_ENTRY_NONE;
+        e->size = 0;
+        e->encoded = 0;
+        e->crc = 0;
+        tally.writer = NULL;
+        tally.userdata = NULL;
+        tally.n = 0;
+
+        if(MXPSQL_MShar_DUP_COPY(origin, i)){
+            /* its first file is planned already */
+            status = mkmshar_copyscratch(&arena, files[i], files[origin[i]], &ctx->options, mkmshar_sink_tally, &tally, &res, meter);
+            e->block = tally.n;
+            e->size = entries[origin[i]].size;
+            e->crc = entries[origin[i]].crc;
+        }
+        else if(files[i] != NULL){
+            const mkmshar_fileinfo* finfo = &looks[i].info;
+
+            status = mkmshar_looklisted(&looks[i], files[i]);
+            if(status == 0 && (sums || (ctx->options.compress && finfo->size >= MXPSQL_MShar_Z_MIN))){
+                /* the block depends on the bytes, the second time it is made it has to come out the same */
+                status = mkmshar_emitscratch(&arena, files[i], NULL, 0, &ctx->options, mkmshar_sink_tally, &tally, &res, meter);
+                e->block = tally.n;
+                e->size = res.nbytes;
+                e->encoded = ((res.packed + 2) / 3) * 4;
+                e->crc = res.crc;
+            }
+            else if(status == 0){
+                e->block = mkmshar_blocklen(files[i], finfo->size, &ctx->options);
+                e->size = finfo->size;
+                e->encoded = ((finfo->size + 2) / 3) * 4;
+            }
+        }
+
+        if(status != 0){
+            e->block = MXPSQL_MShar_ENTRY_NONE;
+            if(origin != NULL) origin[i] = MXPSQL_MShar_DUP_FAILED;
+            ret = mkmshar_filedone(ctx, files[i], status, &res);
+        }
+    }
+
+    mkmshar_arena_free(&arena);
+    return ret;
+}
+
+/* where mkmshar_emitseq and mkmshar_emitpar get their files, an array or a mkmshar_source read as they go */
+typedef struct mkmshar_feed {
+    char** files; /* NULL with a source */
+    size_t nfiles; /* with a source, how many paths it gave so far */
+    const mkmshar_source* source;
+    int ended; /* the source said there is no more */
+    int err; /* errno of a source that failed */
+    const char* kept[MXPSQL_MShar_STATS_SLOWEST]; /* paths of the source that are in stats.slowest, given back at the end */
+    const char* failed; /* the path of the source that stopped the build, given back at the end */
+} mkmshar_feed;
+
+static void mkmshar_feed_init(mkmshar_feed* feed, char** files, size_t nfiles, const mkmshar_source* source){
+    int k;
+
+    feed->files = files;
+    feed->nfiles = nfiles;
+    feed->source = source;
+    feed->ended = 0;
+    feed->err = 0;
+    for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST; k++) feed->kept[k] = NULL;
+    feed->failed = NULL;
+}
+
+#ifdef MXPSQL_MShar_THREADS
+/* 1 if there may be a file i, a source only knows once it is asked */
+static int mkmshar_feed_more(const mkmshar_feed* feed, size_t i){
+    return i < feed->nfiles || (feed->source != NULL && !feed->ended);
+}
+#endif
+
+/* file i into *path, files are asked for in order, 0 if there is none */
+static int mkmshar_feed_next(mkmshar_feed* feed, size_t i, const char** path){
+    const char* p;
+
+    if(i < feed->nfiles){
+        *path = feed->files[i];
+        return 1;
+    }
+    if(feed->source == NULL || feed->ended){
+        return 0;
+    }
+
+    errno = 0;
+    p = feed->source->next(feed->source->userdata);
+    if(p == NULL){
+        feed->ended = 1;
+        feed->err = errno;
+        return 0;
+    }
+    feed->nfiles++;
+    *path = p;
+    return 1;
+}
+
+static void mkmshar_feed_release(const mkmshar_feed* feed, const char* path){
+    if(feed->source != NULL && feed->source->release != NULL && path != NULL){
+        feed->source->release(feed->source->userdata, path);
+    }
+}
+
+/* mkmshar_filedone, then the path goes back to the source unless the stats or errpath point at it, those go back in mkmshar_feed_end */
+static int mkmshar_feed_done(mkmshar_feed* feed, mkmshar_ctx* ctx, const char* path, int status, const mkmshar_fileresult* res){
+    const char* last = ctx->stats.slowest[MXPSQL_MShar_STATS_SLOWEST - 1].path;
+    int ret = mkmshar_filedone(ctx, path, status, res);
+    int k;
+
+    if(feed->source == NULL){
+        return ret;
+    }
+
+    /* whatever was last has dropped off the end if the last entry changed */
+    if(last != NULL && ctx->stats.slowest[MXPSQL_MShar_STATS_SLOWEST - 1].path != last){
+        for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST; k++){
+            if(feed->kept[k] == last){
+                feed->kept[k] = NULL;
+                mkmshar_feed_release(feed, last);
+                break;
+            }
+        }
+    }
+
+    for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST; k++){
+        if(ctx->stats.slowest[k].path == path) break;
+    }
+    if(k < MXPSQL_MShar_STATS_SLOWEST){
+        for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST && feed->kept[k] != NULL; k++);
+        if(k < MXPSQL_MShar_STATS_SLOWEST) feed->kept[k] = path;
+    }
+    else if(ret == 0){
+        mkmshar_feed_release(feed, path);
+    }
+    else{
+        feed->failed = path;
+    }
+    return ret;
+}
+
+#ifdef MXPSQL_MShar_URING
+#if !defined(__cplusplus) && !defined(c_plusplus)
+/* unistd.h only has it with _DEFAULT_SOURCE, which -ansi takes away if a system header came first */
+long syscall(long number, ...);
+#endif
+
+/* where a file of the batch is, see mkmshar_uring */
+#define MXPSQL_MShar_RING_STDIO 0 /* left to stdio, it is not read (or could not be) */
+#define MXPSQL_MShar_RING_OPEN 1 /* being opened and stat'ed */
+#define MXPSQL_MShar_RING_READ 2 /* being read and closed */
+#define MXPSQL_MShar_RING_DONE 3 /* all of it is in the batch buffer */
+
+/* what each sqe was for, in the low bits of its user_data with the file above them */
+#define MXPSQL_MShar_RING_OP_OPEN 0
+#define MXPSQL_MShar_RING_OP_STAT 1
+#define MXPSQL_MShar_RING_OP_READ 2
+#define MXPSQL_MShar_RING_OP_CLOSE 3
+
+/* AT_FDCWD, which fcntl.h also keeps behind _DEFAULT_SOURCE */
+#define MXPSQL_MShar_RING_CWD (-100)
+
+/* queue depths above this are taken as this, the kernel wants at most 32768 entries and two go to every file */
+#define MXPSQL_MShar_RING_MAX 4096
+
+/* one file of a batch */
+typedef struct mkmshar_ringfile {
+    const char* path;
+    int state;
+    int fd; /* -1 if it is not open */
+    int stated; /* stx is filled in */
+    struct statx stx;
+    size_t at; /* where its bytes start in the batch buffer */
+    size_t size;
+    long got; /* what the read gave, bytes or -errno */
+} mkmshar_ringfile;
+
+/* an io_uring without liburing, files are opened, stat'ed, read and closed a batch of options.uring at a time */
+typedef struct mkmshar_uring {
+    int fd;
+    void* sqmap;
+    size_t sqlen;
+    void* cqmap;
+    size_t cqlen;
+    struct io_uring_sqe* sqes;
+    size_t sqeslen;
+    unsigned* sqtail;
+    unsigned* sqarray;
+    unsigned sqmask;
+    unsigned* cqhead;
+    unsigned* cqtail;
+    unsigned cqmask;
+    struct io_uring_cqe* cqes;
+    unsigned tail; /* sqes filled in, the kernel sees them once they are submitted */
+    unsigned queued; /* filled in and not submitted yet */
+    unsigned pending; /* submitted and not completed yet */
+    mkmshar_ringfile* files;
+    size_t depth;
+    size_t nfiles; /* files in this batch */
+    size_t next; /* files of the batch handed out */
+    mkmshar_buf data; /* the bytes of the files that were read */
+    const mkmshar_allocator* a;
+} mkmshar_uring;
+
+/* 0 if there is a ring, -1 if there is none to be had (no io_uring, not allowed, too old or out of memory), then stdio it is */
+static int mkmshar_uring_init(mkmshar_uring* ring, const mkmshar_allocator* a, size_t depth){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    struct io_uring_params p;
+    int err = errno;
+
+    if(depth > MXPSQL_MShar_RING_MAX) depth = MXPSQL_MShar_RING_MAX;
+
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int) syscall(__NR_io_uring_setup, (unsigned) (depth * 2), &p);
+    if(ring->fd < 0){
+        errno = err;
+        return -1;
+    }
+    /* openat, statx, read and close all came with this kernel (5.6) */
+    if(!(p.features & IORING_FEAT_RW_CUR_POS)){
+        close(ring->fd);
+        errno = err;
+        return -1;
+    }
+
+    ring->sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        if(ring->cqlen > ring->sqlen) ring->sqlen = ring->cqlen;
+        ring->cqlen = ring->sqlen;
+    }
+    ring->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqmap = mmap(NULL, ring->sqlen, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqmap = MAP_FAILED;
+    ring->sqes = (struct io_uring_sqe*) MAP_FAILED;
+    if(ring->sqmap != MAP_FAILED){
+        ring->cqmap = (p.features & IORING_FEAT_SINGLE_MMAP) ? ring->sqmap : mmap(NULL, ring->cqlen, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    }
+    ring->files = (mkmshar_ringfile*) a->alloc(a->userdata, sizeof(mkmshar_ringfile) * depth);
+    if(ring->sqmap == MAP_FAILED || ring->cqmap == MAP_FAILED || (void*) ring->sqes == MAP_FAILED || ring->files == NULL){
+        if((void*) ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqeslen);
+        if(ring->cqmap != MAP_FAILED && ring->cqmap != ring->sqmap) munmap(ring->cqmap, ring->cqlen);
+        if(ring->sqmap != MAP_FAILED) munmap(ring->sqmap, ring->sqlen);
+        if(ring->files != NULL) a->release(a->userdata, ring->files);
+        close(ring->fd);
+        errno = err;
+        return -1;
+    }
+
+    ring->sqtail = (unsigned*) ((char*) ring->sqmap + p.sq_off.tail);
+    ring->sqarray = (unsigned*) ((char*) ring->sqmap + p.sq_off.array);
+    ring->sqmask = *(unsigned*) ((char*) ring->sqmap + p.sq_off.ring_mask);
+    ring->cqhead = (unsigned*) ((char*) ring->cqmap + p.cq_off.head);
+    ring->cqtail = (unsigned*) ((char*) ring->cqmap + p.cq_off.tail);
+    ring->cqmask = *(unsigned*) ((char*) ring->cqmap + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) ((char*) ring->cqmap + p.cq_off.cqes);
+    ring->tail = *ring->sqtail;
+    ring->queued = 0;
+    ring->pending = 0;
+    ring->depth = depth;
+    ring->nfiles = 0;
+    ring->next = 0;
+    ring->a = a;
+    mkmshar_buf_init(&ring->data, a);
+    return 0;
+}
+
+/* the files of the batch that were never handed out go back to the source */
+static void mkmshar_uring_free(mkmshar_uring* ring, const mkmshar_feed* feed){
+    size_t k;
+
+    for(k = ring->next; k < ring->nfiles; k++){
+        mkmshar_feed_release(feed, ring->files[k].path);
+    }
+    munmap(ring->sqes, ring->sqeslen);
+    if(ring->cqmap != ring->sqmap) munmap(ring->cqmap, ring->cqlen);
+    munmap(ring->sqmap, ring->sqlen);
+    close(ring->fd);
+    ring->a->release(ring->a->userdata, ring->files);
+    mkmshar_buf_free(&ring->data);
+}
+
+/* the next free sqe, zeroed, for file k */
+static struct io_uring_sqe* mkmshar_uring_sqe(mkmshar_uring* ring, size_t k, int op, int opcode){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    unsigned i = ring->tail & ring->sqmask;
+    struct io_uring_sqe* sqe = &ring->sqes[i];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char) opcode;
+    sqe->user_data = ((unsigned long) k << 2) | (unsigned long) op;
+    ring->sqarray[i] = i;
+    ring->tail++;
+    ring->queued++;
+    return sqe;
+}
+
+/* submit what is queued and wait until all of it is done, -1 if the ring itself failed */
+static int mkmshar_uring_run(mkmshar_uring* ring){
+    __atomic_store_n(ring->sqtail, ring->tail, __ATOMIC_RELEASE);
+
+    while(ring->queued > 0 || ring->pending > 0){
+        unsigned head = *ring->cqhead;
+        long n = syscall(__NR_io_uring_enter, ring->fd, ring->queued, ring->queued + ring->pending, IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if(n < 0){
+            if(errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            return -1;
+        }
+        ring->queued -= (unsigned) n;
+        ring->pending += (unsigned) n;
+
+        while(head != __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE)){
+            struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqmask];
+            mkmshar_ringfile* f = &ring->files[cqe->user_data >> 2];
+
+            switch((int) (cqe->user_data & 3)){
+                case MXPSQL_MShar_RING_OP_OPEN:
+                    if(cqe->res >= 0) f->fd = cqe->res;
+                    break;
+                case MXPSQL_MShar_RING_OP_STAT:
+                    f->stated = (cqe->res == 0);
+                    break;
+                case MXPSQL_MShar_RING_OP_READ:
+                    f->got = cqe->res;
+                    break;
+                default:
+                    /* a short read cancels the close linked to it, the fd is still open then */
+                    if(cqe->res != -ECANCELED) f->fd = -1;
+                    break;
+            }
+            head++;
+            ring->pending--;
+        }
+        __atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/* the next batch from file i on, opened and stat'ed, then the small regular files read and everything closed, 0 if there were no more files */
+static size_t mkmshar_uring_fill(mkmshar_uring* ring, mkmshar_feed* feed, size_t* origin, const mkmshar_entry* plan, size_t i, mkmshar_meter* meter){
+    const char* path = NULL;
+    size_t total = 0;
+    size_t k;
+    int ok;
+    double t;
+
+    ring->nfiles = 0;
+    ring->next = 0;
+    ring->data.len = 0;
+
+    t = mkmshar_meter_start(meter);
+    for(k = 0; k < ring->depth && mkmshar_feed_next(feed, i + k, &path); k++){
+        mkmshar_ringfile* f = &ring->files[k];
+        struct io_uring_sqe* sqe;
+
+        f->path = path;
+        f->state = MXPSQL_MShar_RING_STDIO;
+        f->fd = -1;
+        f->stated = 0;
+        ring->nfiles++;
+        /* the same ones mkmshar_emitseq does not read */
+        if(path == NULL || (plan != NULL && plan[i + k].block == MXPSQL_MShar_ENTRY_NONE) || MXPSQL_MShar_DUP_COPY(origin, i + k)){
+            continue;
+        }
+
+        f->state = MXPSQL_MShar_RING_OPEN;
+        sqe = mkmshar_uring_sqe(ring, k, MXPSQL_MShar_RING_OP_OPEN, IORING_OP_OPENAT);
+        sqe->fd = MXPSQL_MShar_RING_CWD;
+        sqe->addr = (unsigned long) path;
+        sqe->open_flags = O_RDONLY;
+        sqe = mkmshar_uring_sqe(ring, k, MXPSQL_MShar_RING_OP_STAT, IORING_OP_STATX);
+        sqe->fd = MXPSQL_MShar_RING_CWD;
+        sqe->addr = (unsigned long) path;
+        sqe->len = STATX_TYPE | STATX_SIZE;
+        sqe->off = (unsigned long) &f->stx;
+    }
+    ok = (mkmshar_uring_run(ring) == 0);
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_OPEN, t);
+
+    t = mkmshar_meter_start(meter);
+    for(k = 0; k < ring->nfiles; k++){
+        mkmshar_ringfile* f = &ring->files[k];
+
+        if(f->state != MXPSQL_MShar_RING_OPEN) continue;
+        f->state = MXPSQL_MShar_RING_STDIO;
+        if(ok && f->fd >= 0 && f->stated && S_ISREG(f->stx.stx_mode) && f->stx.stx_size < (size_t) (MXPSQL_MShar_URING_MAX)){
+            f->state = MXPSQL_MShar_RING_READ;
+            f->at = total;
+            f->size = (size_t) f->stx.stx_size;
+            f->got = 0;
+            total += f->size;
+        }
+    }
+    /* the buffer cannot move once the reads are in */
+    if(total > 0 && mkmshar_buf_fit(&ring->data, total) != 0){
+        total = 0;
+    }
+    for(k = 0; ok && k < ring->nfiles; k++){
+        mkmshar_ringfile* f = &ring->files[k];
+        struct io_uring_sqe* sqe;
+
+        if(f->state == MXPSQL_MShar_RING_READ && f->size > 0 && total == 0){
+            f->state = MXPSQL_MShar_RING_STDIO;
+        }
+        if(f->state == MXPSQL_MShar_RING_READ && f->size > 0){
+            sqe = mkmshar_uring_sqe(ring, k, MXPSQL_MShar_RING_OP_READ, IORING_OP_READ);
+            sqe->fd = f->fd;
+            sqe->addr = (unsigned long) (ring->data.data + f->at);
+            sqe->len = (unsigned) f->size;
+            sqe->flags = IOSQE_IO_LINK;
+        }
+        if(f->fd >= 0){
+            sqe = mkmshar_uring_sqe(ring, k, MXPSQL_MShar_RING_OP_CLOSE, IORING_OP_CLOSE);
+            sqe->fd = f->fd;
+        }
+    }
+    if(ok) ok = (mkmshar_uring_run(ring) == 0);
+    for(k = 0; k < ring->nfiles; k++){
+        mkmshar_ringfile* f = &ring->files[k];
+
+        if(f->state == MXPSQL_MShar_RING_READ){
+            /* anything but all of it and stdio reads it again, to fail or not the way it always did */
+            f->state = (ok && f->got == (long) f->size) ? MXPSQL_MShar_RING_DONE : MXPSQL_MShar_RING_STDIO;
+        }
+        if(f->fd >= 0){
+            close(f->fd);
+            f->fd = -1;
+        }
+    }
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_READ, t);
+
+    return ring->nfiles;
+}
+
+/* file i into *path like mkmshar_feed_next, with its bytes in *data if the ring read them (NULL if not) */
+static int mkmshar_uring_next(mkmshar_uring* ring, mkmshar_feed* feed, size_t* origin, const mkmshar_entry* plan, size_t i, const char** path, const char** data, size_t* size, mkmshar_meter* meter){
+    mkmshar_ringfile* f;
+
+    if(ring->next == ring->nfiles && mkmshar_uring_fill(ring, feed, origin, plan, i, meter) == 0){
+        return 0;
+    }
+
+    f = &ring->files[ring->next++];
+    *path = f->path;
+    *data = NULL;
+    *size = 0;
+    if(f->state == MXPSQL_MShar_RING_DONE){
+        *data = (f->size > 0) ? ring->data.data + f->at : "";
+        *size = f->size;
+    }
+    return 1;
+}
+#endif
+
+/* one file after another on the calling thread, plan is NULL without a manifest */
+static int mkmshar_emitseq(mkmshar_ctx* ctx, mkmshar_counter* counter, mkmshar_feed* feed, size_t* origin, const mkmshar_entry* plan, mkmshar_out* out){
+    mkmshar_arena arena;
+    const char* path = NULL;
+    const char* data = NULL;
+    size_t size = 0;
+    size_t i;
+    int ret = 0;
+    #ifdef MXPSQL_MShar_URING
+    mkmshar_uring ring;
+    int ringed = (ctx->options.uring > 0 && mkmshar_uring_init(&ring, &counter->face, ctx->options.uring) == 0);
+    #endif
+
+    mkmshar_arena_init(&arena, &counter->face);
+
+    for(i = 0; ; i++){
+        int status = 1;
+        size_t before = ctx->stats.bytes_out;
+        mkmshar_fileresult res;
+
+        #ifdef MXPSQL_MShar_URING
+        if(ringed){
+            if(!mkmshar_uring_next(&ring, feed, origin, plan, i, &path, &data, &size, out->meter)) break;
+        }
+        else
+        #endif
+        if(!mkmshar_feed_next(feed, i, &path)){
+            break;
+        }
+
+        if(plan != NULL && plan[i].block == MXPSQL_MShar_ENTRY_NONE){
+            /* done with when it was planned */
+            continue;
+        }
+        if(MXPSQL_MShar_DUP_COPY(origin, i)){
+            status = mkmshar_copyscratch(&arena, path, feed->files[origin[i]], &ctx->options, mkmshar_out_write, out, &res, out->meter);
+        }
+        else if(path != NULL){
+            status = mkmshar_emitscratch(&arena, path, data, size, &ctx->options, mkmshar_out_write, out, &res, out->meter);
+        }
+        if(plan != NULL){
+            status = mkmshar_planned(&plan[i], status, ctx->stats.bytes_out - before);
+        }
+        if(status == 0 && data != NULL){
+            ctx->stats.uring_files++;
+        }
+
+        if(status != 0 && origin != NULL){
+            origin[i] = MXPSQL_MShar_DUP_FAILED;
+        }
+        if(mkmshar_feed_done(feed, ctx, path, status, &res) != 0){
+            ret = -1;
+            break;
+        }
+    }
+    if(ret == 0 && feed->err != 0){
+        errno = feed->err;
+        ret = -1;
+    }
+
+    #ifdef MXPSQL_MShar_URING
+    if(ringed) mkmshar_uring_free(&ring, feed);
+    #endif
+    mkmshar_arena_free(&arena);
+    return ret;
+}
+
+#ifdef MXPSQL_MShar_THREADS
+/* the block was left for the writing thread, see MXPSQL_MShar_PARALLEL_MAX_BLOCK */
+#define MXPSQL_MShar_SLOT_DEFERRED 2
+
+/* one finished (or deferred) block waiting in the reorder window */
+typedef struct mkmshar_slot {
+    const char* path;
+    mkmshar_buf out;
+    mkmshar_fileresult res;
+    int done;
+    int status;
+    int err;
+} mkmshar_slot;
+
+/* what each worker owns, its allocation counts are summed once it is joined */
+typedef struct mkmshar_workerdata {
+    struct mkmshar_pool* pool;
+    mkmshar_counter counter;
+    mkmshar_meter meter;
+} mkmshar_workerdata;
+
+typedef struct mkmshar_pool {
+    const mkmshar_options* options;
+    mkmshar_feed* feed; /* a source is only asked under lock */
+    size_t* origin; /* see mkmshar_finddups, NULL without dedup, the copies are left to the writing thread */
+    const mkmshar_entry* plan; /* see mkmshar_plan, NULL without a manifest */
+    const mkmshar_look* looks; /* see mkmshar_lookall, NULL if the files were not looked at up front */
+    size_t next; /* next file a worker may claim */
+    size_t written; /* files the writing thread is done with */
+    size_t window;
+    int abort;
+    mkmshar_slot* slots;
+    pthread_mutex_t lock;
+    pthread_cond_t claimable;
+    pthread_cond_t ready;
+} mkmshar_pool;
+
+static void* mkmshar_worker(void* arg){
+    mkmshar_workerdata* me = (mkmshar_workerdata*) arg;
+    mkmshar_pool* pool = me->pool;
+    mkmshar_arena arena;
+
+    mkmshar_arena_init(&arena, &me->counter.face);
+
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        size_t i;
+        const char* path = NULL;
+        mkmshar_fileresult res;
+        mkmshar_slot* slot;
+        int status = 1;
+        int err = 0;
+
+        memset(&res, 0, sizeof(res));
+
+        /* never run more than a window ahead of the writer, that is what bounds memory */
+        while(!pool->abort && mkmshar_feed_more(pool->feed, pool->next) && pool->next >= pool->written + pool->window){
+            pthread_cond_wait(&pool->claimable, &pool->lock);
+        }
+        if(pool->abort || !mkmshar_feed_next(pool->feed, pool->next, &path)){
+            /* the writer may be waiting for a file that is not coming */
+            pthread_cond_broadcast(&pool->ready);
+            break;
+        }
+        i = pool->next++;
+        /* the slot is ours, the writer is done with whatever was in it before, it now grows from this thread's allocator */
+        slot = &pool->slots[i % pool->window];
+        slot->path = path;
+        pthread_mutex_unlock(&pool->lock);
+
+        slot->out.len = 0;
+        slot->out.a = &me->counter.face;
+
+        if(pool->plan != NULL && pool->plan[i].block == MXPSQL_MShar_ENTRY_NONE){
+            /* done with when it was planned, the writer skips it */
+            status = 0;
+        }
+        else if(pool->origin != NULL && pool->origin[i] < MXPSQL_MShar_DUP_FAILED){
+            status = MXPSQL_MShar_SLOT_DEFERRED;
+        }
+        else if(path != NULL){
+            struct stat st;
+            int big;
+            if(pool->looks != NULL){
+                const mkmshar_look* l = &pool->looks[i];
+                big = (l->err == 0 && l->info.regular && (!l->info.sized || (unsigned long) l->info.size > (unsigned long) (MXPSQL_MShar_PARALLEL_MAX_BLOCK)));
+            }
+            else{
+                big = (stat(path, &st) == 0 && S_ISREG(st.st_mode) && (unsigned long) st.st_size > (unsigned long) (MXPSQL_MShar_PARALLEL_MAX_BLOCK));
+            }
+            if(big){
+                status = MXPSQL_MShar_SLOT_DEFERRED;
+            }
+            else{
+                status = mkmshar_emitscratch(&arena, path, NULL, 0, pool->options, mkmshar_sink_str, &slot->out, &res, &me->meter);
+                err = errno;
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        slot->status = status;
+        slot->res = res;
+        slot->err = err;
+        slot->done = 1;
+        pthread_cond_broadcast(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    mkmshar_arena_free(&arena);
+    return NULL;
+}
+
+/* workers encode, the calling thread writes the blocks in order */
+static int mkmshar_emitpar(mkmshar_ctx* ctx, mkmshar_counter* counter, mkmshar_feed* feed, const mkmshar_look* looks, size_t* origin, const mkmshar_entry* plan, size_t nthreads, mkmshar_out* out){
+    const mkmshar_allocator* a = &counter->face;
+    mkmshar_pool pool;
+    pthread_t* threads = NULL;
+    mkmshar_workerdata* workers = NULL;
+    mkmshar_arena arena;
+    size_t started = 0;
+    size_t i;
+    int ret = 0;
+    int err = 0;
+
+    pool.options = &ctx->options;
+    pool.feed = feed;
+    pool.origin = origin;
+    pool.plan = plan;
+    pool.looks = looks;
+    pool.next = 0;
+    pool.written = 0;
+    pool.window = nthreads * (MXPSQL_MShar_REORDER_WINDOW);
+    pool.abort = 0;
+    if(pool.window < nthreads) pool.window = nthreads;
+
+    pool.slots = (mkmshar_slot*) a->alloc(a->userdata, pool.window * sizeof(mkmshar_slot));
+    threads = (pthread_t*) a->alloc(a->userdata, nthreads * sizeof(pthread_t));
+    workers = (mkmshar_workerdata*) a->alloc(a->userdata, nthreads * sizeof(mkmshar_workerdata));
+    if(pool.slots == NULL || threads == NULL || workers == NULL){
+        if(pool.slots != NULL) a->release(a->userdata, pool.slots);
+        if(threads != NULL) a->release(a->userdata, threads);
+        if(workers != NULL) a->release(a->userdata, workers);
+        errno = ENOMEM;
+        return -1;
+    }
+    for(i = 0; i < pool.window; i++){
+        mkmshar_buf_init(&pool.slots[i].out, a);
+        pool.slots[i].path = NULL;
+        pool.slots[i].done = 0;
+    }
+    for(i = 0; i < nthreads; i++){
+        workers[i].pool = &pool;
+        mkmshar_counter_init(&workers[i].counter, counter->real);
+        mkmshar_meter_init(&workers[i].meter, out->meter->on);
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.claimable, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+
+    for(i = 0; i < nthreads; i++){
+        if(pthread_create(&threads[started], NULL, mkmshar_worker, &workers[started]) == 0){
+            started++;
+        }
+    }
+
+    if(started == 0){
+        /* no threads to be had, do it the old way */
+        ret = mkmshar_emitseq(ctx, counter, feed, origin, plan, out);
+        err = errno;
+    }
+    else{
+        mkmshar_arena_init(&arena, a);
+
+        for(i = 0; ; i++){
+            mkmshar_slot* slot = &pool.slots[i % pool.window];
+            mkmshar_fileresult res;
+            size_t before = ctx->stats.bytes_out;
+            int skip;
+            const char* path;
+            double t;
+            int status;
+
+            pthread_mutex_lock(&pool.lock);
+            while(!slot->done && mkmshar_feed_more(feed, i)){
+                pthread_cond_wait(&pool.ready, &pool.lock);
+            }
+            if(!slot->done){
+                /* every file is written */
+                if(feed->err != 0){
+                    ret = -1;
+                    err = feed->err;
+                }
+                pthread_mutex_unlock(&pool.lock);
+                break;
+            }
+            pthread_mutex_unlock(&pool.lock);
+
+            path = slot->path;
+            skip = (plan != NULL && plan[i].block == MXPSQL_MShar_ENTRY_NONE);
+            status = slot->status;
+            res = slot->res;
+            if(skip){
+                /* nothing to write */
+            }
+            else if(status == MXPSQL_MShar_SLOT_DEFERRED && MXPSQL_MShar_DUP_COPY(origin, i)){
+                status = mkmshar_copyscratch(&arena, path, feed->files[origin[i]], &ctx->options, mkmshar_out_write, out, &res, out->meter);
+                err = errno;
+            }
+            else if(status == MXPSQL_MShar_SLOT_DEFERRED){
+                status = mkmshar_emitscratch(&arena, path, NULL, 0, &ctx->options, mkmshar_out_write, out, &res, out->meter);
+                err = errno;
+            }
+            else if(status == 0){
+                /* a pooled file took its encoding time plus the time to write it out */
+                t = mkmshar_meter_start(out->meter);
+                if(mkmshar_out_write(out, slot->out.data, slot->out.len) != 0){
+                    status = -1;
+                    err = errno;
+                }
+                if(out->meter->on) res.seconds += mkmshar_now() - t;
+            }
+            else{
+                err = slot->err;
+            }
+
+            pthread_mutex_lock(&pool.lock);
+            slot->done = 0;
+            pool.written++;
+            pthread_cond_broadcast(&pool.claimable);
+            pthread_mutex_unlock(&pool.lock);
+
+            if(skip){
+                continue;
+            }
+            if(plan != NULL){
+                int planned = mkmshar_planned(&plan[i], status, ctx->stats.bytes_out - before);
+                if(status == 0 && planned != 0) err = errno;
+                status = planned;
+            }
+            if(status != 0 && origin != NULL){
+                origin[i] = MXPSQL_MShar_DUP_FAILED;
+            }
+            if(mkmshar_feed_done(feed, ctx, path, status, &res) != 0){
+                ret = -1;
+                break;
+            }
+        }
+
+        mkmshar_arena_free(&arena);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.abort = 1;
+    pthread_cond_broadcast(&pool.claimable);
+    pthread_mutex_unlock(&pool.lock);
+
+    for(i = 0; i < started; i++){
+        int p;
+
+        pthread_join(threads[i], NULL);
+        counter->allocs += workers[i].counter.allocs;
+        counter->reallocs += workers[i].counter.reallocs;
+        for(p = 0; p < MXPSQL_MShar_PHASES; p++){
+            out->meter->phase[p] += workers[i].meter.phase[p];
+        }
+    }
+
+    pthread_cond_destroy(&pool.ready);
+    pthread_cond_destroy(&pool.claimable);
+    pthread_mutex_destroy(&pool.lock);
+
+    /* files claimed after the one that stopped the build are never written, their paths still go back */
+    if(ret != 0 && started > 0){
+        for(i = pool.written; i < pool.next; i++){
+            mkmshar_feed_release(feed, pool.slots[i % pool.window].path);
+        }
+    }
+
+    /* the slots were grown through the workers' counters, those are only counted, not freed, so they are still good */
+    for(i = 0; i < pool.window; i++){
+        mkmshar_buf_free(&pool.slots[i].out);
+    }
+    a->release(a->userdata, pool.slots);
+    a->release(a->userdata, threads);
+    a->release(a->userdata, workers);
+
+    errno = err;
+    return ret;
+}
+#endif
+
+/* n raw bytes to writer, through z first if it is not NULL */
+static int mkmshar_rawpiece(mkmshar_deflate* z, unsigned long* crc, const char* data, size_t n, mkmshar_write_func writer, void* userdata, mkmshar_meter* meter){
+    double t;
+    int ret;
+
+    if(crc != NULL){
+        t = mkmshar_meter_start(meter);
+        *crc = mkmshar_cksumUpdate(*crc, data, n);
+        mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_BASE64, t);
+    }
+    if(z == NULL){
+        return writer(userdata, data, n);
+    }
+
+    t = mkmshar_meter_start(meter);
+    if(mkmshar_deflate_write(z, data, n) != 0){
+        return -1;
+    }
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_COMPRESS, t);
+    ret = (z->out.len > 0) ? writer(userdata, z->out.data, z->out.len) : 0;
+    z->out.len = 0;
+    return ret;
+}
+
+/* copy size raw bytes of path to writer (as one gzip member if z is not NULL, with their CRC into crc if not NULL), mapped when big enough like mkmshar_emitfile, 0, 1 if the file could not be opened or read (or is shorter than size), -1 on memory allocation or writer failures */
+static int mkmshar_emitraw(const char* path, size_t size, mkmshar_buf* readbuf, mkmshar_deflate* z, unsigned long* crc, mkmshar_write_func writer, void* userdata, mkmshar_meter* meter){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t chunk = MXPSQL_MShar_CHUNK_SIZE;
+    size_t left = size;
+    int mapped = 0;
+    int ret = 0;
+    FILE* fptr = NULL;
+    double t;
+
+    if(z != NULL && mkmshar_deflate_reset(z) != 0){
+        return -1;
+    }
+
+    t = mkmshar_meter_start(meter);
+    fptr = fopen(path, "rb");
+    mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_OPEN, t);
+    if(fptr == NULL){
+        return 1;
+    }
+
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    /* no copy at all, the mapping goes straight to the writer (or the compressor) */
+    if(size > 0 && size >= (size_t) (MXPSQL_MShar_MMAP_THRESHOLD)){
+        struct stat st;
+        void* map = MAP_FAILED;
+
+        t = mkmshar_meter_start(meter);
+        if(fstat(fileno(fptr), &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= 0 && (unsigned long) st.st_size >= (unsigned long) size){
+            map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fptr), 0);
+        }
+        mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_READ, t);
+        if(map != MAP_FAILED){
+            size_t off;
+
+            #ifdef MADV_SEQUENTIAL
+            madvise(map, size, MADV_SEQUENTIAL);
+            #endif
+            if(z == NULL && crc == NULL){
+                ret = writer(userdata, (const char*) map, size);
+            }
+            /* a chunk at a time, or all of the compressed file piles up in z */
+            for(off = 0; (z != NULL || crc != NULL) && off < size && ret == 0; off += chunk){
+                ret = mkmshar_rawpiece(z, crc, ((const char*) map) + off, (size - off < chunk) ? size - off : chunk, writer, userdata, meter);
+            }
+            munmap(map, size);
+            left = 0;
+            mapped = 1;
+        }
+    }
+    #endif
+
+    if(size < chunk){
+        chunk = (size > 0) ? size : 1;
+    }
+    if(!mapped && mkmshar_buf_fit(readbuf, chunk) != 0){
+        ret = -1;
+    }
+
+    while(left > 0 && ret == 0){
+        size_t want = (left < chunk) ? left : chunk;
+        size_t n;
+
+        t = mkmshar_meter_start(meter);
+        n = fread(readbuf->data, 1, want, fptr);
+        mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_READ, t);
+
+        if(n != want){
+            /* it shrank since it was sized, or could not be read */
+            if(!ferror(fptr)) errno = EIO;
+            ret = 1;
+            break;
+        }
+        ret = mkmshar_rawpiece(z, crc, readbuf->data, n, writer, userdata, meter);
+        left -= n;
+    }
+    fclose(fptr);
+
+    if(ret == 0 && z != NULL){
+        t = mkmshar_meter_start(meter);
+        ret = mkmshar_deflate_finish(z);
+        mkmshar_meter_stop(meter, MXPSQL_MShar_PHASE_COMPRESS, t);
+        if(ret == 0) ret = writer(userdata, z->out.data, z->out.len);
+        z->out.len = 0;
+    }
+    return ret;
+}
+
+/* in the header of archives with compressed files */
+static const char mkmshar_gzipcheck[] =
+"if ! command -v gzip > /dev/null 2>&1; then\n\
+    printf \"The gzip command is not found. \\nIt is needed to extract the compressed files of this archive. \\nPlease make it available in PATH or install it.\\n\";\n\
+    exit 1;\n\
+fi\n\
+\n";
+
+/* MXPSQL_MShar_LAYOUT_TRAILER, every file is sized, the whole script is put together and written, then the files go after it as they are */
+static int mkmshar_emittrailer(mkmshar_ctx* ctx, mkmshar_counter* counter, const char* prescript, const char* postscript, char** files, size_t nfiles, const mkmshar_look* looks, size_t* origin, mkmshar_out* out){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    static const char* prestr = (char*)
+"#!/bin/sh \n\
+# This archive is created using MShar, MXPSQL's version of the Shell archiver\n\
+# You need a unix bourne shell, tail and head or dd to extract this, the files are stored raw after the exit at the end of the script\n\
+\n\
+# shellcheck disable=SC2034 # GNU utilities\n\
+\n";
+    /* the manifest goes in between, with options.manifest */
+    static const char* prestr1 = (char*)
+"TEKTONE=;\n\
+DIRNAME=;\n\
+POSIXLY_CORRECT=1; # Make this posix \n\
+POSIX_ME_HARDER=1; # Make this posix \n\
+MSHAR_SKIP=";
+    /* MSHAR_SKIP is the size of the script, padded to 20 columns so it can be filled in once the script is done, then mkmshar_selfhead */
+    static const char* prestr2 = (char*)
+"mshar_cut(){\n\
+    if test \"$((MSHAR_SKIP + $1 + $2))\" -gt \"$MSHAR_TOTAL\"; then\n\
+        printf \"x - %s is cut short in the archive\\n\" \"$TEKTONE\" >&2;\n\
+        return 1;\n\
+    fi\n\
+    if test -n \"$MSHAR_HEADC\"; then\n\
+        tail -c +\"$((MSHAR_SKIP + $1 + 1))\" \"$MSHAR_SELF\" | head -c \"$2\";\n\
+    else\n\
+        tail -c +\"$((MSHAR_SKIP + $1 + 1))\" \"$MSHAR_SELF\" | dd bs=1 count=\"$2\" 2> /dev/null;\n\
+    fi\n\
+}\n\
+\n\
+printf \"This archive is created with MShar (MXPSQL's version of the Shell archiver)\\n\";\n\
+\n\n\n";
+    static const char* poststr = (char*)
+"\n\
+# This is a shell archive lol, created with mshar (MXPSQL's version of the Shell archiver)\n\
+POSIXLY_CORRECT=; # Unposix it as we Done\n\
+POSIX_ME_HARDER=; # Unposix it as we Done\n\
+if test -n \"$MSHAR_CUTBAD\"; then\n\
+    printf \"Some files could not be cut out of the archive.\\n\";\n\
+    exit 1;\n\
+fi\n\
+exit 0;\
+\n";
+
+    const mkmshar_allocator* a = &counter->face;
+    mkmshar_buf script;
+    mkmshar_buf body;
+    mkmshar_buf readbuf;
+    mkmshar_deflate z;
+    mkmshar_entry* plan = NULL; /* with options.manifest */
+    size_t* sizes = NULL;
+    size_t* packs = NULL; /* what goes into the archive, smaller than the size when compressed, 0 for copies */
+    size_t* sums = NULL; /* cksum CRCs, with options.checksum */
+    size_t skipat = 0;
+    size_t baseat = 0;
+    size_t offset = 0;
+    size_t i;
+    int ret = 0;
+    double t;
+
+    mkmshar_buf_init(&script, a);
+    mkmshar_buf_init(&body, a);
+    mkmshar_buf_init(&readbuf, a);
+    sizes = (size_t*) a->alloc(a->userdata, 3 * (nfiles > 0 ? nfiles : 1) * sizeof(size_t));
+    if(ctx->options.manifest){
+        plan = (mkmshar_entry*) a->alloc(a->userdata, (nfiles > 0 ? nfiles : 1) * sizeof(mkmshar_entry));
+    }
+    if(sizes == NULL || (ctx->options.manifest && plan == NULL)){
+        if(sizes != NULL) a->release(a->userdata, sizes);
+        if(plan != NULL) a->release(a->userdata, plan);
+        errno = ENOMEM;
+        return -1;
+    }
+    packs = sizes + nfiles;
+    sums = packs + nfiles;
+    if(ctx->options.compress && mkmshar_deflate_init(&z, a) != 0){
+        a->release(a->userdata, sizes);
+        if(plan != NULL) a->release(a->userdata, plan);
+        return -1;
+    }
+
+    /* sizes first (mkmshar_lookall found them), a file that cannot be sized is dropped (or stops the build) before anything is written */
+    for(i = 0; i < nfiles && ret == 0; i++){
+        int status = 1;
+
+        sums[i] = 0;
+        if(files[i] != NULL){
+            status = (plan != NULL) ? mkmshar_looklisted(&looks[i], files[i]) : mkmshar_looksized(&looks[i]);
+            sizes[i] = looks[i].info.size;
+            packs[i] = looks[i].info.size;
+        }
+
+        if(status == 0 && MXPSQL_MShar_DUP_COPY(origin, i)){
+            packs[i] = 0;
+            sums[i] = sums[origin[i]];
+        }
+        /* the compressed size and the checksum have to be in the script too, so the file is read once for them first (the second time is the same) */
+        else if(status == 0 && ((ctx->options.compress && sizes[i] >= MXPSQL_MShar_Z_MIN) || ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF)){
+            int zip = ctx->options.compress && sizes[i] >= MXPSQL_MShar_Z_MIN;
+            unsigned long crc = 0;
+            mkmshar_tally tally;
+            tally.writer = NULL;
+            tally.userdata = NULL;
+            tally.n = 0;
+            /* only a file that cannot be read can be skipped, running out of memory stops the build */
+            status = mkmshar_emitraw(files[i], sizes[i], &readbuf, zip ? &z : NULL, (ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF) ? &crc : NULL, mkmshar_sink_tally, &tally, out->meter);
+            if(status == 0 && zip && tally.n < sizes[i]){
+                packs[i] = tally.n;
+            }
+            sums[i] = (size_t) mkmshar_cksumFinal(crc, sizes[i]);
+        }
+
+        if(status != 0){
+            mkmshar_fileresult res;
+            sizes[i] = (size_t) -1;
+            if(origin != NULL) origin[i] = MXPSQL_MShar_DUP_FAILED;
+            memset(&res, 0, sizeof(res));
+            ret = mkmshar_filedone(ctx, files[i], status, &res);
+        }
+    }
+
+    /* the blocks first, with a manifest their lengths go in before them */
+    if(ret == 0){
+        t = mkmshar_meter_start(out->meter);
+        for(i = 0; i < nfiles && ret == 0; i++){
+            mkmshar_fileresult res;
+            size_t before = body.len;
+
+            if(plan != NULL){
+                plan[i].block = MXPSQL_MShar_ENTRY_NONE;
+                plan[i].size = sizes[i];
+                plan[i].encoded = packs[i];
+                plan[i].crc = (unsigned long) sums[i];
+            }
+            if(sizes[i] == (size_t) -1) continue;
+            if(MXPSQL_MShar_DUP_COPY(origin, i)){
+                ret = mkmshar_emitcopy(files[i], files[origin[i]], &ctx->options, &body, &res);
+            }
+            else{
+                if(mkmshar_buf_appends(&body, mkmshar_blk_name1) != 0 || mkmshar_buf_appends(&body, files[i]) != 0 || mkmshar_buf_appends(&body, mkmshar_blk_name2) != 0
+                    || (ctx->options.selective && mkmshar_buf_appends(&body, mkmshar_blk_want) != 0)
+                    || mkmshar_buf_appends(&body, mkmshar_blk_dirname) != 0 || mkmshar_buf_appends(&body, mkmshar_blk_info) != 0 || mkmshar_buf_appends(&body, mkmshar_blk_marker) != 0
+                    || mkmshar_buf_appends(&body, mkmshar_blk_cut1) != 0
+                    || mkmshar_buf_appendul(&body, offset) != 0 || mkmshar_buf_append(&body, " ", 1) != 0 || mkmshar_buf_appendul(&body, packs[i]) != 0
+                    || mkmshar_buf_appends(&body, (packs[i] < sizes[i]) ? mkmshar_blk_cut2gz : mkmshar_blk_cut2) != 0
+                    || (ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF && mkmshar_checkline(&body, (unsigned long) sums[i], sizes[i]) != 0)
+                    || (ctx->options.selective && mkmshar_buf_appends(&body, mkmshar_blk_end) != 0)){
+                    ret = -1;
+                }
+                offset += packs[i];
+            }
+            if(plan != NULL) plan[i].block = body.len - before;
+        }
+
+        /* all of the script in one piece, MSHAR_SKIP (and MSHAR_BASE) is only known once it is done */
+        if(ret == 0) ret = mkmshar_buf_appends(&script, prestr);
+        if(ret == 0 && plan != NULL) ret = mkmshar_manifesthead(&script, files, nfiles, plan, ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF, &baseat);
+        if(ret == 0) ret = mkmshar_selecthead(&ctx->options, &script);
+        if(ret == 0) ret = mkmshar_buf_appends(&script, prestr1);
+        skipat = script.len;
+        if(ret == 0) ret = mkmshar_buf_appends(&script, "                    ;\n");
+        if(ret == 0) ret = mkmshar_buf_appends(&script, mkmshar_selfhead);
+        if(ret == 0) ret = mkmshar_buf_appends(&script, mkmshar_selfcheck);
+        if(ret == 0) ret = mkmshar_buf_appends(&script, prestr2);
+        if(ret == 0 && ctx->options.compress) ret = mkmshar_buf_appends(&script, mkmshar_gzipcheck);
+        if(ret == 0) ret = mkmshar_checkhead(&ctx->options, mkmshar_sink_str, &script);
+        if(ret == 0) ret = mkmshar_copyhead(&ctx->options, &script, files, nfiles, origin);
+        if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&script, mkmshar_pick1);
+        if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&script, mkmshar_pickline);
+        if(ret == 0 && plan != NULL && ctx->options.selective) ret = mkmshar_buf_appends(&script, mkmshar_pickwant);
+        if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&script, mkmshar_pick2);
+        if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&script, mkmshar_pick3);
+        if(ret == 0 && plan != NULL && ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF) ret = mkmshar_buf_appends(&script, mkmshar_pickfrom);
+        if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&script, mkmshar_pick4);
+        if(ret == 0 && prescript != NULL) ret = mkmshar_buf_appends(&script, prescript);
+        /* the padding is spaces, so the number still ends where the word does */
+        if(ret == 0 && plan != NULL) mkmshar_ultoa(script.data + baseat, script.len);
+        if(ret == 0) ret = mkmshar_buf_append(&script, body.data, body.len);
+        if(ret == 0 && postscript != NULL) ret = mkmshar_buf_appends(&script, postscript);
+        if(ret == 0 && ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF) ret = mkmshar_buf_appends(&script, mkmshar_cksumend);
+        else if(ret == 0 && ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF) ret = mkmshar_buf_appends(&script, mkmshar_copyend);
+        if(ret == 0) ret = mkmshar_buf_appends(&script, poststr);
+        if(ret == 0) mkmshar_ultoa(script.data + skipat, script.len);
+        mkmshar_meter_stop(out->meter, MXPSQL_MShar_PHASE_FORMAT, t);
+    }
+    mkmshar_buf_free(&body);
+
+    if(ret == 0) ret = mkmshar_out_write(out, script.data, script.len);
+    mkmshar_buf_free(&script);
+
+    for(i = 0; i < nfiles && ret == 0; i++){
+        mkmshar_fileresult res;
+        mkmshar_tally tally;
+        int status;
+
+        if(sizes[i] == (size_t) -1) continue;
+        if(MXPSQL_MShar_DUP_COPY(origin, i)){
+            /* its block is in the script already */
+            memset(&res, 0, sizeof(res));
+            res.duplicate = 1;
+            ret = mkmshar_filedone(ctx, files[i], 0, &res);
+            continue;
+        }
+
+        tally.writer = mkmshar_out_write;
+        tally.userdata = out;
+        tally.n = 0;
+        t = mkmshar_meter_start(out->meter);
+        status = mkmshar_emitraw(files[i], sizes[i], &readbuf, (packs[i] < sizes[i]) ? &z : NULL, NULL, mkmshar_sink_tally, &tally, out->meter);
+        if(status == 0 && tally.n != packs[i]){
+            /* changed since it was counted, the offsets after it would be wrong */
+            errno = EIO;
+            status = -1;
+        }
+        else if(status > 0){
+            /* the script has its offsets already, a file that is gone now cannot be skipped */
+            status = -1;
+        }
+        res.nbytes = sizes[i];
+        res.packed = packs[i];
+        res.compressed = (packs[i] < sizes[i]);
+        res.duplicate = 0;
+        res.crc = (unsigned long) sums[i];
+        res.seconds = out->meter->on ? mkmshar_now() - t : 0.0;
+        ret = mkmshar_filedone(ctx, files[i], status, &res);
+    }
+
+    if(ctx->options.compress) mkmshar_deflate_free(&z);
+    mkmshar_buf_free(&readbuf);
+    a->release(a->userdata, sizes);
+    if(plan != NULL) a->release(a->userdata, plan);
+    return ret;
+}
+
+void mkmshar_ctx_init(mkmshar_ctx* ctx){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    ctx->allocator.alloc = mkmshar_default_alloc;
+    ctx->allocator.resize = mkmshar_default_resize;
+    ctx->allocator.release = mkmshar_default_release;
+    ctx->allocator.userdata = NULL;
+    ctx->options.ignorefileerrors = 0;
+    ctx->options.nthreads = 1;
+    ctx->options.timing = 0;
+    ctx->options.layout = MXPSQL_MShar_LAYOUT_PRINTF;
+    ctx->options.compress = 0;
+    ctx->options.dedup = MXPSQL_MShar_DEDUP_OFF;
+    ctx->options.checksum = MXPSQL_MShar_CHECKSUM_OFF;
+    ctx->options.manifest = 0;
+    ctx->options.selective = 0;
+    ctx->options.recurse = 0;
+    ctx->options.include = NULL;
+    ctx->options.ninclude = 0;
+    ctx->options.exclude = NULL;
+    ctx->options.nexclude = 0;
+    ctx->options.uring = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->err = 0;
+    ctx->errpath = NULL;
+    ctx->kept = NULL;
+}
+
+/* the whole archive, header, scripts, file blocks and footer */
+static int mkmshar_ctx_emit(mkmshar_ctx* ctx, mkmshar_counter* counter, mkmshar_meter* meter, const char* prescript, const char* postscript, mkmshar_feed* feed, const mkmshar_look* looks, size_t* origin, mkmshar_write_func writer, void* userdata){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    static const char* prestr = (char*)
+"#!/bin/sh \n\
+# This archive is created using MShar, MXPSQL's version of the Shell archiver\n\
+# You need a unix bourne shell and the base64 command to extract this\n\
+\n\
+# shellcheck disable=SC2034 # GNU utilities\n\
+\n";
+    /* the manifest goes in between, with options.manifest */
+    static const char* prestr1 = (char*)
+"TEKTONE=;\n\
+DIRNAME=;\n\
+POSIXLY_CORRECT=1; # Make this posix \n\
+POSIX_ME_HARDER=1; # Make this posix \n\
+TTk=\"$(find /bin /usr/bin /usr/local/bin . -name 'base64*' -type f 2> /dev/null | head -n 1)\";\n\n";
+
+    static const char* prestr2 = (char*)
+"printf \"This archive is created with MShar (MXPSQL's version of the Shell archiver)\\n\";\n\
+\n\
+if test -z \"$TTk\"; then\n\
+    printf \"The base64 command is not found you loser. \\nIt is needed to extract the archive. \\nPlease make it available in PATH or install it.\\n\";\n\
+    exit 1;\n\
+fi\n\
+\n\n\n";
+
+    static const char* poststr = (char*)
+"\n\
+# This is a shell archive lol, created with mshar (MXPSQL's version of the Shell archiver)\n\
+POSIXLY_CORRECT=; # Unposix it as we Done\n\
+POSIX_ME_HARDER=; # Unposix it as we Done\n\
+exit 0;\
+\n";
+
+    size_t nthreads = ctx->options.nthreads;
+    char** files = feed->files;
+    size_t nfiles = feed->nfiles;
+    mkmshar_out out;
+    mkmshar_buf head;
+    mkmshar_entry* plan = NULL;
+    size_t baseat = 0;
+    int ret = 0;
+
+    out.ctx = ctx;
+    out.meter = meter;
+    out.writer = writer;
+    out.userdata = userdata;
+
+    if(ctx->options.layout == MXPSQL_MShar_LAYOUT_TRAILER){
+        return mkmshar_emittrailer(ctx, counter, prescript, postscript, files, nfiles, looks, origin, &out);
+    }
+
+    #ifdef MXPSQL_MShar_THREADS
+    if(nthreads == 0){
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (online > 0) ? (size_t) online : 1;
+    }
+    #endif
+    /* more threads than files only burns stacks, a source has as many as it has */
+    if(feed->source == NULL && nthreads > nfiles){
+        nthreads = nfiles;
+    }
+
+    if(ctx->options.manifest){
+        plan = (mkmshar_entry*) counter->face.alloc(counter->face.userdata, (nfiles > 0 ? nfiles : 1) * sizeof(mkmshar_entry));
+        if(plan == NULL){
+            errno = ENOMEM;
+            return -1;
+        }
+        if(mkmshar_plan(ctx, counter, files, nfiles, looks, origin, plan, meter) != 0){
+            counter->face.release(counter->face.userdata, plan);
+            return -1;
+        }
+    }
+
+    /* the header in one piece, with a manifest MSHAR_BASE is only known once it is done */
+    mkmshar_buf_init(&head, &counter->face);
+    ret = mkmshar_buf_appends(&head, prestr);
+    if(ret == 0 && plan != NULL) ret = mkmshar_manifesthead(&head, files, nfiles, plan, ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF, &baseat);
+    if(ret == 0) ret = mkmshar_selecthead(&ctx->options, &head);
+    if(ret == 0) ret = mkmshar_buf_appends(&head, prestr1);
+    if(ret == 0) ret = mkmshar_buf_appends(&head, prestr2);
+    if(ret == 0 && ctx->options.compress) ret = mkmshar_buf_appends(&head, mkmshar_gzipcheck);
+    if(ret == 0) ret = mkmshar_checkhead(&ctx->options, mkmshar_sink_str, &head);
+    if(ret == 0) ret = mkmshar_copyhead(&ctx->options, &head, files, nfiles, origin);
+    if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&head, mkmshar_selfhead);
+    if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&head, mkmshar_pick1);
+    if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&head, mkmshar_pickline);
+    if(ret == 0 && plan != NULL && ctx->options.selective) ret = mkmshar_buf_appends(&head, mkmshar_pickwant);
+    if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&head, mkmshar_pick2);
+    if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&head, mkmshar_pick3);
+    if(ret == 0 && plan != NULL && ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF) ret = mkmshar_buf_appends(&head, mkmshar_pickfrom);
+    if(ret == 0 && plan != NULL) ret = mkmshar_buf_appends(&head, mkmshar_pick4);
+    /* the padding is spaces, so the number still ends where the word does */
+    if(ret == 0 && plan != NULL) mkmshar_ultoa(head.data + baseat, head.len + ((prescript != NULL) ? strlen(prescript) : 0));
+    if(ret == 0) ret = mkmshar_out_write(&out, head.data, head.len);
+    mkmshar_buf_free(&head);
+
+    if(ret == 0 && prescript != NULL){
+        ret = mkmshar_out_write(&out, prescript, strlen(prescript));
+    }
+
+    #ifdef MXPSQL_MShar_THREADS
+    if(ret == 0 && nthreads > 1){
+        ret = mkmshar_emitpar(ctx, counter, feed, looks, origin, plan, nthreads, &out);
+    }
+    else
+    #endif
+    if(ret == 0){
+        ret = mkmshar_emitseq(ctx, counter, feed, origin, plan, &out);
+    }
+
+    if(ret == 0 && postscript != NULL){
+        ret = mkmshar_out_write(&out, postscript, strlen(postscript));
+    }
+    if(ret == 0 && ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF){
+        ret = mkmshar_out_write(&out, mkmshar_cksumend, strlen(mkmshar_cksumend));
+    }
+    else if(ret == 0 && ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF){
+        ret = mkmshar_out_write(&out, mkmshar_copyend, strlen(mkmshar_copyend));
+    }
+    if(ret == 0){
+        ret = mkmshar_out_write(&out, poststr, strlen(poststr));
+    }
+
+    if(plan != NULL){
+        counter->face.release(counter->face.userdata, plan);
+    }
+    return ret;
+}
+
+/* mkmshar_ctx_emit with errno borrowed and the allocation counts added to the stats */
+static int mkmshar_ctx_run(mkmshar_ctx* ctx, mkmshar_counter* counter, const char* prescript, const char* postscript, mkmshar_feed* feed, mkmshar_write_func writer, void* userdata){
+    /* errno is only borrowed, whatever happens in here ends up in ctx->err and the caller's errno is given back */
+    int saved_errno = errno;
+    mkmshar_meter meter;
+    mkmshar_look* looks = NULL;
+    size_t* origin = NULL;
+    double t;
+    int status = 0;
+
+    ctx->err = 0;
+    ctx->errpath = NULL;
+
+    if((feed->files == NULL && feed->source == NULL) || writer == NULL){
+        ctx->err = EDOM;
+        return -1;
+    }
+
+    mkmshar_meter_init(&meter, ctx->options.timing != 0);
+    t = mkmshar_meter_start(&meter);
+
+    errno = 0;
+    if(ctx->options.checksum != MXPSQL_MShar_CHECKSUM_OFF){
+        /* the tables are filled in here, before any worker uses them */
+        mkmshar_cksumImpl();
+    }
+    if(feed->source == NULL && (ctx->options.layout == MXPSQL_MShar_LAYOUT_TRAILER || ctx->options.manifest || ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF)){
+        /* every pass before the blocks goes by these, so a file is opened to be sized only once */
+        looks = (mkmshar_look*) counter->face.alloc(counter->face.userdata, (feed->nfiles > 0 ? feed->nfiles : 1) * sizeof(mkmshar_look));
+        if(looks == NULL){
+            errno = ENOMEM;
+            status = -1;
+        }
+        else{
+            mkmshar_lookall(feed->files, feed->nfiles, looks, &meter);
+        }
+    }
+    if(status == 0 && ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF && feed->nfiles > 1){
+        origin = (size_t*) counter->face.alloc(counter->face.userdata, feed->nfiles * sizeof(size_t));
+        if(origin == NULL){
+            errno = ENOMEM;
+            status = -1;
+        }
+        else{
+            status = mkmshar_finddups(ctx, counter, &meter, feed->files, feed->nfiles, looks, origin);
+        }
+    }
+    if(status == 0){
+        status = mkmshar_ctx_emit(ctx, counter, &meter, prescript, postscript, feed, looks, origin, writer, userdata);
+    }
+    if(origin != NULL){
+        counter->face.release(counter->face.userdata, origin);
+    }
+    if(looks != NULL){
+        counter->face.release(counter->face.userdata, looks);
+    }
+
+    if(meter.on){
+        ctx->stats.total_seconds += mkmshar_now() - t;
+        ctx->stats.open_seconds += meter.phase[MXPSQL_MShar_PHASE_OPEN];
+        ctx->stats.read_seconds += meter.phase[MXPSQL_MShar_PHASE_READ];
+        ctx->stats.base64_seconds += meter.phase[MXPSQL_MShar_PHASE_BASE64];
+        ctx->stats.format_seconds += meter.phase[MXPSQL_MShar_PHASE_FORMAT];
+        ctx->stats.output_seconds += meter.phase[MXPSQL_MShar_PHASE_OUTPUT];
+        ctx->stats.compress_seconds += meter.phase[MXPSQL_MShar_PHASE_COMPRESS];
+        ctx->stats.dedup_seconds += meter.phase[MXPSQL_MShar_PHASE_DEDUP];
+    }
+
+    if(status != 0){
+        /* a writer or allocator that failed without saying why still has to leave an error */
+        ctx->err = (errno != 0) ? errno : EIO;
+    }
+    errno = saved_errno;
+    return status;
+}
+
+/* ops of a compiled shell case pattern */
+#define MXPSQL_MShar_PAT_LIT 0
+#define MXPSQL_MShar_PAT_ANY 1
+#define MXPSQL_MShar_PAT_STAR 2
+#define MXPSQL_MShar_PAT_SET 3
+
+typedef struct mkmshar_patop {
+    int kind;
+    const char* text; /* MXPSQL_MShar_PAT_LIT, len bytes with the escapes taken out */
+    size_t len;
+    unsigned char set[32]; /* MXPSQL_MShar_PAT_SET, one bit per byte value */
+} mkmshar_patop;
+
+/* a pattern compiled once so the walk does not parse it again for every path */
+typedef struct mkmshar_pattern {
+    mkmshar_patop* ops; /* the literal text follows the ops in the same block */
+    size_t nops;
+} mkmshar_pattern;
+
+static void mkmshar_pattern_setbit(mkmshar_patop* op, unsigned char c){
+    op->set[c >> 3] = (unsigned char) (op->set[c >> 3] | (1U << (c & 7)));
+}
+
+/* [...] at p into op, the end of it or NULL if it is not closed (then [ is just a character) */
+static const char* mkmshar_pattern_set(const char* p, mkmshar_patop* op){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const char* q = p + 1;
+    int negate = 0;
+    int first = 1;
+    size_t i;
+
+    memset(op->set, 0, sizeof(op->set));
+    if(*q == '!' || *q == '^'){
+        negate = 1;
+        q++;
+    }
+    while(*q != '\0' && (*q != ']' || first)){
+        unsigned char lo;
+        unsigned char hi;
+
+        first = 0;
+        if(*q == '\\' && q[1] != '\0') q++;
+        lo = (unsigned char) *q++;
+        hi = lo;
+        if(*q == '-' && q[1] != '\0' && q[1] != ']'){
+            q++;
+            if(*q == '\\' && q[1] != '\0') q++;
+            hi = (unsigned char) *q++;
+        }
+        for(i = lo; i <= hi; i++) mkmshar_pattern_setbit(op, (unsigned char) i);
+    }
+    if(*q != ']'){
+        return NULL;
+    }
+    if(negate){
+        for(i = 0; i < sizeof(op->set); i++) op->set[i] = (unsigned char) ~op->set[i];
+    }
+    op->kind = MXPSQL_MShar_PAT_SET;
+    return q + 1;
+}
+
+static int mkmshar_pattern_compile(const mkmshar_allocator* a, const char* pattern, mkmshar_pattern* pat){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t n = strlen(pattern);
+    const char* p = pattern;
+    char* text;
+    mkmshar_patop* lit = NULL;
+
+    /* never more ops than characters, nor more literal text */
+    pat->ops = (mkmshar_patop*) a->alloc(a->userdata, (n + 1) * sizeof(mkmshar_patop) + n + 1);
+    if(pat->ops == NULL){
+        errno = ENOMEM;
+        return -1;
+    }
+    pat->nops = 0;
+    text = (char*) (pat->ops + n + 1);
+
+    while(*p != '\0'){
+        mkmshar_patop* op = &pat->ops[pat->nops];
+        const char* end;
+
+        if(*p == '*'){
+            while(*p == '*') p++;
+            op->kind = MXPSQL_MShar_PAT_STAR;
+            pat->nops++;
+            lit = NULL;
+            continue;
+        }
+        if(*p == '?'){
+            p++;
+            op->kind = MXPSQL_MShar_PAT_ANY;
+            pat->nops++;
+            lit = NULL;
+            continue;
+        }
+        if(*p == '[' && (end = mkmshar_pattern_set(p, op)) != NULL){
+            p = end;
+            pat->nops++;
+            lit = NULL;
+            continue;
+        }
+        if(*p == '\\' && p[1] != '\0') p++;
+        if(lit == NULL){
+            lit = op;
+            lit->kind = MXPSQL_MShar_PAT_LIT;
+            lit->text = text;
+            lit->len = 0;
+            pat->nops++;
+        }
+        *text++ = *p++;
+        lit->len++;
+    }
+    return 0;
+}
+
+/* 1 if the whole of s matches, * backtracks to the last star only, which is enough as a star matches anything */
+static int mkmshar_pattern_match(const mkmshar_pattern* pat, const char* s){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t n = strlen(s);
+    size_t op = 0;
+    size_t at = 0;
+    size_t star = pat->nops;
+    size_t starat = 0;
+
+    /* *.ext and the like, the common case, is one compare at the end */
+    if(pat->nops == 2 && pat->ops[0].kind == MXPSQL_MShar_PAT_STAR && pat->ops[1].kind == MXPSQL_MShar_PAT_LIT){
+        return n >= pat->ops[1].len && memcmp(s + n - pat->ops[1].len, pat->ops[1].text, pat->ops[1].len) == 0;
+    }
+
+    for(;;){
+        if(op < pat->nops){
+            const mkmshar_patop* o = &pat->ops[op];
+            unsigned char c = (unsigned char) s[at];
+
+            if(o->kind == MXPSQL_MShar_PAT_STAR){
+                star = op++;
+                starat = at;
+                continue;
+            }
+            if(o->kind == MXPSQL_MShar_PAT_LIT && n - at >= o->len && memcmp(s + at, o->text, o->len) == 0){
+                at += o->len;
+                op++;
+                continue;
+            }
+            if(at < n && (o->kind == MXPSQL_MShar_PAT_ANY || (o->kind == MXPSQL_MShar_PAT_SET && (o->set[c >> 3] & (1U << (c & 7))) != 0))){
+                at++;
+                op++;
+                continue;
+            }
+        }
+        else if(at == n){
+            return 1;
+        }
+        /* let the last star take one more character and try again from there */
+        if(star == pat->nops || starat == n){
+            return 0;
+        }
+        starat++;
+        at = starat;
+        op = star + 1;
+    }
+}
+
+/* a path made by the walk, on the list of handed out ones until it is given back, the path follows it */
+typedef struct mkmshar_walkpath {
+    struct mkmshar_walkpath* prev;
+    struct mkmshar_walkpath* next;
+} mkmshar_walkpath;
+
+static char* mkmshar_walkpath_str(mkmshar_walkpath* p){
+    return (char*) (p + 1);
+}
+
+/* dir and name joined with a / (if dir does not end in one already) */
+static mkmshar_walkpath* mkmshar_walkpath_make(const mkmshar_allocator* a, const char* dir, size_t ndir, const char* name){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    size_t nname = strlen(name);
+    size_t slash = (ndir > 0 && dir[ndir - 1] != '/') ? 1 : 0;
+    mkmshar_walkpath* p;
+    char* s;
+
+    #ifdef _WIN32
+    if(ndir > 0 && dir[ndir - 1] == '\\') slash = 0;
+    #endif
+    p = (mkmshar_walkpath*) a->alloc(a->userdata, sizeof(mkmshar_walkpath) + ndir + slash + nname + 1);
+    if(p == NULL){
+        return NULL;
+    }
+    p->prev = NULL;
+    p->next = NULL;
+    s = mkmshar_walkpath_str(p);
+    memcpy(s, dir, ndir);
+    if(slash) s[ndir] = '/';
+    memcpy(s + ndir + slash, name, nname + 1);
+    return p;
+}
+
+/* how far a directory got */
+#define MXPSQL_MShar_WALK_QUEUED 0
+#define MXPSQL_MShar_WALK_READING 1
+#define MXPSQL_MShar_WALK_READ 2
+
+/* what a path found by the walk is */
+#define MXPSQL_MShar_WALK_SKIP 0
+#define MXPSQL_MShar_WALK_FILE 1
+#define MXPSQL_MShar_WALK_DIR 2
+
+struct mkmshar_walkdir;
+
+/* one entry of a directory, a file to hand out or a directory to go into */
+typedef struct mkmshar_walkent {
+    mkmshar_walkpath* path; /* NULL for a directory, and once handed out */
+    struct mkmshar_walkdir* dir; /* NULL for a file, and once gone into */
+} mkmshar_walkent;
+
+typedef struct mkmshar_walkdir {
+    mkmshar_walkpath* path;
+    int state;
+    int err; /* errno of a directory that could not be read, it has no entries then */
+    mkmshar_walkent* ents; /* in strcmp order */
+    size_t nents;
+    struct mkmshar_walkdir* qprev; /* the directories waiting to be read, latest first */
+    struct mkmshar_walkdir* qnext;
+} mkmshar_walkdir;
+
+/* where the walk is in one directory */
+typedef struct mkmshar_walkframe {
+    mkmshar_walkdir* dir;
+    size_t i;
+} mkmshar_walkframe;
+
+struct mkmshar_walkreader;
+
+/* a mkmshar_source that walks the directories of another feed, the directories ahead are read by threads while the build takes the files */
+typedef struct mkmshar_walk {
+    mkmshar_ctx* ctx;
+    mkmshar_feed* outer; /* what was named, walked one entry at a time */
+    size_t nouter;
+    mkmshar_counter counter; /* only next allocates from it, release only gives back */
+    mkmshar_pattern* patterns; /* the includes and then the excludes */
+    size_t ninclude;
+    size_t nexclude;
+    mkmshar_walkframe* frames;
+    size_t nframes;
+    size_t capframes;
+    mkmshar_walkpath* out; /* handed out and not given back yet */
+    mkmshar_walkpath* failpath; /* the directory the walk failed on */
+    size_t skipped;
+    int failed;
+    mkmshar_source source;
+    mkmshar_walkdir* queue;
+    size_t nread; /* directories read or being read and not walked yet */
+    #ifdef MXPSQL_MShar_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t work; /* a directory to read, or stop */
+    pthread_cond_t done; /* a directory has been read */
+    int stop;
+    pthread_t* threads;
+    struct mkmshar_walkreader* readers;
+    size_t nreaders;
+    #endif
+} mkmshar_walk;
+
+typedef struct mkmshar_walkreader {
+    mkmshar_walk* walk;
+    mkmshar_counter counter;
+} mkmshar_walkreader;
+
+static void mkmshar_walk_lock(mkmshar_walk* w){
+    #ifdef MXPSQL_MShar_THREADS
+    if(w->nreaders > 0) pthread_mutex_lock(&w->lock);
+    #else
+    (void) w;
+    #endif
+}
+
+static void mkmshar_walk_unlock(mkmshar_walk* w){
+    #ifdef MXPSQL_MShar_THREADS
+    if(w->nreaders > 0) pthread_mutex_unlock(&w->lock);
+    #else
+    (void) w;
+    #endif
+}
+
+static mkmshar_walkdir* mkmshar_walkdir_new(const mkmshar_allocator* a, mkmshar_walkpath* path){
+    mkmshar_walkdir* d = (mkmshar_walkdir*) a->alloc(a->userdata, sizeof(mkmshar_walkdir));
+
+    if(d == NULL){
+        return NULL;
+    }
+    d->path = path;
+    d->state = MXPSQL_MShar_WALK_QUEUED;
+    d->err = 0;
+    d->ents = NULL;
+    d->nents = 0;
+    d->qprev = NULL;
+    d->qnext = NULL;
+    return d;
+}
+
+/* d and everything under it that was not handed out */
+static void mkmshar_walkdir_free(const mkmshar_allocator* a, mkmshar_walkdir* d){
+    size_t i;
+
+    for(i = 0; i < d->nents; i++){
+        if(d->ents[i].path != NULL) a->release(a->userdata, d->ents[i].path);
+        if(d->ents[i].dir != NULL) mkmshar_walkdir_free(a, d->ents[i].dir);
+    }
+    if(d->ents != NULL) a->release(a->userdata, d->ents);
+    if(d->path != NULL) a->release(a->userdata, d->path);
+    a->release(a->userdata, d);
+}
+
+static void mkmshar_walk_enqueue(mkmshar_walk* w, mkmshar_walkdir* d){
+    d->qprev = NULL;
+    d->qnext = w->queue;
+    if(w->queue != NULL) w->queue->qprev = d;
+    w->queue = d;
+}
+
+static void mkmshar_walk_unqueue(mkmshar_walk* w, mkmshar_walkdir* d){
+    if(d->qprev != NULL) d->qprev->qnext = d->qnext;
+    else w->queue = d->qnext;
+    if(d->qnext != NULL) d->qnext->qprev = d->qprev;
+    d->qprev = NULL;
+    d->qnext = NULL;
+}
+
+static const char* mkmshar_walkent_name(const mkmshar_walkent* e){
+    return mkmshar_walkpath_str(e->dir != NULL ? e->dir->path : e->path);
+}
+
+static int mkmshar_walkent_cmp(const void* a, const void* b){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    return strcmp(mkmshar_walkent_name((const mkmshar_walkent*) a), mkmshar_walkent_name((const mkmshar_walkent*) b));
+}
+
+/* 1 if path matches any of the n patterns */
+static int mkmshar_walk_matches(const mkmshar_pattern* patterns, size_t n, const char* path){
+    size_t i;
+
+    for(i = 0; i < n; i++){
+        if(mkmshar_pattern_match(&patterns[i], path)) return 1;
+    }
+    return 0;
+}
+
+/* files are regular files and links to them, links to directories are not followed and anything else is skipped */
+static int mkmshar_walk_kind(const char* path, int link){
+    #if defined(MXPSQL_MShar_OS_POSIX_SUS) && defined(S_IFLNK)
+    struct stat st;
+
+    if(!link){
+        if(lstat(path, &st) != 0) return MXPSQL_MShar_WALK_SKIP;
+        if(S_ISREG(st.st_mode)) return MXPSQL_MShar_WALK_FILE;
+        if(S_ISDIR(st.st_mode)) return MXPSQL_MShar_WALK_DIR;
+        if(!S_ISLNK(st.st_mode)) return MXPSQL_MShar_WALK_SKIP;
+    }
+    if(stat(path, &st) == 0 && S_ISREG(st.st_mode)) return MXPSQL_MShar_WALK_FILE;
+    #elif defined(MXPSQL_MShar_OS_POSIX_SUS)
+    /* system headers included in strict mode before this one hide lstat, links are followed then */
+    struct stat st;
+
+    (void) link;
+    if(stat(path, &st) != 0) return MXPSQL_MShar_WALK_SKIP;
+    if(S_ISREG(st.st_mode)) return MXPSQL_MShar_WALK_FILE;
+    if(S_ISDIR(st.st_mode)) return MXPSQL_MShar_WALK_DIR;
+    #else
+    (void) path;
+    (void) link;
+    #endif
+    return MXPSQL_MShar_WALK_SKIP;
+}
+
+/* p into d unless it is skipped or filtered out, 0 or an errno */
+static int mkmshar_walk_add(const mkmshar_walk* w, const mkmshar_allocator* a, mkmshar_walkdir* d, size_t* cap, mkmshar_walkpath* p, int kind){
+    const char* s = mkmshar_walkpath_str(p);
+    mkmshar_walkent* e;
+
+    if(kind == MXPSQL_MShar_WALK_SKIP || mkmshar_walk_matches(w->patterns + w->ninclude, w->nexclude, s) || (kind == MXPSQL_MShar_WALK_FILE && w->ninclude > 0 && !mkmshar_walk_matches(w->patterns, w->ninclude, s))){
+        a->release(a->userdata, p);
+        return 0;
+    }
+    if(d->nents == *cap){
+        size_t grown = (*cap > 0) ? *cap * 2 : 16;
+        mkmshar_walkent* ents = (mkmshar_walkent*) a->resize(a->userdata, d->ents, grown * sizeof(mkmshar_walkent));
+        if(ents == NULL){
+            a->release(a->userdata, p);
+            return ENOMEM;
+        }
+        d->ents = ents;
+        *cap = grown;
+    }
+    e = &d->ents[d->nents];
+    e->path = NULL;
+    e->dir = NULL;
+    if(kind == MXPSQL_MShar_WALK_DIR){
+        e->dir = mkmshar_walkdir_new(a, p);
+        if(e->dir == NULL){
+            a->release(a->userdata, p);
+            return ENOMEM;
+        }
+    }
+    else{
+        e->path = p;
+    }
+    d->nents++;
+    return 0;
+}
+
+/* the entries of d, sorted, or d->err */
+static void mkmshar_walk_read(const mkmshar_walk* w, const mkmshar_allocator* a, mkmshar_walkdir* d){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const char* base = mkmshar_walkpath_str(d->path);
+    size_t nbase = strlen(base);
+    size_t cap = 0;
+    size_t i;
+    int err = 0;
+
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    {
+        DIR* dir = opendir(base);
+
+        if(dir == NULL){
+            err = (errno != 0) ? errno : EIO;
+        }
+        while(dir != NULL && err == 0){
+            struct dirent* de;
+            mkmshar_walkpath* p;
+            int kind;
+
+            errno = 0;
+            de = readdir(dir);
+            if(de == NULL){
+                err = errno;
+                break;
+            }
+            if(de->d_name[0] == '.' && (de->d_name[1] == '\0' || (de->d_name[1] == '.' && de->d_name[2] == '\0'))) continue;
+            p = mkmshar_walkpath_make(a, base, nbase, de->d_name);
+            if(p == NULL){
+                err = ENOMEM;
+                break;
+            }
+            /* the type readdir gives saves a stat for everything but links */
+            #ifdef DT_DIR
+            switch(de->d_type){
+                case DT_REG: kind = MXPSQL_MShar_WALK_FILE; break;
+                case DT_DIR: kind = MXPSQL_MShar_WALK_DIR; break;
+                case DT_LNK: kind = mkmshar_walk_kind(mkmshar_walkpath_str(p), 1); break;
+                case DT_UNKNOWN: kind = mkmshar_walk_kind(mkmshar_walkpath_str(p), 0); break;
+                default: kind = MXPSQL_MShar_WALK_SKIP; break;
+            }
+            #else
+            kind = mkmshar_walk_kind(mkmshar_walkpath_str(p), 0);
+            #endif
+            err = mkmshar_walk_add(w, a, d, &cap, p, kind);
+        }
+        if(dir != NULL) closedir(dir);
+    }
+    #elif defined(_WIN32)
+    {
+        struct _finddata_t fd;
+        intptr_t h = -1;
+        mkmshar_walkpath* glob = mkmshar_walkpath_make(a, base, nbase, "*");
+
+        if(glob == NULL){
+            err = ENOMEM;
+        }
+        else{
+            h = _findfirst(mkmshar_walkpath_str(glob), &fd);
+            if(h == -1) err = (errno != 0) ? errno : EIO;
+            a->release(a->userdata, glob);
+        }
+        while(h != -1 && err == 0){
+            if(!(fd.name[0] == '.' && (fd.name[1] == '\0' || (fd.name[1] == '.' && fd.name[2] == '\0')))){
+                mkmshar_walkpath* p = mkmshar_walkpath_make(a, base, nbase, fd.name);
+                if(p == NULL){
+                    err = ENOMEM;
+                    break;
+                }
+                err = mkmshar_walk_add(w, a, d, &cap, p, (fd.attrib & _A_SUBDIR) ? MXPSQL_MShar_WALK_DIR : MXPSQL_MShar_WALK_FILE);
+            }
+            if(err == 0 && _findnext(h, &fd) != 0) break;
+        }
+        if(h != -1) _findclose(h);
+    }
+    #else
+    err = ENOSYS;
+    #endif
+
+    if(err != 0){
+        /* half a directory would be worse than none */
+        for(i = 0; i < d->nents; i++){
+            if(d->ents[i].path != NULL) a->release(a->userdata, d->ents[i].path);
+            if(d->ents[i].dir != NULL) mkmshar_walkdir_free(a, d->ents[i].dir);
+        }
+        d->nents = 0;
+        d->err = err;
+    }
+    if(d->nents > 1){
+        qsort(d->ents, d->nents, sizeof(mkmshar_walkent), mkmshar_walkent_cmp);
+    }
+}
+
+/* d has been read, its directories go on the queue with the first one on top as that is the one walked next, under the lock */
+static void mkmshar_walk_readdone(mkmshar_walk* w, mkmshar_walkdir* d){
+    size_t i;
+
+    d->state = MXPSQL_MShar_WALK_READ;
+    for(i = d->nents; i > 0; i--){
+        if(d->ents[i - 1].dir != NULL) mkmshar_walk_enqueue(w, d->ents[i - 1].dir);
+    }
+    #ifdef MXPSQL_MShar_THREADS
+    if(w->nreaders > 0){
+        pthread_cond_broadcast(&w->done);
+        pthread_cond_broadcast(&w->work);
+    }
+    #endif
+}
+
+#ifdef MXPSQL_MShar_THREADS
+/* reads the queued directories, at most MXPSQL_MShar_WALK_AHEAD ahead of the walk */
+static void* mkmshar_walkreader_run(void* arg){
+    mkmshar_walkreader* r = (mkmshar_walkreader*) arg;
+    mkmshar_walk* w = r->walk;
+
+    pthread_mutex_lock(&w->lock);
+    for(;;){
+        mkmshar_walkdir* d;
+
+        while(!w->stop && (w->queue == NULL || w->nread >= (MXPSQL_MShar_WALK_AHEAD))){
+            pthread_cond_wait(&w->work, &w->lock);
+        }
+        if(w->stop) break;
+        d = w->queue;
+        mkmshar_walk_unqueue(w, d);
+        d->state = MXPSQL_MShar_WALK_READING;
+        w->nread++;
+        pthread_mutex_unlock(&w->lock);
+
+        mkmshar_walk_read(w, &r->counter.face, d);
+
+        pthread_mutex_lock(&w->lock);
+        mkmshar_walk_readdone(w, d);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+#endif
+
+/* p goes on the handed out list, under the lock */
+static const char* mkmshar_walk_handout(mkmshar_walk* w, mkmshar_walkpath* p){
+    p->prev = NULL;
+    p->next = w->out;
+    if(w->out != NULL) w->out->prev = p;
+    w->out = p;
+    return mkmshar_walkpath_str(p);
+}
+
+/* the named entry i of the outer feed as the next root, a path to hand out if it is not a directory */
+static mkmshar_walkpath* mkmshar_walk_root(mkmshar_walk* w, int* err){
+    const mkmshar_allocator* a = &w->counter.face;
+    const char* named;
+    mkmshar_walkpath* p;
+    mkmshar_walkdir* d;
+    int isdir = 0;
+
+    if(!mkmshar_feed_next(w->outer, w->nouter, &named)){
+        *err = w->outer->err;
+        return NULL;
+    }
+    w->nouter++;
+    p = mkmshar_walkpath_make(a, "", 0, named);
+    mkmshar_feed_release(w->outer, named);
+    if(p == NULL){
+        *err = ENOMEM;
+        return NULL;
+    }
+
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    {
+        struct stat st;
+        isdir = (stat(mkmshar_walkpath_str(p), &st) == 0 && S_ISDIR(st.st_mode));
+    }
+    #elif defined(_WIN32)
+    {
+        struct _finddata_t fd;
+        intptr_t h = _findfirst(mkmshar_walkpath_str(p), &fd);
+        if(h != -1){
+            isdir = (fd.attrib & _A_SUBDIR) != 0;
+            _findclose(h);
+        }
+    }
+    #endif
+    /* whatever is not a directory is the encoder's to open, or to fail on */
+    if(!isdir){
+        return p;
+    }
+
+    if(w->nframes == w->capframes){
+        size_t grown = (w->capframes > 0) ? w->capframes * 2 : 16;
+        mkmshar_walkframe* frames = (mkmshar_walkframe*) a->resize(a->userdata, w->frames, grown * sizeof(mkmshar_walkframe));
+        if(frames == NULL){
+            a->release(a->userdata, p);
+            *err = ENOMEM;
+            return NULL;
+        }
+        w->frames = frames;
+        w->capframes = grown;
+    }
+    d = mkmshar_walkdir_new(a, p);
+    if(d == NULL){
+        a->release(a->userdata, p);
+        *err = ENOMEM;
+        return NULL;
+    }
+    w->frames[w->nframes].dir = d;
+    w->frames[w->nframes].i = 0;
+    w->nframes++;
+    mkmshar_walk_enqueue(w, d);
+    #ifdef MXPSQL_MShar_THREADS
+    if(w->nreaders > 0) pthread_cond_broadcast(&w->work);
+    #endif
+    *err = 0;
+    return NULL;
+}
+
+/* mkmshar_source.next, depth first in name order */
+static const char* mkmshar_walk_next(void* userdata){
+    mkmshar_walk* w = (mkmshar_walk*) userdata;
+    const mkmshar_allocator* a = &w->counter.face;
+    const char* path = NULL;
+    int err = 0;
+
+    mkmshar_walk_lock(w);
+    while(!w->failed){
+        mkmshar_walkframe* f;
+        mkmshar_walkdir* d;
+        mkmshar_walkent* e;
+
+        if(w->nframes == 0){
+            mkmshar_walkpath* p = mkmshar_walk_root(w, &err);
+            if(p != NULL){
+                path = mkmshar_walk_handout(w, p);
+                break;
+            }
+            if(w->nframes == 0) break;
+            continue;
+        }
+
+        f = &w->frames[w->nframes - 1];
+        d = f->dir;
+        if(d->state == MXPSQL_MShar_WALK_QUEUED){
+            /* the readers have not got to it, no use waiting for them */
+            mkmshar_walk_unqueue(w, d);
+            d->state = MXPSQL_MShar_WALK_READING;
+            w->nread++;
+            mkmshar_walk_unlock(w);
+            mkmshar_walk_read(w, a, d);
+            mkmshar_walk_lock(w);
+            mkmshar_walk_readdone(w, d);
+        }
+        #ifdef MXPSQL_MShar_THREADS
+        while(d->state != MXPSQL_MShar_WALK_READ){
+            pthread_cond_wait(&w->done, &w->lock);
+        }
+        #endif
+
+        if(d->err != 0){
+            if(w->ctx->options.ignorefileerrors == 0){
+                w->failed = 1;
+                w->failpath = d->path;
+                d->path = NULL;
+                mkmshar_walk_handout(w, w->failpath);
+                err = d->err;
+                break;
+            }
+            w->skipped++;
+            d->err = 0;
+        }
+
+        if(f->i == d->nents){
+            w->nframes--;
+            mkmshar_walkdir_free(a, d);
+            w->nread--;
+            #ifdef MXPSQL_MShar_THREADS
+            if(w->nreaders > 0) pthread_cond_broadcast(&w->work);
+            #endif
+            continue;
+        }
+
+        e = &d->ents[f->i++];
+        if(e->dir == NULL){
+            path = mkmshar_walk_handout(w, e->path);
+            e->path = NULL;
+            break;
+        }
+        if(w->nframes == w->capframes){
+            size_t grown = w->capframes * 2;
+            mkmshar_walkframe* frames = (mkmshar_walkframe*) a->resize(a->userdata, w->frames, grown * sizeof(mkmshar_walkframe));
+            if(frames == NULL){
+                f->i--;
+                err = ENOMEM;
+                break;
+            }
+            w->frames = frames;
+            w->capframes = grown;
+        }
+        w->frames[w->nframes].dir = e->dir;
+        w->frames[w->nframes].i = 0;
+        w->nframes++;
+        e->dir = NULL;
+    }
+    mkmshar_walk_unlock(w);
+
+    errno = err;
+    return path;
+}
+
+/* mkmshar_source.release, takes the path off the handed out list */
+static void mkmshar_walk_release(void* userdata, const char* path){
+    mkmshar_walk* w = (mkmshar_walk*) userdata;
+    mkmshar_walkpath* p = ((mkmshar_walkpath*) path) - 1;
+
+    mkmshar_walk_lock(w);
+    if(p->prev != NULL) p->prev->next = p->next;
+    else w->out = p->next;
+    if(p->next != NULL) p->next->prev = p->prev;
+    mkmshar_walk_unlock(w);
+    w->counter.face.release(w->counter.face.userdata, p);
+}
+
+static int mkmshar_walk_start(mkmshar_walk* w, mkmshar_ctx* ctx, const mkmshar_allocator* real, mkmshar_feed* outer){
+    const mkmshar_options* o = &ctx->options;
+    const mkmshar_allocator* a;
+    size_t i;
+
+    w->ctx = ctx;
+    w->outer = outer;
+    w->nouter = 0;
+    mkmshar_counter_init(&w->counter, real);
+    a = &w->counter.face;
+    w->patterns = NULL;
+    w->ninclude = 0;
+    w->nexclude = 0;
+    w->frames = NULL;
+    w->nframes = 0;
+    w->capframes = 0;
+    w->out = NULL;
+    w->failpath = NULL;
+    w->skipped = 0;
+    w->failed = 0;
+    w->source.next = mkmshar_walk_next;
+    w->source.release = mkmshar_walk_release;
+    w->source.userdata = w;
+    w->queue = NULL;
+    w->nread = 0;
+    #ifdef MXPSQL_MShar_THREADS
+    w->stop = 0;
+    w->threads = NULL;
+    w->readers = NULL;
+    w->nreaders = 0;
+    #endif
+
+    if(o->ninclude + o->nexclude > 0){
+        w->patterns = (mkmshar_pattern*) a->alloc(a->userdata, (o->ninclude + o->nexclude) * sizeof(mkmshar_pattern));
+        if(w->patterns == NULL){
+            errno = ENOMEM;
+            return -1;
+        }
+        for(i = 0; i < o->ninclude + o->nexclude; i++){
+            const char* pattern = (i < o->ninclude) ? o->include[i] : o->exclude[i - o->ninclude];
+            if(pattern == NULL || mkmshar_pattern_compile(a, pattern, &w->patterns[i]) != 0){
+                if(pattern == NULL) errno = EDOM;
+                while(i > 0) a->release(a->userdata, w->patterns[--i].ops);
+                a->release(a->userdata, w->patterns);
+                w->patterns = NULL;
+                return -1;
+            }
+        }
+        w->ninclude = o->ninclude;
+        w->nexclude = o->nexclude;
+    }
+
+    #ifdef MXPSQL_MShar_THREADS
+    {
+        size_t n = o->nthreads;
+        if(n == 0){
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            n = (online > 0) ? (size_t) online : 1;
+        }
+        /* one thread walks as fast inline, and without the locking */
+        if(n > 1){
+            w->threads = (pthread_t*) a->alloc(a->userdata, n * sizeof(pthread_t));
+            w->readers = (mkmshar_walkreader*) a->alloc(a->userdata, n * sizeof(mkmshar_walkreader));
+        }
+        if(w->threads != NULL && w->readers != NULL){
+            pthread_mutex_init(&w->lock, NULL);
+            pthread_cond_init(&w->work, NULL);
+            pthread_cond_init(&w->done, NULL);
+            for(i = 0; i < n; i++){
+                w->readers[i].walk = w;
+                mkmshar_counter_init(&w->readers[i].counter, real);
+                if(pthread_create(&w->threads[i], NULL, mkmshar_walkreader_run, &w->readers[i]) != 0) break;
+            }
+            w->nreaders = i;
+            if(i == 0){
+                pthread_cond_destroy(&w->done);
+                pthread_cond_destroy(&w->work);
+                pthread_mutex_destroy(&w->lock);
+            }
+        }
+    }
+    #endif
+    return 0;
+}
+
+/* stops the readers and frees the walk, the paths the stats and errpath point at go to ctx->kept */
+static void mkmshar_walk_end(mkmshar_walk* w, mkmshar_counter* counter){
+    mkmshar_ctx* ctx = w->ctx;
+    const mkmshar_allocator* a = &w->counter.face;
+    size_t i;
+
+    #ifdef MXPSQL_MShar_THREADS
+    if(w->nreaders > 0){
+        pthread_mutex_lock(&w->lock);
+        w->stop = 1;
+        pthread_cond_broadcast(&w->work);
+        pthread_mutex_unlock(&w->lock);
+        for(i = 0; i < w->nreaders; i++){
+            pthread_join(w->threads[i], NULL);
+            w->counter.allocs += w->readers[i].counter.allocs;
+            w->counter.reallocs += w->readers[i].counter.reallocs;
+        }
+        pthread_cond_destroy(&w->done);
+        pthread_cond_destroy(&w->work);
+        pthread_mutex_destroy(&w->lock);
+    }
+    if(w->threads != NULL) a->release(a->userdata, w->threads);
+    if(w->readers != NULL) a->release(a->userdata, w->readers);
     #endif
 
-    static const char b64e[] = {
-        'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
-        'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
-        'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
-        'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
-        'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
-        'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-        'w', 'x', 'y', 'z', '0', '1', '2', '3',
-        '4', '5', '6', '7', '8', '9', '+', '/'};
+    for(i = 0; i < w->nframes; i++){
+        mkmshar_walkdir_free(a, w->frames[i].dir);
+    }
+    if(w->frames != NULL) a->release(a->userdata, w->frames);
+    for(i = 0; i < w->ninclude + w->nexclude; i++){
+        a->release(a->userdata, w->patterns[i].ops);
+    }
+    if(w->patterns != NULL) a->release(a->userdata, w->patterns);
 
-    size_t outlen = ((((inlen) + 2) / 3) * 4);
+    if(w->failpath != NULL){
+        ctx->errpath = mkmshar_walkpath_str(w->failpath);
+    }
+    ctx->stats.skipped += w->skipped;
+    while(w->out != NULL){
+        mkmshar_walkpath* p = w->out;
+        const char* s = mkmshar_walkpath_str(p);
+        int k;
+
+        w->out = p->next;
+        for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST && ctx->stats.slowest[k].path != s; k++);
+        if(k < MXPSQL_MShar_STATS_SLOWEST || ctx->errpath == s){
+            p->prev = NULL;
+            p->next = (mkmshar_walkpath*) ctx->kept;
+            ctx->kept = p;
+        }
+        else{
+            a->release(a->userdata, p);
+        }
+    }
 
-    char *out = (char*) MXPSQL_MShar_Malloc(outlen + 1);
-    char *p;
-    size_t i;
+    counter->allocs += w->counter.allocs;
+    counter->reallocs += w->counter.reallocs;
+}
 
-    if (out == NULL) {
-        return NULL;
+/* if the stats or errpath point at path they point at a copy of it in ctx->kept from then on, so path can go back to its source */
+static void mkmshar_ctx_keep(mkmshar_ctx* ctx, const mkmshar_allocator* a, const char* path){
+    mkmshar_walkpath* p;
+    int used = (path != NULL && ctx->errpath == path);
+    int k;
+
+    for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST && !used; k++){
+        used = (path != NULL && ctx->stats.slowest[k].path == path);
+    }
+    if(!used){
+        return;
     }
-    out[outlen] = '\0';
-    p = out;
 
-    for (i = 0; i < inlen - 2; i += 3)
-    {
-        *p++ = b64e[(data[i] >> 2) & 0x3F];
-        *p++ = b64e[((data[i] & 0x3) << 4) | ((data[i + 1] & 0xF0) >> 4)];
-        *p++ = b64e[((data[i + 1] & 0xF) << 2) | ((data[i + 2] & 0xC0) >> 6)];
-        *p++ = b64e[data[i + 2] & 0x3F];
+    p = mkmshar_walkpath_make(a, "", 0, path);
+    if(p != NULL){
+        p->next = (mkmshar_walkpath*) ctx->kept;
+        ctx->kept = p;
+    }
+    for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST; k++){
+        if(ctx->stats.slowest[k].path != path) continue;
+        if(p != NULL){
+            ctx->stats.slowest[k].path = mkmshar_walkpath_str(p);
+        }
+        else{
+            /* without a copy the file drops off the list */
+            for(; k + 1 < MXPSQL_MShar_STATS_SLOWEST; k++) ctx->stats.slowest[k] = ctx->stats.slowest[k + 1];
+            ctx->stats.slowest[k].path = NULL;
+            ctx->stats.slowest[k].seconds = 0.0;
+            ctx->stats.slowest[k].bytes = 0;
+        }
+        break;
     }
+    if(ctx->errpath == path){
+        ctx->errpath = (p != NULL) ? mkmshar_walkpath_str(p) : NULL;
+    }
+}
 
-    if (i < inlen)
-    {
-        *p++ = b64e[(data[i] >> 2) & 0x3F];
-        if (i == (inlen - 1))
-        {
-            *p++ = b64e[((data[i] & 0x3) << 4)];
-            *p++ = '=';
+/* the paths of the source the stats and errpath still point at are copied to ctx->kept and given back */
+static void mkmshar_feed_end(mkmshar_feed* feed, mkmshar_ctx* ctx, const mkmshar_allocator* a){
+    int k;
+
+    for(k = 0; k < MXPSQL_MShar_STATS_SLOWEST; k++){
+        mkmshar_ctx_keep(ctx, a, feed->kept[k]);
+        mkmshar_feed_release(feed, feed->kept[k]);
+        feed->kept[k] = NULL;
+    }
+    mkmshar_ctx_keep(ctx, a, feed->failed);
+    mkmshar_feed_release(feed, feed->failed);
+    feed->failed = NULL;
+}
+
+/* the build off a source, streamed when the layout allows and read whole first when not */
+static int mkmshar_ctx_pull(mkmshar_ctx* ctx, mkmshar_counter* counter, const char* prescript, const char* postscript, const mkmshar_source* source, mkmshar_write_func writer, void* userdata){
+    mkmshar_feed feed;
+    char** files = NULL;
+    size_t nfiles = 0;
+    size_t cap = 0;
+    int status = 0;
+
+    mkmshar_feed_init(&feed, NULL, 0, source);
+
+    if(ctx->options.layout == MXPSQL_MShar_LAYOUT_TRAILER || ctx->options.manifest || ctx->options.dedup != MXPSQL_MShar_DEDUP_OFF){
+        /* these need every file before the first block, so the list is read whole and the build goes off the array */
+        int saved_errno = errno;
+        const char* path;
+
+        cap = 256;
+        files = (char**) counter->face.alloc(counter->face.userdata, cap * sizeof(char*));
+        if(files == NULL){
+            ctx->err = ENOMEM;
+            status = -1;
         }
-        else
-        {
-            *p++ = b64e[((data[i] & 0x3) << 4) | ((data[i + 1] & 0xF0) >> 4)];
-            *p++ = b64e[((data[i + 1] & 0xF) << 2)];
+        while(status == 0 && mkmshar_feed_next(&feed, nfiles, &path)){
+            if(nfiles == cap){
+                char** grown;
+                cap *= 2;
+                grown = (char**) counter->face.resize(counter->face.userdata, files, cap * sizeof(char*));
+                if(grown == NULL){
+                    mkmshar_feed_release(&feed, path);
+                    ctx->err = ENOMEM;
+                    status = -1;
+                    break;
+                }
+                files = grown;
+            }
+            files[nfiles++] = (char*) path;
         }
-        *p++ = '=';
+        if(status == 0 && feed.err != 0){
+            ctx->err = feed.err;
+            status = -1;
+        }
+        errno = saved_errno;
+
+        if(status != 0){
+            ctx->errpath = NULL;
+        }
+        else{
+            mkmshar_feed_init(&feed, files, nfiles, NULL);
+            status = mkmshar_ctx_run(ctx, counter, prescript, postscript, &feed, writer, userdata);
+        }
+
+        /* all of them go back now, the stats and errpath get copies of the ones they point at */
+        feed.source = source;
+        while(nfiles > 0){
+            nfiles--;
+            mkmshar_ctx_keep(ctx, &counter->face, files[nfiles]);
+            mkmshar_feed_release(&feed, files[nfiles]);
+        }
+        if(files != NULL) counter->face.release(counter->face.userdata, files);
+    }
+    else{
+        status = mkmshar_ctx_run(ctx, counter, prescript, postscript, &feed, writer, userdata);
+        mkmshar_feed_end(&feed, ctx, &counter->face);
     }
 
-    return out;
+    return status;
 }
 
 
-size_t mkmshar_strnlen(const char *s, size_t maxlen)
-{
+/* the build off files or source, through the walk with options.recurse */
+static int mkmshar_ctx_build(mkmshar_ctx* ctx, mkmshar_counter* counter, const char* prescript, const char* postscript, char** files, size_t nfiles, const mkmshar_source* source, mkmshar_write_func writer, void* userdata){
+    int saved_errno = errno;
+    mkmshar_feed outer;
+    mkmshar_walk walk;
+    int status;
 
-    #if defined(__cplusplus) || defined(c_plusplus)
-    using namespace std;
-    #endif
+    if((files == NULL && (source == NULL || source->next == NULL)) || writer == NULL){
+        ctx->err = EDOM;
+        ctx->errpath = NULL;
+        return -1;
+    }
 
-    #if ((__STDC_VERSION__ >= 201112L) && defined(__STDC_LIB_EXT1__))
-        return strnlen_s(s, maxlen);
-    #else
-    size_t len = 0;
-    while (len < maxlen && s[len] != '\0') {
-        len++;
+    mkmshar_feed_init(&outer, files, nfiles, source);
+    if(ctx->options.recurse == 0){
+        if(source != NULL) return mkmshar_ctx_pull(ctx, counter, prescript, postscript, source, writer, userdata);
+        return mkmshar_ctx_run(ctx, counter, prescript, postscript, &outer, writer, userdata);
     }
-    return len;
-    #endif
-}
 
-static void
-print_pad(char** at, size_t* left, int* ret, char p, int num)
-{
-	while(num--) {
-		if(*left > 1) {
-			*(*at)++ = p;
-			(*left)--;
-		}
-		(*ret)++;
-	}
+    errno = 0;
+    if(mkmshar_walk_start(&walk, ctx, counter->real, &outer) != 0){
+        ctx->err = (errno != 0) ? errno : ENOMEM;
+        ctx->errpath = NULL;
+        mkmshar_walk_end(&walk, counter);
+        errno = saved_errno;
+        return -1;
+    }
+    status = mkmshar_ctx_pull(ctx, counter, prescript, postscript, &walk.source, writer, userdata);
+    mkmshar_walk_end(&walk, counter);
+    errno = saved_errno;
+    return status;
 }
 
-static void
-spool_str(char** at, size_t* left, int* ret, const char* buf, int len)
-{
-	int i;
-	for(i=0; i<len; i++) {
-		if(*left > 1) {
-			*(*at)++ = buf[i];
-			(*left)--;
-		}
-		(*ret)++;
-	}
+void mkmshar_ctx_free(mkmshar_ctx* ctx){
+    mkmshar_walkpath* p = (mkmshar_walkpath*) ctx->kept;
+
+    while(p != NULL){
+        mkmshar_walkpath* next = p->next;
+        ctx->allocator.release(ctx->allocator.userdata, p);
+        p = next;
+    }
+    ctx->kept = NULL;
 }
 
-static void
-print_str(char** at, size_t* left, int* ret, char* s,
-	int minw, int precision, int prgiven, int minus)
-{
-	int w;
-	/* with prec: no more than x characters from this string, stop at 0 */
-	if(prgiven)
-		w = mkmshar_strnlen(s, precision);
-	else	w = (int)strlen(s); /* up to the nul */
-	if(w < minw && !minus)
-		print_pad(at, left, ret, ' ', minw - w);
-	spool_str(at, left, ret, s, w);
-	if(w < minw && minus)
-		print_pad(at, left, ret, ' ', minw - w);
+int mkmshar_ctx_sink(mkmshar_ctx* ctx, const char* prescript, const char* postscript, char** files, size_t nfiles, mkmshar_write_func writer, void* userdata){
+    mkmshar_counter counter;
+    int status;
+
+    mkmshar_counter_init(&counter, &ctx->allocator);
+    status = mkmshar_ctx_build(ctx, &counter, prescript, postscript, files, nfiles, NULL, writer, userdata);
+    ctx->stats.allocs += counter.allocs;
+    ctx->stats.reallocs += counter.reallocs;
+    return status;
 }
 
-static void
-print_char(char** at, size_t* left, int* ret, int c,
-	int minw, int minus)
-{
-	if(1 < minw && !minus)
-		print_pad(at, left, ret, ' ', minw - 1);
-	print_pad(at, left, ret, c, 1);
-	if(1 < minw && minus)
-		print_pad(at, left, ret, ' ', minw - 1);
+int mkmshar_ctx_sink_next(mkmshar_ctx* ctx, const char* prescript, const char* postscript, const mkmshar_source* source, mkmshar_write_func writer, void* userdata){
+    mkmshar_counter counter;
+    int status;
+
+    mkmshar_counter_init(&counter, &ctx->allocator);
+    status = mkmshar_ctx_build(ctx, &counter, prescript, postscript, NULL, 0, source, writer, userdata);
+    ctx->stats.allocs += counter.allocs;
+    ctx->stats.reallocs += counter.reallocs;
+    return status;
 }
 
-int mkmshar_dumbvsnprintf(char* str, size_t size, const char* format, va_list arg)
-{
-	char* at = str;
-	size_t left = size;
-	int ret = 0;
-	const char* fmt = format;
-	int conv, minw, precision, prgiven, minus;
-	while(*fmt) {
-		/* copy string before % */
-		while(*fmt && *fmt!='%') {
-			if(left > 1) {
-				*at++ = *fmt++;
-				left--;
-			} else fmt++;
-			ret++;
-		}
-		
-		/* see if we are at end */
-		if(!*fmt) break;
+char* mkmshar_ctx_str(mkmshar_ctx* ctx, const char* prescript, const char* postscript, char** files, size_t nfiles, size_t* len){
+    mkmshar_counter counter;
+    mkmshar_buf arc;
 
-		/* fetch next argument % designation from format string */
-		fmt++; /* skip the '%' */
+    mkmshar_counter_init(&counter, &ctx->allocator);
+    mkmshar_buf_init(&arc, &counter.face);
 
-		/********************************/
-		/* get the argument designation */
-		/********************************/
-		/* we must do this vararg stuff inside this function for
-		 * portability.  Hence, get_designation, and print_designation
-		 * are not their own functions. */
+    if(mkmshar_ctx_build(ctx, &counter, prescript, postscript, files, nfiles, NULL, mkmshar_sink_str, &arc) != 0){
+        mkmshar_buf_free(&arc);
+        ctx->stats.allocs += counter.allocs;
+        ctx->stats.reallocs += counter.reallocs;
+        return NULL;
+    }
 
-		/* printout designation:
-		 * conversion specifier: x, d, u, s, c, n, m, p
-		 * flags: # not supported
-		 *        0 zeropad (on the left)
-		 *	  - left adjust (right by default)
-		 *	  ' ' printspace for positive number (in - position).
-		 *	  + alwayssign
-		 * fieldwidth: [1-9][0-9]* minimum field width.
-		 * 	if this is * then type int next argument specifies the minwidth.
-		 * 	if this is negative, the - flag is set (with positive width).
-		 * precision: period[digits]*, %.2x.
-		 * 	if this is * then type int next argument specifies the precision.
-		 *	just '.' or negative value means precision=0.
-		 *		this is mindigits to print for d, i, u, x
-		 *		this is aftercomma digits for f
-		 *		this is max number significant digits for g
-		 *		maxnumber characters to be printed for s
-		 * length: 0-none (int), 1-l (long), 2-ll (long long)
-		 * 	notsupported: hh (char), h (short), L (long double), q, j, z, t
-		 * Does not support %m$ and *m$ argument designation as array indices.
-		 * Does not support %#x
-		 *
-		 */
-		minw = 0;
-		precision = 1;
-		prgiven = 0;
-		minus = 0;
+    /* hand back only what is used, the geometric growth can leave up to half of it empty */
+    if(arc.cap > arc.len + 1){
+        char* shrunk = (char*) counter.face.resize(counter.face.userdata, arc.data, arc.len + 1);
+        if(shrunk != NULL) arc.data = shrunk;
+    }
 
-		/* field width */
-		if(*fmt == '*') {
-			fmt++; /* skip char */
-			minw = va_arg(arg, int);
-			if(minw < 0) {
-				minus = 1;
-				minw = -minw;
-			}
-		} else while(*fmt >= '0' && *fmt <= '9') {
-			minw = minw*10 + (*fmt++)-'0';
-		}
+    ctx->stats.allocs += counter.allocs;
+    ctx->stats.reallocs += counter.reallocs;
+    if(len != NULL) *len = arc.len;
+    return arc.data;
+}
 
-		/* precision */
-		if(*fmt == '.') {
-			fmt++; /* skip period */
-			prgiven = 1;
-			precision = 0;
-			if(*fmt == '*') {
-				fmt++; /* skip char */
-				precision = va_arg(arg, int);
-				if(precision < 0)
-					precision = 0;
-			} else while(*fmt >= '0' && *fmt <= '9') {
-				precision = precision*10 + (*fmt++)-'0';
-			}
-		}
+int mkmshar_sink(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors, mkmshar_write_func writer, void* userdata){
+    return mkmshar_sink_mt(prescript, postscript, files, nfiles, ignorefileerrors, 1, writer, userdata);
+}
 
-		/* get the conversion */
-		if(!*fmt) conv = 0;
-		else	conv = *fmt++;
+int mkmshar_sink_mt(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors, size_t nthreads, mkmshar_write_func writer, void* userdata){
+    mkmshar_ctx ctx;
 
-		/***********************************/
-		/* print that argument designation */
-		/***********************************/
-		switch(conv) {
-		case 's':
-			print_str(&at, &left, &ret, va_arg(arg, char*),
-				minw, precision, prgiven, minus);
-			break;
-		case 'c':
-			print_char(&at, &left, &ret, va_arg(arg, int),
-				minw, minus);
-			break;
-		case 'n':
-			*va_arg(arg, int*) = ret;
-			break;
-		case 'm':
-			print_str(&at, &left, &ret, strerror(errno),
-				minw, precision, prgiven, minus);
-			break;
-		case '%':
-			print_pad(&at, &left, &ret, '%', 1);
-			break;
-		/* unknown */
-		default:
-		case 0: break;
-		}
-	}
+    mkmshar_ctx_init(&ctx);
+    ctx.options.ignorefileerrors = ignorefileerrors;
+    ctx.options.nthreads = nthreads;
 
-	/* zero terminate */
-	if(left > 0)
-		*at = 0;
-	return ret;
+    if(mkmshar_ctx_sink(&ctx, prescript, postscript, files, nfiles, writer, userdata) != 0){
+        errno = ctx.err;
+        return -1;
+    }
+    return 0;
 }
 
-int mkmshar_snprintf(char *str, size_t size, const char *format, ...)
-{
-    #if defined(__cplusplus) || defined(c_plusplus)
-    using namespace std;
-    #endif
+char* mkmshar(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors){
+    mkmshar_ctx ctx;
+    char* arc = NULL;
 
-    va_list arg_list;
-    int chars_printed = 0;
-    va_start(arg_list, format);
+    mkmshar_ctx_init(&ctx);
+    ctx.options.ignorefileerrors = ignorefileerrors;
 
-    /* check c standard version */
-    #if ((!defined(__STDC_VERSION__) || (__STDC_VERSION__ < 199901L)) || (defined(__STDC__) && !defined(__STDC_VERSION__)))
-    chars_printed = mkmshar_dumbvsnprintf(str, size, format, arg_list);
-    #else
-    chars_printed = vsnprintf(str, size, format, arg_list);
-    #endif
+    arc = mkmshar_ctx_str(&ctx, prescript, postscript, files, nfiles, NULL);
+    if(arc == NULL){
+        errno = ctx.err;
+    }
+    return arc;
+}
 
-    va_end(arg_list);
-    return chars_printed;
+char* mkmshar_x(char* prescript, char* postscript, char** files, size_t nfiles){
+    return mkmshar(prescript, postscript, files, nfiles, 0);
 }
 
+char* mkmshar_s(char* prescript, char* postscript, char** files, size_t nfiles){
+    return mkmshar(prescript, postscript, files, nfiles, 1);
+}
 
-char* mkmshar(char* prescript, char* postscript, char** files, size_t nfiles, int ignorefileerrors){
-    
+/* what kind of payload a block has */
+#define MXPSQL_MShar_BLOCK_PRINTF 0
+#define MXPSQL_MShar_BLOCK_HEREDOC 1
+#define MXPSQL_MShar_BLOCK_CUT 2
+#define MXPSQL_MShar_BLOCK_COPY 3
+#define MXPSQL_MShar_BLOCK_SAME 4
+
+/* one file block of an archive, found by mkmshar_unshar_parse with the same mkmshar_blk_* pieces that wrote it */
+typedef struct mkmshar_block {
+    const char* path;
+    size_t pathlen;
+    int kind;
+    const char* data; /* base64, with newlines for heredoc, or the raw bytes for cut */
+    size_t datalen;
+    int compressed;
+    const char* from; /* for copies */
+    size_t fromlen;
+    int link;
+    int sum; /* it has an mshar_check line */
+    unsigned long crc;
+    size_t size;
+    const char* end;
+} mkmshar_block;
+
+/* move *at past str if that is what is there */
+static int mkmshar_eat(const char** at, const char* end, const char* str){
     #if defined(__cplusplus) || defined(c_plusplus)
     using namespace std;
     #endif
 
-    static const size_t initarcfilesize = (((sizeof(char*) + sizeof(size_t)) * 1024) + 1);
-    const char* old_locale = setlocale(LC_ALL, NULL);
-    size_t i;
-
-    char* arcfile = (char*) MXPSQL_MShar_Calloc(initarcfilesize, initarcfilesize);
+    size_t n = strlen(str);
 
-    setlocale(LC_ALL, "C");
+    if((size_t) (end - *at) < n || memcmp(*at, str, n) != 0){
+        return 0;
+    }
+    *at += n;
+    return 1;
+}
 
-    /* printf("dumb: %d", mkmshar_snprintf(NULL, 0, "dumb %s", "snprintf")); */
+/* the decimal number at *at */
+static int mkmshar_eatnum(const char** at, const char* end, size_t* v){
+    const char* p = *at;
+    size_t n = 0;
 
-    if(files == NULL){
-        MXPSQL_MShar_Free(arcfile);
-        errno = EDOM;
-        setlocale(LC_ALL, old_locale);
-        return NULL;
+    if(p >= end || *p < '0' || *p > '9'){
+        return 0;
     }
+    for(; p < end && *p >= '0' && *p <= '9'; p++){
+        size_t d = (size_t) (*p - '0');
+        if(n > (((size_t) -1) - d) / 10) return 0;
+        n = n * 10 + d;
+    }
+    *at = p;
+    *v = n;
+    return 1;
+}
 
-    if(!arcfile){
-        MXPSQL_MShar_Free(arcfile);
-        setlocale(LC_ALL, old_locale);
-        return NULL;
+/* the text up to the next quote, the quote is left */
+static int mkmshar_eatquoted(const char** at, const char* end, const char** str, size_t* len){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    const char* q = (const char*) memchr(*at, '\'', (size_t) (end - *at));
+
+    if(q == NULL){
+        return 0;
     }
+    *str = *at;
+    *len = (size_t) (q - *at);
+    *at = q;
+    return 1;
+}
 
-    {
-        static const char* prestr = (char*)
-"#!/bin/sh \n\
-# This archive is created using MShar, MXPSQL's version of the Shell archiver\n\
-# You need a unix bourne shell and the base64 command to extract this\n\
-\n\
-# shellcheck disable=SC2034 # GNU utilities\n\
-\n\
-TEKTONE=;\n\
-DIRNAME=;\n\
-POSIXLY_CORRECT=1; # Make this posix \n\
-POSIX_ME_HARDER=1; # Make this posix \n\
-TTk=\"$(find /bin /usr/bin /usr/local/bin . -name 'base64*' -type f 2> /dev/null | head -n 1)\";\n\n";
+/* the block whose TEKTONE line is at at, trailer data starts at skip, 0 if it is one, 1 if it is something else after all, -1 if it is a damaged one (b->path is set then) */
+static int mkmshar_unshar_parse(const char* at, const char* end, const char* arc, size_t arclen, size_t skip, mkmshar_block* b){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
 
-        static const char* prestr2 = (char*)
-"printf \"This archive is created with MShar (MXPSQL's version of the Shell archiver)\\n\";\n\
-\n\
-if test -z \"$TTk\"; then\n\
-    printf \"The base64 command is not found you loser. \\nIt is needed to extract the archive. \\nPlease make it available in PATH or install it.\\n\";\n\
-    exit 1;\n\
-fi\n\
-\n\n\n";
+    int want;
 
-        if(strlen(prestr) + strlen(prestr2) + strlen(arcfile) > initarcfilesize){
-            arcfile = (char*) MXPSQL_MShar_Realloc(arcfile, strlen(prestr) + strlen(prestr2) + strlen(arcfile));
-            if(arcfile == NULL){
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
-        }
+    if(!mkmshar_eat(&at, end, mkmshar_blk_name1) || !mkmshar_eatquoted(&at, end, &b->path, &b->pathlen) || !mkmshar_eat(&at, end, mkmshar_blk_name2)){
+        return 1;
+    }
+    want = mkmshar_eat(&at, end, mkmshar_blk_want);
+    if(!mkmshar_eat(&at, end, mkmshar_blk_dirname)){
+        return 1;
+    }
 
-        strcat(arcfile, prestr);
-        strcat(arcfile, prestr2);
+    /* a block for sure from here on */
+    b->data = NULL;
+    b->datalen = 0;
+    b->compressed = 0;
+    b->from = NULL;
+    b->fromlen = 0;
+    b->link = 0;
+    b->sum = 0;
+    b->crc = 0;
+    b->size = 0;
+    if(!mkmshar_eat(&at, end, mkmshar_blk_info) || !mkmshar_eat(&at, end, mkmshar_blk_marker)){
+        return -1;
     }
 
-    if(prescript != NULL){
-        if(strlen(arcfile) + strlen(arcfile) > strlen(arcfile)){
-            arcfile = (char*) MXPSQL_MShar_Realloc(arcfile, strlen(arcfile) + strlen(prescript) + 1);
-            if(arcfile == NULL){
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
+    if(mkmshar_eat(&at, end, mkmshar_blk_printf1)){
+        b->kind = MXPSQL_MShar_BLOCK_PRINTF;
+        if(!mkmshar_eatquoted(&at, end, &b->data, &b->datalen) || !mkmshar_eat(&at, end, mkmshar_blk_printf2)){
+            return -1;
+        }
+        b->compressed = mkmshar_eat(&at, end, mkmshar_blk_decodegz);
+        if(!b->compressed && !mkmshar_eat(&at, end, mkmshar_blk_decode)){
+            return -1;
         }
-        strcat(arcfile, prescript);
     }
+    else if(mkmshar_eat(&at, end, mkmshar_blk_heredoc1) || (b->compressed = mkmshar_eat(&at, end, mkmshar_blk_heredoc1gz)) != 0){
+        /* @ is not base64, the first one is the delimiter */
+        const char* q = (const char*) memchr(at, '@', (size_t) (end - at));
 
-    for(i = 0; i < nfiles; i++){
-        size_t fsize = 0;
-        FILE* fptr = NULL;
-        char* filecontent = NULL;
-
-        if(files[i] == NULL) {
-            if(ignorefileerrors != 0){
-                continue;
-            } else {
-                MXPSQL_MShar_Free(arcfile);
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
+        b->kind = MXPSQL_MShar_BLOCK_HEREDOC;
+        if(q == NULL || (q > at && q[-1] != '\n')){
+            return -1;
+        }
+        b->data = at;
+        b->datalen = (size_t) (q - at);
+        at = q;
+        if(!mkmshar_eat(&at, end, mkmshar_blk_heredoc2)){
+            return -1;
         }
+    }
+    else if(mkmshar_eat(&at, end, mkmshar_blk_cut1)){
+        size_t off, len;
 
-        fptr = fopen(files[i], "rb");
-        if(fptr == NULL){
-            if(ignorefileerrors != 0){
-                continue;
-            }
-            else{
-                MXPSQL_MShar_Free(arcfile);
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
+        b->kind = MXPSQL_MShar_BLOCK_CUT;
+        if(!mkmshar_eatnum(&at, end, &off) || !mkmshar_eat(&at, end, " ") || !mkmshar_eatnum(&at, end, &len)){
+            return -1;
+        }
+        b->compressed = mkmshar_eat(&at, end, mkmshar_blk_cut2gz);
+        if(!b->compressed && !mkmshar_eat(&at, end, mkmshar_blk_cut2)){
+            return -1;
+        }
+        /* the data is after the script, which only trailer archives say how long it is */
+        if(skip == 0 || skip > arclen || off > arclen - skip || len > arclen - skip - off){
+            return -1;
         }
+        b->data = arc + skip + off;
+        b->datalen = len;
+    }
+    else if(mkmshar_eat(&at, end, mkmshar_blk_from1)){
+        b->kind = MXPSQL_MShar_BLOCK_COPY;
+        if(!mkmshar_eatquoted(&at, end, &b->from, &b->fromlen) || !mkmshar_eat(&at, end, mkmshar_blk_name2)){
+            return -1;
+        }
+        b->link = mkmshar_eat(&at, end, mkmshar_blk_ln);
+        if(!b->link && !mkmshar_eat(&at, end, mkmshar_blk_cp)){
+            return -1;
+        }
+    }
+    else if(mkmshar_eat(&at, end, "\n")){
+        /* the same path again */
+        b->kind = MXPSQL_MShar_BLOCK_SAME;
+        b->from = b->path;
+        b->fromlen = b->pathlen;
+    }
+    else{
+        return -1;
+    }
 
-        if(ferror(fptr) != 0){
-            if(ignorefileerrors != 0){
-                continue;
-            }
-            else{
-                fclose(fptr);
-                MXPSQL_MShar_Free(arcfile);
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
+    if(mkmshar_eat(&at, end, "mshar_check ")){
+        size_t crc;
+        if(!mkmshar_eatnum(&at, end, &crc) || !mkmshar_eat(&at, end, " ") || !mkmshar_eatnum(&at, end, &b->size) || !mkmshar_eat(&at, end, ";\n\n")){
+            return -1;
         }
+        b->crc = (unsigned long) crc;
+        b->sum = 1;
+    }
+    if(want && !mkmshar_eat(&at, end, mkmshar_blk_end)){
+        return -1;
+    }
+    b->end = at;
+    return 0;
+}
 
-        /* Read until the end and get the size as C++ does not need to implement SEEK_END */
-        {
-            long int ifsize = 0;
+/* a file already done, for the copies after it */
+typedef struct mkmshar_seen {
+    const char* path; /* in the archive, not null terminated */
+    size_t pathlen;
+    size_t size;
+    int ok;
+    size_t next; /* in the same bucket, MXPSQL_MShar_ENTRY_NONE at the end */
+} mkmshar_seen;
+
+/* everything mkmshar_unshar_mem keeps while it goes through an archive */
+typedef struct mkmshar_unshar_state {
+    int mode;
+    mkmshar_allocator a;
+    mkmshar_buf path;
+    mkmshar_buf from;
+    mkmshar_buf text; /* heredoc base64 without its newlines */
+    mkmshar_buf data; /* decoded bytes */
+    mkmshar_buf member; /* a whole decoded gzip member */
+    mkmshar_buf win; /* the inflate window */
+    mkmshar_seen* seen;
+    size_t nseen;
+    size_t capseen;
+    size_t* buckets; /* capseen of them, a power of two */
+} mkmshar_unshar_state;
+
+/* where a decoded file goes, the file when extracting and the cksum CRC always */
+typedef struct mkmshar_unshar_out {
+    FILE* fptr;
+    unsigned long crc;
+    size_t total;
+    int err;
+} mkmshar_unshar_out;
+
+static int mkmshar_unshar_put(void* userdata, const char* data, size_t len){
+    mkmshar_unshar_out* out = (mkmshar_unshar_out*) userdata;
+
+    out->crc = mkmshar_cksumUpdate(out->crc, data, len);
+    out->total += len;
+    if(out->fptr != NULL && len > 0 && fwrite(data, 1, len, out->fptr) != len){
+        out->err = (errno != 0) ? errno : EIO;
+        return -1;
+    }
+    return 0;
+}
 
-            while(fgetc(fptr) != EOF || ferror(fptr)){;} /* this may seem hacky, convoluted and unsophisticated, but it is portable and sophisticated due to C++ not mandating to implement SEEK_END just like the comment before (no longer existing). 
-            All you do is read until you reach EOF, then get the file size and return to beginning. 
-            This will also return if an error occured.
-            */
+/* the last file with this path, NULL if there is none */
+static mkmshar_seen* mkmshar_unshar_recall(mkmshar_unshar_state* st, const char* path, size_t len){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
 
-            if(ferror(fptr)){
-                if(ignorefileerrors != 0){
-                    continue;
-                }
-                else{
-                    fclose(fptr);
-                    MXPSQL_MShar_Free(arcfile);
-                    setlocale(LC_ALL, old_locale);
-                    return NULL;
-                }
-            }
+    size_t i;
 
-            if(fseek(fptr, 0, SEEK_CUR) != 0){
-                if(ignorefileerrors != 0){
-                    continue;
-                }
-                else{
-                    fclose(fptr);
-                    MXPSQL_MShar_Free(arcfile);
-                    setlocale(LC_ALL, old_locale);
-                    return NULL;
-                }
-            }
+    if(st->capseen == 0){
+        return NULL;
+    }
+    for(i = st->buckets[mkmshar_hash(0, (const unsigned char*) path, len) & (st->capseen - 1)]; i != MXPSQL_MShar_ENTRY_NONE; i = st->seen[i].next){
+        if(st->seen[i].pathlen == len && memcmp(st->seen[i].path, path, len) == 0) return &st->seen[i];
+    }
+    return NULL;
+}
 
-            ifsize = ftell(fptr);
-            if(ifsize < 0){
-                if(ignorefileerrors != 0){
-                    continue;
-                }
-                else{
-                    fclose(fptr);
-                    MXPSQL_MShar_Free(arcfile);
-                    setlocale(LC_ALL, old_locale);
-                    return NULL;
-                }
-            }
-            else{
-                fsize = (size_t) ifsize;
-            }
+static int mkmshar_unshar_remember(mkmshar_unshar_state* st, const char* path, size_t len, size_t size, int ok){
+    size_t h, i;
 
-            if(fseek(fptr, 0, SEEK_SET) != 0){
-                if(ignorefileerrors != 0){
-                    continue;
-                }
-                else{
-                    fclose(fptr);
-                    MXPSQL_MShar_Free(arcfile);
-                    setlocale(LC_ALL, old_locale);
-                    return NULL;
-                }
-            }
+    if(st->nseen == st->capseen){
+        size_t cap = (st->capseen > 0) ? st->capseen * 2 : 256;
+        mkmshar_seen* seen = (mkmshar_seen*) st->a.resize(st->a.userdata, st->seen, cap * sizeof(mkmshar_seen));
+        size_t* buckets;
 
+        if(seen == NULL){
+            errno = ENOMEM;
+            return -1;
         }
-
-        if(ferror(fptr) != 0){
-            if(ignorefileerrors != 0){
-                continue;
-            }
-            else{
-                fclose(fptr);
-                MXPSQL_MShar_Free(arcfile);
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
+        st->seen = seen;
+        buckets = (size_t*) st->a.resize(st->a.userdata, st->buckets, cap * sizeof(size_t));
+        if(buckets == NULL){
+            errno = ENOMEM;
+            return -1;
         }
-
-        filecontent = (char*) MXPSQL_MShar_Malloc(fsize);
-        if(filecontent == NULL){
-            MXPSQL_MShar_Free(arcfile);
-            MXPSQL_MShar_Free(filecontent);
-            fclose(fptr);
-            setlocale(LC_ALL, old_locale);
-            return NULL;
+        st->buckets = buckets;
+        st->capseen = cap;
+
+        /* newest first in every bucket, so the last of a path repeated is found */
+        for(i = 0; i < cap; i++) buckets[i] = MXPSQL_MShar_ENTRY_NONE;
+        for(i = 0; i < st->nseen; i++){
+            h = mkmshar_hash(0, (const unsigned char*) seen[i].path, seen[i].pathlen) & (cap - 1);
+            seen[i].next = buckets[h];
+            buckets[h] = i;
         }
+    }
 
-        fread(filecontent, fsize, 1, fptr);
-        fclose(fptr);
-
-        /*  MXPSQL_MShar_Realloc if needed */
-        {
-            if(strlen(arcfile) + strlen(filecontent) > strlen(arcfile)){
-                arcfile = (char*) MXPSQL_MShar_Realloc(arcfile, strlen(arcfile) + strlen(filecontent) + 1);
-            }
-
-            {
-                char* fileblock = (char*) MXPSQL_MShar_Calloc(initarcfilesize, initarcfilesize);
-                if(fileblock == NULL){
-                    MXPSQL_MShar_Free(arcfile);
-                    MXPSQL_MShar_Free(filecontent);
-                    setlocale(LC_ALL, old_locale);
-                    return NULL;
-                }
+    h = mkmshar_hash(0, (const unsigned char*) path, len) & (st->capseen - 1);
+    st->seen[st->nseen].path = path;
+    st->seen[st->nseen].pathlen = len;
+    st->seen[st->nseen].size = size;
+    st->seen[st->nseen].ok = ok;
+    st->seen[st->nseen].next = st->buckets[h];
+    st->buckets[h] = st->nseen++;
+    return 0;
+}
 
-                {
-                    char* tektfmt = NULL;
-                    char* tektsrc = NULL;
+/* 0 if path would be written outside the directory (absolute, or .. in it) */
+static int mkmshar_unshar_safe(const char* path){
+    const char* p = path;
 
-                    {
-                        static const char* tektfmt_part1=(char*)"TEKTONE='";
-                        static const char* tektfmt_partmid=(char*)"%s";
-                        static const char* tektfmt_part2=(char*)"'\n";
+    if(*p == '\0' || *p == '/'){
+        return 0;
+    }
+    #ifdef _WIN32
+    for(; *p != '\0'; p++){
+        if(*p == '\\' || *p == ':') return 0;
+    }
+    p = path;
+    #endif
+    while(*p != '\0'){
+        if(p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0')) return 0;
+        while(*p != '\0' && *p != '/') p++;
+        while(*p == '/') p++;
+    }
+    return 1;
+}
 
-                        size_t tektfmt_size = ((strlen(tektfmt_part1) + strlen(files[i]) + strlen(tektfmt_part2)) * sizeof(char*));
+/* the directories path is in, like the mkdir of the archive but all the way down */
+static void mkmshar_unshar_mkdirs(char* path){
+    char* p;
+
+    for(p = path + 1; *p != '\0'; p++){
+        if(*p != '/' || p[-1] == '/') continue;
+        *p = '\0';
+        #ifdef MXPSQL_MShar_OS_POSIX_SUS
+        mkdir(path, 0777);
+        #elif defined(_WIN32)
+        _mkdir(path);
+        #endif
+        *p = '/';
+    }
+}
 
-                        tektfmt = (char*) MXPSQL_MShar_Calloc(tektfmt_size, tektfmt_size);
-                        tektsrc = (char* ) MXPSQL_MShar_Calloc(tektfmt_size, tektfmt_size);
+/* base64 in text (without newlines unless wrapped) to writer, MXPSQL_MShar_CHUNK_SIZE characters at a time, 1 if it is not base64 */
+static int mkmshar_unshar_b64(mkmshar_unshar_state* st, const char* text, size_t n, int wrapped, mkmshar_write_func writer, void* userdata){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
 
-                        if(tektfmt == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
+    size_t chunk = MXPSQL_MShar_CHUNK_SIZE;
+    size_t pos = 0;
+    size_t carry = 0;
+    int padded = 0;
 
-                        strcat(tektfmt, tektfmt_part1);
-                        strcat(tektfmt, tektfmt_partmid);
-                        strcat(tektfmt, tektfmt_part2);
-                    }
+    if(mkmshar_buf_fit(&st->data, (chunk / 4) * 3) != 0 || (wrapped && mkmshar_buf_fit(&st->text, chunk) != 0)){
+        return -1;
+    }
 
-                    /* tektsrc = (char*) MXPSQL_MShar_Calloc(initarcfilesize, initarcfilesize); */
-                    if(tektsrc == NULL){
-                        MXPSQL_MShar_Free(arcfile);
-                        MXPSQL_MShar_Free(filecontent);
-                        MXPSQL_MShar_Free(fileblock);
-                        setlocale(LC_ALL, old_locale);
-                        return NULL;
-                    }
+    while(pos < n){
+        const char* group;
+        size_t fill, whole, m;
+
+        if(wrapped){
+            /* the lines one after another, carry is what did not make a group last time */
+            fill = carry;
+            while(fill < chunk && pos < n){
+                const char* nl = (const char*) memchr(text + pos, '\n', n - pos);
+                size_t seg = (nl != NULL) ? (size_t) (nl - (text + pos)) : n - pos;
+                if(seg > chunk - fill) seg = chunk - fill;
+                memcpy(st->text.data + fill, text + pos, seg);
+                fill += seg;
+                pos += seg;
+                if(pos < n && text[pos] == '\n') pos++;
+            }
+            group = st->text.data;
+        }
+        else{
+            fill = (n - pos < chunk) ? n - pos : chunk;
+            group = text + pos;
+            pos += fill;
+        }
 
-                    if(strlen(files[i]) + strlen(tektsrc) > strlen(fileblock)){
-                        tektsrc = (char*) MXPSQL_MShar_Realloc(tektsrc, strlen(files[i]) + strlen(tektsrc) + 1);
-                        if(tektsrc == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                    }
+        whole = (pos < n) ? fill - fill % 4 : fill;
+        /* nothing can follow padding */
+        if(whole % 4 != 0 || (padded && whole > 0)){
+            return 1;
+        }
+        if(mkmshar_b64Decode(group, whole, st->data.data, &m) != 0){
+            return 1;
+        }
+        padded = (m < (whole / 4) * 3);
+        if(m > 0 && writer(userdata, st->data.data, m) != 0){
+            return -1;
+        }
+        carry = fill - whole;
+        if(carry > 0) memmove(st->text.data, st->text.data + whole, carry);
+    }
+    return (carry > 0) ? 1 : 0;
+}
 
-                    if(sprintf(tektsrc, tektfmt, files[i]) < 0){
-                        MXPSQL_MShar_Free(arcfile);
-                        MXPSQL_MShar_Free(filecontent);
-                        MXPSQL_MShar_Free(fileblock);
-                        MXPSQL_MShar_Free(tektsrc);
-                        setlocale(LC_ALL, old_locale);
-                        return NULL;
-                    }
-                    strcat(fileblock, tektsrc);
+/* the last 4 bytes of the base64 in text, which hold the size of a gzip member, 1 if it is not base64 */
+static int mkmshar_unshar_isize(const char* text, size_t n, size_t* size){
+    char tail[12];
+    char bytes[9];
+    size_t k = sizeof(tail);
+    size_t m;
 
-                    if(tektsrc != NULL) MXPSQL_MShar_Free(tektsrc);
-                    MXPSQL_MShar_Free(tektfmt);
-                }
+    while(n > 0 && k > 0){
+        n--;
+        if(text[n] != '\n') tail[--k] = text[n];
+    }
+    /* 12 characters are at least 7 bytes even when padded */
+    if(k != 0 || mkmshar_b64Decode(tail, sizeof(tail), bytes, &m) != 0 || m < 4){
+        return 1;
+    }
+    *size = (size_t) (unsigned char) bytes[m - 4] | ((size_t) (unsigned char) bytes[m - 3] << 8) | ((size_t) (unsigned char) bytes[m - 2] << 16) | ((size_t) (unsigned char) bytes[m - 1] << 24);
+    return 0;
+}
 
-                {
-                    static char* dirnam = (char*) "\
-DIRNAME=\"./$(dirname \"$TEKTONE\")\"\n\
-mkdir \"$DIRNAME\" 2> /dev/null;\
-\n";
-                    if(strlen(dirnam) + strlen(fileblock) > strlen(fileblock)){
-                        fileblock = (char*) MXPSQL_MShar_Realloc(fileblock, strlen(dirnam) + strlen(fileblock) + 1);
-                        if(fileblock == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                    }
+/* size of a file from its block alone, for MXPSQL_MShar_UNSHAR_LIST, 1 if the payload cannot be right */
+static int mkmshar_unshar_size(const mkmshar_block* b, size_t* size, size_t* stored){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
 
-                    strcat(fileblock, dirnam);
-                }
+    size_t enc = b->datalen;
 
-                {
-                    static char* info = (char*) "printf \"x - %s\\n\" \"$TEKTONE\";\n";
-                    if(strlen(info) + strlen(fileblock) > strlen(fileblock)){
-                        fileblock = (char*) MXPSQL_MShar_Realloc(fileblock, strlen(info) + strlen(fileblock) + 1);
-                        if(fileblock == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                    }
+    *stored = b->datalen;
+    if(b->kind == MXPSQL_MShar_BLOCK_CUT){
+        if(!b->compressed){
+            *size = b->datalen;
+            return 0;
+        }
+        if(b->datalen < 18) return 1;
+        *size = (size_t) (unsigned char) b->data[b->datalen - 4] | ((size_t) (unsigned char) b->data[b->datalen - 3] << 8)
+            | ((size_t) (unsigned char) b->data[b->datalen - 2] << 16) | ((size_t) (unsigned char) b->data[b->datalen - 1] << 24);
+        return 0;
+    }
 
-                    strcat(fileblock, info);
-                }
+    if(b->kind == MXPSQL_MShar_BLOCK_HEREDOC){
+        const char* p = b->data;
+        const char* end = b->data + b->datalen;
+        while((p = (const char*) memchr(p, '\n', (size_t) (end - p))) != NULL){
+            enc--;
+            p++;
+        }
+        *stored = enc;
+    }
+    if(enc % 4 != 0){
+        return 1;
+    }
+    if(b->compressed){
+        return mkmshar_unshar_isize(b->data, b->datalen, size);
+    }
+    *size = (enc / 4) * 3;
+    if(enc > 0){
+        /* the padding is at the very end, there is no newline after it */
+        const char* last = b->data + b->datalen - 1;
+        if(*last == '\n') last--;
+        if(*last == '=') (*size)--;
+        if(*last == '=' && last[-1] == '=') (*size)--;
+    }
+    return 0;
+}
 
-                {
-                    static char* marker = (char*) "#@EE\n";
-                    if(strlen(marker) + strlen(fileblock) > strlen(fileblock)){
-                        fileblock = (char*) MXPSQL_MShar_Realloc(fileblock, strlen(marker) + strlen(fileblock) + 1);
-                        if(fileblock == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                    }
+/* a copy of from that is on disk already, hard linked when the archive would */
+static int mkmshar_unshar_copy(mkmshar_unshar_state* st, const char* path, const char* from, int hard){
+    FILE* in = NULL;
+    FILE* out = NULL;
+    int ret = 0;
 
-                    strcat(fileblock, marker);
-                }
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    if(hard){
+        unlink(path);
+        if(link(from, path) == 0) return 0;
+    }
+    #else
+    (void) hard;
+    #endif
 
-                {
-                    size_t s = 0;
-
-                    /* char* basprintf = (char*) MXPSQL_MShar_Calloc(s, s); */
-                    char* basprintf = NULL;
-                    char* fmt = NULL;
-                    char* bas64 = NULL;
-
-                    bas64 = mkmshar_b64Encode(filecontent, fsize);
-
-                    if(bas64 == NULL){
-                        bas64 = (char*) MXPSQL_MShar_Malloc(sizeof(char));
-                        if(bas64 == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            MXPSQL_MShar_Free(basprintf);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                        strcat(bas64, "");
-                    }
+    if(mkmshar_buf_fit(&st->data, MXPSQL_MShar_CHUNK_SIZE) != 0){
+        return -1;
+    }
+    in = fopen(from, "rb");
+    if(in == NULL){
+        return -1;
+    }
+    out = fopen(path, "wb");
+    if(out == NULL){
+        fclose(in);
+        return -1;
+    }
+    for(;;){
+        size_t n = fread(st->data.data, 1, MXPSQL_MShar_CHUNK_SIZE, in);
+        if(n > 0 && fwrite(st->data.data, 1, n, out) != n){
+            ret = -1;
+            break;
+        }
+        if(n < MXPSQL_MShar_CHUNK_SIZE){
+            if(ferror(in) != 0) ret = -1;
+            break;
+        }
+    }
+    fclose(in);
+    if(fclose(out) != 0) ret = -1;
+    return ret;
+}
 
-                    {
-                        static const char* fmt1 = (char*) "printf '";
-                        static const char* fmtmid = (char*) "%%s";
-                        static const char* fmt2 = (char*) "' '%s' > \"./$TEKTONE\";\n";
-
-                            size_t fmtlen = strlen(fmt1) + strlen(fmtmid) + strlen(fmt2) + 1;
-                            fmt = (char*) MXPSQL_MShar_Calloc(fmtlen, fmtlen);
-
-                            if(fmt == NULL){
-                                MXPSQL_MShar_Free(arcfile);
-                                MXPSQL_MShar_Free(filecontent);
-                                MXPSQL_MShar_Free(fileblock);
-                                if(basprintf != NULL) MXPSQL_MShar_Free(basprintf);
-                                MXPSQL_MShar_Free(bas64);
-                                if(fmt != NULL) MXPSQL_MShar_Free(fmt);
-                                setlocale(LC_ALL, old_locale);
-                                return NULL;
-                            }
-
-                            strcat(fmt, fmt1);
-                            strcat(fmt, fmtmid);
-                            strcat(fmt, fmt2);
-                    }
+/* decode (and write) the payload of b into out, the problem with it or NULL, -1 if memory runs out */
+static int mkmshar_unshar_payload(mkmshar_unshar_state* st, const mkmshar_block* b, mkmshar_unshar_out* out, const char** problem){
+    const char* member = b->data;
+    size_t memberlen = b->datalen;
+    size_t size;
+    int status;
+
+    *problem = NULL;
+    if(b->compressed && b->kind != MXPSQL_MShar_BLOCK_CUT){
+        /* the member is inflated whole, it is only as big as it is in the archive */
+        st->member.len = 0;
+        status = mkmshar_unshar_b64(st, b->data, b->datalen, b->kind == MXPSQL_MShar_BLOCK_HEREDOC, mkmshar_sink_str, &st->member);
+        if(status != 0){
+            if(status > 0) *problem = "its payload is not base64";
+            return (status < 0) ? -1 : 0;
+        }
+        member = st->member.data;
+        memberlen = st->member.len;
+    }
 
-                    s = mkmshar_snprintf(NULL, 0, fmt, bas64);
-                    basprintf = (char*) MXPSQL_MShar_Calloc(s, s);
-                    if(basprintf == NULL){
-                        MXPSQL_MShar_Free(arcfile);
-                        MXPSQL_MShar_Free(fmt);
-                        MXPSQL_MShar_Free(filecontent);
-                        MXPSQL_MShar_Free(fileblock);
-                        setlocale(LC_ALL, old_locale);
-                        return NULL;
-                    }
+    if(b->compressed){
+        if(st->win.data == NULL && mkmshar_buf_fit(&st->win, MXPSQL_MShar_ZI_WINSIZE) != 0){
+            return -1;
+        }
+        status = mkmshar_inflate_member(member, memberlen, (unsigned char*) st->win.data, mkmshar_unshar_put, out, &size);
+        if(status > 0) *problem = "its compressed data is damaged";
+    }
+    else if(b->kind == MXPSQL_MShar_BLOCK_CUT){
+        status = mkmshar_unshar_put(out, b->data, b->datalen);
+    }
+    else{
+        status = mkmshar_unshar_b64(st, b->data, b->datalen, b->kind == MXPSQL_MShar_BLOCK_HEREDOC, mkmshar_unshar_put, out);
+        if(status > 0) *problem = "its payload is not base64";
+    }
 
-                    /* {
-                        static const char* fmt1 = (char*) "printf '";
-                        static const char* fmtmid = (char*) "%%s";
-                        static const char* fmt2 = (char*) "' '%s' > \"./$TEKTONE\";\n";
-                        size_t s1 = (sizeof(char*) * strlen(fmt1));
-
-                        char* ss = (char*) MXPSQL_MShar_Calloc(s1, s1);
-                        if(ss == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            MXPSQL_MShar_Free(basprintf);
-                            MXPSQL_MShar_Free(bas64);
-                            if(ss != NULL) MXPSQL_MShar_Free(ss);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-
-                        strcat(ss, fmt1);
-
-                        if(strlen(bas64) + s1 > s1){
-                            s1 = strlen(bas64) + s1 + 1;
-                            ss = (char*) MXPSQL_MShar_Realloc(ss, s1);
-                            if(ss == NULL){
-                                MXPSQL_MShar_Free(arcfile);
-                                MXPSQL_MShar_Free(filecontent);
-                                MXPSQL_MShar_Free(fileblock);
-                                MXPSQL_MShar_Free(basprintf);
-                                MXPSQL_MShar_Free(bas64);
-                                if(ss != NULL) MXPSQL_MShar_Free(ss);
-                                setlocale(LC_ALL, old_locale);
-                                return NULL;
-                            }
-                        }
-
-                        strcat(ss, bas64);
-
-                        if(strlen(fmt2) + s1 > s1){
-                            s1 = strlen(fmt2) + s1 + 1;
-                            ss = (char*) MXPSQL_MShar_Realloc(ss, s1);
-                            if(ss == NULL){
-                                MXPSQL_MShar_Free(arcfile);
-                                MXPSQL_MShar_Free(filecontent);
-                                MXPSQL_MShar_Free(fileblock);
-                                MXPSQL_MShar_Free(basprintf);
-                                MXPSQL_MShar_Free(bas64);
-                                if(ss != NULL) MXPSQL_MShar_Free(ss);
-                                setlocale(LC_ALL, old_locale);
-                                return NULL;
-                            }
-                        }
-
-                        strcat(ss, fmt2);
-
-                        MXPSQL_MShar_Free(ss);
-                        ss = NULL;
-
-                        if(s1 > s){
-                            s = s1;
-                            basprintf = (char*) MXPSQL_MShar_Realloc(basprintf, s);
-                            if(basprintf == NULL){
-                                MXPSQL_MShar_Free(arcfile);
-                                MXPSQL_MShar_Free(filecontent);
-                                MXPSQL_MShar_Free(fileblock);
-                                MXPSQL_MShar_Free(bas64);
-                                MXPSQL_MShar_Free(fmt);
-                                if(basprintf != NULL) MXPSQL_MShar_Free(basprintf);
-                                setlocale(LC_ALL, old_locale);
-                                return NULL;
-                            }
-                        }
-
-                        {
-                            size_t fmtlen = strlen(fmt1) + strlen(fmtmid) + strlen(fmt2) + 1;
-                            fmt = (char*) MXPSQL_MShar_Calloc(fmtlen, fmtlen);
-
-                            if(fmt == NULL){
-                                MXPSQL_MShar_Free(arcfile);
-                                MXPSQL_MShar_Free(filecontent);
-                                MXPSQL_MShar_Free(fileblock);
-                                MXPSQL_MShar_Free(basprintf);
-                                MXPSQL_MShar_Free(bas64);
-                                if(fmt != NULL) MXPSQL_MShar_Free(fmt);
-                                setlocale(LC_ALL, old_locale);
-                                return NULL;
-                            }
-
-                            strcat(fmt, fmt1);
-                            strcat(fmt, fmtmid);
-                            strcat(fmt, fmt2);
-                        }
-                    } */
-
-                    /* {
-                        size_t sizy;
-                        size_t sizy2;
-                        static const char* fmt1 = (char*) "printf '";
-                        static const char* fmt2 = (char*) "' > \"./$TEKTONE\";\n";
-
-                        bas64 = mkmshar_b64Encode(filecontent, fsize);
-
-                        /\* printf("t: %s", bas64); *\/
-
-                        if(bas64 == NULL){
-                            bas64 = (char*) MXPSQL_MShar_Malloc(sizeof(char));
-                            if(bas64 == NULL){
-                                MXPSQL_MShar_Free(arcfile);
-                                MXPSQL_MShar_Free(filecontent);
-                                MXPSQL_MShar_Free(fileblock);
-                                MXPSQL_MShar_Free(basprintf);
-                                setlocale(LC_ALL, old_locale);
-                                return NULL;
-                            }
-                            strcat(bas64, "");
-                        }
-
-                        sizy = ((strlen(fmt1) + sizeof(bas64) + sizeof(fmt2)) * sizeof(char*));
-                        sizy2 = ((strlen(fmt1) + strlen("%s") + strlen(fmt2)) * sizeof(char*));
-
-                        basprintf = (char*) MXPSQL_MShar_Calloc(sizy, sizy);
-                        fmt = (char*) MXPSQL_MShar_Calloc(sizy2, sizy2);
-
-                        if(basprintf == NULL || fmt == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            if(basprintf != NULL)MXPSQL_MShar_Free(basprintf);
-                            if(fmt != NULL)MXPSQL_MShar_Free(fmt);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-
-                        strcat(fmt, fmt1);
-                        strcat(fmt, "%s");
-                        strcat(fmt, fmt2);
-                    } */
-
-
-                    if(mkmshar_snprintf(basprintf, s, fmt, bas64) < 0){
-                        MXPSQL_MShar_Free(arcfile);
-                        MXPSQL_MShar_Free(filecontent);
-                        MXPSQL_MShar_Free(fileblock);
-                        MXPSQL_MShar_Free(basprintf);
-                        MXPSQL_MShar_Free(bas64);
-                        MXPSQL_MShar_Free(fmt);
-                        setlocale(LC_ALL, old_locale);
-                        return NULL;
-                    }
+    if(status < 0 && out->err != 0){
+        *problem = "it could not be written";
+        return 0;
+    }
+    return (status < 0) ? -1 : 0;
+}
 
-                    if(strlen(basprintf) + strlen(fileblock) > strlen(fileblock)){
-                        fileblock = (char*) MXPSQL_MShar_Realloc(fileblock, strlen(basprintf) + strlen(fileblock) + 1);
-                        if(fileblock == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            MXPSQL_MShar_Free(basprintf);
-                            MXPSQL_MShar_Free(bas64);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                    }
+/* one block, reported and remembered, 0 if fine, 1 if it has a problem, -1 to stop */
+static int mkmshar_unshar_file(mkmshar_unshar_state* st, const mkmshar_block* b, mkmshar_unshar_func report, void* userdata){
+    mkmshar_unsharfile file;
+    mkmshar_unshar_out out;
+    int copy = (b->kind == MXPSQL_MShar_BLOCK_COPY || b->kind == MXPSQL_MShar_BLOCK_SAME);
 
-                    strcat(fileblock, basprintf);
+    st->path.len = 0;
+    st->from.len = 0;
+    if(mkmshar_buf_append(&st->path, b->path, b->pathlen) != 0 || (copy && mkmshar_buf_append(&st->from, b->from, b->fromlen) != 0)){
+        return -1;
+    }
 
-                    MXPSQL_MShar_Free(bas64);
-                    MXPSQL_MShar_Free(basprintf);
-                    MXPSQL_MShar_Free(fmt);
-                }
+    file.path = st->path.data;
+    file.size = b->size;
+    file.stored = 0;
+    file.compressed = b->compressed;
+    file.from = copy ? st->from.data : NULL;
+    file.checked = 0;
+    file.problem = NULL;
+    file.err = 0;
+
+    out.fptr = NULL;
+    out.crc = 0;
+    out.total = 0;
+    out.err = 0;
+
+    if(!mkmshar_unshar_safe(file.path) || (copy && !mkmshar_unshar_safe(file.from))){
+        file.problem = "its path is outside of the directory it is extracted in";
+    }
+    else if(copy){
+        const mkmshar_seen* origin = mkmshar_unshar_recall(st, b->from, b->fromlen);
 
-                {
-                    static char* debas64tmp = (char*)
-"tmp=$(mktemp);\n\
-\"$TTk\" -d \"./$TEKTONE\" > \"$tmp\";\n\
-mv \"$tmp\" \"./$TEKTONE\";\n\
-tmp=;\
-\n\n";
-                    if(strlen(debas64tmp) + strlen(fileblock) > strlen(fileblock)){
-                        fileblock = (char*) MXPSQL_MShar_Realloc(fileblock, strlen(debas64tmp) + strlen(fileblock) + 1);
-                        if(fileblock == NULL){
-                            MXPSQL_MShar_Free(arcfile);
-                            MXPSQL_MShar_Free(filecontent);
-                            MXPSQL_MShar_Free(fileblock);
-                            setlocale(LC_ALL, old_locale);
-                            return NULL;
-                        }
-                    }
-                    strcat(fileblock, debas64tmp);
+        if(origin == NULL){
+            file.problem = "it is a copy of a file that is not before it in the archive";
+        }
+        else if(!origin->ok){
+            file.problem = "it is a copy of a damaged file";
+        }
+        else{
+            file.size = origin->size;
+            if(st->mode == MXPSQL_MShar_UNSHAR_EXTRACT && b->kind == MXPSQL_MShar_BLOCK_COPY){
+                /* the copy may be the first file of its directory */
+                mkmshar_unshar_mkdirs(st->path.data);
+                if(mkmshar_unshar_copy(st, file.path, file.from, b->link) != 0){
+                    file.problem = "it could not be copied";
+                    file.err = (errno != 0) ? errno : EIO;
                 }
-
-                if(strlen(fileblock) + strlen(arcfile) > strlen(arcfile)){
-                    arcfile = (char*) MXPSQL_MShar_Realloc(arcfile, strlen(arcfile) + strlen(fileblock) + 1);
-                    if(fileblock == NULL){
-                        MXPSQL_MShar_Free(arcfile);
-                        MXPSQL_MShar_Free(filecontent);
-                        MXPSQL_MShar_Free(fileblock);
-                        setlocale(LC_ALL, old_locale);
-                        return NULL;
-                    }
+            }
+        }
+    }
+    else if(st->mode == MXPSQL_MShar_UNSHAR_LIST){
+        size_t size;
+        if(mkmshar_unshar_size(b, &size, &file.stored) != 0){
+            file.problem = "its payload is not base64";
+        }
+        else if(!b->sum){
+            file.size = size;
+        }
+    }
+    else{
+        if(st->mode == MXPSQL_MShar_UNSHAR_EXTRACT){
+            mkmshar_unshar_mkdirs(st->path.data);
+            out.fptr = fopen(file.path, "wb");
+            if(out.fptr == NULL){
+                file.problem = "it could not be created";
+                file.err = (errno != 0) ? errno : EIO;
+            }
+        }
+        if(file.problem == NULL){
+            errno = 0;
+            if(mkmshar_unshar_payload(st, b, &out, &file.problem) != 0){
+                if(out.fptr != NULL) fclose(out.fptr);
+                return -1;
+            }
+            file.size = out.total;
+            file.stored = (b->kind == MXPSQL_MShar_BLOCK_HEREDOC) ? b->datalen - (b->datalen + MXPSQL_MShar_WRAP) / (MXPSQL_MShar_WRAP + 1) : b->datalen;
+            file.err = out.err;
+            file.checked = b->compressed;
+            if(file.problem == NULL && b->sum){
+                file.checked = 1;
+                if(out.total != b->size || mkmshar_cksumFinal(out.crc, out.total) != b->crc){
+                    file.problem = "its cksum does not match";
                 }
-                strcat(arcfile, fileblock);
             }
         }
+        if(out.fptr != NULL && fclose(out.fptr) != 0 && file.problem == NULL){
+            file.problem = "it could not be written";
+            file.err = (errno != 0) ? errno : EIO;
+        }
+    }
 
-        MXPSQL_MShar_Free(filecontent);
+    if(mkmshar_unshar_remember(st, b->path, b->pathlen, file.size, file.problem == NULL) != 0){
+        return -1;
     }
+    if(report != NULL && report(userdata, &file) != 0){
+        return -1;
+    }
+    return (file.problem != NULL) ? 1 : 0;
+}
 
-    if(postscript != NULL){
-        if(strlen(arcfile) + strlen(postscript) > strlen(arcfile)){
-            arcfile = (char*) MXPSQL_MShar_Realloc(arcfile, strlen(arcfile) + strlen(postscript) + 1);
-            if(arcfile == NULL){
-                if(arcfile != NULL) MXPSQL_MShar_Free(arcfile);
-                setlocale(LC_ALL, old_locale);
-                return NULL;
-            }
-        }
-        strcat(arcfile, postscript);
+int mkmshar_unshar_mem(const char* archive, size_t len, int mode, mkmshar_unshar_func report, void* userdata){
+    #if defined(__cplusplus) || defined(c_plusplus)
+    using namespace std;
+    #endif
+
+    static const char magic[] = "#!/bin/sh \n# This archive is created using MShar";
+    static const char skipword[] = "MSHAR_SKIP=";
+    /* the last thing every archive has, after the postscript */
+    static const char footer[] = "# This is a shell archive lol, created with mshar";
+    mkmshar_unshar_state st;
+    const char* at = archive;
+    const char* end = archive + len;
+    size_t skip = 0;
+    int bad = 0;
+    int done = 0;
+    int ret = 0;
+
+    if(archive == NULL || len < strlen(magic) || memcmp(archive, magic, strlen(magic)) != 0){
+        errno = EDOM;
+        return -1;
     }
 
-    {
-        static char* poststr = (char*)
-"\n\
-# This is a shell archive lol, created with mshar (MXPSQL's version of the Shell archiver)\n\
-POSIXLY_CORRECT=; # Unposix it as we Done\n\
-POSIX_ME_HARDER=; # Unposix it as we Done\n\
-exit 0;\
-\n";
+    st.mode = mode;
+    st.a.alloc = mkmshar_default_alloc;
+    st.a.resize = mkmshar_default_resize;
+    st.a.release = mkmshar_default_release;
+    st.a.userdata = NULL;
+    mkmshar_buf_init(&st.path, &st.a);
+    mkmshar_buf_init(&st.from, &st.a);
+    mkmshar_buf_init(&st.text, &st.a);
+    mkmshar_buf_init(&st.data, &st.a);
+    mkmshar_buf_init(&st.member, &st.a);
+    mkmshar_buf_init(&st.win, &st.a);
+    st.seen = NULL;
+    st.nseen = 0;
+    st.capseen = 0;
+    st.buckets = NULL;
+    /* fills in the cksum tables */
+    mkmshar_cksumImpl();
+
+    /* a line at a time, the blocks are skipped whole so the payloads are never looked at line by line */
+    while(at < end && ret == 0){
+        const char* nl;
+
+        if(*at == 'T'){
+            mkmshar_block b;
+            int status = mkmshar_unshar_parse(at, end, archive, len, skip, &b);
+
+            if(status == 0){
+                status = mkmshar_unshar_file(&st, &b, report, userdata);
+                if(status < 0) ret = -1;
+                if(status > 0) bad = 1;
+                at = b.end;
+                continue;
+            }
+            if(status < 0){
+                mkmshar_unsharfile file;
 
-        if(strlen(poststr) + strlen(arcfile) > strlen(arcfile)){
-            arcfile = (char*) MXPSQL_MShar_Realloc(arcfile, strlen(arcfile) + strlen(poststr) + 1);
-            if(arcfile == NULL){
-                if(arcfile != NULL) MXPSQL_MShar_Free(arcfile);
-                setlocale(LC_ALL, old_locale);
-                return NULL;
+                /* the next line may be the next block */
+                if(mkmshar_buf_fit(&st.path, b.pathlen) != 0){
+                    ret = -1;
+                    break;
+                }
+                memcpy(st.path.data, b.path, b.pathlen);
+                st.path.data[b.pathlen] = '\0';
+                memset(&file, 0, sizeof(file));
+                file.path = st.path.data;
+                file.problem = "its block in the archive is damaged";
+                bad = 1;
+                if(report != NULL && report(userdata, &file) != 0) ret = -1;
+            }
+        }
+        else if(skip == 0 && *at == 'M' && mkmshar_eat(&at, end, skipword)){
+            /* a trailer archive, the script ends where the data starts */
+            if(!mkmshar_eatnum(&at, end, &skip) || skip > len){
+                errno = EIO;
+                ret = -1;
+                break;
             }
+            end = archive + skip;
+            if(at > end) break;
+        }
+        else if(*at == '#' && mkmshar_eat(&at, end, footer)){
+            done = 1;
         }
 
-        strcat(arcfile, poststr);
+        nl = (const char*) memchr(at, '\n', (size_t) (end - at));
+        if(nl == NULL) break;
+        at = nl + 1;
+    }
+    if(ret == 0 && !done){
+        errno = EIO;
+        ret = -1;
     }
 
-    setlocale(LC_ALL, old_locale);
-    return (char*) arcfile;
+    mkmshar_buf_free(&st.path);
+    mkmshar_buf_free(&st.from);
+    mkmshar_buf_free(&st.text);
+    mkmshar_buf_free(&st.data);
+    mkmshar_buf_free(&st.member);
+    mkmshar_buf_free(&st.win);
+    if(st.seen != NULL) st.a.release(st.a.userdata, st.seen);
+    if(st.buckets != NULL) st.a.release(st.a.userdata, st.buckets);
+    return (ret != 0) ? ret : bad;
 }
 
-char* mkmshar_x(char* prescript, char* postscript, char** files, size_t nfiles){
-    return mkmshar(prescript, postscript, files, nfiles, 0);
-}
+int mkmshar_unshar(const char* path, int mode, mkmshar_unshar_func report, void* userdata){
+    mkmshar_allocator a;
+    mkmshar_fileinfo info;
+    mkmshar_buf arc;
+    FILE* fptr = NULL;
+    int ret;
 
-char* mkmshar_s(char* prescript, char* postscript, char** files, size_t nfiles){
-    return mkmshar(prescript, postscript, files, nfiles, 1);
+    fptr = fopen(path, "rb");
+    if(fptr == NULL){
+        return -1;
+    }
+    if(mkmshar_fileInfo(fptr, &info) != 0){
+        fclose(fptr);
+        return -1;
+    }
+
+    #ifdef MXPSQL_MShar_OS_POSIX_SUS
+    if(info.regular && info.sized && info.size > 0){
+        void* map = mmap(NULL, info.size, PROT_READ, MAP_PRIVATE, fileno(fptr), 0);
+        if(map != MAP_FAILED){
+            #ifdef MADV_SEQUENTIAL
+            madvise(map, info.size, MADV_SEQUENTIAL);
+            #endif
+            ret = mkmshar_unshar_mem((const char*) map, info.size, mode, report, userdata);
+            munmap(map, info.size);
+            fclose(fptr);
+            return ret;
+        }
+    }
+    #endif
+
+    /* read whole, pipes grow as they go */
+    a.alloc = mkmshar_default_alloc;
+    a.resize = mkmshar_default_resize;
+    a.release = mkmshar_default_release;
+    a.userdata = NULL;
+    mkmshar_buf_init(&arc, &a);
+    for(;;){
+        size_t n;
+        if(mkmshar_buf_reserve(&arc, info.sized ? info.size - arc.len + 1 : MXPSQL_MShar_CHUNK_SIZE) != 0){
+            mkmshar_buf_free(&arc);
+            fclose(fptr);
+            return -1;
+        }
+        n = fread(arc.data + arc.len, 1, arc.cap - arc.len - 1, fptr);
+        arc.len += n;
+        if(n == 0){
+            break;
+        }
+    }
+    if(ferror(fptr) != 0){
+        mkmshar_buf_free(&arc);
+        fclose(fptr);
+        errno = EIO;
+        return -1;
+    }
+    fclose(fptr);
+
+    ret = mkmshar_unshar_mem(arc.data, arc.len, mode, report, userdata);
+    mkmshar_buf_free(&arc);
+    return ret;
 }
 
 #endif